@@ -0,0 +1,101 @@
+#ifndef BINARY_WRITER_H
+#define BINARY_WRITER_H
+
+#include "Temperature.h"
+
+// Written in place of a reading that is not available
+#define BINARY_WRITER_NO_TEMPERATURE TEMPERATURE_INVALID
+#define BINARY_WRITER_NO_HUMIDITY UINT16_MAX
+
+// Packed little endian writer into a caller owned, fixed size buffer, the binary counterpart of
+// JsonWriter. Output that does not fit is dropped and reported by hasOverflowed.
+class BinaryWriter
+{
+private:
+  uint8_t *buffer;
+  size_t capacity;
+  size_t length;
+  bool overflow;
+
+  void append(uint32_t value, uint8_t bytes)
+  {
+    if (overflow || length + bytes > capacity)
+    {
+      overflow = true;
+      return;
+    }
+
+    for (uint8_t i = 0; i < bytes; i++)
+    {
+      buffer[length++] = value >> (8 * i);
+    }
+  }
+
+public:
+  BinaryWriter(uint8_t *buffer, size_t capacity)
+  {
+    this->buffer = buffer;
+    this->capacity = capacity;
+    reset();
+  }
+
+  void reset()
+  {
+    length = 0;
+    overflow = false;
+  }
+
+  void u8(uint8_t value)
+  {
+    append(value, 1);
+  }
+
+  void u16(uint16_t value)
+  {
+    append(value, 2);
+  }
+
+  void i16(int16_t value)
+  {
+    append((uint16_t)value, 2);
+  }
+
+  void u32(uint32_t value)
+  {
+    append(value, 4);
+  }
+
+  // Hundredths of a degree, BINARY_WRITER_NO_TEMPERATURE when invalid
+  void temperature(Temperature value, bool useImperialUnits)
+  {
+    i16(useImperialUnits ? value.centiFahrenheit() : value.centiCelsius());
+  }
+
+  // Hundredths of a percent, BINARY_WRITER_NO_HUMIDITY for NaN
+  void humidity(double value)
+  {
+    if (isnan(value) || value < 0 || value * 100 >= BINARY_WRITER_NO_HUMIDITY)
+    {
+      u16(BINARY_WRITER_NO_HUMIDITY);
+      return;
+    }
+    u16((uint16_t)lround(value * 100));
+  }
+
+  const uint8_t *data()
+  {
+    return buffer;
+  }
+
+  size_t size()
+  {
+    return length;
+  }
+
+  bool hasOverflowed()
+  {
+    return overflow;
+  }
+};
+
+#endif
@@ -1,47 +1,189 @@
 #ifndef BUTTON_H
 #define BUTTON_H
 
+#include "SampleBuffer.h"
+
+// ====== Button Settings ======
+// A level must hold this long to count, shorter pulses are contact bounce
+#ifndef BUTTON_DEBOUNCE_TIME
+#define BUTTON_DEBOUNCE_TIME 20
+#endif
+
+// Press length before a long press is reported and auto repeat starts
+#ifndef BUTTON_HOLD_TIME
+#define BUTTON_HOLD_TIME 600
+#endif
+
+// Auto repeat starts at the first interval and speeds up by the step every repeat down to the minimum
+#define BUTTON_REPEAT_INTERVAL 250
+#define BUTTON_REPEAT_MINIMUM_INTERVAL 60
+#define BUTTON_REPEAT_STEP 20
+
+// Edges captured between two updates, a burst beyond this resynchronizes from the pin
+#define BUTTON_EDGE_BUFFER_SIZE 16
+
+enum ButtonEvent
+{
+    BUTTON_PRESSED,
+    // Held for BUTTON_HOLD_TIME
+    BUTTON_HELD,
+    // Auto repeat while held, the first one comes with BUTTON_HELD
+    BUTTON_REPEATED,
+    BUTTON_RELEASED
+};
+
+// Raw pin change captured by the interrupt handler
+struct ButtonEdge
+{
+    unsigned long time;
+    bool level;
+};
+
+// Interrupt driven button. Every pin change is timestamped into a lock free buffer from the interrupt
+// handler, update drains the buffer in one batch and debounces by time, so presses are neither missed
+// nor doubled while the loop is busy. Events go to the callback in the order they happened.
 class Button
 {
 private:
     uint8_t pin;
-    bool previousState;
-    void (*pressedCallback)();
+    void (*eventCallback)(ButtonEvent event);
+
+    SampleBuffer<ButtonEdge, BUTTON_EDGE_BUFFER_SIZE> edges;
+    uint32_t edgeCursor;
+
+    // Debounced level, and the last edge while it is still settling
+    bool stableLevel;
+    bool settling;
+    ButtonEdge pendingEdge;
+
+    // ====== Hold and Repeat ======
+    bool held;
+    unsigned long nextRepeatTime;
+    unsigned long repeatInterval;
+
+    // Overflow safe check of whether time a is at or after time b
+    static bool reached(unsigned long a, unsigned long b)
+    {
+        return (long)(a - b) >= 0;
+    }
+
+    static void IRAM_ATTR handleInterrupt(void *button)
+    {
+        ((Button *)button)->edge(millis());
+    }
+
+    // Report hold and repeat events due up to time, at most one repeat when the loop fell behind
+    void advance(unsigned long time)
+    {
+        if (!stableLevel || !reached(time, nextRepeatTime))
+        {
+            return;
+        }
+
+        if (!held)
+        {
+            held = true;
+            (*eventCallback)(BUTTON_HELD);
+        }
+        (*eventCallback)(BUTTON_REPEATED);
+
+        nextRepeatTime += repeatInterval;
+        if (reached(time, nextRepeatTime))
+        {
+            nextRepeatTime = time + repeatInterval;
+        }
+        repeatInterval = repeatInterval > BUTTON_REPEAT_MINIMUM_INTERVAL + BUTTON_REPEAT_STEP
+                             ? repeatInterval - BUTTON_REPEAT_STEP
+                             : BUTTON_REPEAT_MINIMUM_INTERVAL;
+    }
+
+    // Take level as the debounced level from time on
+    void settle(bool level, unsigned long time)
+    {
+        advance(time);
+
+        if (level == stableLevel)
+        {
+            return;
+        }
+        stableLevel = level;
+
+        if (level)
+        {
+            held = false;
+            nextRepeatTime = time + BUTTON_HOLD_TIME;
+            repeatInterval = BUTTON_REPEAT_INTERVAL;
+            (*eventCallback)(BUTTON_PRESSED);
+        }
+        else
+        {
+            (*eventCallback)(BUTTON_RELEASED);
+        }
+    }
 
 public:
-    Button(uint8_t pin, void (*pressedCallback)())
+    Button(uint8_t pin, void (*eventCallback)(ButtonEvent event))
     {
         this->pin = pin;
         pinMode(this->pin, INPUT);
 
-        this->previousState = false;
+        this->eventCallback = eventCallback;
+
+        edgeCursor = 0;
+        stableLevel = digitalRead(this->pin);
+        settling = false;
+        held = false;
+        nextRepeatTime = 0;
+        repeatInterval = BUTTON_REPEAT_INTERVAL;
 
-        this->pressedCallback = pressedCallback;
+        attachInterruptArg(digitalPinToInterrupt(this->pin), handleInterrupt, this, CHANGE);
     }
 
-    void update()
+    // Capture a pin change, called from the interrupt handler
+    void IRAM_ATTR edge(unsigned long time)
     {
-        bool buttonState = digitalRead(this->pin);
+        ButtonEdge edge = {time, (bool)digitalRead(pin)};
+        edges.push(edge);
+    }
 
-        if (buttonState != this->previousState)
+    // Drain the captured edges and report what happened since the last update
+    void update(unsigned long now = millis())
+    {
+        // Edges were lost in a burst, start over from the pin
+        if (edges.getCount() - edgeCursor > BUTTON_EDGE_BUFFER_SIZE)
         {
-            if (buttonState == true)
-            {
-                //button pressed callback
-                (*this->pressedCallback)();
-            }
-            else if (buttonState == false)
+            edgeCursor = edges.getCount();
+            settling = true;
+            pendingEdge.time = now;
+            pendingEdge.level = digitalRead(pin);
+        }
+
+        // An edge settles the previous one only if it came after the debounce time
+        ButtonEdge edge;
+        while (edges.read(&edgeCursor, &edge))
+        {
+            if (settling && edge.time - pendingEdge.time >= BUTTON_DEBOUNCE_TIME)
             {
-                //TODO released callback
+                settle(pendingEdge.level, pendingEdge.time);
             }
+            settling = true;
+            pendingEdge = edge;
         }
-        else if (buttonState == true)
+
+        if (settling && now - pendingEdge.time >= BUTTON_DEBOUNCE_TIME)
         {
-            //TODO held callback
+            settling = false;
+            settle(pendingEdge.level, pendingEdge.time);
         }
 
-        this->previousState = buttonState;
+        advance(now);
+    }
+
+    // Debounced state
+    bool isPressed()
+    {
+        return stableLevel;
     }
 };
 
-#endif
\ No newline at end of file
+#endif
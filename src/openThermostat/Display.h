@@ -4,6 +4,7 @@
 #include <SPI.h>
 #include <TFT_eSPI.h> // Hardware-specific library
 
+#include "FixedString.h"
 #include "Temperature.h"
 #include "PersistentStorage.h"
 #include "Thermostat.h"
@@ -58,11 +59,80 @@
 #define WELCOME_PAUSE 1500
 #define WIFI_CONNECTED_PAUSE 1500
 
+// Longest full screen message, including the terminator
+#define DISPLAY_MESSAGE_SIZE 64
+
+// ====== Main Screen Settings ======
+// Longest text a main screen widget can show, including the terminator
+#define DISPLAY_WIDGET_TEXT_SIZE 24
+
+// Temperature, humidity, setpoint, mode and state
+#define DISPLAY_WIDGET_COUNT 5
+
+// Direct: widgets are drawn glyph by glyph on the panel, uses no frame buffer memory
+// Sprite: each widget is composited off screen in a sprite the size of its box and pushed to the panel in one burst
+#define DISPLAY_RENDER_DIRECT 0
+#define DISPLAY_RENDER_SPRITE 1
+
+#ifndef DISPLAY_RENDER_MODE
+#define DISPLAY_RENDER_MODE DISPLAY_RENDER_SPRITE
+#endif
+
+// Sprite memory budget: 16 bit sprites are pushed with DMA while the CPU carries on (about 64kB for all widgets),
+// 8 or 4 bit palettised sprites take a half or a quarter of that but are converted and pushed by the CPU
+#ifndef DISPLAY_SPRITE_COLOR_DEPTH
+#define DISPLAY_SPRITE_COLOR_DEPTH 16
+#endif
+
 class Display
 {
 private:
+  // Main screen element that remembers what it last drew so it is only redrawn when it changes
+  struct Widget
+  {
+    // Top centre of the text
+    int16_t x;
+    int16_t y;
+    uint8_t textSize;
+
+    // Last rendered text and its bounding box
+    char text[DISPLAY_WIDGET_TEXT_SIZE];
+    int16_t left;
+    int16_t width;
+    int16_t height;
+
+    // Drawn over by a widget before it, redrawn even if its text did not change
+    bool invalid;
+
+    // Off screen buffer covering the widget's fixed box, NULL when drawing directly
+    TFT_eSprite *sprite;
+  };
+
   TFT_eSPI *tft;
 
+  Widget temperatureWidget;
+  Widget humidityWidget;
+  Widget setpointWidget;
+  Widget modeWidget;
+  Widget stateWidget;
+
+  // Widgets in drawing order, a widget is drawn on top of the ones before it
+  Widget *widgets[DISPLAY_WIDGET_COUNT];
+  uint8_t widgetCount;
+
+  // False when another screen was drawn since the main screen was last rendered
+  bool mainScreenDrawn;
+
+  // Pixels written to the panel by the last main screen update and since startup
+  unsigned long framePixels;
+  unsigned long long totalPixels;
+
+  // Time taken by the last main screen update in microseconds
+  unsigned long frameTime;
+
+  // True while a DMA transfer may still be running and the SPI bus is held
+  bool dmaPending;
+
   PersistentStorage *storage;
 
   Thermostat *thermostat;
@@ -71,6 +141,187 @@ private:
 
   double brightness;
 
+  // widestText sizes the widget's sprite, longer text is clipped when rendering with sprites
+  void initWidget(Widget *widget, int16_t x, int16_t y, uint8_t textSize, const char *widestText)
+  {
+    widget->x = x;
+    widget->y = y;
+    widget->textSize = textSize;
+
+    widget->text[0] = '\0';
+    widget->left = x;
+    widget->width = 0;
+    widget->height = 0;
+    widget->invalid = false;
+    widget->sprite = NULL;
+    widgets[widgetCount++] = widget;
+
+#if DISPLAY_RENDER_MODE == DISPLAY_RENDER_SPRITE
+    tft->setTextSize(textSize);
+    int16_t width = tft->textWidth(widestText, TFT_FONT);
+    int16_t height = tft->fontHeight(TFT_FONT);
+
+    TFT_eSprite *sprite = new TFT_eSprite(tft);
+    sprite->setColorDepth(DISPLAY_SPRITE_COLOR_DEPTH);
+    if (sprite->createSprite(width, height) == NULL)
+    {
+      // Not enough memory, this widget falls back to drawing directly
+      delete sprite;
+      return;
+    }
+    sprite->setTextSize(textSize);
+    sprite->setTextColor(TFT_WHITE, TFT_BLACK);
+
+    widget->sprite = sprite;
+    widget->left = x - width / 2;
+    widget->width = width;
+    widget->height = height;
+#endif
+  }
+
+  void drawWidget(Widget *widget, const char *text)
+  {
+    if (mainScreenDrawn && !widget->invalid && strcmp(widget->text, text) == 0)
+    {
+      return;
+    }
+
+    int16_t oldLeft = widget->left;
+    int16_t oldWidth = widget->width;
+    int16_t oldHeight = widget->height;
+
+    if (widget->sprite != NULL)
+    {
+      drawWidgetSprite(widget, text);
+    }
+    else
+    {
+      drawWidgetDirect(widget, text);
+    }
+
+    strncpy(widget->text, text, DISPLAY_WIDGET_TEXT_SIZE - 1);
+    widget->text[DISPLAY_WIDGET_TEXT_SIZE - 1] = '\0';
+    widget->invalid = false;
+
+    // Both the old and the new box were painted over, including any later widget reaching into them
+    invalidateOverlapping(widget, oldLeft, oldWidth, oldHeight);
+    invalidateOverlapping(widget, widget->left, widget->width, widget->height);
+  }
+
+  // Mark the widgets drawn after widget that intersect the box at its row for redrawing
+  void invalidateOverlapping(Widget *widget, int16_t left, int16_t width, int16_t height)
+  {
+    uint8_t index = 0;
+    while (widgets[index] != widget)
+    {
+      index++;
+    }
+
+    for (index++; index < widgetCount; index++)
+    {
+      Widget *other = widgets[index];
+      if (other->width > 0 && left < other->left + other->width && other->left < left + width &&
+          widget->y < other->y + other->height && other->y < widget->y + height)
+      {
+        other->invalid = true;
+      }
+    }
+  }
+
+  // Composite the whole widget box off screen and push it to the panel in one transfer
+  void drawWidgetSprite(Widget *widget, const char *text)
+  {
+    TFT_eSprite *sprite = widget->sprite;
+
+    // Each widget has its own sprite, so it can be composited while the previous widget is still being transferred
+    sprite->fillSprite(TFT_BLACK);
+    if (text[0] != '\0')
+    {
+      sprite->drawCentreString(text, widget->width / 2, 0, TFT_FONT);
+    }
+
+#if DISPLAY_SPRITE_COLOR_DEPTH == 16
+    // Waits for the previous transfer, then returns as soon as this one is started. The bus is released by finishTransfers
+    if (!dmaPending)
+    {
+      tft->startWrite();
+      dmaPending = true;
+    }
+    tft->pushImageDMA(widget->left, widget->y, widget->width, widget->height, (uint16_t *)sprite->getPointer());
+#else
+    sprite->pushSprite(widget->left, widget->y);
+#endif
+
+    framePixels += widget->width * widget->height;
+  }
+
+  // Wait for outstanding DMA transfers and release the SPI bus
+  void finishTransfers()
+  {
+    if (dmaPending)
+    {
+      tft->dmaWait();
+      tft->endWrite();
+      dmaPending = false;
+    }
+  }
+
+  // Draw the widget's text straight to the panel, clearing only the part of the old text the new text does not cover
+  void drawWidgetDirect(Widget *widget, const char *text)
+  {
+    tft->setTextSize(widget->textSize);
+
+    int16_t width = text[0] == '\0' ? 0 : tft->textWidth(text, TFT_FONT);
+    int16_t height = tft->fontHeight(TFT_FONT);
+    int16_t left = widget->x - width / 2;
+
+    // Text is drawn with a background colour so it overwrites its own box, clear the old box outside of it
+    int16_t oldRight = widget->left + widget->width;
+    int16_t right = left + width;
+    if (mainScreenDrawn && widget->width > 0)
+    {
+      if (width == 0)
+      {
+        tft->fillRect(widget->left, widget->y, widget->width, widget->height, TFT_BLACK);
+        framePixels += widget->width * widget->height;
+      }
+      else
+      {
+        if (widget->left < left)
+        {
+          tft->fillRect(widget->left, widget->y, left - widget->left, widget->height, TFT_BLACK);
+          framePixels += (left - widget->left) * widget->height;
+        }
+        if (oldRight > right)
+        {
+          tft->fillRect(right, widget->y, oldRight - right, widget->height, TFT_BLACK);
+          framePixels += (oldRight - right) * widget->height;
+        }
+      }
+    }
+
+    if (width > 0)
+    {
+      tft->drawCentreString(text, widget->x, widget->y, TFT_FONT);
+      framePixels += width * height;
+    }
+
+    widget->left = left;
+    widget->width = width;
+    widget->height = height;
+  }
+
+  // Any full screen message invalidates the main screen
+  void clearScreen()
+  {
+    finishTransfers();
+
+    tft->fillScreen(TFT_BLACK);
+    tft->setTextColor(TFT_WHITE, TFT_BLACK);
+
+    mainScreenDrawn = false;
+  }
+
 public:
   Display()
   {
@@ -90,23 +341,39 @@ public:
     storage = storage->getInstance();
 
     thermostat = thermostat->getInstance();
+
+    // ====== Initialize Main Screen Widgets ======
+    widgetCount = 0;
+#if DISPLAY_RENDER_MODE == DISPLAY_RENDER_SPRITE && DISPLAY_SPRITE_COLOR_DEPTH == 16
+    tft->initDMA();
+#endif
+    initWidget(&temperatureWidget, 150, TFT_HEIGHT / 2 - 50, 6, "188°FR");
+    initWidget(&humidityWidget, TFT_WIDTH / 3, TFT_HEIGHT / 2 + 50, 2, "100%");
+    initWidget(&setpointWidget, TFT_WIDTH - 60, TFT_HEIGHT / 2 + 30, 1, "188-188°F");
+    initWidget(&modeWidget, TFT_WIDTH - 60, TFT_HEIGHT / 2 - 30, 1, "FAN-ONLY");
+    initWidget(&stateWidget, TFT_WIDTH - 60, TFT_HEIGHT / 2, 1, "COOLING");
+
+    mainScreenDrawn = false;
+    framePixels = 0;
+    totalPixels = 0;
+    frameTime = 0;
+    dmaPending = false;
   }
 
   // Factory Reset Pending
-  void factoryResetPending(String countdown)
+  void factoryResetPending(unsigned long seconds)
   {
-    tft->fillScreen(TFT_BLACK);
-    tft->setTextColor(TFT_WHITE, TFT_BLACK);
+    clearScreen();
 
-    String text = "Factory reset in: " + countdown + "s";
-    tft->drawCentreString(text, TFT_WIDTH / 2, TFT_HEIGHT / 2, TFT_FONT);
+    FixedString<DISPLAY_MESSAGE_SIZE> text;
+    text.appendf("Factory reset in: %lus", seconds);
+    tft->drawCentreString(text.c_str(), TFT_WIDTH / 2, TFT_HEIGHT / 2, TFT_FONT);
   }
 
   // Factory Resetting
   void factoryResetting()
   {
-    tft->fillScreen(TFT_BLACK);
-    tft->setTextColor(TFT_WHITE, TFT_BLACK);
+    clearScreen();
 
     tft->drawCentreString("Resetting...", TFT_WIDTH / 2, TFT_HEIGHT / 2, TFT_FONT);
   }
@@ -114,8 +381,7 @@ public:
   // Factory Reset
   void factoryResetComplete()
   {
-    tft->fillScreen(TFT_BLACK);
-    tft->setTextColor(TFT_WHITE, TFT_BLACK);
+    clearScreen();
 
     tft->drawCentreString("Factory Reset Complate!", TFT_WIDTH / 2, TFT_HEIGHT / 2, TFT_FONT);
   }
@@ -123,8 +389,7 @@ public:
   // Welcome
   void welcome()
   {
-    tft->fillScreen(TFT_BLACK);
-    tft->setTextColor(TFT_WHITE, TFT_BLACK);
+    clearScreen();
 
     tft->drawCentreString("Welcome to openThermostat", TFT_WIDTH / 2, TFT_HEIGHT / 2, TFT_FONT);
 
@@ -132,99 +397,131 @@ public:
   }
 
   // Wifi connecting
-  void wifiConnecting(String ssid)
+  void wifiConnecting(const char *ssid)
   {
-    tft->fillScreen(TFT_BLACK);
-    tft->setTextColor(TFT_WHITE, TFT_BLACK);
+    clearScreen();
 
-    tft->drawCentreString("Connecting to WiFi Network: " + ssid, TFT_WIDTH / 2, TFT_HEIGHT / 2, TFT_FONT);
+    FixedString<DISPLAY_MESSAGE_SIZE> text("Connecting to WiFi Network: ");
+    text.append(ssid);
+    tft->drawCentreString(text.c_str(), TFT_WIDTH / 2, TFT_HEIGHT / 2, TFT_FONT);
   }
 
   // Wifi connected
-  void wifiConnected(String ip)
+  void wifiConnected(const char *ip)
   {
-    tft->fillScreen(TFT_BLACK);
-    tft->setTextColor(TFT_WHITE, TFT_BLACK);
-
-    String ipStr = "IP: " + ip;
+    clearScreen();
 
-    tft->drawCentreString("Connected! " + ipStr, TFT_WIDTH / 2, TFT_HEIGHT / 2, TFT_FONT);
+    FixedString<DISPLAY_MESSAGE_SIZE> text("Connected! IP: ");
+    text.append(ip);
+    tft->drawCentreString(text.c_str(), TFT_WIDTH / 2, TFT_HEIGHT / 2, TFT_FONT);
 
     delay(WIFI_CONNECTED_PAUSE);
   }
 
-  //Main thermostat display
-  void main(double currentTemperature, double currentHumidity)
+  //Main thermostat display, only the widgets whose text changed are redrawn
+  void main(Temperature currentTemperature, double currentHumidity)
   {
-    tft->fillScreen(TFT_BLACK);
-    tft->setTextColor(TFT_WHITE, TFT_BLACK);
+    unsigned long startTime = micros();
+    framePixels = 0;
+
+    if (!mainScreenDrawn)
+    {
+      tft->fillScreen(TFT_BLACK);
+      tft->setTextColor(TFT_WHITE, TFT_BLACK);
+      framePixels += (unsigned long)TFT_WIDTH * TFT_HEIGHT;
+    }
+
+    FixedString<DISPLAY_WIDGET_TEXT_SIZE> text;
+    bool imperial = storage->getSettingScreenImperial();
 
     //current temperature
-    String tempString = "";
-    if (isnan(currentTemperature))
+    if (!currentTemperature.isValid())
+    {
+      text = "NAN";
+    }
+    else if (imperial)
     {
-      tempString += "NAN";
+      text.clear();
+      text.appendf("%d°F", currentTemperature.roundFahrenheit());
     }
     else
     {
-      if (storage->getSettingScreenImperial())
-      {
-        tempString += String((uint8_t)round(celsiusToFahrenheit(currentTemperature))) + "°F";
-      }
-      else
-      {
-        tempString += String((uint8_t)round(currentTemperature)) + "°C";
-      }
+      text.clear();
+      text.appendf("%d°C", currentTemperature.roundCelsius());
     }
     //Show that temperature is remote
     if (storage->getSettingUseRemoteTemperature())
     {
-      tempString += "R";
+      text.append("R");
     }
-    tft->setTextSize(6);
-    tft->drawCentreString(tempString, 150, TFT_HEIGHT / 2 - 50, TFT_FONT);
+    drawWidget(&temperatureWidget, text.c_str());
 
     //humidity
-    String humidityString = "";
+    text.clear();
     if (isnan(currentHumidity))
     {
-      humidityString += "NAN";
+      text.append("NAN");
     }
     else
     {
-      humidityString += String((uint8_t)currentHumidity) + "%";
+      text.appendf("%u%%", (uint8_t)currentHumidity);
     }
-    tft->setTextSize(2);
-    tft->drawCentreString(humidityString, TFT_WIDTH / 3, TFT_HEIGHT / 2 + 50, TFT_FONT);
+    drawWidget(&humidityWidget, text.c_str());
 
     //setpoint
+    text.clear();
     if ((Thermostat::ThermostatMode)thermostat->getMode() == Thermostat::ThermostatMode::AUTOMATIC)
     {
-      String setpointString = "";
-      if (storage->getSettingScreenImperial())
+      if (imperial)
       {
-        setpointString += String((uint8_t)celsiusToFahrenheit(thermostat->getSetpointLow())) + "-";
-        setpointString += String((uint8_t)celsiusToFahrenheit(thermostat->getSetpointHigh())) + "°F";
+        text.appendf("%d-%d°F", thermostat->getSetpointLow().roundFahrenheit(), thermostat->getSetpointHigh().roundFahrenheit());
       }
       else
       {
-        setpointString += String((uint8_t)thermostat->getSetpointLow()) + "-";
-        setpointString += String((uint8_t)thermostat->getSetpointHigh()) + "°C";
+        text.appendf("%d-%d°C", thermostat->getSetpointLow().roundCelsius(), thermostat->getSetpointHigh().roundCelsius());
       }
-      tft->setTextSize(1);
-      tft->drawCentreString(setpointString, TFT_WIDTH - 60, TFT_HEIGHT / 2 + 30, TFT_FONT);
     }
+    drawWidget(&setpointWidget, text.c_str());
 
     //mode
-    String modeStr = thermostat->getModeString();
-    modeStr.toUpperCase();
-    tft->setTextSize(1);
-    tft->drawCentreString(modeStr, TFT_WIDTH - 60, TFT_HEIGHT / 2 - 30, TFT_FONT);
-
-    String stateStr = thermostat->getStateString();
-    stateStr.toUpperCase();
-    tft->setTextSize(1);
-    tft->drawCentreString(stateStr, TFT_WIDTH - 60, TFT_HEIGHT / 2, TFT_FONT);
+    text = Thermostat::getModeName(thermostat->getMode());
+    text.toUpperCase();
+    drawWidget(&modeWidget, text.c_str());
+
+    //state
+    text = Thermostat::getStateName(thermostat->getState());
+    text.toUpperCase();
+    drawWidget(&stateWidget, text.c_str());
+
+    // The bus is shared with the sensor, it is released before returning to the loop
+    finishTransfers();
+
+    mainScreenDrawn = true;
+    totalPixels += framePixels;
+    frameTime = micros() - startTime;
+  }
+
+  // Pixels written to the panel by the last main screen update
+  unsigned long getFramePixels()
+  {
+    return framePixels;
+  }
+
+  // Bytes sent to the panel by the last main screen update, the panel always takes 16 bit colour
+  unsigned long getFrameBytes()
+  {
+    return framePixels * 2;
+  }
+
+  // Time of the last main screen update in microseconds, until its last DMA transfer completed
+  unsigned long getFrameTime()
+  {
+    return frameTime;
+  }
+
+  unsigned long long getTotalPixels()
+  {
+    return totalPixels;
   }
 
   //Backlight brightness control
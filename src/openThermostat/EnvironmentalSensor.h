@@ -0,0 +1,171 @@
+#ifndef ENVIRONMENTAL_SENSOR_H
+#define ENVIRONMENTAL_SENSOR_H
+
+#include <SPI.h>
+#include <Adafruit_Sensor.h>
+#include <Adafruit_BME280.h>
+
+#include "SampleBuffer.h"
+#include "Temperature.h"
+
+// ====== Sampling Settings ======
+// Worst case conversion time with 1x oversampling of temperature, pressure and humidity
+#define BME280_MEASUREMENT_TIME 10
+// Give up on a conversion that has not completed after this long
+#define BME280_MEASUREMENT_TIMEOUT 100
+
+#define BME280_STATUS_MEASURING 0x08
+
+#ifndef ENVIRONMENTAL_SAMPLE_BUFFER_SIZE
+#define ENVIRONMENTAL_SAMPLE_BUFFER_SIZE 16
+#endif
+
+struct EnvironmentalSample
+{
+  unsigned long timestamp;
+  Temperature temperature;
+  float humidity;
+};
+
+// BME280 driver with a non-blocking forced mode conversion
+class ForcedBME280 : public Adafruit_BME280
+{
+public:
+  ForcedBME280(int8_t csPin) : Adafruit_BME280(csPin)
+  {
+  }
+
+  bool begin()
+  {
+    if (!Adafruit_BME280::begin())
+    {
+      return false;
+    }
+
+    // Sleep between conversions, each conversion is triggered by startMeasurement
+    setSampling(Adafruit_BME280::MODE_FORCED,
+                Adafruit_BME280::SAMPLING_X1,
+                Adafruit_BME280::SAMPLING_X1,
+                Adafruit_BME280::SAMPLING_X1,
+                Adafruit_BME280::FILTER_OFF);
+    return true;
+  }
+
+  // Trigger a single conversion and return immediately
+  void startMeasurement()
+  {
+    write8(BME280_REGISTER_CONTROL, _measReg.get());
+  }
+
+  bool isMeasuring()
+  {
+    return read8(BME280_REGISTER_STATUS) & BME280_STATUS_MEASURING;
+  }
+};
+
+class EnvironmentalSensor
+{
+private:
+  enum SamplerState
+  {
+    IDLE,
+    MEASURING
+  };
+
+  ForcedBME280 *bme;
+
+  SampleBuffer<EnvironmentalSample, ENVIRONMENTAL_SAMPLE_BUFFER_SIZE> samples;
+
+  SamplerState samplerState;
+
+  unsigned long samplePeriod;
+  unsigned long lastSampleTime;
+  unsigned long measurementStartTime;
+
+  unsigned long errorCount;
+
+public:
+  EnvironmentalSensor(ForcedBME280 *bme, unsigned long samplePeriod)
+  {
+    this->bme = bme;
+    this->samplePeriod = samplePeriod;
+
+    samplerState = IDLE;
+    lastSampleTime = millis() - samplePeriod;
+    measurementStartTime = 0;
+    errorCount = 0;
+  }
+
+  // Advance the sampling state machine, never waits on the sensor
+  void update()
+  {
+    unsigned long now = millis();
+
+    if (samplerState == IDLE)
+    {
+      if (now - lastSampleTime >= samplePeriod)
+      {
+        lastSampleTime = now;
+        measurementStartTime = now;
+
+        bme->startMeasurement();
+        samplerState = MEASURING;
+      }
+    }
+    else if (samplerState == MEASURING)
+    {
+      if (now - measurementStartTime < BME280_MEASUREMENT_TIME)
+      {
+        return;
+      }
+
+      if (bme->isMeasuring())
+      {
+        if (now - measurementStartTime >= BME280_MEASUREMENT_TIMEOUT)
+        {
+          Serial.println(F("Environmental sensor measurement timed out!"));
+          errorCount++;
+          samplerState = IDLE;
+        }
+        return;
+      }
+
+      // Conversion is complete, reading the result registers does not wait
+      EnvironmentalSample sample;
+      sample.timestamp = measurementStartTime;
+      sample.humidity = bme->readHumidity();
+      sample.temperature = Temperature::fromCelsius(bme->readTemperature());
+
+      if (isnan(sample.humidity) || !sample.temperature.isValid())
+      {
+        Serial.println(F("Failed to read from environmental sensor!"));
+        errorCount++;
+      }
+      else
+      {
+        samples.push(sample);
+      }
+
+      samplerState = IDLE;
+    }
+  }
+
+  // Copy the most recent sample, returns false if no sample has been taken yet
+  bool getLatestSample(EnvironmentalSample *sample)
+  {
+    return samples.latest(sample);
+  }
+
+  // Copy the next sample after cursor, for consumers that need every sample
+  bool readSample(uint32_t *cursor, EnvironmentalSample *sample)
+  {
+    return samples.read(cursor, sample);
+  }
+
+  unsigned long getErrorCount()
+  {
+    return errorCount;
+  }
+};
+
+#endif
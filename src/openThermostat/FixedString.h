@@ -0,0 +1,124 @@
+#ifndef FIXED_STRING_H
+#define FIXED_STRING_H
+
+#include <stdarg.h>
+
+// Constant text with its length, usable at compile time. Views made from literals are null terminated.
+class StringView
+{
+private:
+  const char *text;
+  size_t length;
+
+public:
+  template <size_t N>
+  constexpr StringView(const char (&text)[N]) : text(text), length(N - 1)
+  {
+  }
+
+  constexpr const char *c_str() const
+  {
+    return text;
+  }
+
+  constexpr size_t size() const
+  {
+    return length;
+  }
+};
+
+// Text built in place in a buffer of fixed capacity, for strings formatted over and over without touching
+// the heap. Appending past the capacity truncates.
+template <size_t CAPACITY>
+class FixedString
+{
+private:
+  char text[CAPACITY];
+  size_t length;
+
+public:
+  FixedString()
+  {
+    clear();
+  }
+
+  FixedString(const char *value)
+  {
+    clear();
+    append(value);
+  }
+
+  FixedString(StringView value)
+  {
+    clear();
+    append(value);
+  }
+
+  void clear()
+  {
+    text[0] = '\0';
+    length = 0;
+  }
+
+  FixedString &append(const char *value)
+  {
+    return append(value, strlen(value));
+  }
+
+  FixedString &append(StringView value)
+  {
+    return append(value.c_str(), value.size());
+  }
+
+  FixedString &append(const char *value, size_t valueLength)
+  {
+    size_t space = CAPACITY - 1 - length;
+    if (valueLength > space)
+    {
+      valueLength = space;
+    }
+    memcpy(text + length, value, valueLength);
+    length += valueLength;
+    text[length] = '\0';
+    return *this;
+  }
+
+  // printf style, avoid floating point formats where the heap matters as they may allocate
+  __attribute__((format(printf, 2, 3))) FixedString &appendf(const char *format, ...)
+  {
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(text + length, CAPACITY - length, format, args);
+    va_end(args);
+
+    if (written > 0)
+    {
+      length += (size_t)written < CAPACITY - length ? written : CAPACITY - 1 - length;
+    }
+    return *this;
+  }
+
+  // ASCII only
+  void toUpperCase()
+  {
+    for (size_t i = 0; i < length; i++)
+    {
+      if (text[i] >= 'a' && text[i] <= 'z')
+      {
+        text[i] -= 'a' - 'A';
+      }
+    }
+  }
+
+  const char *c_str() const
+  {
+    return text;
+  }
+
+  size_t size() const
+  {
+    return length;
+  }
+};
+
+#endif
@@ -0,0 +1,371 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "SampleBuffer.h"
+#include "Temperature.h"
+#include "Thermostat.h"
+
+// ====== History Settings ======
+// Raw samples, one per environmental sensor reading (15 minutes at 2 second sampling)
+#ifndef HISTORY_RAW_SIZE
+#define HISTORY_RAW_SIZE 450
+#endif
+
+// 1 minute rollups (4 hours)
+#ifndef HISTORY_MINUTE_SIZE
+#define HISTORY_MINUTE_SIZE 240
+#endif
+
+// 15 minute rollups (1 day)
+#ifndef HISTORY_QUARTER_SIZE
+#define HISTORY_QUARTER_SIZE 96
+#endif
+
+// Relay state transitions, the newest HISTORY_TRANSITION_SIZE - 1 are held
+#define HISTORY_TRANSITION_SIZE 64
+
+// Upper bound of the history's RAM footprint, checked at compile time.
+// Raw: 3 bytes per sample, rollups: 12 bytes per bucket, transitions: 8 bytes each.
+// With the defaults a full day of history costs 1350 + 2880 + 1152 + 512 bytes plus bookkeeping.
+#define HISTORY_MEMORY_BUDGET 6144
+
+#define HISTORY_MINUTE_SECONDS 60
+#define HISTORY_QUARTER_SECONDS 900
+
+// Raw samples store time in steps of this many milliseconds
+#define HISTORY_TIME_STEP 100
+
+struct HistorySample
+{
+  // Seconds since boot
+  uint32_t time;
+  Temperature temperature;
+  // Halves of a percent
+  uint8_t humidity;
+};
+
+struct HistoryBucket
+{
+  // Seconds since boot at the start of the bucket
+  uint32_t time;
+  Temperature temperatureMin;
+  Temperature temperatureMax;
+  Temperature temperatureAverage;
+  // Halves of a percent
+  uint8_t humidityAverage;
+};
+
+struct HistoryTransition
+{
+  // Milliseconds since boot
+  uint32_t time;
+  Thermostat::ThermostatState state;
+};
+
+// Steps through the raw samples from oldest to newest, rebuilding each from the deltas
+struct HistoryRawIterator
+{
+  uint16_t index;
+  uint32_t timeStep;
+  int16_t temperature;
+};
+
+// In RAM time series of temperature and humidity at raw, 1 minute and 15 minute resolution.
+// Raw samples are fixed point deltas to the previous sample, rollups keep min, max and average.
+class History
+{
+private:
+  // Raw sample, each field relative to the previous sample
+  struct RawEntry
+  {
+    int8_t temperatureDelta;
+    uint8_t humidity;
+    uint8_t timeDelta;
+  };
+
+  // Running totals of the bucket currently being filled
+  struct Accumulator
+  {
+    uint32_t time;
+    int32_t temperatureSum;
+    int16_t temperatureMin;
+    int16_t temperatureMax;
+    uint32_t humiditySum;
+    uint16_t count;
+  };
+
+  // ====== Raw Samples ======
+  RawEntry raw[HISTORY_RAW_SIZE];
+  uint16_t rawHead;
+  uint16_t rawCount;
+
+  // Reconstructed values of the oldest raw sample, moved forward as samples are evicted
+  uint32_t rawOldestTimeStep;
+  int16_t rawOldestTemperature;
+
+  // Reconstructed values of the newest raw sample, deltas are taken from these so quantisation never accumulates
+  uint32_t rawNewestTimeStep;
+  int16_t rawNewestTemperature;
+
+  // ====== Rollups ======
+  HistoryBucket minutes[HISTORY_MINUTE_SIZE];
+  uint16_t minuteHead;
+  uint16_t minuteCount;
+
+  HistoryBucket quarters[HISTORY_QUARTER_SIZE];
+  uint16_t quarterHead;
+  uint16_t quarterCount;
+
+  Accumulator minuteAccumulator;
+  Accumulator quarterAccumulator;
+
+  // ====== Relay Transitions ======
+  // Written from the control task
+  SampleBuffer<HistoryTransition, HISTORY_TRANSITION_SIZE> transitions;
+
+  static uint8_t toHumidity(float percent)
+  {
+    float value = round(percent * 2);
+    if (value < 0)
+    {
+      return 0;
+    }
+    if (value > 200)
+    {
+      return 200;
+    }
+    return value;
+  }
+
+  static void resetAccumulator(Accumulator *accumulator, uint32_t time)
+  {
+    accumulator->time = time;
+    accumulator->temperatureSum = 0;
+    accumulator->temperatureMin = INT16_MAX;
+    accumulator->temperatureMax = INT16_MIN;
+    accumulator->humiditySum = 0;
+    accumulator->count = 0;
+  }
+
+  static void accumulate(Accumulator *accumulator, int16_t temperatureMin, int16_t temperatureMax, int32_t temperatureSum, uint32_t humiditySum, uint16_t count)
+  {
+    accumulator->temperatureSum += temperatureSum;
+    accumulator->humiditySum += humiditySum;
+    accumulator->count += count;
+    if (temperatureMin < accumulator->temperatureMin)
+    {
+      accumulator->temperatureMin = temperatureMin;
+    }
+    if (temperatureMax > accumulator->temperatureMax)
+    {
+      accumulator->temperatureMax = temperatureMax;
+    }
+  }
+
+  static void toBucket(Accumulator *accumulator, HistoryBucket *bucket)
+  {
+    bucket->time = accumulator->time;
+    bucket->temperatureMin = Temperature::fromCentiCelsius(accumulator->temperatureMin);
+    bucket->temperatureMax = Temperature::fromCentiCelsius(accumulator->temperatureMax);
+    bucket->temperatureAverage = Temperature::fromCentiCelsius(accumulator->temperatureSum / (int32_t)accumulator->count);
+    bucket->humidityAverage = accumulator->humiditySum / accumulator->count;
+  }
+
+  static void pushBucket(HistoryBucket *buckets, uint16_t size, uint16_t *head, uint16_t *count, Accumulator *accumulator)
+  {
+    toBucket(accumulator, &buckets[*head]);
+    *head = (*head + 1) % size;
+    if (*count < size)
+    {
+      (*count)++;
+    }
+  }
+
+  void addRaw(uint32_t timeStep, int16_t temperature, uint8_t humidity)
+  {
+    RawEntry entry;
+    entry.humidity = humidity;
+
+    if (rawCount == 0)
+    {
+      // First sample is held entirely in the oldest values
+      entry.temperatureDelta = 0;
+      entry.timeDelta = 0;
+      rawOldestTimeStep = timeStep;
+      rawOldestTemperature = temperature;
+      rawNewestTimeStep = timeStep;
+      rawNewestTemperature = temperature;
+    }
+    else
+    {
+      // Saturated deltas catch up over the following samples
+      int32_t temperatureDelta = (int32_t)temperature - rawNewestTemperature;
+      entry.temperatureDelta = temperatureDelta > INT8_MAX ? INT8_MAX : (temperatureDelta < INT8_MIN ? INT8_MIN : temperatureDelta);
+      uint32_t timeDelta = timeStep - rawNewestTimeStep;
+      entry.timeDelta = timeDelta > UINT8_MAX ? UINT8_MAX : timeDelta;
+
+      rawNewestTemperature += entry.temperatureDelta;
+      rawNewestTimeStep += entry.timeDelta;
+    }
+
+    if (rawCount == HISTORY_RAW_SIZE)
+    {
+      // Evict the oldest sample, the next one becomes the oldest
+      uint16_t oldest = rawHead;
+      uint16_t next = (oldest + 1) % HISTORY_RAW_SIZE;
+      rawOldestTemperature += raw[next].temperatureDelta;
+      rawOldestTimeStep += raw[next].timeDelta;
+      raw[next].temperatureDelta = 0;
+      raw[next].timeDelta = 0;
+      rawCount--;
+    }
+
+    raw[rawHead] = entry;
+    rawHead = (rawHead + 1) % HISTORY_RAW_SIZE;
+    rawCount++;
+  }
+
+public:
+  History()
+  {
+    rawHead = 0;
+    rawCount = 0;
+    rawOldestTimeStep = 0;
+    rawOldestTemperature = 0;
+    rawNewestTimeStep = 0;
+    rawNewestTemperature = 0;
+
+    minuteHead = 0;
+    minuteCount = 0;
+    quarterHead = 0;
+    quarterCount = 0;
+
+    resetAccumulator(&minuteAccumulator, 0);
+    resetAccumulator(&quarterAccumulator, 0);
+  }
+
+  // Record an environmental sample taken at timestamp milliseconds since boot
+  void addSample(unsigned long timestamp, Temperature temperature, float humidity)
+  {
+    if (!temperature.isValid() || isnan(humidity))
+    {
+      return;
+    }
+
+    int16_t fixedTemperature = temperature.centiCelsius();
+    uint8_t fixedHumidity = toHumidity(humidity);
+    uint32_t seconds = timestamp / 1000;
+
+    addRaw(timestamp / HISTORY_TIME_STEP, fixedTemperature, fixedHumidity);
+
+    // Close the minute bucket once a sample falls into the next minute
+    uint32_t minuteStart = seconds - seconds % HISTORY_MINUTE_SECONDS;
+    if (minuteAccumulator.count > 0 && minuteStart != minuteAccumulator.time)
+    {
+      pushBucket(minutes, HISTORY_MINUTE_SIZE, &minuteHead, &minuteCount, &minuteAccumulator);
+      accumulate(&quarterAccumulator, minuteAccumulator.temperatureMin, minuteAccumulator.temperatureMax, minuteAccumulator.temperatureSum, minuteAccumulator.humiditySum, minuteAccumulator.count);
+      resetAccumulator(&minuteAccumulator, minuteStart);
+
+      uint32_t quarterStart = seconds - seconds % HISTORY_QUARTER_SECONDS;
+      if (quarterStart != quarterAccumulator.time)
+      {
+        pushBucket(quarters, HISTORY_QUARTER_SIZE, &quarterHead, &quarterCount, &quarterAccumulator);
+        resetAccumulator(&quarterAccumulator, quarterStart);
+      }
+    }
+    if (minuteAccumulator.count == 0)
+    {
+      minuteAccumulator.time = minuteStart;
+      if (quarterAccumulator.count == 0)
+      {
+        quarterAccumulator.time = seconds - seconds % HISTORY_QUARTER_SECONDS;
+      }
+    }
+
+    accumulate(&minuteAccumulator, fixedTemperature, fixedTemperature, fixedTemperature, fixedHumidity, 1);
+  }
+
+  // Record a relay state change, called from the control task
+  void addTransition(Thermostat::ThermostatState state)
+  {
+    HistoryTransition transition;
+    transition.time = millis();
+    transition.state = state;
+    transitions.push(transition);
+  }
+
+  // ====== Raw Samples ======
+  uint16_t getRawCount()
+  {
+    return rawCount;
+  }
+
+  void beginRaw(HistoryRawIterator *iterator)
+  {
+    iterator->index = 0;
+    iterator->timeStep = rawOldestTimeStep;
+    iterator->temperature = rawOldestTemperature;
+  }
+
+  // Next raw sample from oldest to newest, returns false after the newest
+  bool nextRaw(HistoryRawIterator *iterator, HistorySample *sample)
+  {
+    if (iterator->index >= rawCount)
+    {
+      return false;
+    }
+
+    uint16_t position = (rawHead + HISTORY_RAW_SIZE - rawCount + iterator->index) % HISTORY_RAW_SIZE;
+    if (iterator->index > 0)
+    {
+      iterator->timeStep += raw[position].timeDelta;
+      iterator->temperature += raw[position].temperatureDelta;
+    }
+    iterator->index++;
+
+    sample->time = iterator->timeStep * HISTORY_TIME_STEP / 1000;
+    sample->temperature = Temperature::fromCentiCelsius(iterator->temperature);
+    sample->humidity = raw[position].humidity;
+    return true;
+  }
+
+  // ====== Rollups ======
+  uint16_t getMinuteCount()
+  {
+    return minuteCount;
+  }
+
+  // index 0 is the oldest bucket
+  HistoryBucket getMinute(uint16_t index)
+  {
+    return minutes[(minuteHead + HISTORY_MINUTE_SIZE - minuteCount + index) % HISTORY_MINUTE_SIZE];
+  }
+
+  uint16_t getQuarterCount()
+  {
+    return quarterCount;
+  }
+
+  // index 0 is the oldest bucket
+  HistoryBucket getQuarter(uint16_t index)
+  {
+    return quarters[(quarterHead + HISTORY_QUARTER_SIZE - quarterCount + index) % HISTORY_QUARTER_SIZE];
+  }
+
+  // ====== Relay Transitions ======
+  // Cursor at the oldest transition still held, the slot the writer overwrites next is not read
+  uint32_t beginTransitions()
+  {
+    uint32_t count = transitions.getCount();
+    return count >= HISTORY_TRANSITION_SIZE ? count - HISTORY_TRANSITION_SIZE + 1 : 0;
+  }
+
+  bool nextTransition(uint32_t *cursor, HistoryTransition *transition)
+  {
+    return transitions.read(cursor, transition);
+  }
+};
+
+static_assert(sizeof(History) <= HISTORY_MEMORY_BUDGET, "History exceeds HISTORY_MEMORY_BUDGET");
+
+#endif
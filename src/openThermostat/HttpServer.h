@@ -0,0 +1,1040 @@
+#ifndef HTTP_SERVER_H
+#define HTTP_SERVER_H
+
+#include <functional>
+
+#include <sys/select.h>
+
+#include <WiFi.h>
+#include <WiFiClient.h>
+
+#include "RequestArgs.h"
+
+// ====== HTTP Server Settings ======
+// Connections served at the same time, further clients wait in the listen backlog
+#ifndef HTTP_SERVER_MAX_CONNECTIONS
+#define HTTP_SERVER_MAX_CONNECTIONS 6
+#endif
+
+// Request line, headers and body of one request must fit
+#ifndef HTTP_SERVER_REQUEST_BUFFER_SIZE
+#define HTTP_SERVER_REQUEST_BUFFER_SIZE 1024
+#endif
+
+// Close connections that have been idle this long
+#ifndef HTTP_SERVER_IDLE_TIMEOUT
+#define HTTP_SERVER_IDLE_TIMEOUT 5000
+#endif
+
+// Requests served on one keep-alive connection before it is closed
+#ifndef HTTP_SERVER_MAX_KEEP_ALIVE_REQUESTS
+#define HTTP_SERVER_MAX_KEEP_ALIVE_REQUESTS 100
+#endif
+
+// Output the socket had no room for must have been taken by the client within this long, or the
+// connection is dropped
+#ifndef HTTP_SERVER_WRITE_TIMEOUT
+#define HTTP_SERVER_WRITE_TIMEOUT 200
+#endif
+
+// Output held back while a socket is full, shared by the connections: one connection's output waits
+// in it at a time and the others' requests are served once it is free. A response that falls further
+// behind is abandoned and its connection closed. Holds the largest response of the sketch, /metrics.
+#ifndef HTTP_SERVER_OUTPUT_BUFFER_SIZE
+#define HTTP_SERVER_OUTPUT_BUFFER_SIZE 16384
+#endif
+
+// Bytes handed to the socket at a time once it has room, well under its send buffer
+#define HTTP_SERVER_WRITE_PIECE 1024
+
+#define HTTP_SERVER_MAX_ROUTES 10
+#define HTTP_SERVER_PATH_SIZE 32
+
+#define HTTP_SERVER_INVALID_STREAM -1
+
+// Content-Length of a request head without the header while it is parsed
+#define HTTP_SERVER_NO_CONTENT_LENGTH 0xFFFF
+
+// Event driven HTTP/1.1 server. Every call to handleClient accepts waiting clients, reads whatever
+// bytes have arrived on each connection without blocking and serves at most one complete request
+// per connection, so many clients are multiplexed without holding up the caller. Responses go to
+// the socket as far as it has room and the rest is sent from later calls.
+class HttpServer
+{
+public:
+  enum Method
+  {
+    GET,
+    POST,
+    PUT,
+    OTHER
+  };
+
+  typedef std::function<void()> Handler;
+
+private:
+  enum ConnectionState
+  {
+    FREE,
+    READING_HEAD,
+    READING_BODY,
+    // Response left open after its headers, written to with writeStream
+    STREAMING,
+    // Response complete, closed once its buffered output has been sent
+    CLOSING
+  };
+
+  struct Connection
+  {
+    WiFiClient client;
+    ConnectionState state;
+
+    char buffer[HTTP_SERVER_REQUEST_BUFFER_SIZE];
+    uint16_t length;
+
+    // Offset of the body in buffer and its length from Content-Length
+    uint16_t bodyStart;
+    uint16_t contentLength;
+
+    bool keepAlive;
+    bool formBody;
+
+    // Offset of the Accept header's value in buffer, 0 if the request had none
+    uint16_t acceptStart;
+
+    // Status to answer the request with instead of serving it, 0 if it can be served
+    uint16_t rejectCode;
+
+    // Output the socket had no room for yet, held in the output buffer and sent from handleClient
+    uint16_t outputStart;
+    uint16_t outputLength;
+
+    // Set when output started waiting, it must all be sent by then
+    unsigned long writeDeadline;
+
+    // The current response could not be written, the connection closes after it
+    bool writeFailed;
+
+    uint16_t requestCount;
+    unsigned long lastActivityTime;
+
+    // Incremented when the connection closes so stale stream handles are detected
+    uint8_t generation;
+  };
+
+  struct Route
+  {
+    char path[HTTP_SERVER_PATH_SIZE];
+    Handler handler;
+  };
+
+  WiFiServer *listener;
+
+  Connection connections[HTTP_SERVER_MAX_CONNECTIONS];
+
+  // Response bytes a socket had no room for
+  char output[HTTP_SERVER_OUTPUT_BUFFER_SIZE];
+  // Connection whose output waits in the buffer, NULL while it is free
+  Connection *outputOwner;
+
+  Route routes[HTTP_SERVER_MAX_ROUTES];
+  uint8_t routeCount;
+  Handler notFoundHandler;
+
+  // ====== Current Request ======
+  Connection *current;
+  Method currentMethod;
+  char currentPath[HTTP_SERVER_PATH_SIZE];
+  RequestArgs currentArgs;
+  bool responseSent;
+
+  unsigned long requestCount;
+  // Responses by status class, 1xx to 5xx
+  unsigned long responseCounts[5];
+
+  void countResponse(int code)
+  {
+    if (code >= 100 && code < 600)
+    {
+      responseCounts[code / 100 - 1]++;
+    }
+  }
+
+  static const char *statusText(int code)
+  {
+    switch (code)
+    {
+    case 200:
+      return "OK";
+    case 400:
+      return "Bad Request";
+    case 404:
+      return "Not Found";
+    case 405:
+      return "Method Not Allowed";
+    case 413:
+      return "Payload Too Large";
+    case 500:
+      return "Internal Server Error";
+    case 501:
+      return "Not Implemented";
+    case 503:
+      return "Service Unavailable";
+    case 507:
+      return "Insufficient Storage";
+    default:
+      return "";
+    }
+  }
+
+  static bool startsWithIgnoreCase(const char *text, const char *prefix)
+  {
+    while (*prefix != '\0')
+    {
+      if (requestArgLower(*text) != requestArgLower(*prefix))
+      {
+        return false;
+      }
+      text++;
+      prefix++;
+    }
+    return true;
+  }
+
+  static int8_t hexValue(char c)
+  {
+    if (c >= '0' && c <= '9')
+    {
+      return c - '0';
+    }
+    c = requestArgLower(c);
+    if (c >= 'a' && c <= 'f')
+    {
+      return c - 'a' + 10;
+    }
+    return -1;
+  }
+
+  // Decode a percent encoded form component of length bytes into destination
+  static void urlDecode(char *destination, size_t size, const char *source, size_t length)
+  {
+    size_t out = 0;
+    for (size_t i = 0; i < length && out + 1 < size; i++)
+    {
+      if (source[i] == '+')
+      {
+        destination[out++] = ' ';
+      }
+      else if (source[i] == '%' && i + 2 < length && hexValue(source[i + 1]) >= 0 && hexValue(source[i + 2]) >= 0)
+      {
+        destination[out++] = (hexValue(source[i + 1]) << 4) | hexValue(source[i + 2]);
+        i += 2;
+      }
+      else
+      {
+        destination[out++] = source[i];
+      }
+    }
+    destination[out] = '\0';
+  }
+
+  // Add name=value pairs separated by & to the request arguments
+  void parseArgs(const char *text, size_t length)
+  {
+    char name[REQUEST_ARG_NAME_SIZE];
+    char value[REQUEST_ARG_VALUE_SIZE];
+
+    size_t start = 0;
+    while (start < length)
+    {
+      size_t end = start;
+      while (end < length && text[end] != '&')
+      {
+        end++;
+      }
+
+      size_t equals = start;
+      while (equals < end && text[equals] != '=')
+      {
+        equals++;
+      }
+
+      if (equals > start)
+      {
+        urlDecode(name, sizeof(name), text + start, equals - start);
+        if (equals < end)
+        {
+          urlDecode(value, sizeof(value), text + equals + 1, end - equals - 1);
+        }
+        else
+        {
+          value[0] = '\0';
+        }
+        currentArgs.add(name, value);
+      }
+
+      start = end + 1;
+    }
+  }
+
+  void close(Connection *connection)
+  {
+    connection->client.stop();
+    connection->state = FREE;
+    connection->length = 0;
+    releaseOutput(connection);
+    connection->generation++;
+  }
+
+  void releaseOutput(Connection *connection)
+  {
+    connection->outputStart = 0;
+    connection->outputLength = 0;
+    if (outputOwner == connection)
+    {
+      outputOwner = NULL;
+    }
+  }
+
+  // Close once the response has left, the connection is kept until its buffered output is sent
+  void closeAfterOutput(Connection *connection)
+  {
+    if (connection->outputLength > 0)
+    {
+      connection->state = CLOSING;
+    }
+    else
+    {
+      close(connection);
+    }
+  }
+
+  // Connection of a stream handle, NULL if the stream has closed
+  Connection *streamConnection(int32_t stream)
+  {
+    if (stream < 0 || (stream & 0xFF) >= HTTP_SERVER_MAX_CONNECTIONS)
+    {
+      return NULL;
+    }
+
+    Connection *connection = &connections[stream & 0xFF];
+    if (connection->state != STREAMING || connection->generation != ((stream >> 8) & 0xFF))
+    {
+      return NULL;
+    }
+    return connection;
+  }
+
+  // Content-Length value: digits only, at most HTTP_SERVER_REQUEST_BUFFER_SIZE. 413 is set for longer
+  // bodies and 400 for anything else, as a length the server reads differently than a proxy would
+  // lets the rest of the body pass for the next request.
+  static void parseContentLength(Connection *connection, const char *value)
+  {
+    while (*value == ' ')
+    {
+      value++;
+    }
+
+    char *end;
+    unsigned long length = strtoul(value, &end, 10);
+    while (*end == ' ')
+    {
+      end++;
+    }
+
+    if (end == value || *value < '0' || *value > '9' || *end != '\r')
+    {
+      connection->rejectCode = 400;
+    }
+    else if (length > HTTP_SERVER_REQUEST_BUFFER_SIZE)
+    {
+      connection->rejectCode = 413;
+    }
+    else if (connection->contentLength != HTTP_SERVER_NO_CONTENT_LENGTH && connection->contentLength != length)
+    {
+      // A repeated header must agree with the first
+      connection->rejectCode = 400;
+    }
+    else
+    {
+      connection->contentLength = length;
+    }
+  }
+
+  // Parse the request line and headers once the blank line ending them has arrived
+  bool parseHead(Connection *connection)
+  {
+    char *headEnd = strstr(connection->buffer, "\r\n\r\n");
+    if (headEnd == NULL)
+    {
+      return false;
+    }
+
+    connection->bodyStart = headEnd + 4 - connection->buffer;
+    connection->contentLength = HTTP_SERVER_NO_CONTENT_LENGTH;
+    connection->keepAlive = true;
+    connection->formBody = true;
+    connection->acceptStart = 0;
+    connection->rejectCode = 0;
+
+    // Headers
+    char *line = strstr(connection->buffer, "\r\n") + 2;
+    while (line < headEnd + 2)
+    {
+      if (startsWithIgnoreCase(line, "Content-Length:"))
+      {
+        parseContentLength(connection, line + 15);
+      }
+      else if (startsWithIgnoreCase(line, "Transfer-Encoding:"))
+      {
+        // Chunked request bodies are not supported, the body would be read as the next request
+        connection->rejectCode = 501;
+      }
+      else if (startsWithIgnoreCase(line, "Connection:"))
+      {
+        const char *value = line + 11;
+        while (*value == ' ')
+        {
+          value++;
+        }
+        connection->keepAlive = !startsWithIgnoreCase(value, "close");
+      }
+      else if (startsWithIgnoreCase(line, "Content-Type:"))
+      {
+        const char *value = line + 13;
+        while (*value == ' ')
+        {
+          value++;
+        }
+        connection->formBody = startsWithIgnoreCase(value, "application/x-www-form-urlencoded");
+      }
+      else if (startsWithIgnoreCase(line, "Accept:"))
+      {
+        connection->acceptStart = line + 7 - connection->buffer;
+      }
+
+      line = strstr(line, "\r\n") + 2;
+    }
+
+    if (connection->contentLength == HTTP_SERVER_NO_CONTENT_LENGTH)
+    {
+      connection->contentLength = 0;
+    }
+
+    // HTTP/1.0 clients are served one request per connection
+    char *requestLineEnd = strstr(connection->buffer, "\r\n");
+    if (requestLineEnd - connection->buffer >= 8 && strncmp(requestLineEnd - 8, "HTTP/1.0", 8) == 0)
+    {
+      connection->keepAlive = false;
+    }
+
+    return true;
+  }
+
+  // Dispatch the complete request at the start of the connection's buffer
+  void dispatch(Connection *connection)
+  {
+    current = connection;
+    responseSent = false;
+    requestCount++;
+    connection->requestCount++;
+    if (connection->requestCount >= HTTP_SERVER_MAX_KEEP_ALIVE_REQUESTS)
+    {
+      connection->keepAlive = false;
+    }
+
+    // Request line: METHOD SP target SP version
+    char *methodEnd = strchr(connection->buffer, ' ');
+    char *targetEnd = methodEnd == NULL ? NULL : strchr(methodEnd + 1, ' ');
+    if (targetEnd == NULL)
+    {
+      connection->keepAlive = false;
+      send(400, "text/plain", "Bad Request");
+      return;
+    }
+
+    size_t methodLength = methodEnd - connection->buffer;
+    if (methodLength == 3 && strncmp(connection->buffer, "GET", 3) == 0)
+    {
+      currentMethod = GET;
+    }
+    else if (methodLength == 4 && strncmp(connection->buffer, "POST", 4) == 0)
+    {
+      currentMethod = POST;
+    }
+    else if (methodLength == 3 && strncmp(connection->buffer, "PUT", 3) == 0)
+    {
+      currentMethod = PUT;
+    }
+    else
+    {
+      currentMethod = OTHER;
+    }
+
+    // Path and query
+    char *target = methodEnd + 1;
+    char *query = (char *)memchr(target, '?', targetEnd - target);
+    char *pathEnd = query == NULL ? targetEnd : query;
+    urlDecode(currentPath, sizeof(currentPath), target, pathEnd - target);
+
+    currentArgs.clear();
+    if (query != NULL)
+    {
+      parseArgs(query + 1, targetEnd - query - 1);
+    }
+    if (connection->formBody && connection->contentLength > 0)
+    {
+      parseArgs(connection->buffer + connection->bodyStart, connection->contentLength);
+    }
+
+    // Route
+    Handler *handler = &notFoundHandler;
+    for (uint8_t i = 0; i < routeCount; i++)
+    {
+      if (strcmp(routes[i].path, currentPath) == 0)
+      {
+        handler = &routes[i].handler;
+        break;
+      }
+    }
+
+    if (*handler)
+    {
+      (*handler)();
+    }
+    if (!responseSent)
+    {
+      send(404, "text/plain", "Not Found");
+    }
+  }
+
+  void accept(unsigned long now)
+  {
+    for (uint8_t i = 0; i < HTTP_SERVER_MAX_CONNECTIONS; i++)
+    {
+      if (connections[i].state != FREE)
+      {
+        continue;
+      }
+
+      WiFiClient client = listener->available();
+      if (!client)
+      {
+        return;
+      }
+
+      client.setNoDelay(true);
+      connections[i].client = client;
+      connections[i].state = READING_HEAD;
+      connections[i].length = 0;
+      connections[i].outputStart = 0;
+      connections[i].outputLength = 0;
+      connections[i].writeFailed = false;
+      connections[i].requestCount = 0;
+      connections[i].lastActivityTime = now;
+    }
+  }
+
+  // Read what has arrived and serve the request once it is complete
+  void service(Connection *connection, unsigned long now)
+  {
+    // Nothing more is read or served until the output of the last response has been sent
+    if (connection->outputLength > 0)
+    {
+      if (!flush(connection) || (connection->outputLength > 0 && (long)(now - connection->writeDeadline) >= 0))
+      {
+        close(connection);
+        return;
+      }
+      if (connection->outputLength > 0)
+      {
+        return;
+      }
+      if (connection->state == CLOSING)
+      {
+        close(connection);
+        return;
+      }
+    }
+
+    // Requests wait while another connection's output holds the buffer, their responses could not
+    // be held back if the socket filled
+    if (outputOwner != NULL && outputOwner != connection && connection->state != STREAMING)
+    {
+      return;
+    }
+
+    // Streams only send, anything the client sends is discarded
+    if (connection->state == STREAMING)
+    {
+      if (!connection->client.connected())
+      {
+        close(connection);
+        return;
+      }
+      while (connection->client.available() > 0)
+      {
+        connection->client.read((uint8_t *)connection->buffer, HTTP_SERVER_REQUEST_BUFFER_SIZE);
+      }
+      return;
+    }
+
+    int available = connection->client.available();
+    if (available > 0)
+    {
+      int space = HTTP_SERVER_REQUEST_BUFFER_SIZE - 1 - connection->length;
+      if (space <= 0)
+      {
+        reject(connection, 413);
+        return;
+      }
+
+      int received = connection->client.read((uint8_t *)connection->buffer + connection->length, available < space ? available : space);
+      if (received > 0)
+      {
+        connection->length += received;
+        connection->buffer[connection->length] = '\0';
+        connection->lastActivityTime = now;
+      }
+    }
+    else if (!connection->client.connected())
+    {
+      close(connection);
+      return;
+    }
+    else if (now - connection->lastActivityTime >= HTTP_SERVER_IDLE_TIMEOUT)
+    {
+      close(connection);
+      return;
+    }
+
+    if (connection->state == READING_HEAD && parseHead(connection))
+    {
+      connection->state = READING_BODY;
+      if (connection->rejectCode == 0 && connection->bodyStart + connection->contentLength >= HTTP_SERVER_REQUEST_BUFFER_SIZE)
+      {
+        connection->rejectCode = 413;
+      }
+      if (connection->rejectCode != 0)
+      {
+        reject(connection, connection->rejectCode);
+        return;
+      }
+    }
+
+    if (connection->state == READING_BODY && connection->length >= connection->bodyStart + connection->contentLength)
+    {
+      uint16_t requestLength = connection->bodyStart + connection->contentLength;
+
+      // Terminate the body so it can be parsed as text, the byte is restored for pipelined requests
+      char next = connection->buffer[requestLength];
+      connection->buffer[requestLength] = '\0';
+      dispatch(connection);
+      connection->buffer[requestLength] = next;
+      current = NULL;
+
+      if (connection->state == STREAMING)
+      {
+        connection->length = 0;
+        return;
+      }
+
+      if (!connection->keepAlive)
+      {
+        closeAfterOutput(connection);
+        return;
+      }
+
+      // Keep any pipelined bytes of the next request
+      connection->length -= requestLength;
+      memmove(connection->buffer, connection->buffer + requestLength, connection->length);
+      connection->buffer[connection->length] = '\0';
+      connection->state = READING_HEAD;
+    }
+  }
+
+  // Answer a request that cannot be served and close the connection without reading the rest of it
+  void reject(Connection *connection, int code)
+  {
+    current = connection;
+    responseSent = false;
+    connection->keepAlive = false;
+    send(code, "text/plain", statusText(code));
+    current = NULL;
+    closeAfterOutput(connection);
+  }
+
+  // Whether the socket has room for a piece now, never waits
+  bool writable(Connection *connection)
+  {
+    int fd = connection->client.fd();
+    if (fd < 0)
+    {
+      return false;
+    }
+
+    fd_set set;
+    FD_ZERO(&set);
+    FD_SET(fd, &set);
+    struct timeval timeout = {0, 0};
+    return select(fd + 1, NULL, &set, NULL, &timeout) > 0;
+  }
+
+  // Hand the socket one piece of data if it has room, returns the bytes taken. Sets writeFailed if the
+  // client has gone.
+  size_t writePiece(Connection *connection, const char *data, size_t length)
+  {
+    if (!writable(connection))
+    {
+      return 0;
+    }
+
+    size_t piece = length < HTTP_SERVER_WRITE_PIECE ? length : HTTP_SERVER_WRITE_PIECE;
+    size_t sent = connection->client.write((const uint8_t *)data, piece);
+    if (sent == 0)
+    {
+      connection->writeFailed = true;
+    }
+    return sent;
+  }
+
+  // Send buffered output while the socket has room, returns false once the client has gone
+  bool flush(Connection *connection)
+  {
+    while (connection->outputLength > 0)
+    {
+      size_t sent = writePiece(connection, output + connection->outputStart, connection->outputLength);
+      if (sent == 0)
+      {
+        break;
+      }
+      connection->outputStart += sent;
+      connection->outputLength -= sent;
+    }
+    if (connection->outputLength == 0)
+    {
+      releaseOutput(connection);
+    }
+    return !connection->writeFailed;
+  }
+
+  // Send what the socket takes now and buffer the rest for handleClient. Returns false once the client
+  // has gone or fallen further behind than the output buffer holds, the rest of the response is then
+  // dropped and the connection closed after it.
+  bool write(Connection *connection, const char *data, size_t length)
+  {
+    if (connection->writeFailed || !flush(connection))
+    {
+      return abandon(connection);
+    }
+
+    // Straight to the socket unless earlier output is waiting
+    size_t written = 0;
+    while (connection->outputLength == 0 && written < length)
+    {
+      size_t sent = writePiece(connection, data + written, length - written);
+      if (sent == 0)
+      {
+        break;
+      }
+      written += sent;
+    }
+    if (connection->writeFailed)
+    {
+      return abandon(connection);
+    }
+
+    size_t rest = length - written;
+    if (rest == 0)
+    {
+      return true;
+    }
+    if ((outputOwner != NULL && outputOwner != connection) || rest > HTTP_SERVER_OUTPUT_BUFFER_SIZE - connection->outputLength)
+    {
+      return abandon(connection);
+    }
+
+    if (connection->outputLength == 0)
+    {
+      outputOwner = connection;
+      connection->writeDeadline = millis() + HTTP_SERVER_WRITE_TIMEOUT;
+    }
+    if (connection->outputStart + connection->outputLength + rest > HTTP_SERVER_OUTPUT_BUFFER_SIZE)
+    {
+      memmove(output, output + connection->outputStart, connection->outputLength);
+      connection->outputStart = 0;
+    }
+    memcpy(output + connection->outputStart + connection->outputLength, data + written, rest);
+    connection->outputLength += rest;
+    return true;
+  }
+
+  // Drop the buffered output and fail every further write of the response
+  bool abandon(Connection *connection)
+  {
+    connection->writeFailed = true;
+    connection->keepAlive = false;
+    releaseOutput(connection);
+    return false;
+  }
+
+public:
+  HttpServer(int port)
+  {
+    listener = new WiFiServer(port);
+
+    for (uint8_t i = 0; i < HTTP_SERVER_MAX_CONNECTIONS; i++)
+    {
+      connections[i].state = FREE;
+      connections[i].length = 0;
+      connections[i].outputStart = 0;
+      connections[i].outputLength = 0;
+      connections[i].writeFailed = false;
+      connections[i].generation = 0;
+    }
+
+    outputOwner = NULL;
+    routeCount = 0;
+    current = NULL;
+    currentMethod = OTHER;
+    currentPath[0] = '\0';
+    responseSent = false;
+    requestCount = 0;
+    for (uint8_t i = 0; i < 5; i++)
+    {
+      responseCounts[i] = 0;
+    }
+  }
+
+  void on(const char *path, Handler handler)
+  {
+    if (routeCount >= HTTP_SERVER_MAX_ROUTES)
+    {
+      return;
+    }
+
+    strncpy(routes[routeCount].path, path, HTTP_SERVER_PATH_SIZE - 1);
+    routes[routeCount].path[HTTP_SERVER_PATH_SIZE - 1] = '\0';
+    routes[routeCount].handler = handler;
+    routeCount++;
+  }
+
+  void onNotFound(Handler handler)
+  {
+    notFoundHandler = handler;
+  }
+
+  void begin()
+  {
+    listener->begin();
+    listener->setNoDelay(true);
+  }
+
+  // Accept new clients and make progress on every open connection, never waits for a client
+  void handleClient()
+  {
+    unsigned long now = millis();
+
+    accept(now);
+
+    for (uint8_t i = 0; i < HTTP_SERVER_MAX_CONNECTIONS; i++)
+    {
+      if (connections[i].state != FREE)
+      {
+        service(&connections[i], now);
+      }
+    }
+  }
+
+  // ====== Current Request ======
+  Method method()
+  {
+    return currentMethod;
+  }
+
+  const char *uri()
+  {
+    return currentPath;
+  }
+
+  RequestArgs &args()
+  {
+    return currentArgs;
+  }
+
+  // Request body as text, empty if the request had none
+  const char *body()
+  {
+    if (current == NULL || current->contentLength == 0)
+    {
+      return "";
+    }
+    return current->buffer + current->bodyStart;
+  }
+
+  // Whether the request's Accept header lists contentType, quality values are not weighed
+  bool accepts(const char *contentType)
+  {
+    if (current == NULL || current->acceptStart == 0)
+    {
+      return false;
+    }
+
+    for (const char *c = current->buffer + current->acceptStart; *c != '\r' && *c != '\0'; c++)
+    {
+      if (startsWithIgnoreCase(c, contentType))
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void send(int code, const char *contentType, const char *content, size_t length)
+  {
+    if (current == NULL || responseSent)
+    {
+      return;
+    }
+    responseSent = true;
+    countResponse(code);
+
+    char header[160];
+    int headerLength = snprintf(header, sizeof(header),
+                                "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %u\r\nConnection: %s\r\n\r\n",
+                                code, statusText(code), contentType, (unsigned)length, current->keepAlive ? "keep-alive" : "close");
+
+    write(current, header, headerLength);
+    write(current, content, length);
+  }
+
+  void send(int code, const char *contentType, const char *content)
+  {
+    send(code, contentType, content, strlen(content));
+  }
+
+  // ====== Chunked Responses ======
+  // Send headers for a response of unknown length, the body follows through sendChunk
+  // calls made before the handler returns and ends with endChunked
+  bool beginChunked(int code, const char *contentType)
+  {
+    if (current == NULL || responseSent)
+    {
+      return false;
+    }
+    responseSent = true;
+    countResponse(code);
+
+    char header[160];
+    int headerLength = snprintf(header, sizeof(header),
+                                "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nTransfer-Encoding: chunked\r\nConnection: %s\r\n\r\n",
+                                code, statusText(code), contentType, current->keepAlive ? "keep-alive" : "close");
+    return write(current, header, headerLength);
+  }
+
+  bool sendChunk(const char *data, size_t length)
+  {
+    if (current == NULL || length == 0)
+    {
+      // A zero length chunk would end the body
+      return current != NULL;
+    }
+
+    char size[12];
+    int sizeLength = snprintf(size, sizeof(size), "%X\r\n", (unsigned)length);
+    return write(current, size, sizeLength) && write(current, data, length) && write(current, "\r\n", 2);
+  }
+
+  bool endChunked()
+  {
+    if (current == NULL)
+    {
+      return false;
+    }
+    return write(current, "0\r\n\r\n", 5);
+  }
+
+  // ====== Streaming Responses ======
+  // Send headers without a length and keep the connection open for writeStream.
+  // Returns a handle for the stream or HTTP_SERVER_INVALID_STREAM.
+  int32_t beginStream(const char *contentType)
+  {
+    if (current == NULL || responseSent)
+    {
+      return HTTP_SERVER_INVALID_STREAM;
+    }
+    responseSent = true;
+    countResponse(200);
+
+    char header[160];
+    int headerLength = snprintf(header, sizeof(header),
+                                "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nCache-Control: no-cache\r\nConnection: keep-alive\r\n\r\n",
+                                contentType);
+    if (!write(current, header, headerLength))
+    {
+      return HTTP_SERVER_INVALID_STREAM;
+    }
+
+    current->state = STREAMING;
+    return (current->generation << 8) | (current - connections);
+  }
+
+  // Write to an open stream without waiting, returns false and closes it if the client has gone or
+  // fallen too far behind
+  bool writeStream(int32_t stream, const char *data, size_t length)
+  {
+    Connection *connection = streamConnection(stream);
+    if (connection == NULL)
+    {
+      return false;
+    }
+
+    if (!write(connection, data, length))
+    {
+      close(connection);
+      return false;
+    }
+    return true;
+  }
+
+  bool isStreamOpen(int32_t stream)
+  {
+    return streamConnection(stream) != NULL;
+  }
+
+  void closeStream(int32_t stream)
+  {
+    Connection *connection = streamConnection(stream);
+    if (connection != NULL)
+    {
+      close(connection);
+    }
+  }
+
+  // ====== Statistics ======
+  unsigned long getRequestCount()
+  {
+    return requestCount;
+  }
+
+  // Responses sent with a status of statusClass (1 to 5) hundred
+  unsigned long getResponseCount(uint8_t statusClass)
+  {
+    return statusClass >= 1 && statusClass <= 5 ? responseCounts[statusClass - 1] : 0;
+  }
+
+  uint8_t getConnectionCount()
+  {
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < HTTP_SERVER_MAX_CONNECTIONS; i++)
+    {
+      if (connections[i].state != FREE)
+      {
+        count++;
+      }
+    }
+    return count;
+  }
+};
+
+#endif
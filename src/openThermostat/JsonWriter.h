@@ -0,0 +1,308 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+// Maximum nesting of objects and arrays
+#define JSON_WRITER_MAX_DEPTH 8
+
+// ====== Schemas ======
+// Fixed document layouts are constexpr tables of fields: JSON_FIELD_OBJECT opens a nested object
+// closed by its JSON_FIELD_END, JSON_FIELD_VALUE is a member whose value the caller writes.
+enum JsonFieldType : uint8_t
+{
+  JSON_FIELD_OBJECT,
+  JSON_FIELD_END,
+  JSON_FIELD_VALUE
+};
+
+struct JsonField
+{
+  JsonFieldType type;
+  const char *name;
+  // Passed back to the caller to write the member's value
+  uint8_t value;
+  // Bits that select the member, see JsonWriter::document
+  uint32_t select;
+};
+
+// Selects every member of a schema
+#define JSON_SELECT_ALL 0xFFFFFFFF
+
+// Streaming JSON writer into a caller owned, fixed size buffer. Never allocates, output that does
+// not fit is truncated and reported by hasOverflowed so a partial document is never sent.
+class JsonWriter
+{
+private:
+  char *buffer;
+  size_t capacity;
+  size_t length;
+  bool overflow;
+
+  uint8_t depth;
+  // Bit per nesting level, set once the level has its first member
+  uint8_t hasMembers;
+
+  void append(const char *text, size_t textLength)
+  {
+    if (overflow || length + textLength >= capacity)
+    {
+      overflow = true;
+      return;
+    }
+
+    memcpy(buffer + length, text, textLength);
+    length += textLength;
+    buffer[length] = '\0';
+  }
+
+  void append(const char *text)
+  {
+    append(text, strlen(text));
+  }
+
+  void append(char c)
+  {
+    append(&c, 1);
+  }
+
+  // Comma between members of the current object or array
+  void separator()
+  {
+    uint8_t bit = 1 << depth;
+    if (hasMembers & bit)
+    {
+      append(',');
+    }
+    hasMembers |= bit;
+  }
+
+  void open(char bracket)
+  {
+    separator();
+    append(bracket);
+    if (depth + 1 >= JSON_WRITER_MAX_DEPTH)
+    {
+      overflow = true;
+      return;
+    }
+    depth++;
+    hasMembers &= ~(1 << depth);
+  }
+
+  void close(char bracket)
+  {
+    if (depth > 0)
+    {
+      depth--;
+    }
+    append(bracket);
+  }
+
+  void string(const char *text)
+  {
+    append('"');
+    for (const char *c = text; *c != '\0'; c++)
+    {
+      if (*c == '"' || *c == '\\')
+      {
+        append('\\');
+        append(*c);
+      }
+      else if ((uint8_t)*c < 0x20)
+      {
+        char escaped[7];
+        snprintf(escaped, sizeof(escaped), "\\u%04x", *c);
+        append(escaped);
+      }
+      else
+      {
+        append(*c);
+      }
+    }
+    append('"');
+  }
+
+public:
+  JsonWriter(char *buffer, size_t capacity)
+  {
+    this->buffer = buffer;
+    this->capacity = capacity;
+
+    reset();
+  }
+
+  void reset()
+  {
+    length = 0;
+    overflow = capacity == 0;
+    depth = 0;
+    hasMembers = 0;
+
+    if (capacity > 0)
+    {
+      buffer[0] = '\0';
+    }
+  }
+
+  // ====== Structure ======
+  void beginObject()
+  {
+    open('{');
+  }
+
+  void beginObject(const char *name)
+  {
+    key(name);
+    open('{');
+  }
+
+  void endObject()
+  {
+    close('}');
+  }
+
+  void beginArray()
+  {
+    open('[');
+  }
+
+  void beginArray(const char *name)
+  {
+    key(name);
+    open('[');
+  }
+
+  void endArray()
+  {
+    close(']');
+  }
+
+  // Member name, followed by exactly one value
+  void key(const char *name)
+  {
+    separator();
+    string(name);
+    append(':');
+    // The value belongs to this member, not a new one
+    hasMembers &= ~(1 << depth);
+  }
+
+  // ====== Values ======
+  void value(const char *text)
+  {
+    separator();
+    string(text);
+  }
+
+  void value(bool flag)
+  {
+    separator();
+    append(flag ? "true" : "false");
+  }
+
+  void value(long number)
+  {
+    separator();
+    char text[12];
+    snprintf(text, sizeof(text), "%ld", number);
+    append(text);
+  }
+
+  void value(int number)
+  {
+    value((long)number);
+  }
+
+  // Fixed decimal places, NAN and infinity are written as null
+  void value(double number, uint8_t decimals = 2)
+  {
+    separator();
+    if (isnan(number) || isinf(number))
+    {
+      append("null");
+      return;
+    }
+
+    char text[24];
+    snprintf(text, sizeof(text), "%.*f", decimals, number);
+    append(text);
+  }
+
+  // ====== Members ======
+  template <typename T>
+  void member(const char *name, T memberValue)
+  {
+    key(name);
+    value(memberValue);
+  }
+
+  void member(const char *name, double memberValue, uint8_t decimals)
+  {
+    key(name);
+    value(memberValue, decimals);
+  }
+
+  // ====== Documents ======
+  // Write the members of schema whose select bits intersect select as one object, objects with no
+  // selected member are left out. source.writeValue(writer, value) writes each member's value.
+  template <size_t N, typename Source>
+  void document(const JsonField (&schema)[N], uint32_t select, const Source &source)
+  {
+    // Schema objects entered, and how many of them were written so far
+    const char *objects[JSON_WRITER_MAX_DEPTH];
+    uint8_t entered = 0;
+    uint8_t opened = 0;
+
+    beginObject();
+    for (size_t i = 0; i < N; i++)
+    {
+      const JsonField &field = schema[i];
+      if (field.type == JSON_FIELD_OBJECT)
+      {
+        if (entered == JSON_WRITER_MAX_DEPTH)
+        {
+          overflow = true;
+          return;
+        }
+        objects[entered++] = field.name;
+      }
+      else if (field.type == JSON_FIELD_END)
+      {
+        if (opened == entered)
+        {
+          endObject();
+          opened--;
+        }
+        entered--;
+      }
+      else if (field.select & select)
+      {
+        // Open the enclosing objects on their first selected member
+        while (opened < entered)
+        {
+          beginObject(objects[opened++]);
+        }
+        key(field.name);
+        source.writeValue(this, field.value);
+      }
+    }
+    endObject();
+  }
+
+  // ====== Result ======
+  const char *c_str()
+  {
+    return buffer;
+  }
+
+  size_t size()
+  {
+    return length;
+  }
+
+  bool hasOverflowed()
+  {
+    return overflow;
+  }
+};
+
+#endif
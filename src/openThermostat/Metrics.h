@@ -0,0 +1,252 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "Snapshot.h"
+
+// ====== Metrics Settings ======
+// Cycle histograms of the loop stages and the /metrics endpoint, 0 compiles all of it out
+#ifndef METRICS_ENABLED
+#define METRICS_ENABLED 1
+#endif
+
+// Bucket i holds runs of at most 2^(METRICS_FIRST_BUCKET_BITS + 2i) cycles, the last one everything longer
+#define METRICS_HISTOGRAM_BUCKETS 10
+#define METRICS_FIRST_BUCKET_BITS 10
+
+// Schedulers whose tasks are exported
+#define METRICS_MAX_SCHEDULERS 2
+
+// Empty timings run at startup to measure what one timing costs
+#define METRICS_CALIBRATION_RUNS 64
+
+// Cycle counter of the running core, host builds pass a fake one instead
+static uint32_t metricsCycleCount()
+{
+  return ESP.getCycleCount();
+}
+
+// Run lengths in cycles on power of four buckets. Written by one task and read by the web service without
+// locking, so a scrape may see a run counted in its bucket but not yet in the sum. The 64 bit sum is
+// published under a sequence lock, read plainly from the other core it could be torn and go backwards.
+class CycleHistogram
+{
+private:
+  uint32_t counts[METRICS_HISTOGRAM_BUCKETS];
+  // The writer's running sum, readers see the copy in sum
+  uint64_t total;
+  Snapshot<uint64_t> sum;
+  uint32_t maximum;
+
+public:
+  CycleHistogram()
+  {
+    reset();
+  }
+
+  void reset()
+  {
+    for (uint8_t i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++)
+    {
+      counts[i] = 0;
+    }
+    total = 0;
+    sum.write(0);
+    maximum = 0;
+  }
+
+  // Bucket of a run, from the bit length so no loop is needed
+  static uint8_t bucket(uint32_t cycles)
+  {
+    uint32_t below = cycles > 0 ? cycles - 1 : 0;
+    uint8_t bits = below == 0 ? 0 : 32 - __builtin_clz(below);
+    uint8_t index = bits <= METRICS_FIRST_BUCKET_BITS ? 0 : (bits - METRICS_FIRST_BUCKET_BITS + 1) / 2;
+    return index < METRICS_HISTOGRAM_BUCKETS - 1 ? index : METRICS_HISTOGRAM_BUCKETS - 1;
+  }
+
+  // Inclusive upper bound of a bucket, 0 for the last one which has none
+  static uint32_t bucketLimit(uint8_t index)
+  {
+    return index < METRICS_HISTOGRAM_BUCKETS - 1 ? (uint32_t)1 << (METRICS_FIRST_BUCKET_BITS + 2 * index) : 0;
+  }
+
+  void add(uint32_t cycles)
+  {
+    counts[bucket(cycles)]++;
+    total += cycles;
+    sum.write(total);
+    if (cycles > maximum)
+    {
+      maximum = cycles;
+    }
+  }
+
+  uint32_t getCount(uint8_t index) const
+  {
+    return counts[index];
+  }
+
+  uint64_t getSum() const
+  {
+    return sum.read();
+  }
+
+  uint32_t getMaximum() const
+  {
+    return maximum;
+  }
+};
+
+// Timed sections outside the scheduler tasks
+enum MetricsStage
+{
+  // One pass over the main loop's due tasks
+  METRICS_STAGE_LOOP,
+  // One pass over the control task's due tasks
+  METRICS_STAGE_CONTROL_LOOP,
+  METRICS_STAGE_THERMOSTAT,
+  METRICS_STAGE_RELAYS,
+  METRICS_STAGE_COUNT
+};
+
+class Scheduler;
+
+#if METRICS_ENABLED
+// Registry of what /metrics exports besides the statistics other modules keep themselves
+class Metrics
+{
+private:
+  static Metrics *instance;
+
+  uint32_t (*clockCycles)();
+
+  CycleHistogram stages[METRICS_STAGE_COUNT];
+
+  Scheduler *schedulers[METRICS_MAX_SCHEDULERS];
+  const char *schedulerNames[METRICS_MAX_SCHEDULERS];
+  uint8_t schedulerCount;
+
+  // Cycles one timing adds to the section it measures
+  uint32_t overhead;
+
+public:
+  Metrics(uint32_t (*clockCycles)() = metricsCycleCount)
+  {
+    this->clockCycles = clockCycles;
+    schedulerCount = 0;
+
+    // Time empty sections the same way MetricsTimer does, only the pair of reads lands in a measurement
+    uint32_t measured = 0;
+    for (uint8_t i = 0; i < METRICS_CALIBRATION_RUNS; i++)
+    {
+      uint32_t sectionStart = clockCycles();
+      measured += clockCycles() - sectionStart;
+    }
+    overhead = measured / METRICS_CALIBRATION_RUNS;
+  }
+
+  // Singleton, create it in setup before the control task starts. The first call picks the cycle counter.
+  static Metrics *getInstance(uint32_t (*clockCycles)() = metricsCycleCount)
+  {
+    if (!instance)
+    {
+      instance = new Metrics(clockCycles);
+    }
+    return instance;
+  }
+
+  uint32_t cycles()
+  {
+    return (*clockCycles)();
+  }
+
+  CycleHistogram *getStage(MetricsStage stage)
+  {
+    return &stages[stage];
+  }
+
+  static const char *getStageName(MetricsStage stage)
+  {
+    switch (stage)
+    {
+    case METRICS_STAGE_LOOP:
+      return "loop";
+    case METRICS_STAGE_CONTROL_LOOP:
+      return "control_loop";
+    case METRICS_STAGE_THERMOSTAT:
+      return "thermostat";
+    case METRICS_STAGE_RELAYS:
+      return "relays";
+    default:
+      return "";
+    }
+  }
+
+  // Export the tasks of a scheduler under name, false if the registry is full
+  bool addScheduler(const char *name, Scheduler *scheduler)
+  {
+    if (schedulerCount >= METRICS_MAX_SCHEDULERS)
+    {
+      return false;
+    }
+    schedulerNames[schedulerCount] = name;
+    schedulers[schedulerCount] = scheduler;
+    schedulerCount++;
+    return true;
+  }
+
+  uint8_t getSchedulerCount()
+  {
+    return schedulerCount;
+  }
+
+  Scheduler *getScheduler(uint8_t index)
+  {
+    return schedulers[index];
+  }
+
+  const char *getSchedulerName(uint8_t index)
+  {
+    return schedulerNames[index];
+  }
+
+  uint32_t getOverhead()
+  {
+    return overhead;
+  }
+};
+
+Metrics *Metrics::instance = 0;
+
+// Times its scope into a stage histogram
+class MetricsTimer
+{
+private:
+  Metrics *metrics;
+  CycleHistogram *histogram;
+  uint32_t startTime;
+
+public:
+  MetricsTimer(MetricsStage stage)
+  {
+    metrics = Metrics::getInstance();
+    histogram = metrics->getStage(stage);
+    startTime = metrics->cycles();
+  }
+
+  ~MetricsTimer()
+  {
+    histogram->add(metrics->cycles() - startTime);
+  }
+};
+#else
+// Compiled out, timings cost nothing
+class MetricsTimer
+{
+public:
+  MetricsTimer(MetricsStage stage)
+  {
+  }
+};
+#endif
+
+#endif
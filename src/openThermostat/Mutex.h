@@ -0,0 +1,46 @@
+#ifndef MUTEX_H
+#define MUTEX_H
+
+// FreeRTOS mutex shared between tasks
+class Mutex
+{
+private:
+  SemaphoreHandle_t handle;
+
+public:
+  Mutex()
+  {
+    handle = xSemaphoreCreateMutex();
+  }
+
+  void lock()
+  {
+    xSemaphoreTake(handle, portMAX_DELAY);
+  }
+
+  void unlock()
+  {
+    xSemaphoreGive(handle);
+  }
+};
+
+// Holds a mutex for the lifetime of the scope
+class MutexLock
+{
+private:
+  Mutex *mutex;
+
+public:
+  MutexLock(Mutex *mutex)
+  {
+    this->mutex = mutex;
+    this->mutex->lock();
+  }
+
+  ~MutexLock()
+  {
+    mutex->unlock();
+  }
+};
+
+#endif
@@ -3,23 +3,96 @@
 
 #include "EEPROM.h"
 
+#include "Mutex.h"
+#include "Schedule.h"
+#include "SettingsLog.h"
+#include "Temperature.h"
+#include "ThermostatConfig.h"
+
 // ====== Define EEPROM Size ======
+// Builds with many zones need more than the default to keep a full schedule, the ESP32 allows up to 4096
+#ifndef EEPROM_SIZE
 #define EEPROM_SIZE 512
+#endif
+
+// ====== Legacy EEPROM Addresses ======
+// Fixed layout used before the settings log, only read to migrate existing devices
+#define EEPROM_LEGACY_CURRENT_MODE 0           // 1 byte
+#define EEPROM_LEGACY_CURRENT_STATE 1          // 1 byte
+#define EEPROM_LEGACY_CURRENT_SETPOINT_LOW 2   // 8 bytes
+#define EEPROM_LEGACY_CURRENT_SETPOINT_HIGH 10 // 8 bytes
+
+#define EEPROM_LEGACY_SETTING_SCREEN_UNIT 40        // 1 byte
+#define EEPROM_LEGACY_SETTING_REMOTE_TEMPERATURE 41 // 4 bytes
+
+// ====== Settings Log Keys ======
+#define STORAGE_KEY_CURRENT_MODE 0
+#define STORAGE_KEY_CURRENT_STATE 1
+#define STORAGE_KEY_SETPOINT_LOW 2
+#define STORAGE_KEY_SETPOINT_HIGH 3
+
+#define STORAGE_KEY_SETTING_SCREEN_UNIT 16
+#define STORAGE_KEY_SETTING_REMOTE_TEMPERATURE 17
+#define STORAGE_KEY_SETTING_CONTROL_STRATEGY 18
+
+// Weekly schedule, 5 bytes per transition: [minute low][minute high][zone][setpoint low][setpoint high]
+// with setpoints in tenths of a degree above ABSOLUTE_MINIMUM_SETPOINT
+#define STORAGE_KEY_SCHEDULE 19
+#define STORAGE_SCHEDULE_TRANSITION_SIZE 5
+
+static_assert(SCHEDULE_MAX_TRANSITIONS * STORAGE_SCHEDULE_TRANSITION_SIZE <= 255, "SCHEDULE_MAX_TRANSITIONS exceeds a settings log record");
+static_assert((ABSOLUTE_MAXIMUM_SETPOINT - ABSOLUTE_MINIMUM_SETPOINT) * 10 <= 255, "schedule setpoints do not fit a byte");
+
+// Zones after the first store [setpoint low][setpoint high][state] under one key each, from this key up,
+// setpoints as 2 byte hundredths of a degree. Records of earlier firmware lack the state.
+#define STORAGE_KEY_ZONE_SETPOINTS 20
+#define STORAGE_ZONE_RECORD_SIZE 5
+#define STORAGE_LEGACY_ZONE_RECORD_SIZE 4
+
+static_assert(STORAGE_KEY_ZONE_SETPOINTS + THERMOSTAT_ZONE_COUNT - 1 <= SETTINGS_LOG_MAX_KEYS, "THERMOSTAT_ZONE_COUNT exceeds the settings log keys");
 
-// ====== EEPROM Addresses ======
-#define EEPROM_CURRENT_MODE 0           // 1 byte
-#define EEPROM_CURRENT_STATE 1          // 1 byte
-#define EEPROM_CURRENT_SETPOINT_LOW 2   // 8 bytes
-#define EEPROM_CURRENT_SETPOINT_HIGH 10 // 8 bytes
+// Records of every key but the schedule: five single bytes, two temperatures and a record per further zone
+#define STORAGE_OTHER_KEYS_SIZE (5 * (SETTINGS_LOG_RECORD_OVERHEAD + 1) + 2 * (SETTINGS_LOG_RECORD_OVERHEAD + 2) + \
+                                 (THERMOSTAT_ZONE_COUNT - 1) * (SETTINGS_LOG_RECORD_OVERHEAD + STORAGE_ZONE_RECORD_SIZE))
 
-#define EEPROM_SETTING_SCREEN_UNIT 40        // 1 byte
-#define EEPROM_SETTING_REMOTE_TEMPERATURE 41 // 4 bytes
+// A full schedule must fit a compacted bank next to the latest value of every other key
+static_assert(SCHEDULE_MAX_TRANSITIONS * STORAGE_SCHEDULE_TRANSITION_SIZE <=
+                  EEPROM_SIZE / 2 - SETTINGS_LOG_HEADER_SIZE - SETTINGS_LOG_RECORD_OVERHEAD - STORAGE_OTHER_KEYS_SIZE,
+              "SCHEDULE_MAX_TRANSITIONS exceeds the settings log bank");
+
+// ====== Commit Settings ======
+// Minimum time between flash commits, changes made in between are coalesced into one commit
+#ifndef EEPROM_COMMIT_PERIOD
+#define EEPROM_COMMIT_PERIOD 30000
+#endif
 
 class PersistentStorage
 {
 private:
   static PersistentStorage *instance;
 
+  SettingsLog *settingsLog;
+
+  // Guards the RAM mirror and EEPROM buffer, settings are accessed from both cores
+  Mutex mutex;
+
+  // RAM mirror of the values stored in EEPROM
+  uint8_t currentMode;
+  // Per zone values
+  uint8_t currentState[THERMOSTAT_ZONE_COUNT];
+  Temperature setpointLow[THERMOSTAT_ZONE_COUNT];
+  Temperature setpointHigh[THERMOSTAT_ZONE_COUNT];
+  bool screenImperial;
+  bool useRemoteTemperature;
+  uint8_t controlStrategy;
+
+  // True when the EEPROM buffer holds changes that have not been committed to flash
+  bool dirty;
+
+  unsigned long lastCommitTime;
+
+  unsigned long commitCount;
+
   PersistentStorage()
   {
     // ====== Initialize EEPROM ======
@@ -30,17 +103,145 @@ private:
       {
       }
     }
+
+    dirty = false;
+    lastCommitTime = millis();
+    commitCount = 0;
+
+    // ====== Load RAM mirror ======
+    settingsLog = new SettingsLog(EEPROM_SIZE);
+    if (settingsLog->begin())
+    {
+      uint8_t value;
+
+      currentMode = settingsLog->read(STORAGE_KEY_CURRENT_MODE, &value, sizeof(value)) ? value : 0;
+      currentState[0] = settingsLog->read(STORAGE_KEY_CURRENT_STATE, &value, sizeof(value)) ? value : 0;
+      setpointLow[0] = readTemperature(STORAGE_KEY_SETPOINT_LOW);
+      setpointHigh[0] = readTemperature(STORAGE_KEY_SETPOINT_HIGH);
+      screenImperial = settingsLog->read(STORAGE_KEY_SETTING_SCREEN_UNIT, &value, sizeof(value)) ? (bool)value : false;
+      useRemoteTemperature = settingsLog->read(STORAGE_KEY_SETTING_REMOTE_TEMPERATURE, &value, sizeof(value)) ? (bool)value : false;
+      controlStrategy = settingsLog->read(STORAGE_KEY_SETTING_CONTROL_STRATEGY, &value, sizeof(value)) ? value : 0;
+    }
+    else
+    {
+      migrateLegacyLayout();
+    }
+
+    // Zones without a stored record start from the first zone's setpoints
+    for (uint8_t zone = 1; zone < THERMOSTAT_ZONE_COUNT; zone++)
+    {
+      uint8_t record[STORAGE_ZONE_RECORD_SIZE];
+      uint8_t key = STORAGE_KEY_ZONE_SETPOINTS + zone - 1;
+      uint8_t length = settingsLog->length(key);
+      if ((length == STORAGE_ZONE_RECORD_SIZE || length == STORAGE_LEGACY_ZONE_RECORD_SIZE) && settingsLog->read(key, record, length))
+      {
+        int16_t centi[2];
+        memcpy(centi, record, sizeof(centi));
+        setpointLow[zone] = Temperature::fromCentiCelsius(centi[0]);
+        setpointHigh[zone] = Temperature::fromCentiCelsius(centi[1]);
+        currentState[zone] = length == STORAGE_ZONE_RECORD_SIZE ? record[4] : 0;
+      }
+      else
+      {
+        setpointLow[zone] = setpointLow[0];
+        setpointHigh[zone] = setpointHigh[0];
+        currentState[zone] = 0;
+      }
+    }
   }
 
-  void EEPROM_writeDouble(uint8_t address, double value)
+  // Read the values from the fixed address layout and rewrite them as a settings log
+  void migrateLegacyLayout()
   {
-    byte *v = (byte *)(void *)&value;
-    for (int i = 0; i < sizeof(value); i++)
+    currentMode = EEPROM.read(EEPROM_LEGACY_CURRENT_MODE);
+    currentState[0] = EEPROM.read(EEPROM_LEGACY_CURRENT_STATE);
+    setpointLow[0] = Temperature::fromCelsius(EEPROM_readDouble(EEPROM_LEGACY_CURRENT_SETPOINT_LOW));
+    setpointHigh[0] = Temperature::fromCelsius(EEPROM_readDouble(EEPROM_LEGACY_CURRENT_SETPOINT_HIGH));
+    screenImperial = (bool)EEPROM.read(EEPROM_LEGACY_SETTING_SCREEN_UNIT);
+    useRemoteTemperature = (bool)EEPROM.read(EEPROM_LEGACY_SETTING_REMOTE_TEMPERATURE);
+    // Not part of the legacy layout
+    controlStrategy = 0;
+
+    settingsLog->format();
+    writeByte(STORAGE_KEY_CURRENT_MODE, currentMode);
+    writeByte(STORAGE_KEY_CURRENT_STATE, currentState[0]);
+    writeTemperature(STORAGE_KEY_SETPOINT_LOW, setpointLow[0]);
+    writeTemperature(STORAGE_KEY_SETPOINT_HIGH, setpointHigh[0]);
+    writeByte(STORAGE_KEY_SETTING_SCREEN_UNIT, screenImperial);
+    writeByte(STORAGE_KEY_SETTING_REMOTE_TEMPERATURE, useRemoteTemperature);
+    writeByte(STORAGE_KEY_SETTING_CONTROL_STRATEGY, controlStrategy);
+
+    dirty = true;
+  }
+
+  void writeByte(uint8_t key, uint8_t value)
+  {
+    settingsLog->write(key, &value, sizeof(value));
+  }
+
+  // Temperatures are stored as 2 byte hundredths of a degree
+  void writeTemperature(uint8_t key, Temperature value)
+  {
+    int16_t centi = value.centiCelsius();
+    settingsLog->write(key, &centi, sizeof(centi));
+  }
+
+  // Also accepts the 8 byte doubles written by earlier firmware, rewriting them in the fixed point format
+  Temperature readTemperature(uint8_t key)
+  {
+    int16_t centi;
+    if (settingsLog->read(key, &centi, sizeof(centi)))
+    {
+      return Temperature::fromCentiCelsius(centi);
+    }
+
+    double celsius;
+    if (settingsLog->read(key, &celsius, sizeof(celsius)))
+    {
+      Temperature value = Temperature::fromCelsius(celsius);
+      writeTemperature(key, value);
+      dirty = true;
+      return value;
+    }
+
+    return Temperature();
+  }
+
+  // The first zone keeps its original keys, later zones store setpoints and state in one record
+  void writeSetpoints(uint8_t zone, bool low)
+  {
+    if (zone == 0)
+    {
+      writeTemperature(low ? STORAGE_KEY_SETPOINT_LOW : STORAGE_KEY_SETPOINT_HIGH, low ? setpointLow[0] : setpointHigh[0]);
+      return;
+    }
+    writeZoneRecord(zone);
+  }
+
+  void writeZoneRecord(uint8_t zone)
+  {
+    // Never reached in a one zone build, where indexing the arrays past the first zone would not compile cleanly
+    if (THERMOSTAT_ZONE_COUNT > 1)
     {
-      EEPROM.write(address + i, *v++);
+      int16_t centi[2] = {setpointLow[zone].centiCelsius(), setpointHigh[zone].centiCelsius()};
+      uint8_t record[STORAGE_ZONE_RECORD_SIZE];
+      memcpy(record, centi, sizeof(centi));
+      record[4] = currentState[zone];
+      settingsLog->write(STORAGE_KEY_ZONE_SETPOINTS + zone - 1, record, sizeof(record));
     }
   }
 
+  // Tenths of a degree above ABSOLUTE_MINIMUM_SETPOINT, setpoints are always within the absolute limits
+  static uint8_t encodeScheduleSetpoint(Temperature setpoint)
+  {
+    return (setpoint.centiCelsius() - ABSOLUTE_MINIMUM_SETPOINT * 100 + 5) / 10;
+  }
+
+  static Temperature decodeScheduleSetpoint(uint8_t value)
+  {
+    return Temperature::fromCentiCelsius(ABSOLUTE_MINIMUM_SETPOINT * 100 + value * 10);
+  }
+
   double EEPROM_readDouble(uint8_t address)
   {
     double value;
@@ -52,6 +253,19 @@ private:
     return value;
   }
 
+  void commit()
+  {
+    if (!dirty)
+    {
+      return;
+    }
+
+    EEPROM.commit();
+    dirty = false;
+    lastCommitTime = millis();
+    commitCount++;
+  }
+
 public:
   // Singleton
   static PersistentStorage *getInstance()
@@ -63,76 +277,250 @@ public:
     return instance;
   }
 
+  // Commit pending changes once EEPROM_COMMIT_PERIOD has passed since the last commit
+  void update()
+  {
+    MutexLock lock(&mutex);
+
+    if (dirty && millis() - lastCommitTime >= EEPROM_COMMIT_PERIOD)
+    {
+      commit();
+    }
+  }
+
+  // Commit pending changes immediately, call before restarting or powering down
+  void flush()
+  {
+    MutexLock lock(&mutex);
+
+    commit();
+  }
+
+  bool isDirty()
+  {
+    return dirty;
+  }
+
+  unsigned long getCommitCount()
+  {
+    return commitCount;
+  }
+
   // Current Thermostat Mode
   void setCurrentThermostatMode(uint8_t mode)
   {
-    EEPROM.write(EEPROM_CURRENT_MODE, mode);
-    EEPROM.commit();
+    MutexLock lock(&mutex);
+
+    if (mode == currentMode)
+    {
+      return;
+    }
+
+    currentMode = mode;
+    writeByte(STORAGE_KEY_CURRENT_MODE, mode);
+    dirty = true;
   }
 
   uint8_t getCurrentThermostatMode()
   {
-    return EEPROM.read(EEPROM_CURRENT_MODE);
+    MutexLock lock(&mutex);
+
+    return currentMode;
   }
 
   // Current Thermostat State
-  void setCurrentThermostatState(uint8_t state)
+  void setCurrentThermostatState(uint8_t state, uint8_t zone = 0)
   {
-    EEPROM.write(EEPROM_CURRENT_STATE, state);
-    EEPROM.commit();
+    MutexLock lock(&mutex);
+
+    if (state == currentState[zone])
+    {
+      return;
+    }
+
+    currentState[zone] = state;
+    if (zone == 0)
+    {
+      writeByte(STORAGE_KEY_CURRENT_STATE, state);
+    }
+    else
+    {
+      writeZoneRecord(zone);
+    }
+    dirty = true;
   }
 
-  uint8_t getCurrentThermostatState()
+  uint8_t getCurrentThermostatState(uint8_t zone = 0)
   {
-    return EEPROM.read(EEPROM_CURRENT_STATE);
+    MutexLock lock(&mutex);
+
+    return currentState[zone];
   }
 
   // Current Heat Setpoint
-  void setSetpointLow(double setpoint)
+  void setSetpointLow(Temperature setpoint, uint8_t zone = 0)
   {
-    EEPROM_writeDouble(EEPROM_CURRENT_SETPOINT_LOW, setpoint);
-    EEPROM.commit();
+    MutexLock lock(&mutex);
+
+    if (setpoint == setpointLow[zone])
+    {
+      return;
+    }
+
+    setpointLow[zone] = setpoint;
+    writeSetpoints(zone, true);
+    dirty = true;
   }
 
-  double getSetpointLow()
+  Temperature getSetpointLow(uint8_t zone = 0)
   {
-    return EEPROM_readDouble(EEPROM_CURRENT_SETPOINT_LOW);
+    MutexLock lock(&mutex);
+
+    return setpointLow[zone];
   }
 
   // Current Cool Setpoint
-  void setSetpointHigh(double setpoint)
+  void setSetpointHigh(Temperature setpoint, uint8_t zone = 0)
   {
-    EEPROM_writeDouble(EEPROM_CURRENT_SETPOINT_HIGH, setpoint);
-    EEPROM.commit();
+    MutexLock lock(&mutex);
+
+    if (setpoint == setpointHigh[zone])
+    {
+      return;
+    }
+
+    setpointHigh[zone] = setpoint;
+    writeSetpoints(zone, false);
+    dirty = true;
   }
 
-  double getSetpointHigh()
+  Temperature getSetpointHigh(uint8_t zone = 0)
   {
-    return EEPROM_readDouble(EEPROM_CURRENT_SETPOINT_HIGH);
+    MutexLock lock(&mutex);
+
+    return setpointHigh[zone];
   }
 
   // Setting Screen Unit
   void setSettingScreenImperial(bool imperial)
   {
-    EEPROM.write(EEPROM_SETTING_SCREEN_UNIT, imperial);
-    EEPROM.commit();
+    MutexLock lock(&mutex);
+
+    if (imperial == screenImperial)
+    {
+      return;
+    }
+
+    screenImperial = imperial;
+    writeByte(STORAGE_KEY_SETTING_SCREEN_UNIT, imperial);
+    dirty = true;
   }
 
   bool getSettingScreenImperial()
   {
-    return (bool)EEPROM.read(EEPROM_SETTING_SCREEN_UNIT);
+    MutexLock lock(&mutex);
+
+    return screenImperial;
   }
 
   // Setting use remote temperature
   void setSettingUseRemoteTemperature(bool remote)
   {
-    EEPROM.write(EEPROM_SETTING_REMOTE_TEMPERATURE, remote);
-    EEPROM.commit();
+    MutexLock lock(&mutex);
+
+    if (remote == useRemoteTemperature)
+    {
+      return;
+    }
+
+    useRemoteTemperature = remote;
+    writeByte(STORAGE_KEY_SETTING_REMOTE_TEMPERATURE, remote);
+    dirty = true;
   }
 
   bool getSettingUseRemoteTemperature()
   {
-    return (bool)EEPROM.read(EEPROM_SETTING_REMOTE_TEMPERATURE);
+    MutexLock lock(&mutex);
+
+    return useRemoteTemperature;
+  }
+
+  // Setting control strategy
+  void setSettingControlStrategy(uint8_t strategy)
+  {
+    MutexLock lock(&mutex);
+
+    if (strategy == controlStrategy)
+    {
+      return;
+    }
+
+    controlStrategy = strategy;
+    writeByte(STORAGE_KEY_SETTING_CONTROL_STRATEGY, strategy);
+    dirty = true;
+  }
+
+  uint8_t getSettingControlStrategy()
+  {
+    MutexLock lock(&mutex);
+
+    return controlStrategy;
+  }
+
+  // Weekly schedule, not mirrored in RAM as the thermostat keeps the live table.
+  // Setpoints are stored to a tenth of a degree. Returns false and keeps the stored schedule
+  // if the table does not fit the settings log.
+  bool setSchedule(const ScheduleTable &table)
+  {
+    MutexLock lock(&mutex);
+
+    uint8_t data[SCHEDULE_MAX_TRANSITIONS * STORAGE_SCHEDULE_TRANSITION_SIZE];
+    uint8_t *d = data;
+    for (uint8_t i = 0; i < table.count; i++)
+    {
+      const ScheduleTransition &transition = table.transitions[i];
+      *d++ = transition.minute & 0xFF;
+      *d++ = transition.minute >> 8;
+      *d++ = transition.zone;
+      *d++ = encodeScheduleSetpoint(transition.setpointLow);
+      *d++ = encodeScheduleSetpoint(transition.setpointHigh);
+    }
+
+    if (!settingsLog->write(STORAGE_KEY_SCHEDULE, data, d - data))
+    {
+      return false;
+    }
+
+    dirty = true;
+    return true;
+  }
+
+  // Empty when no schedule has been stored or the stored one does not fit this build
+  void getSchedule(ScheduleTable *table)
+  {
+    MutexLock lock(&mutex);
+
+    table->count = 0;
+
+    uint8_t length = settingsLog->length(STORAGE_KEY_SCHEDULE);
+    uint8_t data[SCHEDULE_MAX_TRANSITIONS * STORAGE_SCHEDULE_TRANSITION_SIZE];
+    if (length == 0 || length > sizeof(data) || length % STORAGE_SCHEDULE_TRANSITION_SIZE != 0 ||
+        !settingsLog->read(STORAGE_KEY_SCHEDULE, data, length))
+    {
+      return;
+    }
+
+    const uint8_t *d = data;
+    for (uint8_t i = 0; i < length / STORAGE_SCHEDULE_TRANSITION_SIZE; i++)
+    {
+      ScheduleTransition &transition = table->transitions[i];
+      transition.minute = d[0] | (d[1] << 8);
+      transition.zone = d[2];
+      transition.setpointLow = decodeScheduleSetpoint(d[3]);
+      transition.setpointHigh = decodeScheduleSetpoint(d[4]);
+      d += STORAGE_SCHEDULE_TRANSITION_SIZE;
+    }
+    table->count = length / STORAGE_SCHEDULE_TRANSITION_SIZE;
   }
 };
 
@@ -0,0 +1,79 @@
+#ifndef PID_CONTROLLER_H
+#define PID_CONTROLLER_H
+
+// PID controller producing a duty cycle between 0 and 1 from a temperature error.
+// The integral is clamped so it never winds up past full output, and the derivative
+// acts on the measurement so setpoint changes do not kick the output.
+class PidController
+{
+private:
+  // Duty per degree, per degree second and per degree per second
+  float kp;
+  float ki;
+  float kd;
+
+  float integral;
+  float lastMeasurement;
+  bool hasLastMeasurement;
+
+  static float clamp(float value, float low, float high)
+  {
+    return value < low ? low : (value > high ? high : value);
+  }
+
+public:
+  // No output until setGains is called
+  PidController()
+  {
+    setGains(0, 0, 0);
+    reset();
+  }
+
+  PidController(float kp, float ki, float kd)
+  {
+    setGains(kp, ki, kd);
+    reset();
+  }
+
+  void setGains(float kp, float ki, float kd)
+  {
+    this->kp = kp;
+    this->ki = ki;
+    this->kd = kd;
+  }
+
+  void reset()
+  {
+    integral = 0;
+    lastMeasurement = 0;
+    hasLastMeasurement = false;
+  }
+
+  // error is how far the measurement is on the side that needs output, dt is seconds since the last update.
+  // sign flips the measurement for the derivative, 1 when a rising measurement reduces the error.
+  float update(float error, float measurement, float dt, int8_t sign)
+  {
+    float derivative = 0;
+    if (hasLastMeasurement && dt > 0)
+    {
+      derivative = -sign * (measurement - lastMeasurement) / dt;
+    }
+    lastMeasurement = measurement;
+    hasLastMeasurement = true;
+
+    // Anti-windup: the integral term alone never exceeds the output range
+    if (ki > 0)
+    {
+      integral = clamp(integral + error * dt, 0, 1 / ki);
+    }
+
+    return clamp(kp * error + ki * integral + kd * derivative, 0, 1);
+  }
+
+  float getIntegral()
+  {
+    return integral;
+  }
+};
+
+#endif
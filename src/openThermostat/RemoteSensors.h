@@ -0,0 +1,367 @@
+#ifndef REMOTE_SENSORS_H
+#define REMOTE_SENSORS_H
+
+#include "SensorFusion.h"
+#include "Temperature.h"
+#include "ThermostatConfig.h"
+
+// ====== Remote Sensor Settings ======
+// Sources tracked across all zones, a new source is refused while every slot holds a live one.
+// At least one per zone, zones without the local sensor have nothing else to follow.
+#ifndef REMOTE_SENSOR_CAPACITY
+#define REMOTE_SENSOR_CAPACITY (THERMOSTAT_ZONE_COUNT > 8 ? THERMOSTAT_ZONE_COUNT : 8)
+#endif
+#define REMOTE_SENSOR_ID_SIZE 16
+
+// Sources that have not reported for this long are evicted
+#ifndef REMOTE_SENSOR_TIMEOUT
+#define REMOTE_SENSOR_TIMEOUT SENSOR_REMOTE_TIMEOUT
+#endif
+
+// Weight of a source in the mean
+#define REMOTE_SENSOR_DEFAULT_WEIGHT 1
+#define REMOTE_SENSOR_MAX_WEIGHT 100
+
+// Readings outside this range in Celsius are refused, the operating range of common room sensors
+#ifndef REMOTE_SENSOR_MINIMUM_TEMPERATURE
+#define REMOTE_SENSOR_MINIMUM_TEMPERATURE -40
+#endif
+#ifndef REMOTE_SENSOR_MAXIMUM_TEMPERATURE
+#define REMOTE_SENSOR_MAXIMUM_TEMPERATURE 85
+#endif
+
+// How a zone combines its sources until a request selects another aggregate
+#ifndef REMOTE_SENSOR_AGGREGATE
+#define REMOTE_SENSOR_AGGREGATE REMOTE_AGGREGATE_MEAN
+#endif
+
+#define REMOTE_SENSOR_NONE -1
+
+static_assert(REMOTE_SENSOR_CAPACITY <= 127, "REMOTE_SENSOR_CAPACITY must fit a source index");
+static_assert(REMOTE_SENSOR_CAPACITY >= THERMOSTAT_ZONE_COUNT, "REMOTE_SENSOR_CAPACITY must hold a source for every zone");
+
+enum RemoteAggregate
+{
+  // Mean weighted by each source's weight
+  REMOTE_AGGREGATE_MEAN,
+  REMOTE_AGGREGATE_MINIMUM,
+  REMOTE_AGGREGATE_MAXIMUM,
+  // Only the zone's designated source
+  REMOTE_AGGREGATE_DESIGNATED
+};
+
+// One submitted reading, alone or as part of a batch
+struct RemoteSensorReading
+{
+  char source[REMOTE_SENSOR_ID_SIZE];
+  uint8_t zone;
+  Temperature temperature;
+  uint8_t weight;
+};
+
+// Latest reading of every remote source and each zone's aggregate of them. The sums, minimum and maximum
+// are kept up to date as readings arrive, a zone's sources are only rescanned when its minimum or maximum
+// source moves inward or goes away. Not thread safe, owned by the web service.
+class RemoteSensorTable
+{
+private:
+  struct Source
+  {
+    char id[REMOTE_SENSOR_ID_SIZE];
+    uint8_t zone;
+    Temperature temperature;
+    uint8_t weight;
+    unsigned long time;
+    bool used;
+  };
+
+  struct Zone
+  {
+    RemoteAggregate aggregate;
+    char designated[REMOTE_SENSOR_ID_SIZE];
+    // Over the zone's sources, temperatures in hundredths of a degree
+    int32_t weightedSum;
+    int32_t weightSum;
+    // Source indices, REMOTE_SENSOR_NONE while there is none
+    int8_t minimum;
+    int8_t maximum;
+    int8_t designatedSource;
+    // Last change of the aggregate
+    unsigned long time;
+  };
+
+  Source sources[REMOTE_SENSOR_CAPACITY];
+  Zone zones[THERMOSTAT_ZONE_COUNT];
+
+  int8_t find(const char *id)
+  {
+    for (uint8_t i = 0; i < REMOTE_SENSOR_CAPACITY; i++)
+    {
+      if (sources[i].used && strcmp(sources[i].id, id) == 0)
+      {
+        return i;
+      }
+    }
+    return REMOTE_SENSOR_NONE;
+  }
+
+  int8_t findFree()
+  {
+    for (uint8_t i = 0; i < REMOTE_SENSOR_CAPACITY; i++)
+    {
+      if (!sources[i].used)
+      {
+        return i;
+      }
+    }
+    return REMOTE_SENSOR_NONE;
+  }
+
+  // Lowest or highest source of the zone
+  int8_t scan(uint8_t zone, bool lowest)
+  {
+    int8_t extreme = REMOTE_SENSOR_NONE;
+    for (uint8_t i = 0; i < REMOTE_SENSOR_CAPACITY; i++)
+    {
+      if (!sources[i].used || sources[i].zone != zone)
+      {
+        continue;
+      }
+      if (extreme == REMOTE_SENSOR_NONE ||
+          (lowest ? sources[i].temperature < sources[extreme].temperature : sources[i].temperature > sources[extreme].temperature))
+      {
+        extreme = i;
+      }
+    }
+    return extreme;
+  }
+
+  // Source index moved from previous to its current temperature, or joined the zone when they are equal
+  void track(uint8_t zone, int8_t index, Temperature previous)
+  {
+    Zone &aggregate = zones[zone];
+    Temperature temperature = sources[index].temperature;
+
+    if (aggregate.minimum == index)
+    {
+      if (temperature > previous)
+      {
+        aggregate.minimum = scan(zone, true);
+      }
+    }
+    else if (aggregate.minimum == REMOTE_SENSOR_NONE || temperature < sources[aggregate.minimum].temperature)
+    {
+      aggregate.minimum = index;
+    }
+
+    if (aggregate.maximum == index)
+    {
+      if (temperature < previous)
+      {
+        aggregate.maximum = scan(zone, false);
+      }
+    }
+    else if (aggregate.maximum == REMOTE_SENSOR_NONE || temperature > sources[aggregate.maximum].temperature)
+    {
+      aggregate.maximum = index;
+    }
+  }
+
+  void join(int8_t index)
+  {
+    Source &source = sources[index];
+    Zone &aggregate = zones[source.zone];
+
+    aggregate.weightedSum += (int32_t)source.temperature.centiCelsius() * source.weight;
+    aggregate.weightSum += source.weight;
+    if (strcmp(source.id, aggregate.designated) == 0)
+    {
+      aggregate.designatedSource = index;
+    }
+    track(source.zone, index, source.temperature);
+  }
+
+  void leave(int8_t index)
+  {
+    Source &source = sources[index];
+    Zone &aggregate = zones[source.zone];
+
+    source.used = false;
+    aggregate.weightedSum -= (int32_t)source.temperature.centiCelsius() * source.weight;
+    aggregate.weightSum -= source.weight;
+    if (aggregate.designatedSource == index)
+    {
+      aggregate.designatedSource = REMOTE_SENSOR_NONE;
+    }
+    if (aggregate.minimum == index)
+    {
+      aggregate.minimum = scan(source.zone, true);
+    }
+    if (aggregate.maximum == index)
+    {
+      aggregate.maximum = scan(source.zone, false);
+    }
+  }
+
+public:
+  RemoteSensorTable()
+  {
+    for (uint8_t i = 0; i < REMOTE_SENSOR_CAPACITY; i++)
+    {
+      sources[i].used = false;
+    }
+    for (uint8_t zone = 0; zone < THERMOSTAT_ZONE_COUNT; zone++)
+    {
+      zones[zone].aggregate = REMOTE_SENSOR_AGGREGATE;
+      zones[zone].designated[0] = '\0';
+      zones[zone].weightedSum = 0;
+      zones[zone].weightSum = 0;
+      zones[zone].minimum = REMOTE_SENSOR_NONE;
+      zones[zone].maximum = REMOTE_SENSOR_NONE;
+      zones[zone].designatedSource = REMOTE_SENSOR_NONE;
+      zones[zone].time = 0;
+    }
+  }
+
+  // Whether a reading could come from a working sensor, one that could not would move the zone's aggregate
+  static bool isPlausible(Temperature temperature)
+  {
+    return temperature >= Temperature::fromCelsius(REMOTE_SENSOR_MINIMUM_TEMPERATURE) &&
+           temperature <= Temperature::fromCelsius(REMOTE_SENSOR_MAXIMUM_TEMPERATURE);
+  }
+
+  // Record a reading, false if the source is new and no slot is free even after evicting stale sources
+  bool update(const RemoteSensorReading &reading, unsigned long now)
+  {
+    int8_t index = find(reading.source);
+    if (index == REMOTE_SENSOR_NONE)
+    {
+      index = findFree();
+      if (index == REMOTE_SENSOR_NONE && evict(now))
+      {
+        index = findFree();
+      }
+      if (index == REMOTE_SENSOR_NONE)
+      {
+        return false;
+      }
+
+      Source &source = sources[index];
+      strcpy(source.id, reading.source);
+      source.used = true;
+      source.zone = reading.zone;
+      source.temperature = reading.temperature;
+      source.weight = reading.weight;
+      join(index);
+    }
+    else if (sources[index].zone != reading.zone)
+    {
+      leave(index);
+      zones[sources[index].zone].time = now;
+
+      Source &source = sources[index];
+      source.used = true;
+      source.zone = reading.zone;
+      source.temperature = reading.temperature;
+      source.weight = reading.weight;
+      join(index);
+    }
+    else
+    {
+      Source &source = sources[index];
+      Zone &aggregate = zones[source.zone];
+      Temperature previous = source.temperature;
+
+      aggregate.weightedSum += (int32_t)reading.temperature.centiCelsius() * reading.weight - (int32_t)previous.centiCelsius() * source.weight;
+      aggregate.weightSum += reading.weight - source.weight;
+      source.temperature = reading.temperature;
+      source.weight = reading.weight;
+      track(source.zone, index, previous);
+    }
+
+    sources[index].time = now;
+    zones[reading.zone].time = now;
+    return true;
+  }
+
+  // Drop sources that have not reported within REMOTE_SENSOR_TIMEOUT, true if any was dropped
+  bool evict(unsigned long now)
+  {
+    bool evicted = false;
+    for (uint8_t i = 0; i < REMOTE_SENSOR_CAPACITY; i++)
+    {
+      if (sources[i].used && now - sources[i].time >= REMOTE_SENSOR_TIMEOUT)
+      {
+        leave(i);
+        zones[sources[i].zone].time = now;
+        evicted = true;
+      }
+    }
+    return evicted;
+  }
+
+  // Select how the zone combines its sources, designated names the source REMOTE_AGGREGATE_DESIGNATED follows
+  void setAggregate(uint8_t zone, RemoteAggregate aggregate, const char *designated, unsigned long now)
+  {
+    Zone &target = zones[zone];
+    target.aggregate = aggregate;
+    strncpy(target.designated, designated, sizeof(target.designated) - 1);
+    target.designated[sizeof(target.designated) - 1] = '\0';
+
+    int8_t index = find(target.designated);
+    target.designatedSource = index != REMOTE_SENSOR_NONE && sources[index].zone == zone ? index : REMOTE_SENSOR_NONE;
+    target.time = now;
+  }
+
+  // Zone a source reports for, REMOTE_SENSOR_NONE if it is not tracked
+  int8_t getZone(const char *id)
+  {
+    int8_t index = find(id);
+    return index == REMOTE_SENSOR_NONE ? REMOTE_SENSOR_NONE : sources[index].zone;
+  }
+
+  RemoteAggregate getAggregate(uint8_t zone)
+  {
+    return zones[zone].aggregate;
+  }
+
+  // Aggregate of the zone's sources and when it last changed, invalid while no source contributes
+  SensorReading read(uint8_t zone)
+  {
+    const Zone &aggregate = zones[zone];
+    SensorReading reading = {Temperature(), aggregate.time};
+
+    switch (aggregate.aggregate)
+    {
+    case REMOTE_AGGREGATE_MEAN:
+      if (aggregate.weightSum > 0)
+      {
+        // Rounded half away from zero like every other temperature conversion
+        int32_t half = (aggregate.weightedSum < 0 ? -aggregate.weightSum : aggregate.weightSum) / 2;
+        reading.temperature = Temperature::fromCentiCelsius((aggregate.weightedSum + half) / aggregate.weightSum);
+      }
+      break;
+    case REMOTE_AGGREGATE_MINIMUM:
+      if (aggregate.minimum != REMOTE_SENSOR_NONE)
+      {
+        reading.temperature = sources[aggregate.minimum].temperature;
+      }
+      break;
+    case REMOTE_AGGREGATE_MAXIMUM:
+      if (aggregate.maximum != REMOTE_SENSOR_NONE)
+      {
+        reading.temperature = sources[aggregate.maximum].temperature;
+      }
+      break;
+    case REMOTE_AGGREGATE_DESIGNATED:
+      if (aggregate.designatedSource != REMOTE_SENSOR_NONE)
+      {
+        reading.temperature = sources[aggregate.designatedSource].temperature;
+      }
+      break;
+    }
+    return reading;
+  }
+};
+
+#endif
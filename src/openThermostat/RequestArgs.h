@@ -0,0 +1,258 @@
+#ifndef REQUEST_ARGS_H
+#define REQUEST_ARGS_H
+
+// ====== Request Argument Settings ======
+// Arguments kept per request, further arguments are ignored
+#define REQUEST_ARGS_CAPACITY 8
+// Hash table slots, power of two and larger than the capacity so lookups stay short
+#define REQUEST_ARGS_SLOTS 16
+#define REQUEST_ARG_NAME_SIZE 24
+#define REQUEST_ARG_VALUE_SIZE 32
+
+#define REQUEST_ARGS_HASH_BASIS 2166136261u
+#define REQUEST_ARGS_HASH_PRIME 16777619u
+
+// Case insensitive FNV-1a hash, usable at compile time for argument names
+constexpr char requestArgLower(char c)
+{
+  return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+constexpr uint32_t requestArgHash(const char *name, uint32_t hash = REQUEST_ARGS_HASH_BASIS)
+{
+  return *name == '\0' ? hash : requestArgHash(name + 1, (hash ^ (uint8_t)requestArgLower(*name)) * REQUEST_ARGS_HASH_PRIME);
+}
+
+enum ArgStatus
+{
+  ARG_OK,
+  ARG_MISSING,
+  ARG_INVALID
+};
+
+// Name to value table for enum arguments
+template <typename T>
+struct ArgEnumValue
+{
+  const char *name;
+  T value;
+};
+
+// Query and form arguments of one request, tokenized once into a fixed table with case insensitive names
+class RequestArgs
+{
+private:
+  struct Arg
+  {
+    uint32_t hash;
+    char name[REQUEST_ARG_NAME_SIZE];
+    char value[REQUEST_ARG_VALUE_SIZE];
+    bool used;
+    bool truncated;
+  };
+
+  Arg slots[REQUEST_ARGS_SLOTS];
+  uint8_t count;
+
+  static bool equalsIgnoreCase(const char *a, const char *b)
+  {
+    while (*a != '\0' && requestArgLower(*a) == requestArgLower(*b))
+    {
+      a++;
+      b++;
+    }
+    return requestArgLower(*a) == requestArgLower(*b);
+  }
+
+  static bool copy(char *destination, const char *source, size_t size)
+  {
+    size_t length = strlen(source);
+    bool truncated = length >= size;
+    if (truncated)
+    {
+      length = size - 1;
+    }
+
+    memcpy(destination, source, length);
+    destination[length] = '\0';
+    return !truncated;
+  }
+
+  Arg *find(const char *name)
+  {
+    uint32_t hash = requestArgHash(name);
+    for (uint8_t i = 0; i < REQUEST_ARGS_SLOTS; i++)
+    {
+      Arg *arg = &slots[(hash + i) & (REQUEST_ARGS_SLOTS - 1)];
+      if (!arg->used)
+      {
+        return NULL;
+      }
+      if (arg->hash == hash && equalsIgnoreCase(arg->name, name))
+      {
+        return arg;
+      }
+    }
+    return NULL;
+  }
+
+public:
+  RequestArgs()
+  {
+    clear();
+  }
+
+  void clear()
+  {
+    for (uint8_t i = 0; i < REQUEST_ARGS_SLOTS; i++)
+    {
+      slots[i].used = false;
+    }
+    count = 0;
+  }
+
+  // Add an argument, the first occurrence of a name wins
+  bool add(const char *name, const char *value)
+  {
+    if (count >= REQUEST_ARGS_CAPACITY || find(name) != NULL)
+    {
+      return false;
+    }
+
+    uint32_t hash = requestArgHash(name);
+    uint8_t slot = hash & (REQUEST_ARGS_SLOTS - 1);
+    while (slots[slot].used)
+    {
+      slot = (slot + 1) & (REQUEST_ARGS_SLOTS - 1);
+    }
+
+    Arg *arg = &slots[slot];
+    arg->used = true;
+    arg->hash = hash;
+    arg->truncated = !copy(arg->name, name, sizeof(arg->name));
+    arg->truncated |= !copy(arg->value, value, sizeof(arg->value));
+    count++;
+    return true;
+  }
+
+  uint8_t size()
+  {
+    return count;
+  }
+
+  bool has(const char *name)
+  {
+    return find(name) != NULL;
+  }
+
+  // Raw value, NULL if the argument is missing
+  const char *get(const char *name)
+  {
+    Arg *arg = find(name);
+    return arg == NULL ? NULL : arg->value;
+  }
+
+  // ====== Typed Accessors ======
+  // Finite number, the whole value must parse
+  ArgStatus getDouble(const char *name, double *value)
+  {
+    Arg *arg = find(name);
+    if (arg == NULL)
+    {
+      return ARG_MISSING;
+    }
+    if (arg->truncated || arg->value[0] == '\0')
+    {
+      return ARG_INVALID;
+    }
+
+    char *end;
+    double parsed = strtod(arg->value, &end);
+    if (*end != '\0' || isnan(parsed) || isinf(parsed))
+    {
+      return ARG_INVALID;
+    }
+
+    *value = parsed;
+    return ARG_OK;
+  }
+
+  // Decimal integer between minimum and maximum inclusive, the whole value must parse
+  ArgStatus getLong(const char *name, long minimum, long maximum, long *value)
+  {
+    Arg *arg = find(name);
+    if (arg == NULL)
+    {
+      return ARG_MISSING;
+    }
+    if (arg->truncated || arg->value[0] == '\0')
+    {
+      return ARG_INVALID;
+    }
+
+    // strtol saturates on overflow, which the range check rejects
+    char *end;
+    long parsed = strtol(arg->value, &end, 10);
+    if (*end != '\0' || parsed < minimum || parsed > maximum)
+    {
+      return ARG_INVALID;
+    }
+
+    *value = parsed;
+    return ARG_OK;
+  }
+
+  // true/false or 1/0, case insensitive
+  ArgStatus getBool(const char *name, bool *value)
+  {
+    Arg *arg = find(name);
+    if (arg == NULL)
+    {
+      return ARG_MISSING;
+    }
+
+    if (equalsIgnoreCase(arg->value, "true") || strcmp(arg->value, "1") == 0)
+    {
+      *value = true;
+      return ARG_OK;
+    }
+    if (equalsIgnoreCase(arg->value, "false") || strcmp(arg->value, "0") == 0)
+    {
+      *value = false;
+      return ARG_OK;
+    }
+
+    return ARG_INVALID;
+  }
+
+  // One of the names in table, case insensitive
+  template <typename T, size_t N>
+  ArgStatus getEnum(const char *name, const ArgEnumValue<T> (&table)[N], T *value)
+  {
+    Arg *arg = find(name);
+    if (arg == NULL)
+    {
+      return ARG_MISSING;
+    }
+
+    for (size_t i = 0; i < N; i++)
+    {
+      if (equalsIgnoreCase(arg->value, table[i].name))
+      {
+        *value = table[i].value;
+        return ARG_OK;
+      }
+    }
+
+    return ARG_INVALID;
+  }
+
+  // units=imperial selects Fahrenheit, anything else Celsius
+  bool useImperialUnits()
+  {
+    const char *units = get("units");
+    return units != NULL && equalsIgnoreCase(units, "imperial");
+  }
+};
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef SAMPLE_BUFFER_H
+#define SAMPLE_BUFFER_H
+
+#include <atomic>
+
+// Fixed size, lock free ring buffer with one writer and any number of readers.
+// The writer never blocks and overwrites the oldest entries, readers either take the latest
+// entry or walk the buffer with their own cursor. Reads that race with the writer overwriting
+// the same slot are detected and retried or skipped.
+template <typename T, uint8_t SIZE>
+class SampleBuffer
+{
+private:
+  T entries[SIZE];
+
+  // Total number of entries ever pushed, the next entry is written to head % SIZE
+  std::atomic<uint32_t> head;
+
+  // True if the entry with sequence number sequence could have been overwritten while it was copied
+  bool overwritten(uint32_t sequence)
+  {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return head.load(std::memory_order_relaxed) - sequence >= SIZE;
+  }
+
+public:
+  SampleBuffer()
+  {
+    head.store(0);
+  }
+
+  // Only called from the single writer
+  void push(const T &entry)
+  {
+    uint32_t sequence = head.load(std::memory_order_relaxed);
+    entries[sequence % SIZE] = entry;
+    head.store(sequence + 1, std::memory_order_release);
+  }
+
+  // Copy the most recent entry, returns false if nothing has been pushed yet
+  bool latest(T *entry)
+  {
+    for (;;)
+    {
+      uint32_t count = head.load(std::memory_order_acquire);
+      if (count == 0)
+      {
+        return false;
+      }
+
+      *entry = entries[(count - 1) % SIZE];
+      if (!overwritten(count - 1))
+      {
+        return true;
+      }
+    }
+  }
+
+  // Copy the next entry after cursor and advance it, returns false if the reader is up to date.
+  // Readers that fell SIZE or more entries behind skip ahead to the oldest entry the writer can not be overwriting.
+  bool read(uint32_t *cursor, T *entry)
+  {
+    for (;;)
+    {
+      uint32_t count = head.load(std::memory_order_acquire);
+      if (*cursor == count)
+      {
+        return false;
+      }
+
+      if (count - *cursor >= SIZE)
+      {
+        *cursor = count - SIZE + 1;
+      }
+
+      *entry = entries[*cursor % SIZE];
+      if (!overwritten(*cursor))
+      {
+        (*cursor)++;
+        return true;
+      }
+    }
+  }
+
+  uint32_t getCount()
+  {
+    return head.load(std::memory_order_acquire);
+  }
+};
+
+#endif
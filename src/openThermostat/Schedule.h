@@ -0,0 +1,117 @@
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <time.h>
+
+#include "Temperature.h"
+
+// ====== Schedule Settings ======
+// Transitions in the weekly schedule, every one costs 5 bytes in the settings log
+#ifndef SCHEDULE_MAX_TRANSITIONS
+#define SCHEDULE_MAX_TRANSITIONS 20
+#endif
+
+#define SCHEDULE_MINUTES_PER_DAY 1440
+#define SCHEDULE_MINUTES_PER_WEEK 10080
+
+// Minute of the week while the wall clock is not set
+#define SCHEDULE_NO_TIME -1
+
+// Local time before this year is a clock SNTP has not set yet
+#define SCHEDULE_MINIMUM_VALID_YEAR 2020
+
+// A wall clock step longer than this (or backwards) re-applies the active transitions
+// instead of firing every transition in between
+#define SCHEDULE_MAX_STEP 15
+
+// Setpoints taking effect at a minute of the week, counted from Sunday 00:00 local time
+struct ScheduleTransition
+{
+  uint16_t minute;
+  uint8_t zone;
+  Temperature setpointLow;
+  Temperature setpointHigh;
+};
+
+// Weekly schedule kept sorted by minute so the next transition is found without scanning
+struct ScheduleTable
+{
+  uint8_t count;
+  ScheduleTransition transitions[SCHEDULE_MAX_TRANSITIONS];
+
+  ScheduleTable()
+  {
+    count = 0;
+  }
+
+  // Stable insertion sort by minute, transitions arrive mostly in order
+  void sort()
+  {
+    for (uint8_t i = 1; i < count; i++)
+    {
+      ScheduleTransition transition = transitions[i];
+      uint8_t j = i;
+      while (j > 0 && transitions[j - 1].minute > transition.minute)
+      {
+        transitions[j] = transitions[j - 1];
+        j--;
+      }
+      transitions[j] = transition;
+    }
+  }
+
+  // Index of the first transition after minute, count if there is none (binary search)
+  uint8_t upperBound(uint16_t minute) const
+  {
+    uint8_t low = 0;
+    uint8_t high = count;
+    while (low < high)
+    {
+      uint8_t middle = (low + high) / 2;
+      if (transitions[middle].minute <= minute)
+      {
+        low = middle + 1;
+      }
+      else
+      {
+        high = middle;
+      }
+    }
+    return low;
+  }
+
+  // Latest transition of zone before index next, wrapping to last week. NULL if the zone has none.
+  const ScheduleTransition *activeBefore(uint8_t next, uint8_t zone) const
+  {
+    for (uint8_t i = 1; i <= count; i++)
+    {
+      const ScheduleTransition *transition = &transitions[(next + count - i) % count];
+      if (transition->zone == zone)
+      {
+        return transition;
+      }
+    }
+    return NULL;
+  }
+
+  // Minutes from one minute of the week to a later one, wrapping at the end of the week
+  static int16_t minutesBetween(int16_t from, int16_t to)
+  {
+    return (to - from + SCHEDULE_MINUTES_PER_WEEK) % SCHEDULE_MINUTES_PER_WEEK;
+  }
+};
+
+// Minute of the week from the system clock set by SNTP, SCHEDULE_NO_TIME until it has been set
+static int16_t scheduleWallClock()
+{
+  time_t now = time(NULL);
+  struct tm local;
+  if (localtime_r(&now, &local) == NULL || local.tm_year + 1900 < SCHEDULE_MINIMUM_VALID_YEAR)
+  {
+    return SCHEDULE_NO_TIME;
+  }
+
+  return local.tm_wday * SCHEDULE_MINUTES_PER_DAY + local.tm_hour * 60 + local.tm_min;
+}
+
+#endif
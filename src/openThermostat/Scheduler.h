@@ -0,0 +1,174 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "Metrics.h"
+
+// ====== Scheduler Settings ======
+#ifndef SCHEDULER_MAX_TASKS
+#define SCHEDULER_MAX_TASKS 8
+#endif
+
+class Scheduler
+{
+public:
+  struct Task
+  {
+    const char *name;
+    void (*callback)();
+
+    // Time between runs in milliseconds
+    unsigned long period;
+    // Time a task may start late before it counts as a missed deadline, 0 to disable
+    unsigned long deadline;
+
+    unsigned long nextRunTime;
+
+    // ====== Runtime Statistics ======
+    unsigned long runCount;
+    unsigned long missedDeadlines;
+    // Runtime in microseconds
+    unsigned long lastRuntime;
+    unsigned long maxRuntime;
+    unsigned long long totalRuntime;
+#if METRICS_ENABLED
+    CycleHistogram cycles;
+#endif
+  };
+
+private:
+  Task tasks[SCHEDULER_MAX_TASKS];
+  uint8_t taskCount;
+
+  // Time sources, replaceable with a virtual clock
+  unsigned long (*clockMillis)();
+  unsigned long (*clockMicros)();
+  uint32_t (*clockCycles)();
+
+  // Overflow safe check of whether time a is at or after time b
+  static bool reached(unsigned long a, unsigned long b)
+  {
+    return (long)(a - b) >= 0;
+  }
+
+public:
+  Scheduler(unsigned long (*clockMillis)() = millis, unsigned long (*clockMicros)() = micros, uint32_t (*clockCycles)() = metricsCycleCount)
+  {
+    this->clockMillis = clockMillis;
+    this->clockMicros = clockMicros;
+    this->clockCycles = clockCycles;
+
+    taskCount = 0;
+  }
+
+  // Register a task, returns its id or -1 if the task table is full
+  int8_t addTask(const char *name, void (*callback)(), unsigned long period, unsigned long deadline = 0)
+  {
+    if (taskCount >= SCHEDULER_MAX_TASKS)
+    {
+      return -1;
+    }
+
+    Task *task = &tasks[taskCount];
+    task->name = name;
+    task->callback = callback;
+    task->period = period;
+    task->deadline = deadline;
+    task->nextRunTime = clockMillis();
+
+    task->runCount = 0;
+    task->missedDeadlines = 0;
+    task->lastRuntime = 0;
+    task->maxRuntime = 0;
+    task->totalRuntime = 0;
+#if METRICS_ENABLED
+    task->cycles.reset();
+#endif
+
+    return taskCount++;
+  }
+
+  // Run every task that is due, in registration order
+  void run()
+  {
+    for (uint8_t i = 0; i < taskCount; i++)
+    {
+      Task *task = &tasks[i];
+
+      unsigned long now = clockMillis();
+      if (!reached(now, task->nextRunTime))
+      {
+        continue;
+      }
+
+      if (task->deadline > 0 && now - task->nextRunTime > task->deadline)
+      {
+        task->missedDeadlines++;
+      }
+
+      // Keep a fixed cadence, unless the task fell more than a period behind
+      task->nextRunTime += task->period;
+      if (reached(now, task->nextRunTime))
+      {
+        task->nextRunTime = now + task->period;
+      }
+
+#if METRICS_ENABLED
+      uint32_t startCycles = clockCycles();
+#endif
+      unsigned long startTime = clockMicros();
+      (*task->callback)();
+      unsigned long runtime = clockMicros() - startTime;
+#if METRICS_ENABLED
+      task->cycles.add(clockCycles() - startCycles);
+#endif
+
+      task->runCount++;
+      task->lastRuntime = runtime;
+      task->totalRuntime += runtime;
+      if (runtime > task->maxRuntime)
+      {
+        task->maxRuntime = runtime;
+      }
+    }
+  }
+
+  // Milliseconds until the next task is due, 0 if a task is already due
+  unsigned long getTimeUntilNextTask()
+  {
+    unsigned long now = clockMillis();
+    unsigned long wait = (unsigned long)-1;
+
+    for (uint8_t i = 0; i < taskCount; i++)
+    {
+      if (reached(now, tasks[i].nextRunTime))
+      {
+        return 0;
+      }
+
+      unsigned long remaining = tasks[i].nextRunTime - now;
+      if (remaining < wait)
+      {
+        wait = remaining;
+      }
+    }
+
+    return taskCount > 0 ? wait : 0;
+  }
+
+  uint8_t getTaskCount()
+  {
+    return taskCount;
+  }
+
+  const Task *getTask(uint8_t id)
+  {
+    if (id >= taskCount)
+    {
+      return 0;
+    }
+
+    return &tasks[id];
+  }
+};
+
+#endif
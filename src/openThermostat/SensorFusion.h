@@ -0,0 +1,305 @@
+#ifndef SENSOR_FUSION_H
+#define SENSOR_FUSION_H
+
+#include "Temperature.h"
+#include "ThermostatConfig.h"
+
+// ====== Sensor Fusion Settings ======
+// Readings older than this are stale and no longer used
+#ifndef SENSOR_LOCAL_TIMEOUT
+#define SENSOR_LOCAL_TIMEOUT 10000
+#endif
+#ifndef SENSOR_REMOTE_TIMEOUT
+#define SENSOR_REMOTE_TIMEOUT 300000
+#endif
+
+// Filter applied to every source, one of the filter types below
+#ifndef SENSOR_FILTER
+#define SENSOR_FILTER EmaFilter
+#endif
+
+// Time constant of the EMA filter in seconds
+#ifndef SENSOR_EMA_TIME_CONSTANT
+#define SENSOR_EMA_TIME_CONSTANT 10
+#endif
+
+// Window of the median filter in samples, odd
+#ifndef SENSOR_MEDIAN_WINDOW
+#define SENSOR_MEDIAN_WINDOW 5
+#endif
+
+// Kalman filter noise, variance growth of the true temperature per second and variance of a reading (degrees squared)
+#ifndef SENSOR_KALMAN_PROCESS_NOISE
+#define SENSOR_KALMAN_PROCESS_NOISE 0.0001
+#endif
+#ifndef SENSOR_KALMAN_MEASUREMENT_NOISE
+#define SENSOR_KALMAN_MEASUREMENT_NOISE 0.01
+#endif
+
+// Confidence of a fresh reading from the preferred source, it halves over the timeout
+// and is halved again when the other source stands in
+#define SENSOR_CONFIDENCE_FULL 100
+// Confidence moves in steps so a slowly ageing reading does not change the status every update
+#define SENSOR_CONFIDENCE_STEP 10
+
+static_assert(SENSOR_MEDIAN_WINDOW % 2 == 1, "SENSOR_MEDIAN_WINDOW must be odd");
+
+// ====== Filters ======
+// Every filter takes readings in degrees Celsius with the seconds since the previous reading,
+// keeps its state in place and never allocates.
+
+// Passes readings through unchanged
+class NoFilter
+{
+public:
+  void reset()
+  {
+  }
+
+  float update(float value, float dt)
+  {
+    return value;
+  }
+};
+
+// Exponential moving average with a time constant, so irregular readings are weighed by their spacing
+class EmaFilter
+{
+private:
+  float average;
+  bool primed;
+
+public:
+  EmaFilter()
+  {
+    reset();
+  }
+
+  void reset()
+  {
+    average = 0;
+    primed = false;
+  }
+
+  float update(float value, float dt)
+  {
+    if (!primed)
+    {
+      primed = true;
+      average = value;
+      return average;
+    }
+
+    average += (value - average) * dt / (SENSOR_EMA_TIME_CONSTANT + dt);
+    return average;
+  }
+};
+
+// Median of the last SENSOR_MEDIAN_WINDOW readings, rejects single spikes without lag on steps
+class MedianFilter
+{
+private:
+  float window[SENSOR_MEDIAN_WINDOW];
+  uint8_t next;
+  uint8_t count;
+
+public:
+  MedianFilter()
+  {
+    reset();
+  }
+
+  void reset()
+  {
+    next = 0;
+    count = 0;
+  }
+
+  float update(float value, float dt)
+  {
+    window[next] = value;
+    next = (next + 1) % SENSOR_MEDIAN_WINDOW;
+    if (count < SENSOR_MEDIAN_WINDOW)
+    {
+      count++;
+    }
+
+    // Insertion sort of a copy, the window is a handful of values
+    float sorted[SENSOR_MEDIAN_WINDOW];
+    for (uint8_t i = 0; i < count; i++)
+    {
+      float v = window[i];
+      uint8_t j = i;
+      while (j > 0 && sorted[j - 1] > v)
+      {
+        sorted[j] = sorted[j - 1];
+        j--;
+      }
+      sorted[j] = v;
+    }
+
+    return sorted[count / 2];
+  }
+};
+
+// One dimensional Kalman filter for a slowly wandering temperature
+class KalmanFilter
+{
+private:
+  float estimate;
+  float variance;
+  bool primed;
+
+public:
+  KalmanFilter()
+  {
+    reset();
+  }
+
+  void reset()
+  {
+    estimate = 0;
+    variance = 0;
+    primed = false;
+  }
+
+  float update(float value, float dt)
+  {
+    if (!primed)
+    {
+      primed = true;
+      estimate = value;
+      variance = SENSOR_KALMAN_MEASUREMENT_NOISE;
+      return estimate;
+    }
+
+    variance += SENSOR_KALMAN_PROCESS_NOISE * dt;
+    float gain = variance / (variance + SENSOR_KALMAN_MEASUREMENT_NOISE);
+    estimate += gain * (value - estimate);
+    variance *= 1 - gain;
+    return estimate;
+  }
+};
+
+typedef SENSOR_FILTER SensorFilter;
+
+// Reading of one source and when it was taken
+struct SensorReading
+{
+  Temperature temperature;
+  unsigned long time;
+};
+
+// Temperature handed to the controller with how far it can be trusted, 0 to SENSOR_CONFIDENCE_FULL
+struct FusedTemperature
+{
+  Temperature temperature;
+  uint8_t confidence;
+};
+
+// Filters the local sensor and each zone's remote source, and picks the source every zone follows.
+// A zone uses its preferred source while it is fresh and falls back to the other one when it goes stale.
+class SensorFusion
+{
+private:
+  struct Source
+  {
+    SensorFilter filter;
+    Temperature filtered;
+    unsigned long time;
+    bool hasReading;
+  };
+
+  Source local;
+  Source remote[THERMOSTAT_ZONE_COUNT];
+
+  static void add(Source *source, const SensorReading &reading, unsigned long timeout)
+  {
+    // Same reading as last time, or none yet
+    if (!reading.temperature.isValid() || (source->hasReading && reading.time == source->time))
+    {
+      return;
+    }
+
+    // Start over after a gap, old state says nothing about the new reading
+    float dt = 0;
+    if (source->hasReading && reading.time - source->time < timeout)
+    {
+      dt = (reading.time - source->time) / 1000.0f;
+    }
+    else
+    {
+      source->filter.reset();
+    }
+
+    source->filtered = Temperature::fromCelsius(source->filter.update(reading.temperature.toCelsius(), dt));
+    source->time = reading.time;
+    source->hasReading = true;
+  }
+
+  // Confidence of a source, 0 when stale. A reading stamped after now, by the other core, is fresh.
+  static uint8_t confidence(const Source &source, unsigned long timeout, unsigned long now)
+  {
+    unsigned long age = (long)(now - source.time) < 0 ? 0 : now - source.time;
+    if (!source.hasReading || age >= timeout)
+    {
+      return 0;
+    }
+    uint8_t lost = (unsigned long long)age * (SENSOR_CONFIDENCE_FULL / 2) / timeout;
+    return SENSOR_CONFIDENCE_FULL - (lost + SENSOR_CONFIDENCE_STEP - 1) / SENSOR_CONFIDENCE_STEP * SENSOR_CONFIDENCE_STEP;
+  }
+
+public:
+  SensorFusion()
+  {
+    local.hasReading = false;
+    for (uint8_t zone = 0; zone < THERMOSTAT_ZONE_COUNT; zone++)
+    {
+      remote[zone].hasReading = false;
+    }
+  }
+
+  void addLocal(const SensorReading &reading)
+  {
+    add(&local, reading, SENSOR_LOCAL_TIMEOUT);
+  }
+
+  void addRemote(uint8_t zone, const SensorReading &reading)
+  {
+    add(&remote[zone], reading, SENSOR_REMOTE_TIMEOUT);
+  }
+
+  // Filtered temperature of the zone from its preferred source, or the other one when that is stale.
+  // Zones without the local sensor only have their remote source.
+  FusedTemperature read(uint8_t zone, bool localSensor, bool preferRemote, unsigned long now)
+  {
+    uint8_t localConfidence = localSensor ? confidence(local, SENSOR_LOCAL_TIMEOUT, now) : 0;
+    uint8_t remoteConfidence = confidence(remote[zone], SENSOR_REMOTE_TIMEOUT, now);
+
+    bool useRemote = preferRemote || !localSensor;
+    const Source &preferred = useRemote ? remote[zone] : local;
+    const Source &fallback = useRemote ? local : remote[zone];
+    uint8_t preferredConfidence = useRemote ? remoteConfidence : localConfidence;
+    uint8_t fallbackConfidence = useRemote ? localConfidence : remoteConfidence;
+
+    FusedTemperature fused;
+    if (preferredConfidence > 0)
+    {
+      fused.temperature = preferred.filtered;
+      fused.confidence = preferredConfidence;
+    }
+    else if (fallbackConfidence > 0)
+    {
+      fused.temperature = fallback.filtered;
+      fused.confidence = fallbackConfidence / 2;
+    }
+    else
+    {
+      fused.temperature = Temperature();
+      fused.confidence = 0;
+    }
+    return fused;
+  }
+};
+
+#endif
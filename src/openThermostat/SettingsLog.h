@@ -0,0 +1,340 @@
+#ifndef SETTINGS_LOG_H
+#define SETTINGS_LOG_H
+
+#include "EEPROM.h"
+
+// ====== Settings Log Layout ======
+// The EEPROM region is split into two banks. The active bank holds a header followed by
+// append-only records, when it fills up the latest value of every key is compacted into the
+// other bank which then becomes active. The previous bank stays valid until the new header
+// is written so an interrupted compaction falls back to the old data.
+//
+// Bank header: [magic low][magic high][generation][crc8]
+// Record:      [key][length][data ...][crc8 of key, length and data]
+// A key of SETTINGS_LOG_END_KEY marks the end of the records in a bank.
+//
+// On the ESP32 the EEPROM library is emulated in an NVS blob and every commit() rewrites the
+// whole buffer (measured by test/SettingsLogPowerCutTest.cpp), so appending does not reduce the
+// bytes written per commit there. The log makes every write safe to interrupt, wear is reduced by
+// PersistentStorage coalescing commits.
+
+#define SETTINGS_LOG_MAGIC 0x4F54
+#define SETTINGS_LOG_HEADER_SIZE 4
+#define SETTINGS_LOG_RECORD_OVERHEAD 3
+#define SETTINGS_LOG_END_KEY 0xFF
+
+// Highest key + 1 that can be stored, each key costs 2 bytes of RAM for the index
+#ifndef SETTINGS_LOG_MAX_KEYS
+#define SETTINGS_LOG_MAX_KEYS 64
+#endif
+
+class SettingsLog
+{
+private:
+  uint16_t regionSize;
+  uint16_t bankSize;
+
+  uint8_t activeBank;
+  uint8_t generation;
+
+  // Offset of the next record to be appended in the active bank
+  uint16_t writeOffset;
+
+  // Offset of the latest record for each key, 0 if the key has no record
+  uint16_t index[SETTINGS_LOG_MAX_KEYS];
+
+  static uint8_t crc8(uint8_t crc, uint8_t data)
+  {
+    crc ^= data;
+    for (uint8_t i = 0; i < 8; i++)
+    {
+      crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+    return crc;
+  }
+
+  uint16_t bankStart(uint8_t bank)
+  {
+    return bank * bankSize;
+  }
+
+  bool readHeader(uint8_t bank, uint8_t *headerGeneration)
+  {
+    uint16_t start = bankStart(bank);
+
+    uint8_t crc = 0;
+    for (uint8_t i = 0; i < SETTINGS_LOG_HEADER_SIZE - 1; i++)
+    {
+      crc = crc8(crc, EEPROM.read(start + i));
+    }
+
+    uint16_t magic = EEPROM.read(start) | (EEPROM.read(start + 1) << 8);
+    if (magic != SETTINGS_LOG_MAGIC || crc != EEPROM.read(start + SETTINGS_LOG_HEADER_SIZE - 1))
+    {
+      return false;
+    }
+
+    *headerGeneration = EEPROM.read(start + 2);
+    return true;
+  }
+
+  void writeHeader(uint8_t bank, uint8_t headerGeneration)
+  {
+    uint16_t start = bankStart(bank);
+    uint8_t header[SETTINGS_LOG_HEADER_SIZE - 1] = {SETTINGS_LOG_MAGIC & 0xFF, SETTINGS_LOG_MAGIC >> 8, headerGeneration};
+
+    uint8_t crc = 0;
+    for (uint8_t i = 0; i < SETTINGS_LOG_HEADER_SIZE - 1; i++)
+    {
+      EEPROM.write(start + i, header[i]);
+      crc = crc8(crc, header[i]);
+    }
+    EEPROM.write(start + SETTINGS_LOG_HEADER_SIZE - 1, crc);
+  }
+
+  // Validate the record at offset, returns its total size or 0 if it is the end of the log or corrupt
+  uint16_t recordSize(uint16_t offset)
+  {
+    uint16_t end = bankStart(activeBank) + bankSize;
+    if (offset + SETTINGS_LOG_RECORD_OVERHEAD > end)
+    {
+      return 0;
+    }
+
+    uint8_t key = EEPROM.read(offset);
+    uint8_t length = EEPROM.read(offset + 1);
+    if (key == SETTINGS_LOG_END_KEY || key >= SETTINGS_LOG_MAX_KEYS || offset + SETTINGS_LOG_RECORD_OVERHEAD + length > end)
+    {
+      return 0;
+    }
+
+    uint8_t crc = crc8(crc8(0, key), length);
+    for (uint8_t i = 0; i < length; i++)
+    {
+      crc = crc8(crc, EEPROM.read(offset + 2 + i));
+    }
+    if (crc != EEPROM.read(offset + 2 + length))
+    {
+      return 0;
+    }
+
+    return SETTINGS_LOG_RECORD_OVERHEAD + length;
+  }
+
+  // Rebuild the index from the records of the active bank
+  void replay()
+  {
+    memset(index, 0, sizeof(index));
+
+    uint16_t offset = bankStart(activeBank) + SETTINGS_LOG_HEADER_SIZE;
+    uint16_t size;
+    while ((size = recordSize(offset)) > 0)
+    {
+      index[EEPROM.read(offset)] = offset;
+      offset += size;
+    }
+
+    writeOffset = offset;
+  }
+
+  // The key is written last, replacing the end marker, so a record cut short is never replayed
+  uint16_t writeRecord(uint16_t offset, uint8_t key, const uint8_t *data, uint8_t length)
+  {
+    EEPROM.write(offset + 1, length);
+
+    uint8_t crc = crc8(crc8(0, key), length);
+    for (uint8_t i = 0; i < length; i++)
+    {
+      EEPROM.write(offset + 2 + i, data[i]);
+      crc = crc8(crc, data[i]);
+    }
+    EEPROM.write(offset + 2 + length, crc);
+    EEPROM.write(offset, key);
+
+    return offset + SETTINGS_LOG_RECORD_OVERHEAD + length;
+  }
+
+  // Mark the end of the log so stale bytes after the last record are never replayed
+  void writeEnd(uint16_t offset)
+  {
+    if (offset < bankStart(activeBank) + bankSize)
+    {
+      EEPROM.write(offset, SETTINGS_LOG_END_KEY);
+    }
+  }
+
+  // Bytes the active bank would hold after compaction without key's record
+  uint16_t compactedSize(uint8_t key)
+  {
+    uint16_t size = SETTINGS_LOG_HEADER_SIZE;
+    for (uint8_t other = 0; other < SETTINGS_LOG_MAX_KEYS; other++)
+    {
+      if (other != key && index[other] != 0)
+      {
+        size += SETTINGS_LOG_RECORD_OVERHEAD + EEPROM.read(index[other] + 1);
+      }
+    }
+    return size;
+  }
+
+  // Copy the latest record of every other key and the new value of key into the inactive bank and make it active.
+  // The old bank, including key's old value, stays authoritative until the new header is written.
+  void compact(uint8_t key, const uint8_t *data, uint8_t length)
+  {
+    uint8_t oldBank = activeBank;
+    uint8_t newBank = activeBank ^ 1;
+
+    uint16_t offset = bankStart(newBank) + SETTINGS_LOG_HEADER_SIZE;
+    for (uint8_t other = 0; other < SETTINGS_LOG_MAX_KEYS; other++)
+    {
+      if (other == key || index[other] == 0)
+      {
+        continue;
+      }
+
+      uint16_t size = SETTINGS_LOG_RECORD_OVERHEAD + EEPROM.read(index[other] + 1);
+      for (uint16_t i = 0; i < size; i++)
+      {
+        EEPROM.write(offset + i, EEPROM.read(index[other] + i));
+      }
+      index[other] = offset;
+      offset += size;
+    }
+
+    index[key] = offset;
+    offset = writeRecord(offset, key, data, length);
+
+    activeBank = newBank;
+    writeEnd(offset);
+    writeOffset = offset;
+
+    // Header is written last so the old bank stays authoritative until compaction is complete
+    generation++;
+    writeHeader(newBank, generation);
+
+    // Invalidate the old header so the banks can not be confused if generations wrap
+    EEPROM.write(bankStart(oldBank), 0);
+  }
+
+public:
+  SettingsLog(uint16_t regionSize)
+  {
+    this->regionSize = regionSize;
+    this->bankSize = regionSize / 2;
+
+    activeBank = 0;
+    generation = 0;
+    writeOffset = SETTINGS_LOG_HEADER_SIZE;
+    memset(index, 0, sizeof(index));
+  }
+
+  // Find the active bank and replay its records, returns false if the region holds no log
+  bool begin()
+  {
+    uint8_t generation0, generation1;
+    bool valid0 = readHeader(0, &generation0);
+    bool valid1 = readHeader(1, &generation1);
+
+    if (!valid0 && !valid1)
+    {
+      return false;
+    }
+
+    if (valid0 && valid1)
+    {
+      // Newest generation wins, compared with wrap around
+      activeBank = (int8_t)(generation1 - generation0) > 0 ? 1 : 0;
+    }
+    else
+    {
+      activeBank = valid1 ? 1 : 0;
+    }
+    generation = activeBank == 0 ? generation0 : generation1;
+
+    replay();
+    return true;
+  }
+
+  // Erase the log and start an empty one in the first bank
+  void format()
+  {
+    memset(index, 0, sizeof(index));
+
+    activeBank = 0;
+    generation = 0;
+    writeOffset = bankStart(activeBank) + SETTINGS_LOG_HEADER_SIZE;
+    writeEnd(writeOffset);
+    writeHeader(0, generation);
+    EEPROM.write(bankStart(1), 0);
+  }
+
+  // Append a new value for key, compacting the log if the active bank is full.
+  // Returns false and keeps the old value if the value does not fit even after compaction.
+  bool write(uint8_t key, const void *data, uint8_t length)
+  {
+    if (key >= SETTINGS_LOG_MAX_KEYS || SETTINGS_LOG_HEADER_SIZE + SETTINGS_LOG_RECORD_OVERHEAD + length > bankSize)
+    {
+      return false;
+    }
+
+    if (writeOffset + SETTINGS_LOG_RECORD_OVERHEAD + length > bankStart(activeBank) + bankSize)
+    {
+      // Checked before the inactive bank is touched, the new value replaces the old one in the compacted bank
+      if (compactedSize(key) + SETTINGS_LOG_RECORD_OVERHEAD + length > bankSize)
+      {
+        return false;
+      }
+
+      compact(key, (const uint8_t *)data, length);
+      return true;
+    }
+
+    // The end marker moves first, the old one is replaced by the record's key
+    uint16_t offset = writeOffset;
+    writeEnd(offset + SETTINGS_LOG_RECORD_OVERHEAD + length);
+    writeOffset = writeRecord(offset, key, (const uint8_t *)data, length);
+    index[key] = offset;
+
+    return true;
+  }
+
+  // Read the latest value of key, returns false if the key has no record of the given length
+  bool read(uint8_t key, void *data, uint8_t length)
+  {
+    if (key >= SETTINGS_LOG_MAX_KEYS || index[key] == 0 || EEPROM.read(index[key] + 1) != length)
+    {
+      return false;
+    }
+
+    uint8_t *d = (uint8_t *)data;
+    for (uint8_t i = 0; i < length; i++)
+    {
+      d[i] = EEPROM.read(index[key] + 2 + i);
+    }
+
+    return true;
+  }
+
+  // Length of the latest value of key, 0 if the key has no record
+  uint8_t length(uint8_t key)
+  {
+    if (key >= SETTINGS_LOG_MAX_KEYS || index[key] == 0)
+    {
+      return 0;
+    }
+
+    return EEPROM.read(index[key] + 1);
+  }
+
+  uint16_t getUsedBytes()
+  {
+    return writeOffset - bankStart(activeBank);
+  }
+
+  uint16_t getBankSize()
+  {
+    return bankSize;
+  }
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <atomic>
+
+// Single writer, multiple reader value exchange between tasks on different cores.
+// The writer never blocks, readers retry if they raced with a write (sequence lock).
+template <typename T>
+class Snapshot
+{
+private:
+  T value;
+
+  // Odd while a write is in progress, incremented by 2 for every completed write
+  std::atomic<uint32_t> sequence;
+
+public:
+  Snapshot()
+  {
+    value = T();
+    sequence.store(0);
+  }
+
+  Snapshot(const T &initial)
+  {
+    value = initial;
+    sequence.store(0);
+  }
+
+  // Only called from the single writer
+  void write(const T &newValue)
+  {
+    uint32_t current = sequence.load(std::memory_order_relaxed);
+    sequence.store(current + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    value = newValue;
+
+    sequence.store(current + 2, std::memory_order_release);
+  }
+
+  T read() const
+  {
+    for (;;)
+    {
+      uint32_t before = sequence.load(std::memory_order_acquire);
+      if (before & 1)
+      {
+        continue;
+      }
+
+      T copy = value;
+
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (sequence.load(std::memory_order_relaxed) == before)
+      {
+        return copy;
+      }
+    }
+  }
+
+  // Number of completed writes
+  uint32_t getVersion() const
+  {
+    return sequence.load(std::memory_order_acquire) / 2;
+  }
+};
+
+#endif
@@ -1,14 +1,149 @@
 #ifndef TEMPERATURE_H
 #define TEMPERATURE_H
 
-double celsiusToFahrenheit(double celsius)
-{
-  return (celsius * 9 / 5) + 32;
-}
+// Hundredths of a degree marking a missing reading
+#define TEMPERATURE_INVALID INT16_MIN
 
-double fahrenheitToCelsius(double fahrenheit)
+// Fixed point temperature in hundredths of a degree Celsius. Comparisons and arithmetic are integer only,
+// floating point is only used where a value enters or leaves the thermostat in another unit.
+class Temperature
 {
-  return (fahrenheit - 32) * 5 / 9;
-}
+private:
+  int16_t centi;
+
+  constexpr explicit Temperature(int16_t centi) : centi(centi) {}
+
+  // Round to the nearest hundredth and saturate to the valid range, NaN becomes invalid
+  static constexpr int16_t fromFloating(double hundredths)
+  {
+    return hundredths != hundredths ? TEMPERATURE_INVALID
+                                    : (hundredths >= INT16_MAX ? INT16_MAX
+                                                               : (hundredths <= -INT16_MAX ? -INT16_MAX
+                                                                                           : (int16_t)(hundredths < 0 ? hundredths - 0.5 : hundredths + 0.5)));
+  }
+
+  // Integer division rounding half away from zero
+  static constexpr int32_t divideRounded(int32_t value, int32_t divisor)
+  {
+    return value < 0 ? (value - divisor / 2) / divisor : (value + divisor / 2) / divisor;
+  }
+
+  static constexpr int16_t saturate(int32_t value)
+  {
+    return value >= INT16_MAX ? INT16_MAX : (value <= -INT16_MAX ? -INT16_MAX : (int16_t)value);
+  }
+
+public:
+  // Invalid until assigned
+  constexpr Temperature() : centi(TEMPERATURE_INVALID) {}
+
+  static constexpr Temperature fromCentiCelsius(int16_t value)
+  {
+    return Temperature(value);
+  }
+
+  static constexpr Temperature fromCelsius(double celsius)
+  {
+    return Temperature(fromFloating(celsius * 100));
+  }
+
+  static constexpr Temperature fromFahrenheit(double fahrenheit)
+  {
+    return Temperature(fromFloating((fahrenheit - 32) * 500 / 9));
+  }
+
+  static constexpr Temperature fromUnits(double value, bool imperial)
+  {
+    return imperial ? fromFahrenheit(value) : fromCelsius(value);
+  }
+
+  constexpr bool isValid() const
+  {
+    return centi != TEMPERATURE_INVALID;
+  }
+
+  constexpr int16_t centiCelsius() const
+  {
+    return centi;
+  }
+
+  constexpr int16_t centiFahrenheit() const
+  {
+    return isValid() ? saturate(divideRounded((int32_t)centi * 9, 5) + 3200) : TEMPERATURE_INVALID;
+  }
+
+  // Whole degrees, rounded half away from zero
+  constexpr int16_t roundCelsius() const
+  {
+    return divideRounded(centi, 100);
+  }
+
+  constexpr int16_t roundFahrenheit() const
+  {
+    return divideRounded(centiFahrenheit(), 100);
+  }
+
+  // NaN when invalid
+  constexpr float toCelsius() const
+  {
+    return isValid() ? centi / 100.0f : NAN;
+  }
+
+  constexpr float toFahrenheit() const
+  {
+    return isValid() ? centiFahrenheit() / 100.0f : NAN;
+  }
+
+  constexpr float toUnits(bool imperial) const
+  {
+    return imperial ? toFahrenheit() : toCelsius();
+  }
+
+  // Sums and differences of temperatures, also used for offsets such as hysteresis. Invalid if either side is,
+  // so a missing reading or setpoint never turns into a plausible value.
+  constexpr Temperature operator+(Temperature other) const
+  {
+    return isValid() && other.isValid() ? Temperature(saturate((int32_t)centi + other.centi)) : Temperature();
+  }
+
+  constexpr Temperature operator-(Temperature other) const
+  {
+    return isValid() && other.isValid() ? Temperature(saturate((int32_t)centi - other.centi)) : Temperature();
+  }
+
+  constexpr bool operator==(Temperature other) const
+  {
+    return centi == other.centi;
+  }
+
+  constexpr bool operator!=(Temperature other) const
+  {
+    return centi != other.centi;
+  }
+
+  // Orderings are false if either side is invalid, like comparisons with NaN, so a missing reading or
+  // setpoint never reads as colder or warmer than a real one
+  constexpr bool operator<(Temperature other) const
+  {
+    return isValid() && other.isValid() && centi < other.centi;
+  }
+
+  constexpr bool operator<=(Temperature other) const
+  {
+    return isValid() && other.isValid() && centi <= other.centi;
+  }
+
+  constexpr bool operator>(Temperature other) const
+  {
+    return isValid() && other.isValid() && centi > other.centi;
+  }
+
+  constexpr bool operator>=(Temperature other) const
+  {
+    return isValid() && other.isValid() && centi >= other.centi;
+  }
+};
+
+static_assert(sizeof(Temperature) == 2, "Temperature must stay a bare int16_t");
 
 #endif
@@ -1,75 +1,113 @@
 #ifndef THERMOSTAT_H
 #define THERMOSTAT_H
 
+#include "FixedString.h"
 #include "PersistentStorage.h"
-
-// ====== Thermostat Settings ======
-#ifndef MINIMUM_SETPOINT
-#define MINIMUM_SETPOINT 18
-#define MAXIMUM_SETPOINT 32
+#include "PidController.h"
+#include "Schedule.h"
+#include "SensorFusion.h"
+#include "Snapshot.h"
+#include "ThermostatConfig.h"
+
+// ====== PID Strategy Settings ======
+// Gains in duty cycle per degree, per degree second and per degree per second
+#ifndef PID_KP
+#define PID_KP 0.5
+#endif
+#ifndef PID_KI
+#define PID_KI 0.00014
+#endif
+#ifndef PID_KD
+#define PID_KD 120
 #endif
 
-#define ABSOLUTE_MINIMUM_SETPOINT 18
-#define ABSOLUTE_MAXIMUM_SETPOINT 32
-#define MINIMUM_SETPOINT_RANGE 10
+// Time between PID updates
+#ifndef PID_SAMPLE_PERIOD
+#define PID_SAMPLE_PERIOD 10000
+#endif
 
-#ifndef HYSTERESIS
-#define HYSTERESIS 1
+// The relay is on for duty cycle times this period, then off for the rest (at most 4 cycles an hour)
+#ifndef PID_CYCLE_PERIOD
+#define PID_CYCLE_PERIOD 900000
 #endif
 
-#ifndef STATE_CHANGE_DELAY
-#define STATE_CHANGE_DELAY 30000
+// ====== Sensor Settings ======
+// Readings trusted less than this are ignored and the zone holds its state, as with no reading at all
+#ifndef THERMOSTAT_MINIMUM_CONFIDENCE
+#define THERMOSTAT_MINIMUM_CONFIDENCE 1
 #endif
 
+static_assert(ThermostatConfig::minimumOnTime + ThermostatConfig::minimumOffTime <= PID_CYCLE_PERIOD, "minimum run and rest times do not fit in PID_CYCLE_PERIOD");
+
 class Thermostat
 {
 private:
   PersistentStorage *storage = storage->getInstance();
 
-  double SETPOINT_MIN;
-  double SETPOINT_MAX;
+  // Time source, replaceable with a virtual clock
+  unsigned long (*clockMillis)();
 
-  double hysteresis;
+  // ====== Zone State ======
+  // One array per field indexed by zone, so a pass over all zones walks each field contiguously.
+  // Setpoints and state live in PersistentStorage, also indexed by zone.
+  unsigned long lastStateChangeTime[THERMOSTAT_ZONE_COUNT];
 
-  unsigned long lastStateChangeTime;
+  // ====== PID Strategy ======
+  PidController heatPid[THERMOSTAT_ZONE_COUNT];
+  PidController coolPid[THERMOSTAT_ZONE_COUNT];
+  bool pidRunning[THERMOSTAT_ZONE_COUNT];
+  unsigned long lastPidTime[THERMOSTAT_ZONE_COUNT];
+  float heatDuty[THERMOSTAT_ZONE_COUNT];
+  float coolDuty[THERMOSTAT_ZONE_COUNT];
 
-  static Thermostat *instance;
+  // Current relay cycle, the relay runs in cycleState for cycleOnTime from cycleStartTime
+  unsigned long cycleStartTime[THERMOSTAT_ZONE_COUNT];
+  unsigned long cycleOnTime[THERMOSTAT_ZONE_COUNT];
+  uint8_t cycleState[THERMOSTAT_ZONE_COUNT];
 
-  Thermostat()
-  {
-    lastStateChangeTime = 0;
+  // ====== Schedule ======
+  // Written by setSchedule, the control task follows its own copy
+  Snapshot<ScheduleTable> schedule;
+  ScheduleTable activeSchedule;
+  uint32_t activeScheduleVersion;
 
-    SETPOINT_MIN = MINIMUM_SETPOINT;
-    SETPOINT_MAX = MAXIMUM_SETPOINT;
+  // Index of the next transition to fire and the minute of the week the schedule was last run at
+  uint8_t scheduleNext;
+  int16_t scheduleMinute;
 
-    // ====== Initialize setpoint limits ======
-    //Cap setpoint min
-    if (SETPOINT_MIN < ABSOLUTE_MINIMUM_SETPOINT)
-    {
-      SETPOINT_MIN = ABSOLUTE_MINIMUM_SETPOINT;
-    }
+  // Set when a zone's setpoints are changed by hand, cleared by the zone's next transition
+  std::atomic<bool> scheduleOverride[THERMOSTAT_ZONE_COUNT];
 
-    //Make sure setpoint min is no larger than ABSOLUTE_MAXIMUM_SETPOINT - MINIMUM_SETPOINT_RANGE
-    //If setpoint min is greater than or equal to ABSOLUTE_MAXIMUM_SETPOINT - MINIMUM_SETPOINT_RANGE + 1 this will cause setpoint max to be less than the minimum setpoint range
-    if (SETPOINT_MIN > ABSOLUTE_MAXIMUM_SETPOINT - MINIMUM_SETPOINT_RANGE)
-    {
-      SETPOINT_MIN = ABSOLUTE_MAXIMUM_SETPOINT - MINIMUM_SETPOINT_RANGE;
-    }
+  // Minute of the week source, replaceable with a virtual clock
+  int16_t (*wallClock)();
 
-    //Make sure setpoint max is at least 10 degrees higher than setpoint min
-    if (SETPOINT_MAX < SETPOINT_MIN + MINIMUM_SETPOINT_RANGE)
+  static Thermostat *instance;
+
+  Thermostat()
+  {
+    clockMillis = millis;
+    wallClock = scheduleWallClock;
+    stateChangeCallback = NULL;
+    for (uint8_t zone = 0; zone < THERMOSTAT_ZONE_COUNT; zone++)
     {
-      SETPOINT_MAX = SETPOINT_MIN + MINIMUM_SETPOINT_RANGE;
+      lastStateChangeTime[zone] = 0;
+      heatPid[zone].setGains(PID_KP, PID_KI, PID_KD);
+      coolPid[zone].setGains(PID_KP, PID_KI, PID_KD);
+      pidRunning[zone] = false;
+      scheduleOverride[zone] = false;
     }
 
-    //Cap setpoint max
-    if (SETPOINT_MAX > ABSOLUTE_MAXIMUM_SETPOINT)
+    // A stored schedule that does not fit this build is dropped
+    ScheduleTable table;
+    storage->getSchedule(&table);
+    if (!normalizeSchedule(&table))
     {
-      SETPOINT_MAX = ABSOLUTE_MAXIMUM_SETPOINT;
+      table.count = 0;
     }
-
-    // ====== Initialize Hysteresis ======
-    hysteresis = HYSTERESIS;
+    schedule.write(table);
+    activeScheduleVersion = 0;
+    scheduleNext = 0;
+    scheduleMinute = SCHEDULE_NO_TIME;
   }
 
 public:
@@ -91,114 +129,361 @@ public:
     FAN = 3
   };
 
-  // Singleton
-  static Thermostat *getInstance()
+  // How AUTOMATIC mode decides when to run the relays
+  enum ControlStrategy
   {
-    if (!instance)
+    // Bang-bang around the setpoints with a fixed hysteresis
+    STRATEGY_HYSTERESIS = 0,
+    // Time proportioned duty cycle from a PID controller per direction
+    STRATEGY_PID = 1
+  };
+
+private:
+  // Called whenever a zone's state changes, from the task running update
+  void (*stateChangeCallback)(uint8_t zone, ThermostatState state);
+
+  // Update the zone's PID controllers and switch its relay along the current cycle
+  void updatePid(uint8_t zone, Temperature currentTemperature, unsigned long now)
+  {
+    if (!pidRunning[zone] || now - lastPidTime[zone] >= PID_SAMPLE_PERIOD)
     {
-      instance = new Thermostat;
+      float dt = pidRunning[zone] ? (now - lastPidTime[zone]) / 1000.0f : 0;
+      if (!pidRunning[zone])
+      {
+        heatPid[zone].reset();
+        coolPid[zone].reset();
+        // Start a cycle right away
+        cycleStartTime[zone] = now - PID_CYCLE_PERIOD;
+      }
+      pidRunning[zone] = true;
+      lastPidTime[zone] = now;
+
+      // An unset setpoint would feed NaN into the integral, that direction stays off instead
+      float measurement = currentTemperature.toCelsius();
+      Temperature heatError = getSetpointLow(zone) - currentTemperature;
+      Temperature coolError = currentTemperature - getSetpointHigh(zone);
+      heatDuty[zone] = ThermostatConfig::canHeat && heatError.isValid() ? heatPid[zone].update(heatError.toCelsius(), measurement, dt, 1) : 0;
+      coolDuty[zone] = ThermostatConfig::canCool && coolError.isValid() ? coolPid[zone].update(coolError.toCelsius(), measurement, dt, -1) : 0;
     }
-    return instance;
+
+    // Plan the next cycle from the latest duty
+    if (now - cycleStartTime[zone] >= PID_CYCLE_PERIOD)
+    {
+      cycleStartTime[zone] = now;
+
+      float duty = 0;
+      cycleState[zone] = IDLE;
+      if (heatDuty[zone] > 0 && heatDuty[zone] >= coolDuty[zone])
+      {
+        cycleState[zone] = HEATING;
+        duty = heatDuty[zone];
+      }
+      else if (coolDuty[zone] > 0)
+      {
+        cycleState[zone] = COOLING;
+        duty = coolDuty[zone];
+      }
+
+      cycleOnTime[zone] = duty * PID_CYCLE_PERIOD;
+      if (cycleOnTime[zone] < ThermostatConfig::minimumOnTime)
+      {
+        cycleOnTime[zone] = 0;
+      }
+      else if (PID_CYCLE_PERIOD - cycleOnTime[zone] < ThermostatConfig::minimumOffTime)
+      {
+        cycleOnTime[zone] = PID_CYCLE_PERIOD;
+      }
+    }
+
+    ThermostatState target = now - cycleStartTime[zone] < cycleOnTime[zone] ? (ThermostatState)cycleState[zone] : IDLE;
+    ThermostatState current = getState(zone);
+    if (target == current)
+    {
+      return;
+    }
+
+    // Honour minimum run and rest times, a reversal passes through IDLE
+    unsigned long sinceChange = now - lastStateChangeTime[zone];
+    if (current != IDLE)
+    {
+      if (sinceChange < ThermostatConfig::minimumOnTime)
+      {
+        return;
+      }
+      target = IDLE;
+    }
+    else if (sinceChange < ThermostatConfig::minimumOffTime)
+    {
+      return;
+    }
+
+    lastStateChangeTime[zone] = now;
+    setState(target, zone);
+  }
+
+  // Check every transition is in range, round setpoints to the tenth of a degree they are stored with and sort
+  static bool normalizeSchedule(ScheduleTable *table)
+  {
+    if (table->count > SCHEDULE_MAX_TRANSITIONS)
+    {
+      return false;
+    }
+
+    for (uint8_t i = 0; i < table->count; i++)
+    {
+      ScheduleTransition &transition = table->transitions[i];
+      if (transition.minute >= SCHEDULE_MINUTES_PER_WEEK || transition.zone >= THERMOSTAT_ZONE_COUNT ||
+          !(transition.setpointLow >= setpointMinimum && transition.setpointLow <= setpointMaximum) ||
+          !(transition.setpointHigh >= setpointMinimum && transition.setpointHigh <= setpointMaximum))
+      {
+        return false;
+      }
+
+      transition.setpointLow = Temperature::fromCentiCelsius((transition.setpointLow.centiCelsius() + 5) / 10 * 10);
+      transition.setpointHigh = Temperature::fromCentiCelsius((transition.setpointHigh.centiCelsius() + 5) / 10 * 10);
+    }
+
+    table->sort();
+    return true;
+  }
+
+  void applyTransition(const ScheduleTransition *transition)
+  {
+    storage->setSetpointLow(transition->setpointLow, transition->zone);
+    storage->setSetpointHigh(transition->setpointHigh, transition->zone);
   }
 
-  ThermostatState update(double currentTemperature)
+  // Fire the transitions due since the last run, O(1) while the wall clock stays on the same minute.
+  // A new table or a clock jump places the schedule again with a binary search and applies each
+  // zone's active transition, zones under a manual override keep their setpoints across a clock jump.
+  void updateSchedule()
+  {
+    int16_t minute = wallClock();
+    if (minute == SCHEDULE_NO_TIME)
+    {
+      return;
+    }
+
+    bool tableChanged = false;
+    uint32_t version = schedule.getVersion();
+    if (version != activeScheduleVersion)
+    {
+      activeScheduleVersion = version;
+      activeSchedule = schedule.read();
+      tableChanged = true;
+    }
+
+    if (minute == scheduleMinute && !tableChanged)
+    {
+      return;
+    }
+
+    const ScheduleTable &table = activeSchedule;
+    if (table.count == 0)
+    {
+      scheduleMinute = minute;
+      return;
+    }
+
+    if (tableChanged || scheduleMinute == SCHEDULE_NO_TIME || ScheduleTable::minutesBetween(scheduleMinute, minute) > SCHEDULE_MAX_STEP)
+    {
+      scheduleNext = table.upperBound(minute) % table.count;
+      for (uint8_t zone = 0; zone < THERMOSTAT_ZONE_COUNT; zone++)
+      {
+        const ScheduleTransition *active = table.activeBefore(scheduleNext, zone);
+        if (active != NULL && (tableChanged || !scheduleOverride[zone]))
+        {
+          scheduleOverride[zone] = false;
+          applyTransition(active);
+        }
+      }
+    }
+    else
+    {
+      // Transitions in (scheduleMinute, minute], at most one lap of the table
+      int16_t elapsed = ScheduleTable::minutesBetween(scheduleMinute, minute);
+      for (uint8_t i = 0; i < table.count; i++)
+      {
+        const ScheduleTransition *transition = &table.transitions[scheduleNext];
+        int16_t due = ScheduleTable::minutesBetween(scheduleMinute, transition->minute);
+        if (due == 0 || due > elapsed)
+        {
+          break;
+        }
+
+        scheduleOverride[transition->zone] = false;
+        applyTransition(transition);
+        scheduleNext = (scheduleNext + 1) % table.count;
+      }
+    }
+
+    scheduleMinute = minute;
+  }
+
+  ThermostatState updateZone(uint8_t zone, Temperature currentTemperature, ThermostatMode mode, ControlStrategy strategy, unsigned long now)
   {
     //check temperature is not NAN
-    if (!isnan(currentTemperature))
+    if (currentTemperature.isValid())
     {
 
       // Mode state machine
-      if (getMode() == OFF)
+      if (mode == OFF)
       {
         //set state to IDLE
-        setState(IDLE);
+        setState(IDLE, zone);
       }
-      else if (getMode() == HEAT)
+      else if (mode == HEAT)
       {
         //set state to HEATING
-        setState(HEATING);
+        setState(HEATING, zone);
       }
-      else if (getMode() == COOL)
+      else if (mode == COOL)
       {
         //set state to COOLING
-        setState(COOLING);
+        setState(COOLING, zone);
+      }
+      else if (mode == AUTOMATIC && strategy == STRATEGY_PID)
+      {
+        updatePid(zone, currentTemperature, now);
       }
-      else if (getMode() == AUTOMATIC)
+      else if (mode == AUTOMATIC)
       {
         // Limit state update rate
-        if (millis() >= lastStateChangeTime + STATE_CHANGE_DELAY)
+        if (now - lastStateChangeTime[zone] >= ThermostatConfig::stateChangeDelay)
         {
-          lastStateChangeTime = millis();
+          lastStateChangeTime[zone] = now;
 
           // Update thermostat state
+          Temperature setpointLow = getSetpointLow(zone);
+          Temperature setpointHigh = getSetpointHigh(zone);
 
-          //If current temperature is greater than setpoint plus hysteresis, turn off heating          
+          //If current temperature is greater than setpoint plus hysteresis, turn off heating
           //If current temperature is less than setpoint minus hysteresis, turn off cooling
-          if (currentTemperature >= getSetpointLow() + hysteresis && currentTemperature <= getSetpointHigh() - hysteresis)
+          if (currentTemperature >= setpointLow + hysteresis && currentTemperature <= setpointHigh - hysteresis)
           {
             //set state to IDLE
-            setState(IDLE);
+            setState(IDLE, zone);
           }
           //Else, if current temperature is less than setpoint minus hysteresis, turn on heating
-          else if (currentTemperature <= getSetpointLow() - hysteresis)
+          else if (ThermostatConfig::canHeat && currentTemperature <= setpointLow - hysteresis)
           {
             //set state to HEATING
-            setState(HEATING);
+            setState(HEATING, zone);
           }
           //Else, if current  temperature is greater than setpoint plus hysteresis, turn on cooling
-          else if (currentTemperature >= getSetpointHigh() + hysteresis)
+          else if (ThermostatConfig::canCool && currentTemperature >= setpointHigh + hysteresis)
           {
             //set state to COOLING
-            setState(COOLING);
+            setState(COOLING, zone);
           }
         }
       }
-      else if (getMode() == FAN_ONLY)
+      else if (mode == FAN_ONLY)
       {
-        setState(FAN);
+        setState(FAN, zone);
       }
     }
 
-    return getState();
+    // Start over from a clean integral whenever the PID strategy resumes
+    if (mode != AUTOMATIC || strategy != STRATEGY_PID)
+    {
+      pidRunning[zone] = false;
+    }
+
+    return getState(zone);
+  }
+
+public:
+  // Singleton
+  static Thermostat *getInstance()
+  {
+    if (!instance)
+    {
+      instance = new Thermostat;
+    }
+    return instance;
+  }
+
+  ThermostatState update(Temperature currentTemperature, uint8_t zone = 0)
+  {
+    updateSchedule();
+    return updateZone(zone, currentTemperature, getMode(), getControlStrategy(), clockMillis());
+  }
+
+  // Update every zone in one pass, mode, strategy and time are read once for all of them.
+  // readings and states hold THERMOSTAT_ZONE_COUNT entries.
+  void updateZones(const FusedTemperature *readings, ThermostatState *states)
+  {
+    updateSchedule();
+
+    ThermostatMode mode = getMode();
+    ControlStrategy strategy = getControlStrategy();
+    unsigned long now = clockMillis();
+
+    for (uint8_t zone = 0; zone < THERMOSTAT_ZONE_COUNT; zone++)
+    {
+      Temperature temperature = readings[zone].confidence >= THERMOSTAT_MINIMUM_CONFIDENCE ? readings[zone].temperature : Temperature();
+      states[zone] = updateZone(zone, temperature, mode, strategy, now);
+    }
   }
 
   // ====== Setters & Getters ======
-  bool setSetpointLow(double setpoint)
+  // Limits of the configuration as temperatures, so the bounds checks compare against constants
+  static constexpr Temperature setpointMinimum = Temperature::fromCelsius(ThermostatConfig::setpointMinimum);
+  static constexpr Temperature setpointMaximum = Temperature::fromCelsius(ThermostatConfig::setpointMaximum);
+  static constexpr Temperature hysteresis = Temperature::fromCelsius(ThermostatConfig::hysteresis);
+
+  // Setpoints set here are a manual override, kept until the zone's next scheduled transition
+  bool setSetpointLow(Temperature setpoint, uint8_t zone = 0)
   {
-    if (setpoint >= SETPOINT_MIN && setpoint <= SETPOINT_MAX)
+    if (setpoint >= setpointMinimum && setpoint <= setpointMaximum)
     {
-      storage->setSetpointLow(setpoint);
+      storage->setSetpointLow(setpoint, zone);
+      scheduleOverride[zone] = true;
       return true;
     }
 
     return false;
   }
 
-  double getSetpointLow()
+  Temperature getSetpointLow(uint8_t zone = 0)
   {
-    return storage->getSetpointLow();
+    return storage->getSetpointLow(zone);
   }
 
-  bool setSetpointHigh(double setpoint)
+  bool setSetpointHigh(Temperature setpoint, uint8_t zone = 0)
   {
-    if (setpoint >= SETPOINT_MIN && setpoint <= SETPOINT_MAX)
+    if (setpoint >= setpointMinimum && setpoint <= setpointMaximum)
     {
-      storage->setSetpointHigh(setpoint);
+      storage->setSetpointHigh(setpoint, zone);
+      scheduleOverride[zone] = true;
       return true;
     }
 
     return false;
   }
 
-  double getSetpointHigh()
+  Temperature getSetpointHigh(uint8_t zone = 0)
   {
-    return storage->getSetpointHigh();
+    return storage->getSetpointHigh(zone);
   }
 
-  void setMode(ThermostatMode mode)
+  // Returns false for a mode the configured equipment cannot run
+  bool setMode(ThermostatMode mode)
   {
+    if (!supportsMode(mode))
+    {
+      return false;
+    }
+
     //set current mode
     storage->setCurrentThermostatMode((uint8_t)mode);
+    return true;
+  }
+
+  static constexpr bool supportsMode(ThermostatMode mode)
+  {
+    return (mode != HEAT || ThermostatConfig::canHeat) && (mode != COOL || ThermostatConfig::canCool);
   }
 
   ThermostatMode getMode()
@@ -206,54 +491,176 @@ public:
     return (ThermostatMode)storage->getCurrentThermostatMode();
   }
 
-  String getModeString()
+  static constexpr StringView getModeName(ThermostatMode mode)
   {
-    switch ((ThermostatMode)storage->getCurrentThermostatMode())
+    return mode == ThermostatMode::OFF         ? StringView("off")
+           : mode == ThermostatMode::HEAT      ? StringView("heat")
+           : mode == ThermostatMode::COOL      ? StringView("cool")
+           : mode == ThermostatMode::AUTOMATIC ? StringView("auto")
+           : mode == ThermostatMode::FAN_ONLY  ? StringView("fan-only")
+                                               : StringView("");
+  }
+
+  void setControlStrategy(ControlStrategy strategy)
+  {
+    storage->setSettingControlStrategy((uint8_t)strategy);
+  }
+
+  ControlStrategy getControlStrategy()
+  {
+    return (ControlStrategy)storage->getSettingControlStrategy();
+  }
+
+  static const char *getControlStrategyName(ControlStrategy strategy)
+  {
+    switch (strategy)
     {
-    case Thermostat::ThermostatMode::OFF:
-      return "off";
-    case Thermostat::ThermostatMode::HEAT:
-      return "heat";
-    case Thermostat::ThermostatMode::COOL:
-      return "cool";
-    case Thermostat::ThermostatMode::AUTOMATIC:
-      return "auto";
-    case Thermostat::ThermostatMode::FAN_ONLY:
-      return "fan-only";
+    case Thermostat::ControlStrategy::STRATEGY_HYSTERESIS:
+      return "hysteresis";
+    case Thermostat::ControlStrategy::STRATEGY_PID:
+      return "pid";
     default:
       return "";
     }
   }
 
-  void setState(ThermostatState state)
+  void setState(ThermostatState state, uint8_t zone = 0)
   {
+    if (state == getState(zone))
+    {
+      return;
+    }
+
     //set current state
-    storage->setCurrentThermostatState((int8_t)state);
+    storage->setCurrentThermostatState((int8_t)state, zone);
+
+    if (stateChangeCallback != NULL)
+    {
+      (*stateChangeCallback)(zone, state);
+    }
+  }
+
+  void setStateChangeCallback(void (*callback)(uint8_t zone, ThermostatState state))
+  {
+    stateChangeCallback = callback;
   }
 
-  ThermostatState getState()
+  // Run the state machine on another time source, such as a simulated clock
+  void setClock(unsigned long (*clockMillis)())
   {
-    return (ThermostatState)storage->getCurrentThermostatState();
+    this->clockMillis = clockMillis;
   }
 
-  String getStateString()
+  // Minute of the week the schedule follows, SCHEDULE_NO_TIME while unknown
+  void setWallClock(int16_t (*wallClock)())
   {
-    switch ((ThermostatState)storage->getCurrentThermostatState())
+    this->wallClock = wallClock;
+  }
+
+  // ====== Schedule ======
+  // Replace and store the weekly schedule, returns false if a transition is out of range or the
+  // schedule could not be stored, the running schedule is kept then. Called from one task only.
+  bool setSchedule(const ScheduleTable &newTable)
+  {
+    ScheduleTable table = newTable;
+    if (!normalizeSchedule(&table) || !storage->setSchedule(table))
     {
-    case Thermostat::ThermostatState::IDLE:
-      return "idle";
-    case Thermostat::ThermostatState::HEATING:
-      return "heating";
-    case Thermostat::ThermostatState::COOLING:
-      return "cooling";
-    case Thermostat::ThermostatState::FAN:
-      return "fan";
-    default:
-      return "";
+      return false;
     }
+
+    schedule.write(table);
+    return true;
+  }
+
+  // True if every transition of table is in range, the check setSchedule makes before storing it
+  static bool isValidSchedule(const ScheduleTable &table)
+  {
+    ScheduleTable normalized = table;
+    return normalizeSchedule(&normalized);
+  }
+
+  ScheduleTable getSchedule()
+  {
+    return schedule.read();
+  }
+
+  int16_t getWallClock()
+  {
+    return wallClock();
+  }
+
+  bool isScheduleOverridden(uint8_t zone = 0)
+  {
+    return scheduleOverride[zone];
+  }
+
+  ThermostatState getState(uint8_t zone = 0)
+  {
+    return (ThermostatState)storage->getCurrentThermostatState(zone);
+  }
+
+  static constexpr StringView getStateName(ThermostatState state)
+  {
+    return state == ThermostatState::IDLE      ? StringView("idle")
+           : state == ThermostatState::HEATING ? StringView("heating")
+           : state == ThermostatState::COOLING ? StringView("cooling")
+           : state == ThermostatState::FAN     ? StringView("fan")
+                                               : StringView("");
   }
 };
 
 Thermostat *Thermostat::instance = 0;
+constexpr Temperature Thermostat::setpointMinimum;
+constexpr Temperature Thermostat::setpointMaximum;
+constexpr Temperature Thermostat::hysteresis;
+
+// Everything a status response shows, published by the control task whenever a value changes
+// Per zone fields are indexed by zone, humidity comes from the local sensor
+struct ThermostatStatus
+{
+  Temperature temperature[THERMOSTAT_ZONE_COUNT];
+  // Trust in each zone's temperature, 0 to SENSOR_CONFIDENCE_FULL
+  uint8_t confidence[THERMOSTAT_ZONE_COUNT];
+  float humidity;
+  Temperature setpointLow[THERMOSTAT_ZONE_COUNT];
+  Temperature setpointHigh[THERMOSTAT_ZONE_COUNT];
+  Thermostat::ThermostatMode mode;
+  Thermostat::ThermostatState state[THERMOSTAT_ZONE_COUNT];
+
+  // No readings, OFF and IDLE everywhere
+  ThermostatStatus()
+  {
+    humidity = NAN;
+    mode = Thermostat::ThermostatMode::OFF;
+    for (uint8_t zone = 0; zone < THERMOSTAT_ZONE_COUNT; zone++)
+    {
+      temperature[zone] = Temperature();
+      confidence[zone] = 0;
+      setpointLow[zone] = Temperature();
+      setpointHigh[zone] = Temperature();
+      state[zone] = Thermostat::ThermostatState::IDLE;
+    }
+  }
+
+  // Field by field comparison where NaN humidity equals NaN
+  bool equals(const ThermostatStatus &other) const
+  {
+    if (!(humidity == other.humidity || (isnan(humidity) && isnan(other.humidity))) || mode != other.mode)
+    {
+      return false;
+    }
+
+    for (uint8_t zone = 0; zone < THERMOSTAT_ZONE_COUNT; zone++)
+    {
+      if (temperature[zone] != other.temperature[zone] || confidence[zone] != other.confidence[zone] ||
+          setpointLow[zone] != other.setpointLow[zone] || setpointHigh[zone] != other.setpointHigh[zone] ||
+          state[zone] != other.state[zone])
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+};
 
 #endif
@@ -0,0 +1,104 @@
+#ifndef THERMOSTAT_CONFIG_H
+#define THERMOSTAT_CONFIG_H
+
+// ====== Thermostat Settings ======
+#ifndef MINIMUM_SETPOINT
+#define MINIMUM_SETPOINT 18
+#define MAXIMUM_SETPOINT 32
+#endif
+
+#define ABSOLUTE_MINIMUM_SETPOINT 18
+#define ABSOLUTE_MAXIMUM_SETPOINT 32
+#define MINIMUM_SETPOINT_RANGE 10
+
+#ifndef HYSTERESIS
+#define HYSTERESIS 1
+#endif
+
+// Zones run by one controller, each with its own sensor source, setpoints, state and relays
+#ifndef THERMOSTAT_ZONE_COUNT
+#define THERMOSTAT_ZONE_COUNT 1
+#endif
+
+#ifndef STATE_CHANGE_DELAY
+#define STATE_CHANGE_DELAY 30000
+#endif
+
+// Compressor protection, shorter runs and rests are never scheduled by the PID strategy
+#ifndef PID_MINIMUM_ON_TIME
+#define PID_MINIMUM_ON_TIME 180000
+#endif
+#ifndef PID_MINIMUM_OFF_TIME
+#define PID_MINIMUM_OFF_TIME 180000
+#endif
+
+// Configuration the thermostat is built with, one of the types below
+#ifndef THERMOSTAT_CONFIG
+#define THERMOSTAT_CONFIG DefaultThermostatConfig
+#endif
+
+// Thermostat policy, fixed at compile time. Setpoint limits are in Celsius, times in milliseconds.
+// Every configuration is checked by ThermostatConfigCheck, invalid ones do not compile.
+struct DefaultThermostatConfig
+{
+  static constexpr double setpointMinimum = MINIMUM_SETPOINT;
+  static constexpr double setpointMaximum = MAXIMUM_SETPOINT;
+  static constexpr double hysteresis = HYSTERESIS;
+  static constexpr unsigned long stateChangeDelay = STATE_CHANGE_DELAY;
+  static constexpr unsigned long minimumOnTime = PID_MINIMUM_ON_TIME;
+  static constexpr unsigned long minimumOffTime = PID_MINIMUM_OFF_TIME;
+  static constexpr bool canHeat = true;
+  static constexpr bool canCool = true;
+  // Screen unit after a factory reset
+  static constexpr bool defaultImperial = false;
+};
+
+// Furnace or boiler without cooling, COOL mode is rejected and AUTOMATIC only heats
+struct HeatOnlyThermostatConfig
+{
+  static constexpr double setpointMinimum = 18;
+  static constexpr double setpointMaximum = 30;
+  static constexpr double hysteresis = 0.5;
+  static constexpr unsigned long stateChangeDelay = 30000;
+  static constexpr unsigned long minimumOnTime = 120000;
+  static constexpr unsigned long minimumOffTime = 120000;
+  static constexpr bool canHeat = true;
+  static constexpr bool canCool = false;
+  static constexpr bool defaultImperial = false;
+};
+
+// Heat pump, one compressor for both directions so runs and rests are longer
+struct HeatPumpThermostatConfig
+{
+  static constexpr double setpointMinimum = 18;
+  static constexpr double setpointMaximum = 32;
+  static constexpr double hysteresis = 1;
+  static constexpr unsigned long stateChangeDelay = 300000;
+  static constexpr unsigned long minimumOnTime = 300000;
+  static constexpr unsigned long minimumOffTime = 300000;
+  static constexpr bool canHeat = true;
+  static constexpr bool canCool = true;
+  static constexpr bool defaultImperial = false;
+};
+
+template <typename Config>
+struct ThermostatConfigCheck
+{
+  static_assert(Config::setpointMinimum >= ABSOLUTE_MINIMUM_SETPOINT, "setpointMinimum is below ABSOLUTE_MINIMUM_SETPOINT");
+  static_assert(Config::setpointMaximum <= ABSOLUTE_MAXIMUM_SETPOINT, "setpointMaximum is above ABSOLUTE_MAXIMUM_SETPOINT");
+  static_assert(Config::setpointMaximum - Config::setpointMinimum >= MINIMUM_SETPOINT_RANGE, "setpoint limits are closer than MINIMUM_SETPOINT_RANGE");
+  static_assert(Config::hysteresis > 0 && 2 * Config::hysteresis < Config::setpointMaximum - Config::setpointMinimum, "hysteresis does not fit the setpoint range");
+  static_assert(Config::minimumOnTime > 0 && Config::minimumOffTime > 0, "minimum run and rest times must be set");
+  static_assert(Config::canHeat || Config::canCool, "a thermostat must be able to heat or cool");
+
+  static constexpr bool valid = true;
+};
+
+static_assert(ThermostatConfigCheck<DefaultThermostatConfig>::valid, "");
+static_assert(ThermostatConfigCheck<HeatOnlyThermostatConfig>::valid, "");
+static_assert(ThermostatConfigCheck<HeatPumpThermostatConfig>::valid, "");
+
+typedef THERMOSTAT_CONFIG ThermostatConfig;
+static_assert(ThermostatConfigCheck<ThermostatConfig>::valid, "");
+
+#endif
@@ -1,320 +1,1428 @@
-#include <unordered_map>
-#include <string>
-
 #include <WiFi.h>
-#include <WiFiClient.h>
-#include <WebServer.h>
 #include <ESPmDNS.h>
 
+#include "BinaryWriter.h"
+#include "History.h"
+#include "HttpServer.h"
+#include "JsonWriter.h"
+#include "Metrics.h"
+#include "RemoteSensors.h"
+#include "RequestArgs.h"
+#include "Scheduler.h"
+#include "Snapshot.h"
 #include "Temperature.h"
 #include "Thermostat.h"
 
+// ====== Response Settings ======
+// Largest response body, responses that do not fit are answered with 500
+#ifndef WEB_RESPONSE_BUFFER_SIZE
+#define WEB_RESPONSE_BUFFER_SIZE 512
+#endif
+
+// Largest memoized status document
+#ifndef WEB_STATUS_CACHE_SIZE
+#define WEB_STATUS_CACHE_SIZE 256
+#endif
+
+// ====== Binary Telemetry ======
+// Served instead of JSON when the Accept header lists it. Every document starts with
+// [u16 magic][u8 version][u8 type][u8 flags], fields are little endian, temperatures are
+// hundredths of a degree and humidity hundredths of a percent.
+#define WEB_BINARY_CONTENT_TYPE "application/vnd.openthermostat"
+#define WEB_BINARY_MAGIC 0x544F
+#define WEB_BINARY_VERSION 2
+
+#define WEB_BINARY_FLAG_IMPERIAL 0x01
+
+// Document types
+#define WEB_BINARY_STATUS 1
+#define WEB_BINARY_HISTORY_RAW 2
+#define WEB_BINARY_HISTORY_MINUTE 3
+#define WEB_BINARY_HISTORY_QUARTER 4
+#define WEB_BINARY_HISTORY_TRANSITIONS 5
+
+// ====== Event Stream Settings ======
+// Clients held open on /events, kept below HTTP_SERVER_MAX_CONNECTIONS so requests can still be served
+#ifndef WEB_EVENT_MAX_SUBSCRIBERS
+#define WEB_EVENT_MAX_SUBSCRIBERS 3
+#endif
+
+// Smallest change pushed to subscribers
+#ifndef WEB_EVENT_TEMPERATURE_THRESHOLD
+#define WEB_EVENT_TEMPERATURE_THRESHOLD 0.1
+#endif
+#ifndef WEB_EVENT_HUMIDITY_THRESHOLD
+#define WEB_EVENT_HUMIDITY_THRESHOLD 1.0
+#endif
+// Confidence decays a step between sensor samples and recovers with each one, only larger moves are pushed
+#ifndef WEB_EVENT_CONFIDENCE_THRESHOLD
+#define WEB_EVENT_CONFIDENCE_THRESHOLD 25
+#endif
+
+#define WEB_EVENT_CHECK_PERIOD 250
+// Comment sent when nothing changed so closed connections are noticed
+#define WEB_EVENT_HEARTBEAT_PERIOD 15000
+
 class WebService
 {
 private:
-  WebServer *server;
+  HttpServer *server;
 
   PersistentStorage *storage;
   Thermostat *thermostat;
+  History *history;
 
-  double currentTemperature;
-  double currentHumidity;
+  // Status served to clients, versioned so its renderings are only redone after a change
+  ThermostatStatus status;
+  uint32_t statusVersion;
+  uint32_t controlStatusVersion;
 
-  double remoteTemperature;
+  // Rendered status document and the status version and zone it was rendered from
+  struct CachedDocument
+  {
+    uint32_t version;
+    uint8_t zone;
+    uint16_t length;
+    char data[WEB_STATUS_CACHE_SIZE];
+  };
+
+  // Indexed by [binary][imperial]
+  CachedDocument statusCache[2][2];
+
+  // Readings of every remote source, only touched by request handlers and update
+  RemoteSensorTable remoteSensors;
+  // Aggregate of each zone's remote sources, written by request handlers, read by the control task
+  Snapshot<SensorReading> remoteTemperature[THERMOSTAT_ZONE_COUNT];
+
+  // Reused for every response body
+  char responseBuffer[WEB_RESPONSE_BUFFER_SIZE];
+  JsonWriter json;
+  BinaryWriter binary;
+
+  // ====== Event Stream ======
+  enum EventField
+  {
+    EVENT_TEMPERATURE = 1 << 0,
+    EVENT_HUMIDITY = 1 << 1,
+    EVENT_SETPOINT_LOW = 1 << 2,
+    EVENT_SETPOINT_HIGH = 1 << 3,
+    EVENT_MODE = 1 << 4,
+    EVENT_STATE = 1 << 5,
+    EVENT_CONFIDENCE = 1 << 6
+  };
+
+  struct EventSubscriber
+  {
+    int32_t stream;
+    uint8_t zone;
+    bool imperial;
+  };
 
-  String getArgValue(String argName, bool ignoreCase = false)
+  // Values as last pushed to subscribers, in Celsius
+  struct EventValues
   {
-    for (uint8_t i = 0; i < server->args(); i++)
-    {
-      String name = server->argName(i);
+    Temperature temperature;
+    uint8_t confidence;
+    double humidity;
+    Temperature setpointLow;
+    Temperature setpointHigh;
+    Thermostat::ThermostatMode mode;
+    Thermostat::ThermostatState state;
+  };
+
+  EventSubscriber subscribers[WEB_EVENT_MAX_SUBSCRIBERS];
+  EventValues published[THERMOSTAT_ZONE_COUNT];
+
+  unsigned long lastEventCheckTime;
+  unsigned long lastHeartbeatTime;
+
+  // ====== Response Documents ======
+  // Members of the status document, written by StatusDocument::writeValue
+  enum StatusValue
+  {
+    STATUS_TEMPERATURE,
+    STATUS_CONFIDENCE,
+    STATUS_HUMIDITY,
+    STATUS_SETPOINT_LOW,
+    STATUS_SETPOINT_HIGH,
+    STATUS_MODE_DESCRIPTION,
+    STATUS_MODE_VALUE,
+    STATUS_STATE_DESCRIPTION,
+    STATUS_STATE_VALUE
+  };
+
+  // Selected by the event fields, so change events are the status document restricted to what changed
+  static constexpr JsonField statusSchema[] = {
+      {JSON_FIELD_OBJECT, "environment", 0, 0},
+      {JSON_FIELD_VALUE, "temperature", STATUS_TEMPERATURE, EVENT_TEMPERATURE},
+      {JSON_FIELD_VALUE, "confidence", STATUS_CONFIDENCE, EVENT_CONFIDENCE},
+      {JSON_FIELD_VALUE, "humidity", STATUS_HUMIDITY, EVENT_HUMIDITY},
+      {JSON_FIELD_END, NULL, 0, 0},
+      {JSON_FIELD_OBJECT, "thermostat", 0, 0},
+      {JSON_FIELD_VALUE, "setpoint_low", STATUS_SETPOINT_LOW, EVENT_SETPOINT_LOW},
+      {JSON_FIELD_VALUE, "setpoint_high", STATUS_SETPOINT_HIGH, EVENT_SETPOINT_HIGH},
+      {JSON_FIELD_OBJECT, "mode", 0, 0},
+      {JSON_FIELD_VALUE, "description", STATUS_MODE_DESCRIPTION, EVENT_MODE},
+      {JSON_FIELD_VALUE, "value", STATUS_MODE_VALUE, EVENT_MODE},
+      {JSON_FIELD_END, NULL, 0, 0},
+      {JSON_FIELD_OBJECT, "state", 0, 0},
+      {JSON_FIELD_VALUE, "description", STATUS_STATE_DESCRIPTION, EVENT_STATE},
+      {JSON_FIELD_VALUE, "value", STATUS_STATE_VALUE, EVENT_STATE},
+      {JSON_FIELD_END, NULL, 0, 0},
+      {JSON_FIELD_END, NULL, 0, 0}};
+
+  struct StatusDocument
+  {
+    const EventValues *values;
+    bool useImperialUnits;
 
-      if (ignoreCase)
+    void writeValue(JsonWriter *json, uint8_t value) const
+    {
+      switch (value)
       {
-        name.toLowerCase();
-        argName.toLowerCase();
+      case STATUS_TEMPERATURE:
+        json->value(values->temperature.toUnits(useImperialUnits));
+        break;
+      case STATUS_CONFIDENCE:
+        json->value((int)values->confidence);
+        break;
+      case STATUS_HUMIDITY:
+        json->value(values->humidity);
+        break;
+      case STATUS_SETPOINT_LOW:
+        json->value(values->setpointLow.toUnits(useImperialUnits));
+        break;
+      case STATUS_SETPOINT_HIGH:
+        json->value(values->setpointHigh.toUnits(useImperialUnits));
+        break;
+      case STATUS_MODE_DESCRIPTION:
+        json->value(Thermostat::getModeName(values->mode).c_str());
+        break;
+      case STATUS_MODE_VALUE:
+        json->value((int)values->mode);
+        break;
+      case STATUS_STATE_DESCRIPTION:
+        json->value(Thermostat::getStateName(values->state).c_str());
+        break;
+      case STATUS_STATE_VALUE:
+        json->value((int)values->state);
+        break;
       }
+    }
+  };
+
+  enum SettingsValue
+  {
+    SETTINGS_SCREEN_IMPERIAL,
+    SETTINGS_USE_REMOTE_TEMPERATURE,
+    SETTINGS_CONTROL_STRATEGY
+  };
+
+  static constexpr JsonField settingsSchema[] = {
+      {JSON_FIELD_VALUE, "screenImperial", SETTINGS_SCREEN_IMPERIAL, JSON_SELECT_ALL},
+      {JSON_FIELD_VALUE, "useRemoteTemperature", SETTINGS_USE_REMOTE_TEMPERATURE, JSON_SELECT_ALL},
+      {JSON_FIELD_VALUE, "controlStrategy", SETTINGS_CONTROL_STRATEGY, JSON_SELECT_ALL}};
+
+  struct SettingsDocument
+  {
+    WebService *service;
 
-      if (name == argName)
+    void writeValue(JsonWriter *json, uint8_t value) const
+    {
+      switch (value)
       {
-        return server->arg(i);
+      case SETTINGS_SCREEN_IMPERIAL:
+        json->value(service->storage->getSettingScreenImperial());
+        break;
+      case SETTINGS_USE_REMOTE_TEMPERATURE:
+        json->value(service->storage->getSettingUseRemoteTemperature());
+        break;
+      case SETTINGS_CONTROL_STRATEGY:
+        json->value(Thermostat::getControlStrategyName(service->thermostat->getControlStrategy()));
+        break;
       }
     }
+  };
 
-    return "";
+  // Status values of a zone, in Celsius
+  EventValues statusValues(uint8_t zone)
+  {
+    EventValues values;
+    values.temperature = status.temperature[zone];
+    values.confidence = status.confidence[zone];
+    values.humidity = status.humidity;
+    values.setpointLow = status.setpointLow[zone];
+    values.setpointHigh = status.setpointHigh[zone];
+    values.mode = status.mode;
+    values.state = status.state[zone];
+    return values;
   }
 
-  String statusJSON(bool useImperialUnits = false)
+  JsonWriter *statusJSON(uint8_t zone, bool useImperialUnits = false)
   {
-    double temperature = currentTemperature;
-    double setpoint_low = thermostat->getSetpointLow();
-    double setpoint_high = thermostat->getSetpointHigh();
+    EventValues values = statusValues(zone);
+    StatusDocument document = {&values, useImperialUnits};
 
-    if (useImperialUnits)
-    {
-      temperature = celsiusToFahrenheit(temperature);
-      setpoint_low = celsiusToFahrenheit(setpoint_low);
-      setpoint_high = celsiusToFahrenheit(setpoint_high);
-    }
+    json.reset();
+    json.document(statusSchema, JSON_SELECT_ALL, document);
+    return &json;
+  }
 
-    char temp[400];
-    //Note: Workaround for error when inserting mode and state descriptions with printf
-    String json = "{ \"environment\": { \"temperature\": %0.2f, \"humidity\": %0.2f }, \"thermostat\": { \"setpoint_low\": %0.2f, \"setpoint_high\": %0.2f, \"mode\": { \"description\": \"" + thermostat->getModeString() + "\", \"value\": %d }, \"state\": { \"description\": \"" + thermostat->getStateString() + "\", \"value\": %d } } }";
-    sprintf(temp,
-            json.c_str(),
-            temperature, currentHumidity, setpoint_low, setpoint_high, thermostat->getMode(), thermostat->getState());
+  // Same fields as statusJSON: [i16 temperature][u16 humidity][i16 setpoint_low][i16 setpoint_high][u8 mode][u8 state][u8 confidence]
+  BinaryWriter *statusBinary(uint8_t zone, bool useImperialUnits = false)
+  {
+    binary.reset();
+    binaryHeader(&binary, WEB_BINARY_STATUS, useImperialUnits);
+    binary.temperature(status.temperature[zone], useImperialUnits);
+    binary.humidity(status.humidity);
+    binary.temperature(status.setpointLow[zone], useImperialUnits);
+    binary.temperature(status.setpointHigh[zone], useImperialUnits);
+    binary.u8(status.mode);
+    binary.u8(status.state[zone]);
+    binary.u8(status.confidence[zone]);
+    return &binary;
+  }
 
-    return String(temp);
+  static void binaryHeader(BinaryWriter *writer, uint8_t type, bool useImperialUnits)
+  {
+    writer->u16(WEB_BINARY_MAGIC);
+    writer->u8(WEB_BINARY_VERSION);
+    writer->u8(type);
+    writer->u8(useImperialUnits ? WEB_BINARY_FLAG_IMPERIAL : 0);
   }
 
-  String settingsJSON()
+  JsonWriter *settingsJSON()
   {
-    char temp[400];
-    snprintf(temp, 400,
-             "{ \"screenImperial\": %s, \"useRemoteTemperature\": %s }",
-             storage->getSettingScreenImperial() ? "true" : "false", storage->getSettingUseRemoteTemperature() ? "true" : "false");
+    SettingsDocument document = {this};
 
-    return String(temp);
+    json.reset();
+    json.document(settingsSchema, JSON_SELECT_ALL, document);
+    return &json;
   }
 
-  void handleRoot()
+  // Only the members in fields, with the same layout as statusJSON so clients can merge it into the last status
+  JsonWriter *deltaJSON(uint8_t zone, uint8_t fields, bool useImperialUnits)
   {
-    //Get url params
-    String units = getArgValue("units", true);
+    StatusDocument document = {&published[zone], useImperialUnits};
+
+    json.reset();
+    json.document(statusSchema, fields, document);
+    return &json;
+  }
 
-    bool useImperialUnits = false;
-    if (units.length() > 0)
+  // Send a document straight from the response buffer
+  void send(int code, JsonWriter *document)
+  {
+    if (document->hasOverflowed())
     {
-      units.toLowerCase();
+      server->send(500, "text/plain", "Response too large");
+      return;
+    }
 
-      if (units.equals("imperial"))
+    server->send(code, "application/json", document->c_str(), document->size());
+  }
+
+  // Send the status in the encoding the client accepts, rendering it only if it changed since the last request
+  void sendStatus(int code, uint8_t zone, bool useImperialUnits)
+  {
+    bool useBinary = server->accepts(WEB_BINARY_CONTENT_TYPE);
+    CachedDocument *cached = &statusCache[useBinary][useImperialUnits];
+
+    if (cached->version != statusVersion || cached->zone != zone)
+    {
+      const char *data;
+      size_t length;
+      bool overflow;
+      if (useBinary)
       {
-        useImperialUnits = true;
+        BinaryWriter *document = statusBinary(zone, useImperialUnits);
+        data = (const char *)document->data();
+        length = document->size();
+        overflow = document->hasOverflowed();
       }
+      else
+      {
+        JsonWriter *document = statusJSON(zone, useImperialUnits);
+        data = document->c_str();
+        length = document->size();
+        overflow = document->hasOverflowed();
+      }
+
+      if (overflow || length > sizeof(cached->data))
+      {
+        server->send(500, "text/plain", "Response too large");
+        return;
+      }
+
+      memcpy(cached->data, data, length);
+      cached->length = length;
+      cached->version = statusVersion;
+      cached->zone = zone;
     }
 
-    server->send(200, "application/json", statusJSON(useImperialUnits));
+    server->send(code, useBinary ? WEB_BINARY_CONTENT_TYPE : "application/json", cached->data, cached->length);
+  }
+
+  // Adopt a new status, invalidating the cached renderings if anything changed
+  void setStatus(const ThermostatStatus &newStatus)
+  {
+    if (!newStatus.equals(status))
+    {
+      status = newStatus;
+      statusVersion++;
+    }
+  }
+
+  // Pick up settings changed by a request before the control task publishes them
+  void refreshStatus(uint8_t zone)
+  {
+    ThermostatStatus newStatus = status;
+    newStatus.setpointLow[zone] = thermostat->getSetpointLow(zone);
+    newStatus.setpointHigh[zone] = thermostat->getSetpointHigh(zone);
+    newStatus.mode = thermostat->getMode();
+    setStatus(newStatus);
+  }
+
+  // zone=<index> selects the zone a request applies to, the first zone when missing.
+  // Answers 400 and returns false for an index outside the configured zones.
+  bool getZone(RequestArgs &args, uint8_t *zone)
+  {
+    long value = 0;
+    if (args.getLong("zone", 0, THERMOSTAT_ZONE_COUNT - 1, &value) == ARG_INVALID)
+    {
+      server->send(400, "text/plain", "Unknown zone");
+      return false;
+    }
+
+    *zone = value;
+    return true;
+  }
+
+  void handleRoot()
+  {
+    RequestArgs &args = server->args();
+
+    uint8_t zone;
+    if (!getZone(args, &zone))
+    {
+      return;
+    }
+
+    sendStatus(200, zone, args.useImperialUnits());
   }
 
   void handleMode()
   {
-    //Get url params
-    String units = getArgValue("units", true);
+    RequestArgs &args = server->args();
+    bool useImperialUnits = args.useImperialUnits();
 
-    bool useImperialUnits = false;
-    if (units.length() > 0)
+    // The mode is shared by all zones, zone only selects the status returned
+    uint8_t zone;
+    if (!getZone(args, &zone))
     {
-      units.toLowerCase();
+      return;
+    }
+
+    if (server->method() == HttpServer::POST || server->method() == HttpServer::PUT)
+    {
+      static const ArgEnumValue<Thermostat::ThermostatMode> modes[] = {
+          {"off", Thermostat::ThermostatMode::OFF},
+          {"heat", Thermostat::ThermostatMode::HEAT},
+          {"cool", Thermostat::ThermostatMode::COOL},
+          {"auto", Thermostat::ThermostatMode::AUTOMATIC},
+          {"fan-only", Thermostat::ThermostatMode::FAN_ONLY}};
 
-      if (units.equals("imperial"))
+      //Make sure required params are included and valid
+      Thermostat::ThermostatMode mode;
+      if (args.getEnum("mode", modes, &mode) != ARG_OK)
       {
-        useImperialUnits = true;
+        sendStatus(400, zone, useImperialUnits);
+        return;
       }
+
+      //Update mode, modes the equipment cannot run are rejected
+      if (!thermostat->setMode(mode))
+      {
+        sendStatus(400, zone, useImperialUnits);
+        return;
+      }
+      refreshStatus(zone);
+
+      //return response
+      sendStatus(200, zone, useImperialUnits);
+      return;
+    }
+
+    sendStatus(405, zone, useImperialUnits);
+  }
+
+  void handleSetpoint()
+  {
+    RequestArgs &args = server->args();
+    bool useImperialUnits = args.useImperialUnits();
+
+    uint8_t zone;
+    if (!getZone(args, &zone))
+    {
+      return;
     }
 
-    if (server->method() == HTTP_POST || server->method() == HTTP_PUT)
+    if (server->method() == HttpServer::POST || server->method() == HttpServer::PUT)
     {
-      //Get url params
-      String modeStr = getArgValue("mode", true);
+      double setpointLow;
+      ArgStatus lowStatus = args.getDouble("low", &setpointLow);
+      double setpointHigh;
+      ArgStatus highStatus = args.getDouble("high", &setpointHigh);
 
-      //Make sure required params are included
-      if (modeStr.length() <= 0)
+      //Reject the whole request if either value is malformed
+      if (lowStatus == ARG_INVALID || highStatus == ARG_INVALID)
       {
-        server->send(400, "application/json", statusJSON(useImperialUnits));
+        sendStatus(400, zone, useImperialUnits);
         return;
       }
 
-      modeStr.toLowerCase();
+      bool success = true;
 
-      static std::unordered_map<std::string, Thermostat::ThermostatMode> const table = {
-          {"off", Thermostat::ThermostatMode::OFF},
-          {"heat", Thermostat::ThermostatMode::HEAT},
-          {"cool", Thermostat::ThermostatMode::COOL},
-          {"auto", Thermostat::ThermostatMode::AUTOMATIC},
-          {"fan-only", Thermostat::ThermostatMode::FAN_ONLY}};
+      //Setpoint lower limit
+      if (lowStatus == ARG_OK)
+      {
+        success = thermostat->setSetpointLow(Temperature::fromUnits(setpointLow, useImperialUnits), zone) && success;
+      }
 
-      auto modeFind = table.find(modeStr.c_str());
-      if (modeFind != table.end())
+      //setpoint upper limit
+      if (highStatus == ARG_OK)
       {
-        //Get mode from table
-        Thermostat::ThermostatMode mode = modeFind->second;
+        success = thermostat->setSetpointHigh(Temperature::fromUnits(setpointHigh, useImperialUnits), zone) && success;
+      }
 
-        //Update mode
-        thermostat->setMode(mode);
+      refreshStatus(zone);
 
-        //return response
-        server->send(200, "application/json", statusJSON(useImperialUnits));
+      //return response
+      if (success)
+      {
+        sendStatus(200, zone, useImperialUnits);
       }
       else
       {
-        //return response
-        server->send(400, "application/json", statusJSON(useImperialUnits));
+        sendStatus(400, zone, useImperialUnits);
       }
 
       return;
     }
 
-    server->send(405, "application/json", statusJSON(useImperialUnits));
+    sendStatus(405, zone, useImperialUnits);
   }
 
-  void handleSetpoint()
+  // ====== Remote Sensors ======
+  // [[source, zone, temperature], ...] with an optional weight after the temperature, alone or as the
+  // "readings" member of an object. Sources are plain strings without escapes. False if any reading is
+  // malformed or implausible.
+  static bool parseReadings(const char *text, bool useImperialUnits, RemoteSensorReading *readings, uint8_t *count)
   {
-    //Get url params
-    String units = getArgValue("units", true);
+    const char *member = strstr(text, "\"readings\"");
+    const char *c = strchr(member != NULL ? member : text, '[');
+    if (c == NULL)
+    {
+      return false;
+    }
+
+    *count = 0;
+    c = skipSpace(c + 1);
+    if (*c == ']')
+    {
+      return true;
+    }
 
-    bool useImperialUnits = false;
-    if (units.length() > 0)
+    for (;;)
     {
-      units.toLowerCase();
+      if (*c != '[' || *count >= REMOTE_SENSOR_CAPACITY)
+      {
+        return false;
+      }
+      RemoteSensorReading &reading = readings[(*count)++];
 
-      if (units.equals("imperial"))
+      c = skipSpace(c + 1);
+      if (*c != '"')
       {
-        useImperialUnits = true;
+        return false;
       }
+      const char *end = strchr(c + 1, '"');
+      if (end == NULL || end - c - 1 >= REMOTE_SENSOR_ID_SIZE || memchr(c + 1, '\\', end - c - 1) != NULL)
+      {
+        return false;
+      }
+      memcpy(reading.source, c + 1, end - c - 1);
+      reading.source[end - c - 1] = '\0';
+      c = skipSpace(end + 1);
+
+      // zone, temperature and the optional weight
+      double values[3];
+      uint8_t parsed = 0;
+      while (*c == ',' && parsed < 3)
+      {
+        char *number;
+        values[parsed] = strtod(c + 1, &number);
+        if (number == c + 1)
+        {
+          return false;
+        }
+        parsed++;
+        c = skipSpace(number);
+      }
+      if (*c != ']' || parsed < 2)
+      {
+        return false;
+      }
+      c = skipSpace(c + 1);
+
+      if (parsed < 3)
+      {
+        values[2] = REMOTE_SENSOR_DEFAULT_WEIGHT;
+      }
+      if (!(values[0] >= 0 && values[0] < THERMOSTAT_ZONE_COUNT && values[0] == floor(values[0])) ||
+          !(values[2] >= 1 && values[2] <= REMOTE_SENSOR_MAX_WEIGHT && values[2] == floor(values[2])) ||
+          isnan(values[1]) || isinf(values[1]))
+      {
+        return false;
+      }
+      reading.zone = values[0];
+      reading.temperature = Temperature::fromUnits(values[1], useImperialUnits);
+      reading.weight = values[2];
+      if (!RemoteSensorTable::isPlausible(reading.temperature))
+      {
+        return false;
+      }
+
+      if (*c == ']')
+      {
+        return true;
+      }
+      if (*c != ',')
+      {
+        return false;
+      }
+      c = skipSpace(c + 1);
     }
+  }
 
-    if (server->method() == HTTP_POST || server->method() == HTTP_PUT)
+  // Hand the zone's aggregate to the control task, and show it until the control task publishes again
+  void publishRemoteReading(uint8_t zone, ThermostatStatus *newStatus)
+  {
+    SensorReading reading = remoteSensors.read(zone);
+    remoteTemperature[zone].write(reading);
+    if (reading.temperature.isValid())
     {
-      bool success = true;
+      newStatus->temperature[zone] = reading.temperature;
+    }
+  }
+
+  // POST temperature=[&source=][&weight=] records one reading of a source in the zone, a body of
+  // readings without a temperature argument records a batch. aggregate=mean|minimum|maximum|designated
+  // selects how the zone combines its sources, designated follows the source named by source.
+  void handleTemperature()
+  {
+    RequestArgs &args = server->args();
+    bool useImperialUnits = args.useImperialUnits();
 
-      //Get url params
-      double setpointLow = 0;
-      String setpointLowStr = getArgValue("low", true);
-      double setpointHigh = 0;
-      String setpointHighStr = getArgValue("high", true);
+    uint8_t zone;
+    if (!getZone(args, &zone))
+    {
+      return;
+    }
 
-      //Setpoint lower limit
-      if (setpointLowStr.length() > 0)
+    if (server->method() == HttpServer::POST || server->method() == HttpServer::PUT)
+    {
+      static const ArgEnumValue<RemoteAggregate> aggregates[] = {
+          {"mean", REMOTE_AGGREGATE_MEAN},
+          {"minimum", REMOTE_AGGREGATE_MINIMUM},
+          {"maximum", REMOTE_AGGREGATE_MAXIMUM},
+          {"designated", REMOTE_AGGREGATE_DESIGNATED}};
+
+      RemoteAggregate aggregate;
+      ArgStatus aggregateStatus = args.getEnum("aggregate", aggregates, &aggregate);
+      const char *source = args.has("source") ? args.get("source") : "";
+      if (aggregateStatus == ARG_INVALID || strlen(source) >= REMOTE_SENSOR_ID_SIZE)
       {
-        // Convert argument to integer
-        // Note: cast to int returns 0 if invalid
-        setpointLow = setpointLowStr.toDouble();
+        sendStatus(400, zone, useImperialUnits);
+        return;
+      }
 
-        if (setpointLow != 0)
+      RemoteSensorReading readings[REMOTE_SENSOR_CAPACITY];
+      uint8_t count = 0;
+      if (args.has("temperature"))
+      {
+        double temperature;
+        long weight = REMOTE_SENSOR_DEFAULT_WEIGHT;
+        if (args.getDouble("temperature", &temperature) != ARG_OK ||
+            args.getLong("weight", 1, REMOTE_SENSOR_MAX_WEIGHT, &weight) == ARG_INVALID ||
+            !RemoteSensorTable::isPlausible(Temperature::fromUnits(temperature, useImperialUnits)))
         {
-          if (useImperialUnits)
-          {
-            setpointLow = fahrenheitToCelsius(setpointLow);
-          }
-
-          success = thermostat->setSetpointLow(setpointLow);
+          //Bad request
+          sendStatus(400, zone, useImperialUnits);
+          return;
         }
-      }
 
-      //setpoint upper limit
-      if (setpointHighStr.length() > 0)
+        strcpy(readings[0].source, source);
+        readings[0].zone = zone;
+        readings[0].temperature = Temperature::fromUnits(temperature, useImperialUnits);
+        readings[0].weight = weight;
+        count = 1;
+      }
+      else if (aggregateStatus == ARG_MISSING && !parseReadings(server->body(), useImperialUnits, readings, &count))
       {
-        // Convert argument to integer
-        // Note: cast to int returns 0 if invalid
-        setpointHigh = setpointHighStr.toDouble();
+        //Bad request
+        sendStatus(400, zone, useImperialUnits);
+        return;
+      }
 
-        if (setpointHigh != 0)
+      //Update remote temperatures, readings before a refused one are kept
+      unsigned long now = millis();
+      bool touched[THERMOSTAT_ZONE_COUNT] = {false};
+      if (aggregateStatus == ARG_OK)
+      {
+        remoteSensors.setAggregate(zone, aggregate, source, now);
+        touched[zone] = true;
+      }
+      bool stored = true;
+      for (uint8_t i = 0; stored && i < count; i++)
+      {
+        // A source that moves leaves its previous zone's aggregate
+        int8_t previousZone = remoteSensors.getZone(readings[i].source);
+        if (previousZone != REMOTE_SENSOR_NONE)
         {
-          if (useImperialUnits)
-          {
-            setpointHigh = fahrenheitToCelsius(setpointHigh);
-          }
+          touched[previousZone] = true;
+        }
+        stored = remoteSensors.update(readings[i], now);
+        touched[readings[i].zone] = true;
+      }
 
-          success = thermostat->setSetpointHigh(setpointHigh);
+      ThermostatStatus newStatus = status;
+      for (uint8_t z = 0; z < THERMOSTAT_ZONE_COUNT; z++)
+      {
+        if (touched[z])
+        {
+          publishRemoteReading(z, &newStatus);
         }
       }
+      setStatus(newStatus);
 
-      //return response
-      if (success)
+      // Every source slot holds a live source
+      sendStatus(stored ? 200 : 503, zone, useImperialUnits);
+      return;
+    }
+
+    //Method not allowed
+    sendStatus(405, zone, useImperialUnits);
+  }
+
+  void handleSettings()
+  {
+    if (server->method() == HttpServer::GET)
+    {
+      send(200, settingsJSON());
+      return;
+    }
+    else if (server->method() == HttpServer::POST || server->method() == HttpServer::PUT)
+    {
+      RequestArgs &args = server->args();
+
+      bool screenImperial;
+      ArgStatus screenImperialStatus = args.getBool("screenImperial", &screenImperial);
+      bool useRemoteTemperature;
+      ArgStatus useRemoteTemperatureStatus = args.getBool("useRemoteTemperature", &useRemoteTemperature);
+
+      static const ArgEnumValue<Thermostat::ControlStrategy> strategies[] = {
+          {"hysteresis", Thermostat::ControlStrategy::STRATEGY_HYSTERESIS},
+          {"pid", Thermostat::ControlStrategy::STRATEGY_PID}};
+      Thermostat::ControlStrategy controlStrategy;
+      ArgStatus controlStrategyStatus = args.getEnum("controlStrategy", strategies, &controlStrategy);
+
+      if (screenImperialStatus == ARG_INVALID || useRemoteTemperatureStatus == ARG_INVALID || controlStrategyStatus == ARG_INVALID)
       {
-        server->send(200, "application/json", statusJSON(useImperialUnits));
+        send(400, settingsJSON());
+        return;
       }
-      else
+
+      //Update storage with the settings that were included
+      if (screenImperialStatus == ARG_OK)
       {
-        server->send(400, "application/json", statusJSON(useImperialUnits));
+        storage->setSettingScreenImperial(screenImperial);
+      }
+      if (useRemoteTemperatureStatus == ARG_OK)
+      {
+        storage->setSettingUseRemoteTemperature(useRemoteTemperature);
+      }
+      if (controlStrategyStatus == ARG_OK)
+      {
+        thermostat->setControlStrategy(controlStrategy);
       }
 
+      send(200, settingsJSON());
       return;
     }
 
-    server->send(405, "application/json", statusJSON(useImperialUnits));
+    //Method not allowed
+    send(405, settingsJSON());
   }
 
-  void handleTemperature()
+  // Server-Sent Events stream, a full "status" event followed by "change" events holding only what changed
+  void handleEvents()
   {
-    //Get url params
-    String units = getArgValue("units", true);
+    RequestArgs &args = server->args();
+    bool useImperialUnits = args.useImperialUnits();
 
-    bool useImperialUnits = false;
-    if (units.length() > 0)
+    uint8_t zone;
+    if (!getZone(args, &zone))
     {
-      units.toLowerCase();
+      return;
+    }
+
+    if (server->method() != HttpServer::GET)
+    {
+      sendStatus(405, zone, useImperialUnits);
+      return;
+    }
 
-      if (units.equals("imperial"))
+    EventSubscriber *subscriber = NULL;
+    for (uint8_t i = 0; i < WEB_EVENT_MAX_SUBSCRIBERS; i++)
+    {
+      if (!server->isStreamOpen(subscribers[i].stream))
       {
-        useImperialUnits = true;
+        subscriber = &subscribers[i];
+        break;
       }
     }
+    if (subscriber == NULL)
+    {
+      server->send(503, "text/plain", "Too many subscribers");
+      return;
+    }
+
+    // Bring existing subscribers up to date so the new subscriber's status is the common baseline
+    publishChanges();
+
+    subscriber->stream = server->beginStream("text/event-stream");
+    subscriber->zone = zone;
+    subscriber->imperial = useImperialUnits;
+    sendEvent(subscriber, "status", statusJSON(zone, useImperialUnits));
+  }
+
+  static bool changed(Temperature previous, Temperature current, Temperature threshold)
+  {
+    if (!previous.isValid() || !current.isValid())
+    {
+      return previous.isValid() != current.isValid();
+    }
+    return current - previous >= threshold || previous - current >= threshold;
+  }
 
-    if (server->method() == HTTP_POST || server->method() == HTTP_PUT)
+  // Losing or regaining every source is always a change
+  static bool changed(uint8_t previous, uint8_t current, uint8_t threshold)
+  {
+    if (previous == 0 || current == 0)
     {
-      String temperatureStr = getArgValue("temperature", true);
+      return previous != current;
+    }
+    return current >= previous + threshold || previous >= current + threshold;
+  }
 
-      if (temperatureStr.length() <= 0)
+  static bool changed(double previous, double current, double threshold)
+  {
+    if (isnan(previous) || isnan(current))
+    {
+      return isnan(previous) != isnan(current);
+    }
+    return fabs(current - previous) >= threshold;
+  }
+
+  void sendEvent(EventSubscriber *subscriber, const char *event, JsonWriter *document)
+  {
+    if (document->hasOverflowed())
+    {
+      return;
+    }
+
+    char prefix[32];
+    int prefixLength = snprintf(prefix, sizeof(prefix), "event: %s\ndata: ", event);
+
+    if (!server->writeStream(subscriber->stream, prefix, prefixLength) ||
+        !server->writeStream(subscriber->stream, document->c_str(), document->size()) ||
+        !server->writeStream(subscriber->stream, "\n\n", 2))
+    {
+      subscriber->stream = HTTP_SERVER_INVALID_STREAM;
+    }
+  }
+
+  // Push a change event to every subscriber of a zone where any value moved past its threshold
+  void publishChanges()
+  {
+    for (uint8_t zone = 0; zone < THERMOSTAT_ZONE_COUNT; zone++)
+    {
+      publishChanges(zone);
+    }
+  }
+
+  void publishChanges(uint8_t zone)
+  {
+    EventValues &published = this->published[zone];
+
+    EventValues current = statusValues(zone);
+
+    // Only the changed fields move the baseline, so slow drifts still add up to an event
+    uint8_t fields = 0;
+    if (changed(published.temperature, current.temperature, Temperature::fromCelsius(WEB_EVENT_TEMPERATURE_THRESHOLD)))
+    {
+      fields |= EVENT_TEMPERATURE;
+      published.temperature = current.temperature;
+    }
+    if (changed(published.confidence, current.confidence, WEB_EVENT_CONFIDENCE_THRESHOLD))
+    {
+      fields |= EVENT_CONFIDENCE;
+      published.confidence = current.confidence;
+    }
+    if (changed(published.humidity, current.humidity, WEB_EVENT_HUMIDITY_THRESHOLD))
+    {
+      fields |= EVENT_HUMIDITY;
+      published.humidity = current.humidity;
+    }
+    if (published.setpointLow != current.setpointLow)
+    {
+      fields |= EVENT_SETPOINT_LOW;
+      published.setpointLow = current.setpointLow;
+    }
+    if (published.setpointHigh != current.setpointHigh)
+    {
+      fields |= EVENT_SETPOINT_HIGH;
+      published.setpointHigh = current.setpointHigh;
+    }
+    if (published.mode != current.mode)
+    {
+      fields |= EVENT_MODE;
+      published.mode = current.mode;
+    }
+    if (published.state != current.state)
+    {
+      fields |= EVENT_STATE;
+      published.state = current.state;
+    }
+
+    if (fields == 0)
+    {
+      return;
+    }
+
+    // Render each unit system at most once
+    for (uint8_t imperial = 0; imperial < 2; imperial++)
+    {
+      JsonWriter *document = NULL;
+      for (uint8_t i = 0; i < WEB_EVENT_MAX_SUBSCRIBERS; i++)
       {
-        //Bad request
-        server->send(400, "application/json", statusJSON(useImperialUnits));
-        return;
+        if (subscribers[i].zone != zone || subscribers[i].imperial != (bool)imperial || !server->isStreamOpen(subscribers[i].stream))
+        {
+          continue;
+        }
+
+        if (document == NULL)
+        {
+          document = deltaJSON(zone, fields, imperial);
+        }
+        sendEvent(&subscribers[i], "change", document);
       }
+    }
+  }
 
-      double temperature = temperatureStr.toDouble();
-      if (useImperialUnits)
+  void sendHeartbeat()
+  {
+    for (uint8_t i = 0; i < WEB_EVENT_MAX_SUBSCRIBERS; i++)
+    {
+      if (server->isStreamOpen(subscribers[i].stream) && !server->writeStream(subscribers[i].stream, ":\n\n", 3))
       {
-        temperature = fahrenheitToCelsius(temperature);
+        subscribers[i].stream = HTTP_SERVER_INVALID_STREAM;
       }
+    }
+  }
 
-      //TODO check temperature is in a valid range
+  // ====== History ======
+  // Append bytes to the chunk in the response buffer, sending the chunk first if they would not fit
+  bool appendChunk(size_t *length, const char *data, int dataLength)
+  {
+    if (dataLength < 0 || (size_t)dataLength >= sizeof(responseBuffer))
+    {
+      return false;
+    }
 
-      //Update remote temperature
-      remoteTemperature = temperature;
-      currentTemperature = remoteTemperature;
+    if (*length + dataLength > sizeof(responseBuffer))
+    {
+      if (!server->sendChunk(responseBuffer, *length))
+      {
+        return false;
+      }
+      *length = 0;
+    }
+
+    memcpy(responseBuffer + *length, data, dataLength);
+    *length += dataLength;
+    return true;
+  }
 
-      server->send(200, "application/json", statusJSON(useImperialUnits));
+  // JSON: { "uptime", "resolution", "entries": [ ... ] }, entries are [time, temperature, humidity] for raw samples,
+  // [time, min, max, average, humidity] for rollups and [time, state] for transitions.
+  // Binary: header, u32 uptime, then fixed size records in the same order as the JSON entries.
+  // Times are seconds since boot. Streamed in chunks so the size is not bound by the response buffer.
+  void handleHistory()
+  {
+    RequestArgs &args = server->args();
+    bool useImperialUnits = args.useImperialUnits();
+
+    if (server->method() != HttpServer::GET)
+    {
+      sendStatus(405, 0, useImperialUnits);
       return;
     }
 
-    //Method not allowed
-    server->send(405, "application/json", statusJSON(useImperialUnits));
+    enum Resolution
+    {
+      RAW,
+      MINUTE,
+      QUARTER,
+      TRANSITIONS
+    };
+    static const ArgEnumValue<Resolution> resolutions[] = {
+        {"raw", RAW},
+        {"minute", MINUTE},
+        {"quarter", QUARTER},
+        {"transitions", TRANSITIONS}};
+    static const uint8_t binaryTypes[] = {WEB_BINARY_HISTORY_RAW, WEB_BINARY_HISTORY_MINUTE, WEB_BINARY_HISTORY_QUARTER, WEB_BINARY_HISTORY_TRANSITIONS};
+
+    Resolution resolution = MINUTE;
+    double since = 0;
+    if (args.getEnum("resolution", resolutions, &resolution) == ARG_INVALID ||
+        args.getDouble("since", &since) == ARG_INVALID)
+    {
+      server->send(400, "text/plain", "Bad Request");
+      return;
+    }
+
+    bool binary = server->accepts(WEB_BINARY_CONTENT_TYPE);
+    if (!server->beginChunked(200, binary ? WEB_BINARY_CONTENT_TYPE : "application/json"))
+    {
+      return;
+    }
+
+    // One entry at a time, as text or as a binary record
+    char entry[80];
+    BinaryWriter record((uint8_t *)entry, sizeof(entry));
+    size_t length = 0;
+    bool first = true;
+    bool ok;
+
+    if (binary)
+    {
+      binaryHeader(&record, binaryTypes[resolution], useImperialUnits);
+      record.u32(millis() / 1000);
+      ok = appendChunk(&length, entry, record.size());
+    }
+    else
+    {
+      ok = appendChunk(&length, entry, snprintf(entry, sizeof(entry), "{\"uptime\":%lu,\"resolution\":\"%s\",\"entries\":[",
+                                                millis() / 1000, resolutions[resolution].name));
+    }
+
+    if (resolution == RAW)
+    {
+      HistoryRawIterator iterator;
+      HistorySample sample;
+      history->beginRaw(&iterator);
+      while (ok && history->nextRaw(&iterator, &sample))
+      {
+        if (sample.time < since)
+        {
+          continue;
+        }
+
+        double humidity = sample.humidity / 2.0;
+        if (binary)
+        {
+          record.reset();
+          record.u32(sample.time);
+          record.temperature(sample.temperature, useImperialUnits);
+          record.humidity(humidity);
+          ok = appendChunk(&length, entry, record.size());
+        }
+        else
+        {
+          ok = appendChunk(&length, entry, snprintf(entry, sizeof(entry), "%s[%lu,%.2f,%.1f]", first ? "" : ",",
+                                                    (unsigned long)sample.time, sample.temperature.toUnits(useImperialUnits), humidity));
+        }
+        first = false;
+      }
+    }
+    else if (resolution == MINUTE || resolution == QUARTER)
+    {
+      uint16_t count = resolution == MINUTE ? history->getMinuteCount() : history->getQuarterCount();
+      for (uint16_t i = 0; ok && i < count; i++)
+      {
+        HistoryBucket bucket = resolution == MINUTE ? history->getMinute(i) : history->getQuarter(i);
+        if (bucket.time < since)
+        {
+          continue;
+        }
+
+        double humidity = bucket.humidityAverage / 2.0;
+        if (binary)
+        {
+          record.reset();
+          record.u32(bucket.time);
+          record.temperature(bucket.temperatureMin, useImperialUnits);
+          record.temperature(bucket.temperatureMax, useImperialUnits);
+          record.temperature(bucket.temperatureAverage, useImperialUnits);
+          record.humidity(humidity);
+          ok = appendChunk(&length, entry, record.size());
+        }
+        else
+        {
+          ok = appendChunk(&length, entry, snprintf(entry, sizeof(entry), "%s[%lu,%.2f,%.2f,%.2f,%.1f]", first ? "" : ",",
+                                                    (unsigned long)bucket.time, bucket.temperatureMin.toUnits(useImperialUnits),
+                                                    bucket.temperatureMax.toUnits(useImperialUnits), bucket.temperatureAverage.toUnits(useImperialUnits), humidity));
+        }
+        first = false;
+      }
+    }
+    else
+    {
+      uint32_t cursor = history->beginTransitions();
+      HistoryTransition transition;
+      while (ok && history->nextTransition(&cursor, &transition))
+      {
+        if (transition.time / 1000 < since)
+        {
+          continue;
+        }
+
+        if (binary)
+        {
+          record.reset();
+          record.u32(transition.time / 1000);
+          record.u8(transition.state);
+          ok = appendChunk(&length, entry, record.size());
+        }
+        else
+        {
+          ok = appendChunk(&length, entry, snprintf(entry, sizeof(entry), "%s[%lu,\"%s\"]", first ? "" : ",",
+                                                    (unsigned long)(transition.time / 1000), Thermostat::getStateName(transition.state).c_str()));
+        }
+        first = false;
+      }
+    }
+
+    if (!binary)
+    {
+      ok = ok && appendChunk(&length, "]}", 2);
+    }
+    if (ok && server->sendChunk(responseBuffer, length))
+    {
+      server->endChunked();
+    }
   }
 
-  void handleSettings()
+  // ====== Schedule ======
+  static const char *skipSpace(const char *c)
+  {
+    while (isspace(*c))
+    {
+      c++;
+    }
+    return c;
+  }
+
+  // [[minute, zone, setpoint_low, setpoint_high], ...], alone or as the "transitions" member of an object
+  static bool parseSchedule(const char *text, bool useImperialUnits, ScheduleTable *table)
+  {
+    const char *member = strstr(text, "\"transitions\"");
+    const char *c = strchr(member != NULL ? member : text, '[');
+    if (c == NULL)
+    {
+      return false;
+    }
+
+    table->count = 0;
+    c = skipSpace(c + 1);
+    if (*c == ']')
+    {
+      return true;
+    }
+
+    for (;;)
+    {
+      if (*c != '[' || table->count >= SCHEDULE_MAX_TRANSITIONS)
+      {
+        return false;
+      }
+      c++;
+
+      double values[4];
+      for (uint8_t i = 0; i < 4; i++)
+      {
+        char *end;
+        values[i] = strtod(c, &end);
+        if (end == c)
+        {
+          return false;
+        }
+
+        c = skipSpace(end);
+        if (*c != (i < 3 ? ',' : ']'))
+        {
+          return false;
+        }
+        c++;
+      }
+
+      // Checked here as out of range values can not be converted, setSchedule checks the rest
+      if (!(values[0] >= 0 && values[0] < SCHEDULE_MINUTES_PER_WEEK && values[0] == floor(values[0])) ||
+          !(values[1] >= 0 && values[1] < THERMOSTAT_ZONE_COUNT && values[1] == floor(values[1])))
+      {
+        return false;
+      }
+
+      ScheduleTransition &transition = table->transitions[table->count++];
+      transition.minute = values[0];
+      transition.zone = values[1];
+      transition.setpointLow = Temperature::fromUnits(values[2], useImperialUnits);
+      transition.setpointHigh = Temperature::fromUnits(values[3], useImperialUnits);
+
+      c = skipSpace(c);
+      if (*c == ']')
+      {
+        return true;
+      }
+      if (*c != ',')
+      {
+        return false;
+      }
+      c = skipSpace(c + 1);
+    }
+  }
+
+  // { "clock", "override": [ ... ], "transitions": [ [minute, zone, setpoint_low, setpoint_high], ... ] }
+  // Minutes count from Sunday 00:00 local time, clock is the current minute of the week or null until SNTP
+  // has set it and override lists the zones holding manual setpoints until their next transition.
+  // PUT replaces the whole schedule with a transitions array in the same format. Streamed in chunks.
+  void handleSchedule()
   {
-    if (server->method() == HTTP_GET)
+    RequestArgs &args = server->args();
+    bool useImperialUnits = args.useImperialUnits();
+
+    if (server->method() == HttpServer::POST || server->method() == HttpServer::PUT)
+    {
+      ScheduleTable table;
+      if (!parseSchedule(server->body(), useImperialUnits, &table) || !Thermostat::isValidSchedule(table))
+      {
+        server->send(400, "text/plain", "Bad Request");
+        return;
+      }
+
+      // The stored and running schedule stay as they were
+      if (!thermostat->setSchedule(table))
+      {
+        server->send(507, "text/plain", "Insufficient Storage");
+        return;
+      }
+    }
+    else if (server->method() != HttpServer::GET)
+    {
+      server->send(405, "text/plain", "Method Not Allowed");
+      return;
+    }
+
+    if (!server->beginChunked(200, "application/json"))
     {
-      server->send(200, "application/json", settingsJSON());
       return;
     }
-    else if (server->method() == HTTP_POST || server->method() == HTTP_PUT)
+
+    ScheduleTable table = thermostat->getSchedule();
+    int16_t clock = thermostat->getWallClock();
+
+    char entry[64];
+    size_t length = 0;
+    bool ok;
+    if (clock == SCHEDULE_NO_TIME)
+    {
+      ok = appendChunk(&length, entry, snprintf(entry, sizeof(entry), "{\"clock\":null,\"override\":["));
+    }
+    else
+    {
+      ok = appendChunk(&length, entry, snprintf(entry, sizeof(entry), "{\"clock\":%d,\"override\":[", clock));
+    }
+
+    for (uint8_t zone = 0; ok && zone < THERMOSTAT_ZONE_COUNT; zone++)
+    {
+      ok = appendChunk(&length, entry, snprintf(entry, sizeof(entry), "%s%s", zone == 0 ? "" : ",",
+                                                table.count > 0 && thermostat->isScheduleOverridden(zone) ? "true" : "false"));
+    }
+    ok = ok && appendChunk(&length, "],\"transitions\":[", 17);
+
+    for (uint8_t i = 0; ok && i < table.count; i++)
+    {
+      const ScheduleTransition &transition = table.transitions[i];
+      ok = appendChunk(&length, entry, snprintf(entry, sizeof(entry), "%s[%u,%u,%.2f,%.2f]", i == 0 ? "" : ",",
+                                                transition.minute, transition.zone, transition.setpointLow.toUnits(useImperialUnits),
+                                                transition.setpointHigh.toUnits(useImperialUnits)));
+    }
+
+    ok = ok && appendChunk(&length, "]}", 2);
+    if (ok && server->sendChunk(responseBuffer, length))
+    {
+      server->endChunked();
+    }
+  }
+
+#if METRICS_ENABLED
+  // ====== Metrics ======
+  bool appendFamily(size_t *length, const char *name, const char *type, const char *help)
+  {
+    char entry[160];
+    return appendChunk(length, entry, snprintf(entry, sizeof(entry), "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type));
+  }
+
+  bool appendSample(size_t *length, const char *name, const char *labels, unsigned long long value)
+  {
+    char entry[160];
+    if (labels[0] == '\0')
+    {
+      return appendChunk(length, entry, snprintf(entry, sizeof(entry), "%s %llu\n", name, value));
+    }
+    return appendChunk(length, entry, snprintf(entry, sizeof(entry), "%s{%s} %llu\n", name, labels, value));
+  }
+
+  // Cumulative buckets, sum and count of one histogram series
+  bool appendHistogram(size_t *length, const char *name, const char *labels, const CycleHistogram &histogram)
+  {
+    char entry[160];
+    unsigned long count = 0;
+    bool ok = true;
+    for (uint8_t i = 0; ok && i < METRICS_HISTOGRAM_BUCKETS; i++)
     {
-      //Get screen units param and update storage
-      String screenImperialStr = getArgValue("screenImperial", true);
-      if (screenImperialStr.length() > 0)
+      count += histogram.getCount(i);
+      if (i < METRICS_HISTOGRAM_BUCKETS - 1)
       {
-        screenImperialStr.toLowerCase();
-        bool screenImperial = screenImperialStr.equals("true");
-        storage->setSettingScreenImperial(screenImperial);
+        ok = appendChunk(length, entry, snprintf(entry, sizeof(entry), "%s_bucket{%s,le=\"%lu\"} %lu\n", name, labels,
+                                                 (unsigned long)CycleHistogram::bucketLimit(i), count));
       }
+      else
+      {
+        ok = appendChunk(length, entry, snprintf(entry, sizeof(entry), "%s_bucket{%s,le=\"+Inf\"} %lu\n", name, labels, count));
+      }
+    }
+    ok = ok && appendChunk(length, entry, snprintf(entry, sizeof(entry), "%s_sum{%s} %llu\n", name, labels, (unsigned long long)histogram.getSum()));
+    return ok && appendChunk(length, entry, snprintf(entry, sizeof(entry), "%s_count{%s} %lu\n", name, labels, count));
+  }
 
-      //Get use remote temperature param and update storage
-      String useRemoteTemperatureStr = getArgValue("useRemoteTemperature", true);
-      if (useRemoteTemperatureStr.length() > 0)
+  // Every scheduler task as one family, value picks what is exported: 0 histogram, 1 maximum, 2 runs, 3 missed deadlines
+  bool appendTasks(size_t *length, const char *name, uint8_t value)
+  {
+    Metrics *metrics = Metrics::getInstance();
+    char labels[64];
+    bool ok = true;
+    for (uint8_t s = 0; ok && s < metrics->getSchedulerCount(); s++)
+    {
+      Scheduler *scheduler = metrics->getScheduler(s);
+      for (uint8_t t = 0; ok && t < scheduler->getTaskCount(); t++)
       {
-        useRemoteTemperatureStr.toLowerCase();
-        bool useRemoteTemperature = useRemoteTemperatureStr.equals("true");
-        storage->setSettingUseRemoteTemperature(useRemoteTemperature);
+        const Scheduler::Task *task = scheduler->getTask(t);
+        snprintf(labels, sizeof(labels), "scheduler=\"%s\",task=\"%s\"", metrics->getSchedulerName(s), task->name);
+        switch (value)
+        {
+        case 0:
+          ok = appendHistogram(length, name, labels, task->cycles);
+          break;
+        case 1:
+          ok = appendSample(length, name, labels, task->cycles.getMaximum());
+          break;
+        case 2:
+          ok = appendSample(length, name, labels, task->runCount);
+          break;
+        default:
+          ok = appendSample(length, name, labels, task->missedDeadlines);
+          break;
+        }
       }
+    }
+    return ok;
+  }
 
-      server->send(200, "application/json", settingsJSON());
+  // Prometheus text format. Times are in CPU cycles, openthermostat_cpu_frequency_hertz converts them.
+  // Streamed in chunks.
+  void handleMetrics()
+  {
+    if (server->method() != HttpServer::GET)
+    {
+      server->send(405, "text/plain", "Method Not Allowed");
       return;
     }
 
-    //Method not allowed
-    server->send(405, "application/json", settingsJSON());
+    if (!server->beginChunked(200, "text/plain; version=0.0.4"))
+    {
+      return;
+    }
+
+    Metrics *metrics = Metrics::getInstance();
+    char labels[48];
+    size_t length = 0;
+    bool ok = true;
+
+    ok = ok && appendFamily(&length, "openthermostat_task_cycles", "histogram", "Cycles per run of a scheduler task");
+    ok = ok && appendTasks(&length, "openthermostat_task_cycles", 0);
+    ok = ok && appendFamily(&length, "openthermostat_task_max_cycles", "gauge", "Longest run of a scheduler task");
+    ok = ok && appendTasks(&length, "openthermostat_task_max_cycles", 1);
+    ok = ok && appendFamily(&length, "openthermostat_task_runs_total", "counter", "Runs of a scheduler task");
+    ok = ok && appendTasks(&length, "openthermostat_task_runs_total", 2);
+    ok = ok && appendFamily(&length, "openthermostat_task_missed_deadlines_total", "counter", "Runs that started later than the task deadline");
+    ok = ok && appendTasks(&length, "openthermostat_task_missed_deadlines_total", 3);
+
+    ok = ok && appendFamily(&length, "openthermostat_stage_cycles", "histogram", "Cycles per pass of a loop or control stage");
+    for (uint8_t i = 0; ok && i < METRICS_STAGE_COUNT; i++)
+    {
+      snprintf(labels, sizeof(labels), "stage=\"%s\"", Metrics::getStageName((MetricsStage)i));
+      ok = appendHistogram(&length, "openthermostat_stage_cycles", labels, *metrics->getStage((MetricsStage)i));
+    }
+    ok = ok && appendFamily(&length, "openthermostat_stage_max_cycles", "gauge", "Longest pass of a loop or control stage");
+    for (uint8_t i = 0; ok && i < METRICS_STAGE_COUNT; i++)
+    {
+      snprintf(labels, sizeof(labels), "stage=\"%s\"", Metrics::getStageName((MetricsStage)i));
+      ok = appendSample(&length, "openthermostat_stage_max_cycles", labels, metrics->getStage((MetricsStage)i)->getMaximum());
+    }
+
+    ok = ok && appendFamily(&length, "openthermostat_metrics_overhead_cycles", "gauge", "Cycles one timing adds to what it measures");
+    ok = ok && appendSample(&length, "openthermostat_metrics_overhead_cycles", "", metrics->getOverhead());
+    ok = ok && appendFamily(&length, "openthermostat_cpu_frequency_hertz", "gauge", "CPU clock");
+    ok = ok && appendSample(&length, "openthermostat_cpu_frequency_hertz", "", ESP.getCpuFreqMHz() * 1000000ULL);
+
+    ok = ok && appendFamily(&length, "openthermostat_heap_free_bytes", "gauge", "Free heap");
+    ok = ok && appendSample(&length, "openthermostat_heap_free_bytes", "", ESP.getFreeHeap());
+    ok = ok && appendFamily(&length, "openthermostat_heap_min_free_bytes", "gauge", "Lowest free heap since boot");
+    ok = ok && appendSample(&length, "openthermostat_heap_min_free_bytes", "", ESP.getMinFreeHeap());
+
+    ok = ok && appendFamily(&length, "openthermostat_storage_commits_total", "counter", "Settings commits to flash");
+    ok = ok && appendSample(&length, "openthermostat_storage_commits_total", "", storage->getCommitCount());
+
+    ok = ok && appendFamily(&length, "openthermostat_http_requests_total", "counter", "HTTP requests dispatched");
+    ok = ok && appendSample(&length, "openthermostat_http_requests_total", "", server->getRequestCount());
+    ok = ok && appendFamily(&length, "openthermostat_http_responses_total", "counter", "HTTP responses by status class");
+    for (uint8_t statusClass = 1; ok && statusClass <= 5; statusClass++)
+    {
+      snprintf(labels, sizeof(labels), "code=\"%uxx\"", statusClass);
+      ok = appendSample(&length, "openthermostat_http_responses_total", labels, server->getResponseCount(statusClass));
+    }
+    ok = ok && appendFamily(&length, "openthermostat_http_connections", "gauge", "Open HTTP connections");
+    ok = ok && appendSample(&length, "openthermostat_http_connections", "", server->getConnectionCount());
+
+    if (ok && server->sendChunk(responseBuffer, length))
+    {
+      server->endChunked();
+    }
   }
+#endif
 
   void handleNotFound()
   {
@@ -322,36 +1430,108 @@ private:
   }
 
 public:
-  WebService(int port)
+  WebService(int port, History *history) : json(responseBuffer, sizeof(responseBuffer)), binary((uint8_t *)responseBuffer, sizeof(responseBuffer))
   {
-    server = new WebServer(port);
+    server = new HttpServer(port);
+
+    this->history = history;
 
     storage = storage->getInstance();
 
     thermostat = thermostat->getInstance();
 
-    // initialize remote temperature
-    remoteTemperature = NAN;
+    // ====== Initialize Status ======
+    // status starts out empty from its constructor
+    for (uint8_t zone = 0; zone < THERMOSTAT_ZONE_COUNT; zone++)
+    {
+      // initialize remote temperature
+      SensorReading none = {Temperature(), 0};
+      remoteTemperature[zone].write(none);
+
+      published[zone].temperature = Temperature();
+      published[zone].confidence = 0;
+      published[zone].humidity = NAN;
+      published[zone].setpointLow = Temperature();
+      published[zone].setpointHigh = Temperature();
+      published[zone].mode = Thermostat::ThermostatMode::OFF;
+      published[zone].state = Thermostat::ThermostatState::IDLE;
+    }
+    statusVersion = 1;
+    controlStatusVersion = 0;
+    for (uint8_t i = 0; i < 2; i++)
+    {
+      statusCache[i][0].version = 0;
+      statusCache[i][1].version = 0;
+    }
+
+    // ====== Initialize Event Stream ======
+    for (uint8_t i = 0; i < WEB_EVENT_MAX_SUBSCRIBERS; i++)
+    {
+      subscribers[i].stream = HTTP_SERVER_INVALID_STREAM;
+      subscribers[i].zone = 0;
+      subscribers[i].imperial = false;
+    }
+    lastEventCheckTime = 0;
+    lastHeartbeatTime = 0;
 
     server->on("/", std::bind(&WebService::handleRoot, this));
     server->on("/mode", std::bind(&WebService::handleMode, this));
     server->on("/setpoint", std::bind(&WebService::handleSetpoint, this));
     server->on("/temperature", std::bind(&WebService::handleTemperature, this));
     server->on("/settings", std::bind(&WebService::handleSettings, this));
+    server->on("/events", std::bind(&WebService::handleEvents, this));
+    server->on("/history", std::bind(&WebService::handleHistory, this));
+    server->on("/schedule", std::bind(&WebService::handleSchedule, this));
+#if METRICS_ENABLED
+    server->on("/metrics", std::bind(&WebService::handleMetrics, this));
+#endif
     server->onNotFound(std::bind(&WebService::handleNotFound, this));
     server->begin();
   }
 
-  void update(double temperature, double humidity)
+  // newStatus is the control task's published status and version its snapshot version
+  void update(const ThermostatStatus &newStatus, uint32_t version)
   {
-    currentTemperature = temperature;
-    currentHumidity = humidity;
+    // Only a new publication replaces the status, so changes made by requests are not reverted by an older one
+    if (version != controlStatusVersion)
+    {
+      controlStatusVersion = version;
+      setStatus(newStatus);
+    }
 
     server->handleClient();
+
+    unsigned long now = millis();
+    if (now - lastEventCheckTime >= WEB_EVENT_CHECK_PERIOD)
+    {
+      lastEventCheckTime = now;
+
+      // Sources that stopped reporting leave their zone's aggregate
+      if (remoteSensors.evict(now))
+      {
+        ThermostatStatus newStatus = status;
+        for (uint8_t zone = 0; zone < THERMOSTAT_ZONE_COUNT; zone++)
+        {
+          publishRemoteReading(zone, &newStatus);
+        }
+        setStatus(newStatus);
+      }
+
+      publishChanges();
+    }
+    if (now - lastHeartbeatTime >= WEB_EVENT_HEARTBEAT_PERIOD)
+    {
+      lastHeartbeatTime = now;
+      sendHeartbeat();
+    }
   }
 
-  double getRemoteTemperature()
+  // Latest remote reading of the zone with when it arrived, for the sensor fusion
+  SensorReading getRemoteReading(uint8_t zone = 0)
   {
-    return remoteTemperature;
+    return remoteTemperature[zone].read();
   }
 };
+
+constexpr JsonField WebService::statusSchema[];
+constexpr JsonField WebService::settingsSchema[];
@@ -1,17 +1,17 @@
 #include <WiFi.h>
 #include <WiFiClient.h>
-#include <WebServer.h>
 #include <ESPmDNS.h>
 
-#include <SPI.h>
-#include <Adafruit_Sensor.h>
-#include <Adafruit_BME280.h>
-
 #include "Display.h"
+#include "EnvironmentalSensor.h"
+#include "History.h"
+#include "Metrics.h"
 #include "PersistentStorage.h"
 #include "Thermostat.h"
 #include "WebService.h"
 #include "Button.h"
+#include "Scheduler.h"
+#include "Snapshot.h"
 
 // End user specific config file for WiFi network settings
 #include "wifi.h"
@@ -31,16 +31,51 @@
 #define PORT 80
 #endif
 
+// ====== Clock Settings ======
+// Wall clock for the weekly schedule, set over SNTP once WiFi is up. TIMEZONE is a POSIX TZ string.
+#ifndef TIMEZONE
+#define TIMEZONE "UTC0"
+#endif
+#ifndef NTP_SERVER
+#define NTP_SERVER "pool.ntp.org"
+#endif
+
 // ====== Relay Settings ======
 #define HEAT_RELAY_PIN 26
 #define COOL_RELAY_PIN 27
 #define FAN_RELAY_PIN 14
 
+// ====== Zone Settings ======
+// Relays and temperature source of each zone, one entry per THERMOSTAT_ZONE_COUNT.
+// Zones without the local sensor take their temperature from /temperature?zone=<index>.
+struct ZoneHardware
+{
+  uint8_t heatRelayPin;
+  uint8_t coolRelayPin;
+  uint8_t fanRelayPin;
+  bool localSensor;
+};
+
+// Builds for more zones define ZONE_HARDWARE as the entries of zones[]
+#ifndef ZONE_HARDWARE
+#define ZONE_HARDWARE {HEAT_RELAY_PIN, COOL_RELAY_PIN, FAN_RELAY_PIN, true}
+#endif
+
+const ZoneHardware zones[] = {ZONE_HARDWARE};
+
+static_assert(sizeof(zones) / sizeof(zones[0]) == THERMOSTAT_ZONE_COUNT, "zones must list the hardware of every zone");
+
 // ====== Environmental Sensor Settings ======
 #define BME_CS_PIN 33
-Adafruit_BME280 bme(BME_CS_PIN); // hardware SPI
+ForcedBME280 bme(BME_CS_PIN); // hardware SPI
 
 #define ENVIRONMENTAL_SENSOR_UPDATE_PERIOD 2000
+// How often the sampling pipeline is polled for a completed conversion
+#define ENVIRONMENTAL_SENSOR_POLL_PERIOD 5
+// Print every sample to Serial
+#ifndef ENVIRONMENTAL_SENSOR_DEBUG
+#define ENVIRONMENTAL_SENSOR_DEBUG 0
+#endif
 
 // ====== Thermostat ======
 #ifndef DEFAULT_HEAT_SETPOINT
@@ -57,13 +92,36 @@ Adafruit_BME280 bme(BME_CS_PIN); // hardware SPI
 #define DOWN_BUTTON_PIN 4
 #define MULTI_BUTTON_PIN 15
 
+#define BUTTON_UPDATE_PERIOD 10
+
+// ====== Task Settings ======
+#define WEB_SERVICE_UPDATE_PERIOD 2
+#define THERMOSTAT_UPDATE_PERIOD 100
+#define STORAGE_UPDATE_PERIOD 1000
+
+// Control path (thermostat and relays) runs in its own task, pinned to the core Arduino loop() is not on.
+// Sensor sampling stays with the display on the loop() core as both share the SPI bus.
+#define CONTROL_TASK_CORE 0
+#define CONTROL_TASK_PRIORITY 5
+#define CONTROL_TASK_STACK_SIZE 4096
+
 // ====== Globals ======
 
-float currentTemperature = NAN;
-float currentHumidity = NAN;
+// Published by the control task, read by the web service and display
+Snapshot<ThermostatStatus> controlStatus;
+// Last value written to controlStatus, only touched by the control task
+ThermostatStatus publishedStatus;
+// Filters and picks the temperature every zone follows, only touched by the control task
+SensorFusion sensorFusion;
 
 Display *display;
 
+EnvironmentalSensor *environmentalSensor;
+// Position of the sensor task in the sample buffer
+uint32_t environmentalSampleCursor = 0;
+
+History *history;
+
 PersistentStorage *storage;
 
 Thermostat *thermostat;
@@ -74,6 +132,9 @@ Button *upButton;
 Button *downButton;
 Button *multiButton;
 
+Scheduler *scheduler;
+Scheduler *controlScheduler;
+
 void (*resetFunc)(void) = 0; //declare reset function @ address 0
 
 void setup()
@@ -81,14 +142,17 @@ void setup()
   Serial.begin(115200);
 
   // ====== Initialize relays ======
-  pinMode(HEAT_RELAY_PIN, OUTPUT);
-  digitalWrite(HEAT_RELAY_PIN, LOW);
+  for (uint8_t zone = 0; zone < THERMOSTAT_ZONE_COUNT; zone++)
+  {
+    pinMode(zones[zone].heatRelayPin, OUTPUT);
+    digitalWrite(zones[zone].heatRelayPin, LOW);
 
-  pinMode(COOL_RELAY_PIN, OUTPUT);
-  digitalWrite(COOL_RELAY_PIN, LOW);
+    pinMode(zones[zone].coolRelayPin, OUTPUT);
+    digitalWrite(zones[zone].coolRelayPin, LOW);
 
-  pinMode(FAN_RELAY_PIN, OUTPUT);
-  digitalWrite(FAN_RELAY_PIN, LOW);
+    pinMode(zones[zone].fanRelayPin, OUTPUT);
+    digitalWrite(zones[zone].fanRelayPin, LOW);
+  }
 
   // ====== Create Display ======
   display = new Display();
@@ -102,7 +166,7 @@ void setup()
     while (millis() < factoryResetStartTime + FACTORY_RESET_TIME && digitalRead(FACTORY_RESET_PIN) == HIGH)
     {
       // Show factory reset pending on screen
-      display->factoryResetPending(String(ceil(((factoryResetStartTime + FACTORY_RESET_TIME) - millis()) / 1000)));
+      display->factoryResetPending(ceil(((factoryResetStartTime + FACTORY_RESET_TIME) - millis()) / 1000));
 
       Serial.print("Factory resetting in ");
       Serial.print(ceil(((factoryResetStartTime + FACTORY_RESET_TIME) - millis()) / 1000));
@@ -115,14 +179,21 @@ void setup()
       display->factoryResetting();
       Serial.print("Resetting...");
 
+      storage = storage->getInstance();
       storage->setCurrentThermostatMode(Thermostat::ThermostatMode::OFF);
-      storage->setCurrentThermostatState(Thermostat::ThermostatState::IDLE);
-      storage->setSetpointLow(DEFAULT_SETPOINT_LOW);
-      storage->setSetpointHigh(DEFAULT_SETPOINT_HIGH);
+      for (uint8_t zone = 0; zone < THERMOSTAT_ZONE_COUNT; zone++)
+      {
+        storage->setCurrentThermostatState(Thermostat::ThermostatState::IDLE, zone);
+        storage->setSetpointLow(Temperature::fromCelsius(DEFAULT_SETPOINT_LOW), zone);
+        storage->setSetpointHigh(Temperature::fromCelsius(DEFAULT_SETPOINT_HIGH), zone);
+      }
       Serial.print("thermostat reset...");
 
-      storage->setSettingScreenImperial(false);
+      storage->setSettingScreenImperial(ThermostatConfig::defaultImperial);
       storage->setSettingUseRemoteTemperature(false);
+      storage->setSettingControlStrategy(Thermostat::ControlStrategy::STRATEGY_HYSTERESIS);
+      storage->setSchedule(ScheduleTable());
+      storage->flush();
       Serial.print("storage reset...");
       delay(200);
 
@@ -176,7 +247,13 @@ void setup()
   Serial.println(WiFi.localIP());
 
   // Show wifi connected on screen
-  display->wifiConnected(WiFi.localIP().toString());
+  IPAddress ip = WiFi.localIP();
+  FixedString<16> address;
+  address.appendf("%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+  display->wifiConnected(address.c_str());
+
+  // Sync the wall clock in the background, the schedule waits until it is set
+  configTzTime(TIMEZONE, NTP_SERVER);
 
   // ====== Initialize temperature sensor ======
   // TODO show temperature initialization on screen
@@ -188,111 +265,244 @@ void setup()
     }
   }
 
+  environmentalSensor = new EnvironmentalSensor(&bme, ENVIRONMENTAL_SENSOR_UPDATE_PERIOD);
+
   // ====== Get Persistent Storage singleton
   storage = storage->getInstance();
 
   // ====== Get Thermostat singleton
   thermostat = thermostat->getInstance();
 
+  // ====== Initialize History ======
+  history = new History();
+  thermostat->setStateChangeCallback(&recordStateChange);
+
   // ====== Initialize Web Service ======
   int port = PORT;
-  webService = new WebService(port);
+  webService = new WebService(port, history);
 
   // ====== Initialize Buttons ======
-  upButton = new Button(UP_BUTTON_PIN, &upButtonPressed);
-  downButton = new Button(DOWN_BUTTON_PIN, &downButtonPressed);
-  multiButton = new Button(MULTI_BUTTON_PIN, &multiButtonPressed);
-}
+  upButton = new Button(UP_BUTTON_PIN, &upButtonEvent);
+  downButton = new Button(DOWN_BUTTON_PIN, &downButtonEvent);
+  multiButton = new Button(MULTI_BUTTON_PIN, &multiButtonEvent);
+
+#if METRICS_ENABLED
+  // ====== Initialize Metrics ======
+  // Before the control task starts, both cores time into it
+  Metrics *metrics = Metrics::getInstance();
+#endif
 
-unsigned long lastEnvironemntalSensorUpdateTime = 0;
-unsigned long lastScreenUpdateTime = 0;
+  // ====== Initialize Schedulers ======
+  // Tasks run in registration order when due
+  scheduler = new Scheduler();
+  scheduler->addTask("buttons", &updateButtons, BUTTON_UPDATE_PERIOD, BUTTON_UPDATE_PERIOD);
+  scheduler->addTask("sensor", &updateEnvironmentalSensor, ENVIRONMENTAL_SENSOR_POLL_PERIOD);
+  scheduler->addTask("web", &updateWebService, WEB_SERVICE_UPDATE_PERIOD);
+  scheduler->addTask("display", &updateDisplay, SCREEN_UPDATE_PERIOD);
+  scheduler->addTask("storage", &updateStorage, STORAGE_UPDATE_PERIOD);
+
+  controlScheduler = new Scheduler();
+  controlScheduler->addTask("control", &updateThermostat, THERMOSTAT_UPDATE_PERIOD, THERMOSTAT_UPDATE_PERIOD);
+
+#if METRICS_ENABLED
+  metrics->addScheduler("main", scheduler);
+  metrics->addScheduler("control", controlScheduler);
+#endif
+
+  // ====== Start Control Task ======
+  xTaskCreatePinnedToCore(controlTask, "control", CONTROL_TASK_STACK_SIZE, NULL, CONTROL_TASK_PRIORITY, NULL, CONTROL_TASK_CORE);
+}
 
 void loop()
 {
-  upButton->update();
-  downButton->update();
-  multiButton->update();
-
-  // Update temperature and humidity
-  if (millis() >= lastEnvironemntalSensorUpdateTime + ENVIRONMENTAL_SENSOR_UPDATE_PERIOD)
   {
-    lastEnvironemntalSensorUpdateTime = millis();
+    MetricsTimer timer(METRICS_STAGE_LOOP);
+    scheduler->run();
+  }
 
-    // Reading temperature or humidity takes about 250 milliseconds!
-    // Sensor readings may also be up to 2 seconds 'old' (its a very slow sensor)
-    float tempHumidity = bme.readHumidity();
-    // Read temperature as Celsius (the default)
-    float tempTemperature = bme.readTemperature();
+  // Sleep until the next task is due
+  delay(scheduler->getTimeUntilNextTask());
+}
 
-    if (isnan(tempHumidity) || isnan(tempTemperature))
-    {
-      Serial.println(F("Failed to read from environmental sensor!"));
-    }
-    else
+void controlTask(void *parameters)
+{
+  for (;;)
+  {
     {
-      currentHumidity = tempHumidity;
-      currentTemperature = tempTemperature;
-
-      Serial.print("Temp: ");
-      Serial.print(currentTemperature);
-      Serial.print("°C    Hum: ");
-      Serial.print(currentHumidity);
-      Serial.println("%");
+      MetricsTimer timer(METRICS_STAGE_CONTROL_LOOP);
+      controlScheduler->run();
     }
+
+    delay(controlScheduler->getTimeUntilNextTask());
+  }
+}
+
+// Presses are captured by interrupts, this only drains and debounces them
+void updateButtons()
+{
+  unsigned long now = millis();
+  upButton->update(now);
+  downButton->update(now);
+  multiButton->update(now);
+}
+
+void updateEnvironmentalSensor()
+{
+  // Start or collect a conversion, never waits on the sensor
+  environmentalSensor->update();
+
+  EnvironmentalSample sample;
+  while (environmentalSensor->readSample(&environmentalSampleCursor, &sample))
+  {
+#if ENVIRONMENTAL_SENSOR_DEBUG
+    Serial.print("Temp: ");
+    Serial.print(sample.temperature.toCelsius());
+    Serial.print("°C    Hum: ");
+    Serial.print(sample.humidity);
+    Serial.println("%");
+#endif
+
+    history->addSample(sample.timestamp, sample.temperature, sample.humidity);
+  }
+}
+
+// Runs in the control task, history follows the first zone
+void recordStateChange(uint8_t zone, Thermostat::ThermostatState state)
+{
+  if (zone == 0)
+  {
+    history->addTransition(state);
+  }
+}
+
+// Runs in the control task
+void updateThermostat()
+{
+  float currentHumidity = NAN;
+
+  // Latest local reading, the sample buffer never blocks the control task
+  EnvironmentalSample sample;
+  if (environmentalSensor->getLatestSample(&sample))
+  {
+    SensorReading local = {sample.temperature, sample.timestamp};
+    sensorFusion.addLocal(local);
+    currentHumidity = sample.humidity;
   }
 
   // Check remote temperature
-  if (storage->getSettingUseRemoteTemperature())
+  bool useRemoteTemperature = storage->getSettingUseRemoteTemperature();
+
+  ThermostatStatus status;
+  FusedTemperature readings[THERMOSTAT_ZONE_COUNT];
+  for (uint8_t zone = 0; zone < THERMOSTAT_ZONE_COUNT; zone++)
   {
-    currentTemperature = webService->getRemoteTemperature();
+    sensorFusion.addRemote(zone, webService->getRemoteReading(zone));
   }
 
-  // Update WiFi
-  webService->update(currentTemperature, currentHumidity);
+  // Taken after the readings were collected, so none of them is newer than now
+  unsigned long now = millis();
+  for (uint8_t zone = 0; zone < THERMOSTAT_ZONE_COUNT; zone++)
+  {
+    readings[zone] = sensorFusion.read(zone, zones[zone].localSensor, useRemoteTemperature, now);
+    status.temperature[zone] = readings[zone].temperature;
+    status.confidence[zone] = readings[zone].confidence;
+  }
 
   //Update thermostat
-  Thermostat::ThermostatState state = thermostat->update(currentTemperature);
+  {
+    MetricsTimer timer(METRICS_STAGE_THERMOSTAT);
+    thermostat->updateZones(readings, status.state);
+  }
+  {
+    MetricsTimer timer(METRICS_STAGE_RELAYS);
+    for (uint8_t zone = 0; zone < THERMOSTAT_ZONE_COUNT; zone++)
+    {
+      writeRelays(zone, status.state[zone]);
+    }
+  }
+  for (uint8_t zone = 0; zone < THERMOSTAT_ZONE_COUNT; zone++)
+  {
+    status.setpointLow[zone] = thermostat->getSetpointLow(zone);
+    status.setpointHigh[zone] = thermostat->getSetpointHigh(zone);
+  }
+  status.humidity = currentHumidity;
+  status.mode = thermostat->getMode();
+
+  // Publish only on change so readers can key caches on the snapshot version
+  if (!status.equals(publishedStatus))
+  {
+    publishedStatus = status;
+    controlStatus.write(status);
+  }
+}
+
+// Drive a zone's relay outputs for its thermostat state, the only place the control loop touches hardware
+void writeRelays(uint8_t zone, Thermostat::ThermostatState state)
+{
+  const ZoneHardware &hardware = zones[zone];
+
   if (state == Thermostat::ThermostatState::IDLE)
   {
-    digitalWrite(HEAT_RELAY_PIN, LOW);
-    digitalWrite(COOL_RELAY_PIN, LOW);
-    digitalWrite(FAN_RELAY_PIN, LOW);
+    digitalWrite(hardware.heatRelayPin, LOW);
+    digitalWrite(hardware.coolRelayPin, LOW);
+    digitalWrite(hardware.fanRelayPin, LOW);
   }
   else if (state == Thermostat::ThermostatState::HEATING)
   {
-    digitalWrite(HEAT_RELAY_PIN, HIGH);
-    digitalWrite(COOL_RELAY_PIN, LOW);
-    digitalWrite(FAN_RELAY_PIN, LOW);
+    digitalWrite(hardware.heatRelayPin, HIGH);
+    digitalWrite(hardware.coolRelayPin, LOW);
+    digitalWrite(hardware.fanRelayPin, LOW);
   }
   else if (state == Thermostat::ThermostatState::COOLING)
   {
-    digitalWrite(HEAT_RELAY_PIN, LOW);
-    digitalWrite(COOL_RELAY_PIN, HIGH);
-    digitalWrite(FAN_RELAY_PIN, LOW);
+    digitalWrite(hardware.heatRelayPin, LOW);
+    digitalWrite(hardware.coolRelayPin, HIGH);
+    digitalWrite(hardware.fanRelayPin, LOW);
   }
   else if (state == Thermostat::ThermostatState::FAN)
   {
-    digitalWrite(HEAT_RELAY_PIN, LOW);
-    digitalWrite(COOL_RELAY_PIN, LOW);
-    digitalWrite(FAN_RELAY_PIN, HIGH);
+    digitalWrite(hardware.heatRelayPin, LOW);
+    digitalWrite(hardware.coolRelayPin, LOW);
+    digitalWrite(hardware.fanRelayPin, HIGH);
   }
+}
 
-  if (millis() >= lastScreenUpdateTime + SCREEN_UPDATE_PERIOD)
-  {
-    lastScreenUpdateTime = millis();
-    // Update display
-    display->main(currentTemperature, currentHumidity);
-  }
+void updateWebService()
+{
+  // Version first, a write in between only means the same status is applied again next time
+  uint32_t version = controlStatus.getVersion();
+  ThermostatStatus status = controlStatus.read();
+
+  // Update WiFi
+  webService->update(status, version);
+}
+
+void updateDisplay()
+{
+  ThermostatStatus status = controlStatus.read();
 
-  delay(30);
+  // Update display
+  display->main(status.temperature[0], status.humidity);
 }
 
-void upButtonPressed()
+void updateStorage()
 {
+  // Commit settings changes to flash
+  storage->update();
+}
+
+// Up and down step the setpoint on every press and auto repeat while held
+void upButtonEvent(ButtonEvent event)
+{
+  if (event != BUTTON_PRESSED && event != BUTTON_REPEATED)
+  {
+    return;
+  }
+
   if (thermostat->getMode() == Thermostat::ThermostatMode::AUTOMATIC)
   {
     //Increase 1 degree of current screen unit
-    double increase = 1;
+    Temperature increase = Temperature::fromCelsius(1);
     // if (storage->getSettingScreenImperial() == true)
     // {
     //   increase = 1.8;
@@ -302,12 +512,17 @@ void upButtonPressed()
   }
 }
 
-void downButtonPressed()
+void downButtonEvent(ButtonEvent event)
 {
+  if (event != BUTTON_PRESSED && event != BUTTON_REPEATED)
+  {
+    return;
+  }
+
   if (thermostat->getMode() == Thermostat::ThermostatMode::AUTOMATIC)
   {
     //Decrease 1 degree of current screen unit
-    double decrease = 1;
+    Temperature decrease = Temperature::fromCelsius(1);
     // if (storage->getSettingScreenImperial() == true)
     // {
     //   decrease = 1.8;
@@ -317,8 +532,13 @@ void downButtonPressed()
   }
 }
 
-void multiButtonPressed()
+void multiButtonEvent(ButtonEvent event)
 {
+  if (event != BUTTON_PRESSED)
+  {
+    return;
+  }
+
   Thermostat::ThermostatMode mode = thermostat->getMode();
 
   if (mode == Thermostat::ThermostatMode::OFF)
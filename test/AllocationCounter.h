@@ -0,0 +1,80 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <stdlib.h>
+
+#include <new>
+
+// Counts heap allocations while allocationCounting is set by replacing malloc and operator new for
+// the whole test executable, so include it from one translation unit only.
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *pointer, size_t size);
+
+static volatile bool allocationCounting = false;
+static unsigned long long allocationCount = 0;
+
+extern "C" void *malloc(size_t size)
+{
+  if (allocationCounting)
+  {
+    allocationCount++;
+  }
+  return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+  if (allocationCounting)
+  {
+    allocationCount++;
+  }
+  return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *pointer, size_t size)
+{
+  if (allocationCounting)
+  {
+    allocationCount++;
+  }
+  return __libc_realloc(pointer, size);
+}
+
+void *operator new(size_t size)
+{
+  void *pointer = malloc(size);
+  if (pointer == nullptr)
+  {
+    throw std::bad_alloc();
+  }
+  return pointer;
+}
+
+void *operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+void operator delete(void *pointer) noexcept
+{
+  free(pointer);
+}
+
+void operator delete[](void *pointer) noexcept
+{
+  free(pointer);
+}
+
+void operator delete(void *pointer, size_t size) noexcept
+{
+  free(pointer);
+}
+
+void operator delete[](void *pointer, size_t size) noexcept
+{
+  free(pointer);
+}
+
+#endif
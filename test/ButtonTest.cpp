@@ -0,0 +1,255 @@
+// Button on scripted pin waveforms: bouncing presses and releases give exactly one event each,
+// glitches shorter than the debounce time give none, presses made while the loop is blocked are
+// neither missed nor doubled, holding reports one long press and an accelerating auto repeat, and a
+// burst that overflows the edge buffer resynchronizes from the pin.
+
+#include <algorithm>
+#include <vector>
+
+#include "Check.h"
+#include "Hal.h"
+#include "Button.h"
+
+#define BUTTON_PIN 5
+// The sketch's button task period
+#define UPDATE_PERIOD 10
+#define WAVEFORMS 500
+
+struct Event
+{
+  ButtonEvent event;
+  unsigned long time;
+};
+
+static std::vector<Event> events;
+
+static void record(ButtonEvent event)
+{
+  Event recorded = {event, millis()};
+  events.push_back(recorded);
+}
+
+// One pin change at a time offset in milliseconds
+struct Edge
+{
+  unsigned long time;
+  uint8_t level;
+};
+
+typedef std::vector<Edge> Waveform;
+
+static uint32_t randomState = 1;
+
+static uint32_t randomBelow(uint32_t limit)
+{
+  randomState = randomState * 1103515245 + 12345;
+  return (randomState >> 8) % limit;
+}
+
+// Contact bounce from the current level to level, starting at time: up to maxToggles random toggles
+// over at most bounceTime milliseconds, ending on level. Returns the time of the last edge.
+static unsigned long bounce(Waveform *waveform, unsigned long time, uint8_t level, unsigned long bounceTime, uint8_t maxToggles = 11)
+{
+  uint8_t toggles = 1 + 2 * randomBelow(maxToggles / 2 + 1);
+  unsigned long end = time + randomBelow(bounceTime + 1);
+  for (uint8_t i = 0; i < toggles; i++)
+  {
+    unsigned long at = i + 1 == toggles ? end : time + (end - time) * i / toggles;
+    Edge edge = {at, (uint8_t)(i % 2 == 0 ? level : !level)};
+    waveform->push_back(edge);
+  }
+  return end;
+}
+
+// Play waveform from now on, updating the button every period until duration has passed
+static void play(Button *button, const Waveform &waveform, unsigned long duration, unsigned long period = UPDATE_PERIOD)
+{
+  size_t next = 0;
+  for (unsigned long elapsed = 0; elapsed <= duration; elapsed++)
+  {
+    while (next < waveform.size() && waveform[next].time == elapsed)
+    {
+      halSetPin(BUTTON_PIN, waveform[next].level);
+      next++;
+    }
+    if (elapsed % period == 0)
+    {
+      button->update();
+    }
+    halAdvance(1);
+  }
+}
+
+static unsigned long countOf(ButtonEvent event)
+{
+  unsigned long count = 0;
+  for (const Event &recorded : events)
+  {
+    count += recorded.event == event;
+  }
+  return count;
+}
+
+// Presses and releases bouncing for up to 15 ms, held for 100 to 500 ms
+static void testBounce(Button *button)
+{
+  unsigned long failures = 0;
+  unsigned long worstLatency = 0;
+  for (unsigned long run = 0; run < WAVEFORMS; run++)
+  {
+    Waveform waveform;
+    unsigned long pressed = bounce(&waveform, 5, HIGH, BUTTON_DEBOUNCE_TIME - 5);
+    unsigned long released = bounce(&waveform, pressed + 100 + randomBelow(400), LOW, BUTTON_DEBOUNCE_TIME - 5);
+
+    events.clear();
+    unsigned long start = millis();
+    play(button, waveform, released + 100);
+
+    bool ok = events.size() == 2 && events[0].event == BUTTON_PRESSED && events[1].event == BUTTON_RELEASED;
+    if (ok)
+    {
+      // Reported once the last bounce has settled and the next update ran
+      unsigned long pressLatency = events[0].time - start - pressed;
+      unsigned long releaseLatency = events[1].time - start - released;
+      ok = pressLatency >= BUTTON_DEBOUNCE_TIME && pressLatency < BUTTON_DEBOUNCE_TIME + UPDATE_PERIOD &&
+           releaseLatency >= BUTTON_DEBOUNCE_TIME && releaseLatency < BUTTON_DEBOUNCE_TIME + UPDATE_PERIOD;
+      worstLatency = std::max(worstLatency, std::max(pressLatency, releaseLatency));
+    }
+    failures += !ok;
+  }
+  printf("%d bouncing presses: %lu failures, worst latency %lu ms\n", WAVEFORMS, failures, worstLatency);
+  CHECK_EQUAL(0, failures);
+  CHECK(!button->isPressed());
+}
+
+// Pulses shorter than the debounce time are ignored, whether or not an update falls inside them
+static void testGlitch(Button *button)
+{
+  for (unsigned long width = 1; width < BUTTON_DEBOUNCE_TIME; width++)
+  {
+    Waveform waveform = {{3, HIGH}, {3 + width, LOW}};
+    events.clear();
+    play(button, waveform, 100);
+    CHECK_EQUAL(0, events.size());
+  }
+
+  // A dropout while held is not a release
+  Waveform waveform = {{0, HIGH}, {100, LOW}, {105, HIGH}, {300, LOW}};
+  events.clear();
+  play(button, waveform, 400);
+  CHECK_EQUAL(1, countOf(BUTTON_PRESSED));
+  CHECK_EQUAL(1, countOf(BUTTON_RELEASED));
+}
+
+// The loop is blocked for 400 ms while the button is pressed twice, bouncing
+static void testBlockedLoop(Button *button)
+{
+  Waveform waveform;
+  unsigned long pressed = bounce(&waveform, 20, HIGH, 10, 3);
+  unsigned long released = bounce(&waveform, pressed + 80, LOW, 10, 3);
+  pressed = bounce(&waveform, released + 60, HIGH, 10, 3);
+  bounce(&waveform, pressed + 80, LOW, 10, 3);
+  CHECK(waveform.size() <= BUTTON_EDGE_BUFFER_SIZE);
+
+  events.clear();
+  play(button, waveform, 400, 400);
+  CHECK_EQUAL(4, events.size());
+  for (size_t i = 0; i < events.size(); i++)
+  {
+    CHECK(events[i].event == (i % 2 == 0 ? BUTTON_PRESSED : BUTTON_RELEASED));
+  }
+}
+
+// Held for three seconds: one long press after BUTTON_HOLD_TIME, then repeats speeding up by
+// BUTTON_REPEAT_STEP down to BUTTON_REPEAT_MINIMUM_INTERVAL
+static void testHold(Button *button)
+{
+  const unsigned long hold = 3000;
+  Waveform waveform;
+  unsigned long pressed = bounce(&waveform, 0, HIGH, 10);
+  Edge release = {pressed + hold, LOW};
+  waveform.push_back(release);
+
+  events.clear();
+  unsigned long start = millis();
+  play(button, waveform, pressed + hold + 100);
+  CHECK(!events.empty() && events.back().event == BUTTON_RELEASED);
+
+  // Expected repeat times from the press: repeats continue until the update before the one that
+  // reports the release, the release is only known once it has settled
+  unsigned long lastUpdate = events.back().time - start - UPDATE_PERIOD - pressed;
+  std::vector<unsigned long> expected;
+  unsigned long interval = BUTTON_REPEAT_INTERVAL;
+  for (unsigned long due = BUTTON_HOLD_TIME; due <= lastUpdate;)
+  {
+    expected.push_back(due);
+    due += interval;
+    interval = std::max(interval - BUTTON_REPEAT_STEP, (unsigned long)BUTTON_REPEAT_MINIMUM_INTERVAL);
+  }
+
+  CHECK_EQUAL(1, countOf(BUTTON_PRESSED));
+  CHECK_EQUAL(1, countOf(BUTTON_HELD));
+  CHECK_EQUAL(1, countOf(BUTTON_RELEASED));
+  CHECK_EQUAL(expected.size(), countOf(BUTTON_REPEATED));
+  CHECK(events.size() >= 3 && events[1].event == BUTTON_HELD && events[2].event == BUTTON_REPEATED);
+
+  // Each repeat within one update period of its due time
+  size_t repeat = 0;
+  for (const Event &recorded : events)
+  {
+    if (recorded.event == BUTTON_REPEATED && repeat < expected.size())
+    {
+      long late = (long)(recorded.time - start - pressed) - (long)expected[repeat++];
+      CHECK(late >= 0 && late < UPDATE_PERIOD);
+    }
+  }
+  printf("Held %lu ms: %lu repeats, last interval %lu ms\n", hold, (unsigned long)expected.size(),
+         expected.size() > 1 ? expected.back() - expected[expected.size() - 2] : 0);
+  CHECK_EQUAL(BUTTON_REPEAT_MINIMUM_INTERVAL, expected.back() - expected[expected.size() - 2]);
+}
+
+// More edges than the buffer holds between two updates: the button follows the pin it ends on
+static void testOverflow(Button *button)
+{
+  for (uint8_t level = 0; level < 2; level++)
+  {
+    Waveform waveform;
+    for (unsigned long i = 0; i < 3 * BUTTON_EDGE_BUFFER_SIZE; i++)
+    {
+      Edge edge = {i / 4, (uint8_t)(i % 2 == 0 ? HIGH : LOW)};
+      waveform.push_back(edge);
+    }
+    if (level == HIGH)
+    {
+      Edge edge = {12, HIGH};
+      waveform.push_back(edge);
+    }
+
+    events.clear();
+    play(button, waveform, 200, 50);
+    CHECK(button->isPressed() == (level == HIGH));
+    CHECK_EQUAL(level == HIGH ? 1 : 0, countOf(BUTTON_PRESSED));
+    CHECK_EQUAL(0, countOf(BUTTON_RELEASED));
+
+    // Back to released
+    Waveform release = {{0, LOW}};
+    events.clear();
+    play(button, release, 100);
+    CHECK(!button->isPressed());
+  }
+}
+
+int main()
+{
+  halSetPin(BUTTON_PIN, LOW);
+  Button button(BUTTON_PIN, record);
+  CHECK_EQUAL(INPUT, halPinMode(BUTTON_PIN));
+
+  testBounce(&button);
+  testGlitch(&button);
+  testBlockedLoop(&button);
+  testHold(&button);
+  testOverflow(&button);
+
+  return checkResult();
+}
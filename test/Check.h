@@ -0,0 +1,44 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Minimal assertions for the host tests, a failed check is reported and the test exits non-zero at the end
+
+static int checkFailures = 0;
+
+#define CHECK(condition)                                                     \
+  do                                                                         \
+  {                                                                          \
+    if (!(condition))                                                        \
+    {                                                                        \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+      checkFailures++;                                                       \
+    }                                                                        \
+  } while (0)
+
+#define CHECK_EQUAL(expected, actual)                                                     \
+  do                                                                                      \
+  {                                                                                       \
+    long long checkExpected = (long long)(expected);                                      \
+    long long checkActual = (long long)(actual);                                          \
+    if (checkExpected != checkActual)                                                     \
+    {                                                                                     \
+      fprintf(stderr, "%s:%d: CHECK_EQUAL(%s, %s) failed: %lld != %lld\n", __FILE__, __LINE__, \
+              #expected, #actual, checkExpected, checkActual);                            \
+      checkFailures++;                                                                    \
+    }                                                                                     \
+  } while (0)
+
+static int checkResult()
+{
+  if (checkFailures > 0)
+  {
+    fprintf(stderr, "%d check(s) failed\n", checkFailures);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+#endif
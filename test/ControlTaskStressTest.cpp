@@ -0,0 +1,136 @@
+// The sketch on real threads: the control task runs on its own thread while loop() is stalled by
+// blocking I/O and HTTP clients keep the web service busy. Relay decisions must follow a mode
+// change within one control period no matter what the other core is doing.
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+#include "HttpClient.h"
+#include "Sketch.h"
+
+// loop() blocks this long in every STALL_PERIOD, longer than a control period
+#define STALL_TIME 200
+#define STALL_PERIOD 250
+
+#define HTTP_CLIENTS 3
+#define MODE_CHANGES 40
+
+// Slack for the host's thread scheduling on top of THERMOSTAT_UPDATE_PERIOD
+#define LATENCY_MARGIN 50
+
+static std::atomic<bool> running(true);
+static std::atomic<unsigned long> stalls(0);
+static std::atomic<unsigned long> responses(0);
+
+// Stands in for a blocking network write or flash commit on the loop() core
+static void stallTask()
+{
+  stalls++;
+  delay(STALL_TIME);
+}
+
+static void loopThread()
+{
+  while (running)
+  {
+    loop();
+  }
+}
+
+static void clientThread()
+{
+  HttpClient client;
+  HttpResponse response;
+  while (running)
+  {
+    if (!client.isOpen() && !client.connect(halListenPort()))
+    {
+      continue;
+    }
+    if (client.request("GET / HTTP/1.1\r\nHost: test\r\n\r\n", &response, 2000) && response.status == 200)
+    {
+      responses++;
+    }
+    else
+    {
+      client.close();
+    }
+  }
+}
+
+// Milliseconds until the heat relay reaches level
+static unsigned long waitForRelay(uint8_t level)
+{
+  unsigned long start = millis();
+  while (halPinLevel(HEAT_RELAY_PIN) != level && millis() - start < 5000)
+  {
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  return millis() - start;
+}
+
+int main()
+{
+  halUseRealTime(true);
+  halEepromErase();
+  setup();
+
+  scheduler->addTask("stall", stallTask, STALL_PERIOD);
+  CHECK_EQUAL(1, halTaskCount());
+  halStartTasks();
+
+  std::thread loopRunner(loopThread);
+  std::vector<std::thread> clients;
+  for (uint8_t i = 0; i < HTTP_CLIENTS; i++)
+  {
+    clients.push_back(std::thread(clientThread));
+  }
+
+  // Relays only switch once the control task has a temperature
+  unsigned long start = millis();
+  while (!controlStatus.read().temperature[0].isValid() && millis() - start < 10000)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  CHECK(controlStatus.read().temperature[0].isValid());
+
+  unsigned long worstLatency = 0;
+  unsigned long totalLatency = 0;
+  for (uint8_t i = 0; i < MODE_CHANGES; i++)
+  {
+    // Land anywhere in the stall cycle
+    std::this_thread::sleep_for(std::chrono::milliseconds(rand() % STALL_PERIOD));
+
+    thermostat->setMode(i % 2 == 0 ? Thermostat::ThermostatMode::HEAT : Thermostat::ThermostatMode::OFF);
+    unsigned long latency = waitForRelay(i % 2 == 0 ? HIGH : LOW);
+    totalLatency += latency;
+    if (latency > worstLatency)
+    {
+      worstLatency = latency;
+    }
+  }
+
+  running = false;
+  loopRunner.join();
+  for (std::thread &client : clients)
+  {
+    client.join();
+  }
+
+  const Scheduler::Task *control = controlScheduler->getTask(0);
+  printf("%d mode changes during %lu loop() stalls of %d ms and %lu HTTP responses\n", MODE_CHANGES, stalls.load(),
+         STALL_TIME, responses.load());
+  printf("Relay latency: mean %lu ms, worst %lu ms. Control task: %lu runs, %lu missed deadlines, worst %lu us\n",
+         totalLatency / MODE_CHANGES, worstLatency, control->runCount, control->missedDeadlines, control->maxRuntime);
+
+  CHECK(stalls > MODE_CHANGES / 2);
+  CHECK(responses > 0);
+  CHECK(worstLatency <= THERMOSTAT_UPDATE_PERIOD + LATENCY_MARGIN);
+  CHECK_EQUAL(0, control->missedDeadlines);
+
+  // The control task is still running, skip static destructors it could race with
+  fflush(stdout);
+  _exit(checkResult());
+}
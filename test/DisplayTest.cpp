@@ -0,0 +1,153 @@
+// Main screen rendering against the host framebuffer: only widgets whose text changed reach the
+// panel, the pixels the display reports are the pixels the panel received, and a screen built up
+// incrementally is identical to one drawn from scratch. Every update leaves the shared SPI bus free
+// and its frame time covers the bus time of everything it sent, DMA included.
+
+#include <vector>
+
+#include "Check.h"
+#include "Hal.h"
+#include "Display.h"
+#include "EnvironmentalSensor.h"
+
+#define FULL_SCREEN_PIXELS ((unsigned long)HAL_PANEL_WIDTH * HAL_PANEL_HEIGHT)
+
+#define HOUR 3600
+
+static std::vector<uint16_t> snapshot()
+{
+  return std::vector<uint16_t>(halFramebuffer(), halFramebuffer() + FULL_SCREEN_PIXELS);
+}
+
+// Draw the main screen and check the panel received exactly the pixels the display counted
+static unsigned long drawMain(Display *display, Temperature temperature, double humidity)
+{
+  unsigned long long pixels = halDisplay.pixels;
+  unsigned long long busTime = halDisplay.busTime;
+  display->main(temperature, humidity);
+  CHECK_EQUAL(display->getFramePixels(), halDisplay.pixels - pixels);
+  CHECK_EQUAL(display->getFramePixels() * 2, display->getFrameBytes());
+  CHECK(display->getFrameTime() >= halDisplay.busTime - busTime);
+  CHECK(halSpiOwner() == nullptr);
+  CHECK_EQUAL(0, halDisplay.dmaErrors);
+  return display->getFramePixels();
+}
+
+// The incrementally updated panel must match a full redraw of the same values
+static void checkMatchesFullRedraw(Display *display, Temperature temperature, double humidity)
+{
+  std::vector<uint16_t> incremental = snapshot();
+
+  display->welcome();
+  CHECK(drawMain(display, temperature, humidity) >= FULL_SCREEN_PIXELS);
+  CHECK(snapshot() == incremental);
+}
+
+static void testIncremental(Display *display, Thermostat *thermostat)
+{
+  Temperature temperature = Temperature::fromCelsius(21);
+  thermostat->setMode(Thermostat::ThermostatMode::OFF);
+
+  // The first frame clears the screen and draws every widget
+  CHECK(drawMain(display, temperature, 40) >= FULL_SCREEN_PIXELS);
+
+  // Nothing changed, nothing is sent
+  CHECK_EQUAL(0, drawMain(display, temperature, 40));
+  CHECK_EQUAL(0, drawMain(display, temperature, 40));
+
+  // One widget changed, only its box and the widgets it overlaps are sent. The temperature box is the largest
+  // and reaches under the widgets to its right.
+  temperature = Temperature::fromCelsius(22);
+  unsigned long pixels = drawMain(display, temperature, 40);
+  CHECK(pixels > 0);
+  CHECK(pixels < FULL_SCREEN_PIXELS / 2);
+  checkMatchesFullRedraw(display, temperature, 40);
+
+  // Narrower and wider text must not leave the old text behind
+  CHECK(drawMain(display, temperature, 100) > 0);
+  checkMatchesFullRedraw(display, temperature, 100);
+  CHECK(drawMain(display, temperature, 5) > 0);
+  checkMatchesFullRedraw(display, temperature, 5);
+  CHECK(drawMain(display, Temperature(), 5) > 0);
+  checkMatchesFullRedraw(display, Temperature(), 5);
+
+  // The setpoint appears in AUTOMATIC and disappears again, the mode widget changes with it
+  thermostat->setMode(Thermostat::ThermostatMode::AUTOMATIC);
+  CHECK(drawMain(display, temperature, 5) > 0);
+  checkMatchesFullRedraw(display, temperature, 5);
+  thermostat->setMode(Thermostat::ThermostatMode::OFF);
+  CHECK(drawMain(display, temperature, 5) > 0);
+  checkMatchesFullRedraw(display, temperature, 5);
+
+  // Another screen in between forces a full redraw even when the values are the same
+  display->wifiConnecting("network");
+  CHECK(drawMain(display, temperature, 5) >= FULL_SCREEN_PIXELS);
+}
+
+// An hour of once a second updates with the temperature and humidity drifting slowly, the sensor
+// sampling on the same bus in between
+static void reportHour(Display *display)
+{
+  ForcedBME280 bme(33);
+  CHECK(bme.begin());
+  EnvironmentalSensor sensor(&bme, 2000);
+  unsigned long collisions = halSpiCollisions();
+
+  // Full redraw for reference
+  display->welcome();
+  drawMain(display, Temperature::fromCelsius(20), 40);
+  unsigned long fullBytes = display->getFrameBytes();
+  unsigned long fullTime = display->getFrameTime();
+
+  unsigned long long bytes = 0;
+  unsigned long long frameTime = 0;
+  unsigned long longestFrame = 0;
+  unsigned long frames = 0;
+  unsigned long changedFrames = 0;
+  for (unsigned long second = 0; second < HOUR; second++)
+  {
+    Temperature temperature = Temperature::fromCelsius(20 + 2 * sin(second * 2 * M_PI / HOUR));
+    double humidity = 40 + 5 * cos(second * 2 * M_PI / HOUR);
+    if (drawMain(display, temperature, humidity) > 0)
+    {
+      bytes += display->getFrameBytes();
+      frameTime += display->getFrameTime();
+      changedFrames++;
+    }
+    if (display->getFrameTime() > longestFrame)
+    {
+      longestFrame = display->getFrameTime();
+    }
+    frames++;
+
+    for (uint8_t poll = 0; poll < 10; poll++)
+    {
+      halAdvance(100);
+      sensor.update();
+    }
+  }
+
+  printf("Full screen: %lu bytes in %lu us at %d MHz\n", fullBytes, fullTime, HAL_SPI_FREQUENCY / 1000000);
+  printf("%lu frames, %lu changed: %.0f bytes in %.0f us per changed frame, longest %lu us, %.0f bytes per frame "
+         "on average\n",
+         frames, changedFrames, (double)bytes / changedFrames, (double)frameTime / changedFrames, longestFrame,
+         (double)bytes / frames);
+  CHECK(changedFrames < frames / 10);
+  CHECK(bytes / frames < 2 * FULL_SCREEN_PIXELS / 100);
+  CHECK(longestFrame < fullTime);
+  CHECK_EQUAL(collisions, halSpiCollisions());
+  CHECK(sensor.getErrorCount() == 0);
+}
+
+int main()
+{
+  halEepromErase();
+  Display *display = new Display();
+  Thermostat *thermostat = Thermostat::getInstance();
+
+  testIncremental(display, thermostat);
+  reportHour(display);
+
+  CHECK(halSpiOwner() == nullptr);
+  return checkResult();
+}
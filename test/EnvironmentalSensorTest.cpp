@@ -0,0 +1,125 @@
+// Sampling pipeline against the mock BME280 in the HAL: conversions are started and collected
+// without ever waiting on the sensor, slow or missing sensors are counted as errors and readers
+// that fall behind the ring buffer skip ahead.
+
+#include "Check.h"
+#include "EnvironmentalSensor.h"
+#include "Hal.h"
+
+#define SAMPLE_PERIOD 2000
+#define POLL_PERIOD 5
+
+// Poll the pipeline like the sensor task for duration ms, returns the longest time one update took
+static unsigned long long poll(EnvironmentalSensor *sensor, unsigned long duration)
+{
+  unsigned long long longest = 0;
+  unsigned long start = millis();
+  while (millis() - start < duration)
+  {
+    unsigned long long before = halMicros();
+    sensor->update();
+    if (halMicros() - before > longest)
+    {
+      longest = halMicros() - before;
+    }
+    halAdvance(POLL_PERIOD);
+  }
+  return longest;
+}
+
+static void testSampling(ForcedBME280 *bme)
+{
+  EnvironmentalSensor sensor(bme, SAMPLE_PERIOD);
+  uint32_t cursor = 0;
+  EnvironmentalSample sample;
+  CHECK(!sensor.getLatestSample(&sample));
+
+  halBme280.temperature = 21.37;
+  halBme280.humidity = 45.5;
+  unsigned long start = millis();
+  unsigned long conversions = halBme280.conversions;
+  unsigned long long longest = poll(&sensor, 60000);
+
+  // One conversion per period, collected without reading early or blocking
+  CHECK_EQUAL(30, halBme280.conversions - conversions);
+  CHECK_EQUAL(0, halBme280.earlyReads);
+  CHECK_EQUAL(0, halBme280.blockedTime);
+  CHECK_EQUAL(0, longest);
+  CHECK_EQUAL(0, sensor.getErrorCount());
+  CHECK(halSpiOwner() == nullptr);
+
+  // The reader fell behind the buffer and skips to the oldest samples it still holds
+  unsigned long samples = 0;
+  unsigned long lastTimestamp = start + (30 - ENVIRONMENTAL_SAMPLE_BUFFER_SIZE) * SAMPLE_PERIOD;
+  while (sensor.readSample(&cursor, &sample))
+  {
+    CHECK_EQUAL(SAMPLE_PERIOD, sample.timestamp - lastTimestamp);
+    CHECK_EQUAL(2137, sample.temperature.centiCelsius());
+    CHECK(sample.humidity == 45.5f);
+    lastTimestamp = sample.timestamp;
+    samples++;
+  }
+  CHECK_EQUAL(ENVIRONMENTAL_SAMPLE_BUFFER_SIZE - 1, samples);
+
+  // A reader that keeps up sees every sample, the latest is always available
+  halBme280.temperature = 19;
+  poll(&sensor, SAMPLE_PERIOD);
+  CHECK(sensor.readSample(&cursor, &sample));
+  CHECK_EQUAL(1900, sample.temperature.centiCelsius());
+  CHECK(!sensor.readSample(&cursor, &sample));
+  CHECK(sensor.getLatestSample(&sample));
+  CHECK_EQUAL(1900, sample.temperature.centiCelsius());
+}
+
+// Conversions slower than BME280_MEASUREMENT_TIME are waited for by polling the status register
+static void testSlowConversion(ForcedBME280 *bme)
+{
+  halBme280.conversionTime = 40000;
+  EnvironmentalSensor sensor(bme, SAMPLE_PERIOD);
+  poll(&sensor, 10 * SAMPLE_PERIOD);
+
+  EnvironmentalSample sample;
+  CHECK(sensor.getLatestSample(&sample));
+  CHECK_EQUAL(0, halBme280.earlyReads);
+  CHECK_EQUAL(0, sensor.getErrorCount());
+  halBme280.conversionTime = 9300;
+}
+
+// A conversion that never completes is given up on after BME280_MEASUREMENT_TIMEOUT
+static void testTimeout(ForcedBME280 *bme)
+{
+  halBme280.conversionTime = 10 * BME280_MEASUREMENT_TIMEOUT * 1000UL;
+  EnvironmentalSensor sensor(bme, SAMPLE_PERIOD);
+  poll(&sensor, 10 * SAMPLE_PERIOD);
+
+  EnvironmentalSample sample;
+  CHECK(!sensor.getLatestSample(&sample));
+  CHECK_EQUAL(10, sensor.getErrorCount());
+  halBme280.conversionTime = 9300;
+}
+
+// A sensor returning no data is an error, not a sample
+static void testMissingSensor(ForcedBME280 *bme)
+{
+  halBme280.present = false;
+  EnvironmentalSensor sensor(bme, SAMPLE_PERIOD);
+  poll(&sensor, 10 * SAMPLE_PERIOD);
+
+  EnvironmentalSample sample;
+  CHECK(!sensor.getLatestSample(&sample));
+  CHECK_EQUAL(10, sensor.getErrorCount());
+  halBme280.present = true;
+}
+
+int main()
+{
+  ForcedBME280 bme(33);
+  CHECK(bme.begin());
+
+  testSampling(&bme);
+  testSlowConversion(&bme);
+  testTimeout(&bme);
+  testMissingSensor(&bme);
+
+  return checkResult();
+}
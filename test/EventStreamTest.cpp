@@ -0,0 +1,241 @@
+// /events against polling GET / over a simulated hour of the whole sketch: bytes on the wire for
+// both, a subscriber that merges the change events into its first status ends up with the same
+// document a poll returns, changes below the thresholds are not pushed and subscribers are bounded.
+
+#include "Check.h"
+#include "HttpClient.h"
+#include "JsonDocument.h"
+#include "Sketch.h"
+
+#define POLL_PERIOD 5000
+#define HOUR 3600000UL
+
+#define STATUS_REQUEST "GET / HTTP/1.1\r\n\r\n"
+#define EVENTS_REQUEST "GET /events HTTP/1.1\r\n\r\n"
+
+// Whether the subscriber's merged document matches a polled one: exactly, apart from values that
+// moved by less than their event threshold since they were last pushed
+static bool matches(const Document &merged, const Document &polled)
+{
+  if (merged.size() != polled.size())
+  {
+    return false;
+  }
+
+  for (Document::const_iterator member = polled.begin(); member != polled.end(); ++member)
+  {
+    Document::const_iterator other = merged.find(member->first);
+    if (other == merged.end())
+    {
+      return false;
+    }
+
+    double threshold = 0;
+    if (member->first == "/environment/temperature")
+    {
+      threshold = WEB_EVENT_TEMPERATURE_THRESHOLD;
+    }
+    else if (member->first == "/environment/humidity")
+    {
+      threshold = WEB_EVENT_HUMIDITY_THRESHOLD;
+    }
+    else if (member->first == "/environment/confidence")
+    {
+      threshold = WEB_EVENT_CONFIDENCE_THRESHOLD;
+    }
+
+    if (threshold == 0 ? other->second != member->second
+                       : fabs(atof(other->second.c_str()) - atof(member->second.c_str())) >= threshold)
+    {
+      fprintf(stderr, "%s: merged %s, polled %s\n", member->first.c_str(), other->second.c_str(), member->second.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+struct Subscriber
+{
+  HttpClient client;
+  // Status of the response to the subscription, 0 until its head arrived
+  int status;
+  Document state;
+  unsigned long statusEvents;
+  unsigned long changeEvents;
+  unsigned long heartbeats;
+
+  Subscriber() : status(0), statusEvents(0), changeEvents(0), heartbeats(0)
+  {
+  }
+
+  bool subscribe()
+  {
+    return client.connect(halListenPort()) && client.send(EVENTS_REQUEST);
+  }
+
+  // Apply every complete event received so far
+  void receive()
+  {
+    client.poll();
+    std::string &pending = client.pending();
+    if (status == 0)
+    {
+      size_t headEnd = pending.find("\r\n\r\n");
+      if (headEnd == std::string::npos)
+      {
+        return;
+      }
+      status = atoi(pending.c_str() + 9);
+      if (status != 200)
+      {
+        return;
+      }
+      CHECK_EQUAL(0, pending.find("HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\n"));
+      pending.erase(0, headEnd + 4);
+    }
+    if (status != 200)
+    {
+      return;
+    }
+
+    size_t end;
+    while ((end = pending.find("\n\n")) != std::string::npos)
+    {
+      std::string event = pending.substr(0, end);
+      pending.erase(0, end + 2);
+
+      if (event == ":")
+      {
+        heartbeats++;
+        continue;
+      }
+
+      size_t dataStart = event.find("\ndata: ") + 7;
+      Document data = parse(event.substr(dataStart));
+      if (event.compare(0, 13, "event: status") == 0)
+      {
+        state = data;
+        statusEvents++;
+      }
+      else
+      {
+        CHECK(event.compare(0, 13, "event: change") == 0);
+        for (Document::iterator member = data.begin(); member != data.end(); ++member)
+        {
+          CHECK(state.count(member->first) == 1);
+          state[member->first] = member->second;
+        }
+        changeEvents++;
+      }
+    }
+  }
+};
+
+// Run the sketch for duration, polling GET / every POLL_PERIOD on a keep-alive connection
+static void run(unsigned long duration, Subscriber *subscriber, HttpClient *poller, unsigned long long *pollBytes,
+                std::string *lastStatus)
+{
+  unsigned long start = millis();
+  unsigned long lastPoll = start - POLL_PERIOD;
+  bool waiting = false;
+  while (millis() - start < duration)
+  {
+    if (!waiting && millis() - lastPoll >= POLL_PERIOD)
+    {
+      if (!poller->isOpen())
+      {
+        poller->connect(halListenPort());
+      }
+      poller->send(STATUS_REQUEST);
+      *pollBytes += strlen(STATUS_REQUEST);
+      lastPoll = millis();
+      waiting = true;
+    }
+
+    sketchStep();
+
+    poller->poll();
+    HttpResponse response;
+    if (waiting && poller->takeResponse(&response))
+    {
+      *pollBytes += response.size;
+      *lastStatus = response.body;
+      waiting = false;
+    }
+    subscriber->receive();
+  }
+}
+
+int main()
+{
+  halEepromErase();
+  setup();
+
+  Subscriber subscriber;
+  CHECK(subscriber.subscribe());
+  unsigned long long streamBaseline = strlen(EVENTS_REQUEST);
+
+  HttpClient poller;
+  unsigned long long pollBytes = 0;
+  std::string lastStatus;
+
+  // A quiet hour: the room holds its temperature, only heartbeats are sent
+  run(HOUR, &subscriber, &poller, &pollBytes, &lastStatus);
+  unsigned long changes = subscriber.changeEvents;
+  unsigned long long quietStreamBytes = streamBaseline + subscriber.client.getBytesReceived();
+  unsigned long long quietPollBytes = pollBytes;
+  printf("Quiet hour: %llu bytes streamed (%lu changes, %lu heartbeats), %llu bytes polling every %d s\n",
+         quietStreamBytes, changes, subscriber.heartbeats, quietPollBytes, POLL_PERIOD / 1000);
+  CHECK_EQUAL(1, subscriber.statusEvents);
+  CHECK(changes <= 2);
+  CHECK(subscriber.heartbeats >= HOUR / WEB_EVENT_HEARTBEAT_PERIOD - 1);
+  CHECK(quietStreamBytes * 50 < quietPollBytes);
+
+  // Changes smaller than the threshold are not pushed
+  changes = subscriber.changeEvents;
+  halBme280.temperature += WEB_EVENT_TEMPERATURE_THRESHOLD / 2;
+  run(10000, &subscriber, &poller, &pollBytes, &lastStatus);
+  CHECK_EQUAL(changes, subscriber.changeEvents);
+
+  // A busy hour: the temperature drifts, the setpoint and mode change every few minutes
+  unsigned long long streamBytes = subscriber.client.getBytesReceived();
+  pollBytes = 0;
+  changes = subscriber.changeEvents;
+  for (unsigned long minute = 0; minute < 60; minute++)
+  {
+    halBme280.temperature = 21 + 2 * sin(minute * 2 * M_PI / 60);
+    if (minute % 10 == 0)
+    {
+      thermostat->setMode(minute % 20 == 0 ? Thermostat::ThermostatMode::HEAT : Thermostat::ThermostatMode::AUTOMATIC);
+    }
+    if (minute % 15 == 0)
+    {
+      thermostat->setSetpointLow(Temperature::fromCelsius(minute % 30 == 0 ? 20 : 21));
+    }
+    run(60000, &subscriber, &poller, &pollBytes, &lastStatus);
+  }
+  streamBytes = subscriber.client.getBytesReceived() - streamBytes;
+  changes = subscriber.changeEvents - changes;
+  printf("Busy hour: %llu bytes streamed in %lu changes, %llu bytes polling every %d s\n", streamBytes, changes,
+         pollBytes, POLL_PERIOD / 1000);
+  CHECK(changes > 60);
+  CHECK(streamBytes * 20 < pollBytes);
+
+  // The merged events are the document a poll returns
+  run(POLL_PERIOD, &subscriber, &poller, &pollBytes, &lastStatus);
+  Document polled = parse(lastStatus);
+  CHECK(polled.size() == 9);
+  CHECK(matches(subscriber.state, polled));
+
+  // Fan-out is bounded: with the first subscriber still open, the last of these is refused
+  Subscriber others[WEB_EVENT_MAX_SUBSCRIBERS];
+  for (uint8_t i = 0; i < WEB_EVENT_MAX_SUBSCRIBERS; i++)
+  {
+    CHECK(others[i].subscribe());
+    run(10, &others[i], &poller, &pollBytes, &lastStatus);
+  }
+  CHECK_EQUAL(1, others[WEB_EVENT_MAX_SUBSCRIBERS - 2].statusEvents);
+  CHECK_EQUAL(503, others[WEB_EVENT_MAX_SUBSCRIBERS - 1].status);
+
+  return checkResult();
+}
@@ -0,0 +1,264 @@
+// The history's memory bound and contents over simulated days: the footprint is fixed at the
+// documented bound however long the sketch runs, feeding it never allocates, the raw deltas rebuild
+// every sample exactly and the rollups hold the min, max and average of their samples. /history
+// streams more than the response buffer holds, in chunks.
+
+#include <map>
+
+#include "AllocationCounter.h"
+#include "Check.h"
+#include "HttpClient.h"
+#include "Sketch.h"
+
+#define DAY 86400000UL
+#define SAMPLE_PERIOD 2000
+
+// Documented cost of each part of a day of history, see HISTORY_MEMORY_BUDGET
+#define RAW_BYTES (HISTORY_RAW_SIZE * 3)
+#define ROLLUP_BYTES ((HISTORY_MINUTE_SIZE + HISTORY_QUARTER_SIZE) * 12)
+#define TRANSITION_BYTES (HISTORY_TRANSITION_SIZE * 8)
+
+struct Expected
+{
+  int16_t temperatureMin;
+  int16_t temperatureMax;
+  int32_t temperatureSum;
+  uint32_t humiditySum;
+  uint16_t count;
+};
+
+struct Input
+{
+  uint32_t time;
+  int16_t temperature;
+  uint8_t humidity;
+};
+
+typedef std::map<uint32_t, Expected> Buckets;
+
+// A daily swing with a little sensor noise, in the units the history stores
+static Input inputAt(unsigned long timestamp)
+{
+  Input input;
+  input.time = timestamp / 1000;
+  input.temperature = 2000 + 300 * sin(timestamp * 2 * M_PI / DAY) + (int)(timestamp / SAMPLE_PERIOD * 7 % 11) - 5;
+  input.humidity = 80 + 20 * cos(timestamp * 2 * M_PI / DAY);
+  return input;
+}
+
+static void expect(Buckets *buckets, uint32_t start, const Input &input)
+{
+  Buckets::iterator bucket = buckets->find(start);
+  if (bucket == buckets->end())
+  {
+    Expected expected = {input.temperature, input.temperature, 0, 0, 0};
+    bucket = buckets->insert(std::make_pair(start, expected)).first;
+  }
+  bucket->second.temperatureMin = std::min(bucket->second.temperatureMin, input.temperature);
+  bucket->second.temperatureMax = std::max(bucket->second.temperatureMax, input.temperature);
+  bucket->second.temperatureSum += input.temperature;
+  bucket->second.humiditySum += input.humidity;
+  bucket->second.count++;
+}
+
+static void checkBucket(const Buckets &buckets, const HistoryBucket &bucket)
+{
+  Buckets::const_iterator expected = buckets.find(bucket.time);
+  CHECK(expected != buckets.end());
+  if (expected == buckets.end())
+  {
+    return;
+  }
+  CHECK_EQUAL(expected->second.temperatureMin, bucket.temperatureMin.centiCelsius());
+  CHECK_EQUAL(expected->second.temperatureMax, bucket.temperatureMax.centiCelsius());
+  CHECK_EQUAL(expected->second.temperatureSum / expected->second.count, bucket.temperatureAverage.centiCelsius());
+  CHECK_EQUAL(expected->second.humiditySum / expected->second.count, bucket.humidityAverage);
+}
+
+static void checkRollups(History *history, const Buckets &minutes, const Buckets &quarters, uint32_t now)
+{
+  CHECK_EQUAL(HISTORY_MINUTE_SIZE, history->getMinuteCount());
+  for (uint16_t i = 0; i < history->getMinuteCount(); i++)
+  {
+    HistoryBucket bucket = history->getMinute(i);
+    CHECK_EQUAL(now - now % HISTORY_MINUTE_SECONDS - (HISTORY_MINUTE_SIZE - i) * HISTORY_MINUTE_SECONDS, bucket.time);
+    checkBucket(minutes, bucket);
+  }
+
+  // The quarter rollups cover a whole day
+  CHECK_EQUAL(HISTORY_QUARTER_SIZE, history->getQuarterCount());
+  CHECK_EQUAL(DAY / 1000 - HISTORY_QUARTER_SECONDS, history->getQuarter(HISTORY_QUARTER_SIZE - 1).time - history->getQuarter(0).time);
+  for (uint16_t i = 0; i < history->getQuarterCount(); i++)
+  {
+    HistoryBucket bucket = history->getQuarter(i);
+    CHECK_EQUAL(now - now % HISTORY_QUARTER_SECONDS - (HISTORY_QUARTER_SIZE - i) * HISTORY_QUARTER_SECONDS, bucket.time);
+    checkBucket(quarters, bucket);
+  }
+}
+
+// Feed days of samples into a history of its own, the footprint stays at the bound and nothing is allocated
+static void testDays(uint8_t days)
+{
+  History *history = new History();
+  Buckets minutes;
+  Buckets quarters;
+  Input raw[HISTORY_RAW_SIZE];
+  // Up to a quarter past the last day, so the day's last quarter is closed
+  unsigned long samples = (days * DAY + HISTORY_QUARTER_SECONDS * 1000UL) / SAMPLE_PERIOD;
+
+  unsigned long long allocations = allocationCount;
+  unsigned long timestamp = 0;
+  for (unsigned long i = 0; i < samples; i++)
+  {
+    timestamp = 1000 + i * SAMPLE_PERIOD;
+    Input input = inputAt(timestamp);
+
+    allocationCounting = true;
+    history->addSample(timestamp, Temperature::fromCentiCelsius(input.temperature), input.humidity / 2.0);
+    allocationCounting = false;
+
+    raw[i % HISTORY_RAW_SIZE] = input;
+    expect(&minutes, input.time - input.time % HISTORY_MINUTE_SECONDS, input);
+    expect(&quarters, input.time - input.time % HISTORY_QUARTER_SECONDS, input);
+  }
+  CHECK_EQUAL(0, allocationCount - allocations);
+
+  // The raw deltas rebuild the newest samples exactly, no quantisation error accumulates over the days
+  CHECK_EQUAL(HISTORY_RAW_SIZE, history->getRawCount());
+  HistoryRawIterator iterator;
+  HistorySample sample;
+  history->beginRaw(&iterator);
+  for (unsigned long i = samples - HISTORY_RAW_SIZE; i < samples; i++)
+  {
+    CHECK(history->nextRaw(&iterator, &sample));
+    const Input &input = raw[i % HISTORY_RAW_SIZE];
+    CHECK_EQUAL(input.time, sample.time);
+    CHECK_EQUAL(input.temperature, sample.temperature.centiCelsius());
+    CHECK_EQUAL(input.humidity, sample.humidity);
+  }
+  CHECK(!history->nextRaw(&iterator, &sample));
+
+  checkRollups(history, minutes, quarters, timestamp / 1000);
+  delete history;
+}
+
+// Only the last HISTORY_TRANSITION_SIZE - 1 transitions are held, oldest first
+static void testTransitions()
+{
+  History history;
+  for (uint16_t i = 0; i < 3 * HISTORY_TRANSITION_SIZE; i++)
+  {
+    halAdvance(1000);
+    history.addTransition(i % 2 == 0 ? Thermostat::ThermostatState::HEATING : Thermostat::ThermostatState::IDLE);
+  }
+
+  uint32_t cursor = history.beginTransitions();
+  HistoryTransition transition;
+  unsigned long count = 0;
+  uint32_t last = 0;
+  while (history.nextTransition(&cursor, &transition))
+  {
+    CHECK(count == 0 || transition.time == last + 1000);
+    last = transition.time;
+    count++;
+  }
+  CHECK_EQUAL(HISTORY_TRANSITION_SIZE - 1, count);
+  CHECK_EQUAL(millis(), last);
+}
+
+// Run loop() until the response arrives
+static bool exchange(HttpClient *client, const std::string &request, HttpResponse *response)
+{
+  if (!client->isOpen() && !client->connect(halListenPort()))
+  {
+    return false;
+  }
+  client->send(request);
+
+  for (unsigned long pass = 0; pass < 1000; pass++)
+  {
+    loop();
+    bool open = client->poll();
+    if (client->takeResponse(response))
+    {
+      return true;
+    }
+    if (!open)
+    {
+      return false;
+    }
+  }
+  return false;
+}
+
+// Entries in a /history JSON document
+static unsigned long entryCount(const std::string &body)
+{
+  unsigned long count = 0;
+  for (size_t at = body.find("\"entries\":[") + 11; at < body.size(); at++)
+  {
+    count += body[at] == '[';
+  }
+  return count;
+}
+
+// The sketch's own history after a day, streamed over /history
+static void testEndpoint()
+{
+  halEepromErase();
+  setup();
+
+  // Skip ahead a day and fill the sketch's history as the sensor would have
+  unsigned long start = millis();
+  halAdvance(DAY);
+  for (unsigned long timestamp = start; timestamp < millis(); timestamp += SAMPLE_PERIOD)
+  {
+    Input input = inputAt(timestamp);
+    history->addSample(timestamp, Temperature::fromCentiCelsius(input.temperature), input.humidity / 2.0);
+  }
+
+  HttpClient client;
+  HttpResponse response;
+  const char *resolutions[] = {"raw", "minute", "quarter"};
+  unsigned long counts[] = {HISTORY_RAW_SIZE, HISTORY_MINUTE_SIZE, HISTORY_QUARTER_SIZE};
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    CHECK(exchange(&client, std::string("GET /history?resolution=") + resolutions[i] + " HTTP/1.1\r\n\r\n", &response));
+    CHECK_EQUAL(200, response.status);
+    CHECK(response.headers.find("Transfer-Encoding: chunked") != std::string::npos);
+    CHECK_EQUAL(response.body.size() - 2, response.body.rfind("]}"));
+    CHECK_EQUAL(counts[i], entryCount(response.body));
+    printf("/history?resolution=%s: %lu entries in %lu bytes\n", resolutions[i], counts[i], (unsigned long)response.body.size());
+  }
+  CHECK(response.body.size() > WEB_RESPONSE_BUFFER_SIZE);
+
+  // A range from the last hour only
+  unsigned long since = millis() / 1000 - 3600;
+  unsigned long inRange = 0;
+  for (uint16_t i = 0; i < history->getMinuteCount(); i++)
+  {
+    inRange += history->getMinute(i).time >= since;
+  }
+  char request[80];
+  snprintf(request, sizeof(request), "GET /history?resolution=minute&since=%lu HTTP/1.1\r\n\r\n", since);
+  CHECK(exchange(&client, request, &response));
+  CHECK(inRange >= 59 && inRange <= 60);
+  CHECK_EQUAL(inRange, entryCount(response.body));
+}
+
+int main()
+{
+  printf("History: %lu bytes, %d raw + %d rollup + %d transition bytes, budget %d bytes\n", (unsigned long)sizeof(History),
+         RAW_BYTES, ROLLUP_BYTES, TRANSITION_BYTES, HISTORY_MEMORY_BUDGET);
+  CHECK_EQUAL(12, sizeof(HistoryBucket));
+  CHECK_EQUAL(8, sizeof(HistoryTransition));
+  CHECK(RAW_BYTES + ROLLUP_BYTES + TRANSITION_BYTES <= sizeof(History));
+  CHECK(sizeof(History) <= HISTORY_MEMORY_BUDGET);
+
+  testDays(1);
+  testDays(3);
+  testTransitions();
+  testEndpoint();
+
+  return checkResult();
+}
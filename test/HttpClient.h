@@ -0,0 +1,250 @@
+#ifndef HTTP_CLIENT_H
+#define HTTP_CLIENT_H
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+// Test client for the sketch's HTTP server over loopback. Reads never block, so tests on the
+// simulated clock can pump the sketch between polls, threaded tests use request().
+
+struct HttpResponse
+{
+  int status;
+  std::string headers;
+  std::string body;
+  // Bytes of the whole response on the wire
+  size_t size;
+};
+
+class HttpClient
+{
+private:
+  int fd;
+  bool open;
+  std::string received;
+  unsigned long long bytesReceived;
+
+  static bool header(const std::string &headers, const char *name, std::string *value)
+  {
+    size_t start = 0;
+    while ((start = headers.find("\r\n", start)) != std::string::npos)
+    {
+      start += 2;
+      if (strncasecmp(headers.c_str() + start, name, strlen(name)) == 0 && headers[start + strlen(name)] == ':')
+      {
+        size_t valueStart = headers.find_first_not_of(' ', start + strlen(name) + 1);
+        *value = headers.substr(valueStart, headers.find("\r\n", valueStart) - valueStart);
+        return true;
+      }
+    }
+    return false;
+  }
+
+public:
+  HttpClient()
+  {
+    fd = -1;
+    open = false;
+    bytesReceived = 0;
+  }
+
+  ~HttpClient()
+  {
+    close();
+  }
+
+  // A small receiveBuffer makes a client that stops reading stall the server's writes quickly
+  bool connect(uint16_t port, int receiveBuffer = 0)
+  {
+    close();
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (receiveBuffer > 0)
+    {
+      setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, sizeof(receiveBuffer));
+    }
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (::connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0)
+    {
+      close();
+      return false;
+    }
+
+    int noDelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    open = true;
+    received.clear();
+    return true;
+  }
+
+  void close()
+  {
+    if (fd >= 0)
+    {
+      ::close(fd);
+      fd = -1;
+    }
+    open = false;
+  }
+
+  bool send(const std::string &data)
+  {
+    size_t sent = 0;
+    while (fd >= 0 && sent < data.size())
+    {
+      ssize_t result = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+      if (result <= 0)
+      {
+        return false;
+      }
+      sent += result;
+    }
+    return sent == data.size();
+  }
+
+  // Read whatever has arrived without waiting, returns false once the server has closed the connection
+  bool poll()
+  {
+    char buffer[4096];
+    while (open)
+    {
+      ssize_t result = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+      if (result > 0)
+      {
+        received.append(buffer, result);
+        bytesReceived += result;
+      }
+      else if (result == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+      {
+        open = false;
+      }
+      else
+      {
+        break;
+      }
+    }
+    return open;
+  }
+
+  // Take the first complete response out of what has arrived, false if it is not complete yet.
+  // Responses without a length end when the server closes the connection.
+  bool takeResponse(HttpResponse *response)
+  {
+    size_t headEnd = received.find("\r\n\r\n");
+    if (headEnd == std::string::npos)
+    {
+      return false;
+    }
+
+    response->headers = received.substr(0, headEnd + 2);
+    response->status = atoi(received.c_str() + 9);
+    size_t bodyStart = headEnd + 4;
+
+    std::string value;
+    size_t end;
+    if (header(response->headers, "Content-Length", &value))
+    {
+      end = bodyStart + strtoul(value.c_str(), NULL, 10);
+      if (received.size() < end)
+      {
+        return false;
+      }
+      response->body = received.substr(bodyStart, end - bodyStart);
+    }
+    else if (header(response->headers, "Transfer-Encoding", &value) && value == "chunked")
+    {
+      response->body.clear();
+      end = bodyStart;
+      for (;;)
+      {
+        size_t sizeEnd = received.find("\r\n", end);
+        if (sizeEnd == std::string::npos)
+        {
+          return false;
+        }
+        size_t size = strtoul(received.c_str() + end, NULL, 16);
+        if (received.size() < sizeEnd + 2 + size + 2)
+        {
+          return false;
+        }
+        response->body.append(received, sizeEnd + 2, size);
+        end = sizeEnd + 2 + size + 2;
+        if (size == 0)
+        {
+          break;
+        }
+      }
+    }
+    else
+    {
+      if (open)
+      {
+        return false;
+      }
+      end = received.size();
+      response->body = received.substr(bodyStart);
+    }
+
+    response->size = end;
+    received.erase(0, end);
+    return true;
+  }
+
+  bool isOpen()
+  {
+    return open;
+  }
+
+  // Received bytes not taken as a response yet, such as an event stream
+  std::string &pending()
+  {
+    return received;
+  }
+
+  unsigned long long getBytesReceived()
+  {
+    return bytesReceived;
+  }
+
+  // Send a request and wait for its response, for servers running on another thread
+  bool request(const std::string &text, HttpResponse *response, unsigned long timeout = 5000)
+  {
+    if (!send(text))
+    {
+      return false;
+    }
+
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+    while (std::chrono::steady_clock::now() < deadline)
+    {
+      bool stillOpen = poll();
+      if (takeResponse(response))
+      {
+        return true;
+      }
+      if (!stillOpen)
+      {
+        return false;
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    return false;
+  }
+};
+
+#endif
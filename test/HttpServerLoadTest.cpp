@@ -0,0 +1,110 @@
+// The sketch's web service under concurrent clients on real time: more clients than
+// HTTP_SERVER_MAX_CONNECTIONS, half on keep-alive connections and half connecting for every
+// request, while loop() runs its other tasks. Reports request latency percentiles and throughput.
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+#include "HttpClient.h"
+#include "Sketch.h"
+
+#define CLIENTS 10
+#define REQUESTS_PER_CLIENT 300
+
+static std::atomic<bool> running(true);
+static std::mutex latenciesMutex;
+// Microseconds from sending a request to its complete response
+static std::vector<double> latencies;
+static std::atomic<unsigned long> failures(0);
+
+static void loopThread()
+{
+  while (running)
+  {
+    loop();
+  }
+}
+
+static void clientThread(bool keepAlive)
+{
+  const char *request = keepAlive ? "GET / HTTP/1.1\r\n\r\n" : "GET / HTTP/1.1\r\nConnection: close\r\n\r\n";
+  std::vector<double> own;
+  HttpClient client;
+  HttpResponse response;
+
+  for (unsigned long i = 0; i < REQUESTS_PER_CLIENT; i++)
+  {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (!client.isOpen() && !client.connect(halListenPort()))
+    {
+      failures++;
+      continue;
+    }
+    if (!client.request(request, &response) || response.status != 200)
+    {
+      failures++;
+      client.close();
+      continue;
+    }
+    own.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+
+    // Wait for the server to close, keep-alive connections are also closed after HTTP_SERVER_MAX_KEEP_ALIVE_REQUESTS
+    if (!keepAlive || response.headers.find("Connection: close") != std::string::npos)
+    {
+      client.close();
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(latenciesMutex);
+  latencies.insert(latencies.end(), own.begin(), own.end());
+}
+
+static double percentile(double fraction)
+{
+  return latencies[(size_t)(fraction * (latencies.size() - 1))];
+}
+
+int main()
+{
+  halUseRealTime(true);
+  halEepromErase();
+  setup();
+  halStartTasks();
+
+  std::thread loopRunner(loopThread);
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::vector<std::thread> clients;
+  for (uint8_t i = 0; i < CLIENTS; i++)
+  {
+    clients.push_back(std::thread(clientThread, i % 2 == 0));
+  }
+  for (std::thread &client : clients)
+  {
+    client.join();
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  running = false;
+  loopRunner.join();
+
+  std::sort(latencies.begin(), latencies.end());
+  printf("%d clients, %lu requests in %.1f s: %.0f requests/s, %lu failed\n", CLIENTS, (unsigned long)latencies.size(),
+         seconds, latencies.size() / seconds, failures.load());
+  printf("Latency: p50 %.2f ms, p99 %.2f ms, max %.2f ms\n", percentile(0.5) / 1000, percentile(0.99) / 1000,
+         latencies.back() / 1000);
+
+  CHECK_EQUAL(0, failures);
+  CHECK_EQUAL(CLIENTS * REQUESTS_PER_CLIENT, latencies.size());
+  // A request waits for at most a few web service periods even with every connection slot taken
+  CHECK(percentile(0.5) < 20 * WEB_SERVICE_UPDATE_PERIOD * 1000);
+  CHECK(percentile(0.99) < 100 * WEB_SERVICE_UPDATE_PERIOD * 1000);
+
+  // The control task is still running, skip static destructors it could race with
+  fflush(stdout);
+  _exit(checkResult());
+}
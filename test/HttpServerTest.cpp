@@ -0,0 +1,312 @@
+// HTTP server request framing and slow clients on the simulated clock: Content-Length values the
+// server could read differently than a proxy are refused before anything is stored, oversized
+// requests are answered and closed, and a client that stops reading never holds the server up. Its
+// output is buffered and sent as the client reads, and the connection is dropped once the buffer
+// overflows or the output has waited HTTP_SERVER_WRITE_TIMEOUT.
+
+#include <chrono>
+
+#include "Check.h"
+#include "Hal.h"
+#include "HttpClient.h"
+#include "HttpServer.h"
+
+#define LARGE_RESPONSE_SIZE 262144
+
+// Bytes of one stream message
+#define MESSAGE_SIZE 100
+
+static HttpServer *server;
+static unsigned long echoRequests = 0;
+static char largeResponse[LARGE_RESPONSE_SIZE];
+static int32_t stream = HTTP_SERVER_INVALID_STREAM;
+
+// What beginStream sends ahead of the messages
+static const char streamHeader[] = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nCache-Control: no-cache\r\nConnection: keep-alive\r\n\r\n";
+
+static void handleEcho()
+{
+  echoRequests++;
+  server->send(200, "text/plain", server->body());
+}
+
+static void handleLarge()
+{
+  server->send(200, "text/plain", largeResponse, sizeof(largeResponse));
+}
+
+static void handleStream()
+{
+  stream = server->beginStream("text/plain");
+}
+
+// Serve until the client has a complete response, false if the connection closed without one
+static bool exchange(HttpClient *client, const std::string &request, HttpResponse *response)
+{
+  if (!client->isOpen() && !client->connect(halListenPort()))
+  {
+    return false;
+  }
+  client->send(request);
+
+  for (unsigned long pass = 0; pass < 1000; pass++)
+  {
+    server->handleClient();
+    halAdvance(1);
+
+    bool open = client->poll();
+    if (client->takeResponse(response))
+    {
+      return true;
+    }
+    if (!open)
+    {
+      return false;
+    }
+  }
+  return false;
+}
+
+// The response to request and whether the server closed the connection after it
+static int statusOf(const std::string &request, bool *closed)
+{
+  HttpClient client;
+  HttpResponse response;
+  if (!exchange(&client, request, &response))
+  {
+    return 0;
+  }
+
+  for (uint8_t pass = 0; pass < 10; pass++)
+  {
+    server->handleClient();
+  }
+  *closed = !client.poll();
+  return response.status;
+}
+
+static void testContentLength()
+{
+  bool closed;
+  unsigned long requests = echoRequests;
+
+  CHECK_EQUAL(200, statusOf("POST /echo HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello", &closed));
+  CHECK(!closed);
+  CHECK_EQUAL(200, statusOf("POST /echo HTTP/1.1\r\nContent-Length:  5 \r\n\r\nhello", &closed));
+  CHECK_EQUAL(2, echoRequests - requests);
+
+  // 65541 and 2^32 + 5 would have been stored as 5 in 16 and 32 bits
+  CHECK_EQUAL(413, statusOf("POST /echo HTTP/1.1\r\nContent-Length: 65541\r\n\r\nhello", &closed));
+  CHECK(closed);
+  CHECK_EQUAL(413, statusOf("POST /echo HTTP/1.1\r\nContent-Length: 4294967301\r\n\r\nhello", &closed));
+  CHECK(closed);
+  CHECK_EQUAL(413, statusOf("POST /echo HTTP/1.1\r\nContent-Length: 1025\r\n\r\nhello", &closed));
+  CHECK(closed);
+
+  // Lengths that are not a plain number
+  CHECK_EQUAL(400, statusOf("POST /echo HTTP/1.1\r\nContent-Length: -1\r\n\r\nhello", &closed));
+  CHECK(closed);
+  CHECK_EQUAL(400, statusOf("POST /echo HTTP/1.1\r\nContent-Length: 5x\r\n\r\nhello", &closed));
+  CHECK_EQUAL(400, statusOf("POST /echo HTTP/1.1\r\nContent-Length:\r\n\r\nhello", &closed));
+
+  // Repeated headers must agree
+  CHECK_EQUAL(200, statusOf("POST /echo HTTP/1.1\r\nContent-Length: 5\r\nContent-Length: 5\r\n\r\nhello", &closed));
+  CHECK_EQUAL(400, statusOf("POST /echo HTTP/1.1\r\nContent-Length: 5\r\nContent-Length: 0\r\n\r\nhello", &closed));
+  CHECK(closed);
+
+  CHECK_EQUAL(3, echoRequests - requests);
+}
+
+// A body the server does not frame must not be served as a request of its own
+static void testSmuggling()
+{
+  bool closed;
+  unsigned long requests = echoRequests;
+
+  CHECK_EQUAL(501, statusOf("POST /echo HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                            "2F\r\nGET /echo HTTP/1.1\r\nContent-Length: 0\r\n\r\n\r\n0\r\n\r\n",
+                            &closed));
+  CHECK(closed);
+  CHECK_EQUAL(400, statusOf("POST /echo HTTP/1.1\r\nContent-Length: 0\r\nContent-Length: 45\r\n\r\n"
+                            "GET /echo HTTP/1.1\r\nContent-Length: 0\r\n\r\n",
+                            &closed));
+  CHECK(closed);
+
+  CHECK_EQUAL(0, echoRequests - requests);
+}
+
+// A rejected request after a served one on the same connection is still answered, and leaves no
+// current request behind
+static void testRejectAfterRequest()
+{
+  HttpClient client;
+  HttpResponse response;
+  CHECK(exchange(&client, "POST /echo HTTP/1.1\r\nAccept: text/plain\r\nContent-Length: 5\r\n\r\nhello", &response));
+  CHECK_EQUAL(200, response.status);
+  CHECK(response.body == "hello");
+
+  CHECK(exchange(&client, "POST /echo HTTP/1.1\r\nAccept: text/plain\r\nContent-Length: 9999\r\n\r\n", &response));
+  CHECK_EQUAL(413, response.status);
+  CHECK(!server->accepts("text/plain"));
+  CHECK(server->body()[0] == '\0');
+
+  // A head that never ends fills the buffer
+  CHECK(exchange(&client, "GET /echo HTTP/1.1\r\nX-Padding: " + std::string(2000, 'x'), &response));
+  CHECK_EQUAL(413, response.status);
+  CHECK(!server->accepts("text/plain"));
+}
+
+// A client that stops reading a response larger than the socket and output buffer hold is dropped
+// at once, without waiting for it
+static void testStalledClient()
+{
+  HttpClient stalled;
+  CHECK(stalled.connect(halListenPort(), 4096));
+  stalled.send("GET /large HTTP/1.1\r\n\r\n");
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (uint8_t pass = 0; pass < 10; pass++)
+  {
+    server->handleClient();
+  }
+  double blocked = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  stalled.poll();
+  printf("Stalled client: loop blocked %.0f ms for a %d byte response, %llu bytes delivered\n", blocked,
+         LARGE_RESPONSE_SIZE, stalled.getBytesReceived());
+  CHECK(blocked < HTTP_SERVER_WRITE_TIMEOUT / 2);
+  CHECK(stalled.getBytesReceived() < LARGE_RESPONSE_SIZE);
+  CHECK_EQUAL(0, server->getConnectionCount());
+
+  // Other clients are served as usual
+  HttpClient client;
+  HttpResponse response;
+  CHECK(exchange(&client, "POST /echo HTTP/1.1\r\nContent-Length: 2\r\n\r\nok", &response));
+  CHECK(response.body == "ok");
+}
+
+// Open a stream for a client that does not read
+static bool openStream(HttpClient *client)
+{
+  stream = HTTP_SERVER_INVALID_STREAM;
+  if (!client->connect(halListenPort(), 4096))
+  {
+    return false;
+  }
+  client->send("GET /stream HTTP/1.1\r\n\r\n");
+  for (uint8_t pass = 0; pass < 100 && stream == HTTP_SERVER_INVALID_STREAM; pass++)
+  {
+    server->handleClient();
+  }
+  return server->isStreamOpen(stream);
+}
+
+// Write count messages to the stream, returns the number taken and the longest a write took in ms
+static unsigned long writeMessages(unsigned long count, double *longest)
+{
+  unsigned long taken = 0;
+  for (; taken < count; taken++)
+  {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool ok = server->writeStream(stream, largeResponse, MESSAGE_SIZE);
+    double took = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    *longest = took > *longest ? took : *longest;
+    if (!ok)
+    {
+      break;
+    }
+  }
+  return taken;
+}
+
+// Stream writes to a client that stops reading never wait: they fill the socket, then the output
+// buffer, and the stream is closed once that overflows or the output has waited for the write
+// timeout, however often it is written to in between. Other clients are answered once the buffer is
+// free again, and a client that reads late gets everything.
+static void testStalledStream()
+{
+  double longest = 0;
+
+  // The number of messages the socket and output buffer take
+  HttpClient probe;
+  CHECK(openStream(&probe));
+  unsigned long capacity = writeMessages(100000, &longest);
+  CHECK(!server->isStreamOpen(stream));
+  CHECK(capacity > HTTP_SERVER_OUTPUT_BUFFER_SIZE / MESSAGE_SIZE);
+  probe.close();
+  server->handleClient();
+
+  // Half the output buffer waiting: a message every millisecond does not push the deadline back
+  HttpClient stalled;
+  CHECK(openStream(&stalled));
+  unsigned long buffered = capacity - HTTP_SERVER_OUTPUT_BUFFER_SIZE / MESSAGE_SIZE / 2;
+  CHECK_EQUAL(buffered, writeMessages(buffered, &longest));
+  HttpClient other;
+  HttpResponse response;
+  CHECK(other.connect(halListenPort()));
+  other.send("POST /echo HTTP/1.1\r\nContent-Length: 2\r\n\r\nok");
+  bool answered = false;
+  unsigned long start = millis();
+  while (server->isStreamOpen(stream) && millis() - start <= 2 * HTTP_SERVER_WRITE_TIMEOUT)
+  {
+    server->writeStream(stream, ":\n", 2);
+    server->handleClient();
+    halAdvance(1);
+    other.poll();
+    answered = answered || other.takeResponse(&response);
+    CHECK(!answered || !server->isStreamOpen(stream));
+  }
+  unsigned long dropped = millis() - start;
+  CHECK(dropped >= HTTP_SERVER_WRITE_TIMEOUT && dropped <= HTTP_SERVER_WRITE_TIMEOUT + 1);
+  stalled.close();
+
+  for (uint8_t pass = 0; pass < 100 && !answered; pass++)
+  {
+    server->handleClient();
+    other.poll();
+    answered = other.takeResponse(&response);
+  }
+  CHECK(answered);
+  CHECK(response.body == "ok");
+  other.close();
+  server->handleClient();
+
+  // The same backlog reaches a client that starts reading before the deadline, in order and complete
+  HttpClient late;
+  CHECK(openStream(&late));
+  CHECK_EQUAL(buffered, writeMessages(buffered, &longest));
+  unsigned long long expected = strlen(streamHeader) + buffered * MESSAGE_SIZE;
+  for (unsigned long pass = 0; pass < 10000 && late.getBytesReceived() < expected; pass++)
+  {
+    server->handleClient();
+    late.poll();
+  }
+  halAdvance(2 * HTTP_SERVER_WRITE_TIMEOUT);
+  server->handleClient();
+  CHECK(late.getBytesReceived() == expected);
+  CHECK(server->isStreamOpen(stream));
+  CHECK(server->writeStream(stream, largeResponse, MESSAGE_SIZE));
+  server->closeStream(stream);
+
+  printf("Stalled stream: %lu messages taken, dropped after %lu ms, longest write %.2f ms\n", capacity, dropped, longest);
+  CHECK(longest < HTTP_SERVER_WRITE_TIMEOUT / 10);
+}
+
+int main()
+{
+  memset(largeResponse, 'x', sizeof(largeResponse));
+
+  server = new HttpServer(0);
+  server->on("/echo", handleEcho);
+  server->on("/large", handleLarge);
+  server->on("/stream", handleStream);
+  server->begin();
+
+  testContentLength();
+  testSmuggling();
+  testRejectAfterRequest();
+  testStalledClient();
+  testStalledStream();
+
+  return checkResult();
+}
@@ -0,0 +1,18 @@
+// Must not compile: setpoint limits closer than MINIMUM_SETPOINT_RANGE, checked by the
+// ThermostatConfigInvalid test in CMakeLists.txt
+
+struct NarrowThermostatConfig
+{
+  static constexpr double setpointMinimum = 20;
+  static constexpr double setpointMaximum = 25;
+  static constexpr double hysteresis = 1;
+  static constexpr unsigned long stateChangeDelay = 30000;
+  static constexpr unsigned long minimumOnTime = 120000;
+  static constexpr unsigned long minimumOffTime = 120000;
+  static constexpr bool canHeat = true;
+  static constexpr bool canCool = true;
+  static constexpr bool defaultImperial = false;
+};
+
+#define THERMOSTAT_CONFIG NarrowThermostatConfig
+#include "ThermostatConfig.h"
@@ -0,0 +1,58 @@
+#ifndef JSON_DOCUMENT_H
+#define JSON_DOCUMENT_H
+
+#include <map>
+#include <string>
+
+// Flattens the service's JSON documents into "path/to/member" -> value text, array elements are
+// numbered from 0. Enough for what JsonWriter produces, no escapes or whitespace.
+
+typedef std::map<std::string, std::string> Document;
+
+static size_t flatten(const std::string &json, size_t at, const std::string &path, Document *document)
+{
+  if (json[at] == '{' || json[at] == '[')
+  {
+    char close = json[at] == '{' ? '}' : ']';
+    at++;
+    for (unsigned long index = 0; json[at] != close; index++)
+    {
+      if (close == '}')
+      {
+        size_t nameEnd = json.find('"', at + 1);
+        std::string name = json.substr(at + 1, nameEnd - at - 1);
+        at = flatten(json, nameEnd + 2, path + "/" + name, document);
+      }
+      else
+      {
+        at = flatten(json, at, path + "/" + std::to_string(index), document);
+      }
+      if (json[at] == ',')
+      {
+        at++;
+      }
+    }
+    return at + 1;
+  }
+
+  size_t end = at;
+  if (json[at] == '"')
+  {
+    end = json.find('"', at + 1) + 1;
+  }
+  else
+  {
+    end = json.find_first_of(",}]", at);
+  }
+  (*document)[path] = json.substr(at, end - at);
+  return end;
+}
+
+static Document parse(const std::string &json)
+{
+  Document document;
+  flatten(json, 0, "", &document);
+  return document;
+}
+
+#endif
@@ -0,0 +1,201 @@
+// Metrics on a fake cycle counter: the histogram buckets, sum and maximum, the calibrated overhead is
+// exactly the cost of the pair of cycle counter reads around a section, the sum is never seen torn or
+// going backwards from another thread, and /metrics exports the stages consistently.
+
+#include <atomic>
+#include <thread>
+
+#include "Check.h"
+#include "HttpClient.h"
+#include "Sketch.h"
+
+// Cycles every read of the fake counter costs
+#define FAKE_READ_CYCLES 7
+
+static uint32_t fakeCycles = 0;
+
+static uint32_t fakeClock()
+{
+  fakeCycles += FAKE_READ_CYCLES;
+  return fakeCycles;
+}
+
+static void testHistogram()
+{
+  // Bucket limits are powers of four from 2^METRICS_FIRST_BUCKET_BITS, each run lands in the first bucket that holds it
+  for (uint8_t i = 0; i < METRICS_HISTOGRAM_BUCKETS - 1; i++)
+  {
+    uint32_t limit = CycleHistogram::bucketLimit(i);
+    CHECK_EQUAL((uint32_t)1 << (METRICS_FIRST_BUCKET_BITS + 2 * i), limit);
+    CHECK_EQUAL(i, CycleHistogram::bucket(limit));
+    CHECK_EQUAL(i + 1, CycleHistogram::bucket(limit + 1));
+  }
+  CHECK_EQUAL(0, CycleHistogram::bucket(0));
+  CHECK_EQUAL(0, CycleHistogram::bucketLimit(METRICS_HISTOGRAM_BUCKETS - 1));
+  CHECK_EQUAL(METRICS_HISTOGRAM_BUCKETS - 1, CycleHistogram::bucket(UINT32_MAX));
+
+  CycleHistogram histogram;
+  const uint32_t runs[] = {1, 1024, 1025, 4096, 1 << 20, UINT32_MAX, UINT32_MAX};
+  uint64_t sum = 0;
+  for (uint32_t cycles : runs)
+  {
+    histogram.add(cycles);
+    sum += cycles;
+  }
+  CHECK_EQUAL(2, histogram.getCount(0));
+  CHECK_EQUAL(2, histogram.getCount(1));
+  CHECK_EQUAL(1, histogram.getCount(CycleHistogram::bucket(1 << 20)));
+  CHECK_EQUAL(2, histogram.getCount(METRICS_HISTOGRAM_BUCKETS - 1));
+  CHECK_EQUAL(UINT32_MAX, histogram.getMaximum());
+
+  // Sums past 32 bits are exact
+  CHECK(sum > UINT32_MAX);
+  CHECK(histogram.getSum() == sum);
+
+  histogram.reset();
+  CHECK(histogram.getSum() == 0);
+  CHECK_EQUAL(0, histogram.getMaximum());
+  CHECK_EQUAL(0, histogram.getCount(METRICS_HISTOGRAM_BUCKETS - 1));
+}
+
+// A scraper thread reads the sum while runs carrying across 32 bits are added: every sum it sees is a
+// whole number of runs and never less than the one before
+static void testConcurrentSum()
+{
+  const uint32_t run = 0xFFFFFFF0;
+  CycleHistogram histogram;
+  std::atomic<bool> done(false);
+  unsigned long torn = 0;
+  unsigned long backwards = 0;
+  unsigned long reads = 0;
+
+  std::thread scraper([&]() {
+    uint64_t previous = 0;
+    while (!done.load())
+    {
+      uint64_t sum = histogram.getSum();
+      torn += sum % run != 0;
+      backwards += sum < previous;
+      previous = sum;
+      reads++;
+    }
+  });
+  for (unsigned long i = 0; i < 2000000; i++)
+  {
+    histogram.add(run);
+  }
+  done.store(true);
+  scraper.join();
+
+  printf("Concurrent sum: %lu reads, %lu torn, %lu backwards\n", reads, torn, backwards);
+  CHECK(reads > 0);
+  CHECK_EQUAL(0, torn);
+  CHECK_EQUAL(0, backwards);
+  CHECK(histogram.getSum() == 2000000ULL * run);
+}
+
+// The overhead is what MetricsTimer adds to a section, and only that
+static void testTimer(Metrics *metrics)
+{
+  CHECK_EQUAL(FAKE_READ_CYCLES, metrics->getOverhead());
+
+  // An empty section measures exactly the overhead, a section that takes cycles measures them on top
+  CycleHistogram *histogram = metrics->getStage(METRICS_STAGE_RELAYS);
+  histogram->reset();
+  {
+    MetricsTimer timer(METRICS_STAGE_RELAYS);
+  }
+  CHECK(histogram->getSum() == metrics->getOverhead());
+  {
+    MetricsTimer timer(METRICS_STAGE_RELAYS);
+    fakeCycles += 100000;
+  }
+  CHECK_EQUAL(100000 + metrics->getOverhead(), histogram->getMaximum());
+  CHECK(histogram->getSum() == 100000 + 2 * metrics->getOverhead());
+  CHECK_EQUAL(1, histogram->getCount(0));
+  CHECK_EQUAL(1, histogram->getCount(CycleHistogram::bucket(100000)));
+  histogram->reset();
+}
+
+// Run loop() until the response arrives
+static bool exchange(HttpClient *client, const std::string &request, HttpResponse *response)
+{
+  if (!client->poll() && !client->connect(halListenPort()))
+  {
+    return false;
+  }
+  client->send(request);
+
+  for (unsigned long pass = 0; pass < 1000; pass++)
+  {
+    loop();
+    bool open = client->poll();
+    if (client->takeResponse(response))
+    {
+      return true;
+    }
+    if (!open)
+    {
+      return false;
+    }
+  }
+  return false;
+}
+
+// Value of one sample line, -1 if it is missing
+static double sample(const std::string &text, const std::string &series)
+{
+  size_t at = text.find("\n" + series + " ");
+  return at == std::string::npos ? -1 : atof(text.c_str() + at + series.size() + 2);
+}
+
+static void testEndpoint()
+{
+  for (unsigned long i = 0; i < 1000; i++)
+  {
+    sketchStep();
+  }
+
+  HttpClient client;
+  HttpResponse response;
+  CHECK(exchange(&client, "GET /metrics HTTP/1.1\r\n\r\n", &response));
+  CHECK_EQUAL(200, response.status);
+  const std::string &text = response.body;
+
+  CHECK_EQUAL(FAKE_READ_CYCLES, sample(text, "openthermostat_metrics_overhead_cycles"));
+
+  // Sections take no cycles of their own on the fake counter, so every pass measures the overhead. The
+  // test runs the control scheduler directly, outside the control loop stage, which stays empty.
+  for (uint8_t i = 0; i < METRICS_STAGE_COUNT; i++)
+  {
+    std::string labels = std::string("{stage=\"") + Metrics::getStageName((MetricsStage)i) + "\"";
+    double count = sample(text, "openthermostat_stage_cycles_count" + labels + "}");
+    CHECK(i == METRICS_STAGE_CONTROL_LOOP ? count == 0 : count > 0);
+    CHECK_EQUAL(count, sample(text, "openthermostat_stage_cycles_bucket" + labels + ",le=\"+Inf\"}"));
+    CHECK_EQUAL(count, sample(text, "openthermostat_stage_cycles_bucket" + labels + ",le=\"1024\"}"));
+    CHECK_EQUAL(count * FAKE_READ_CYCLES, sample(text, "openthermostat_stage_cycles_sum" + labels + "}"));
+    CHECK_EQUAL(count > 0 ? FAKE_READ_CYCLES : 0, sample(text, "openthermostat_stage_max_cycles" + labels + "}"));
+  }
+
+  // One control pass per run of the control task
+  double controlPasses = sample(text, "openthermostat_stage_cycles_count{stage=\"thermostat\"}");
+  // Tasks are exported per scheduler
+  CHECK(sample(text, "openthermostat_task_runs_total{scheduler=\"control\",task=\"control\"}") == controlPasses);
+  CHECK(sample(text, "openthermostat_task_runs_total{scheduler=\"main\",task=\"buttons\"}") > 0);
+}
+
+int main()
+{
+  testHistogram();
+  testConcurrentSum();
+
+  // The first call picks the cycle counter, before setup creates the metrics with the default one
+  Metrics *metrics = Metrics::getInstance(fakeClock);
+  testTimer(metrics);
+
+  halEepromErase();
+  setup();
+  testEndpoint();
+
+  return checkResult();
+}
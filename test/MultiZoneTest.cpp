@@ -0,0 +1,233 @@
+// Sixteen zones on one controller: every zone takes its own setpoints and remote temperature through
+// the zone-indexed routes, heats, cools or idles on its own relays without touching the others,
+// reports its own status, and keeps its setpoints and state in the settings log. Zones past the configured
+// count are refused.
+
+#define THERMOSTAT_ZONE_COUNT 16
+// Room for every zone's record next to a full schedule
+#define EEPROM_SIZE 1024
+
+// The first zone on the board's relays and sensor, the others on expander outputs from pin 64 with
+// remote sensors
+#define REMOTE_ZONE(zone) {(uint8_t)(61 + 3 * (zone)), (uint8_t)(62 + 3 * (zone)), (uint8_t)(63 + 3 * (zone)), false}
+#define ZONE_HARDWARE                                                                                       \
+  {HEAT_RELAY_PIN, COOL_RELAY_PIN, FAN_RELAY_PIN, true}, REMOTE_ZONE(1), REMOTE_ZONE(2), REMOTE_ZONE(3),   \
+      REMOTE_ZONE(4), REMOTE_ZONE(5), REMOTE_ZONE(6), REMOTE_ZONE(7), REMOTE_ZONE(8), REMOTE_ZONE(9),       \
+      REMOTE_ZONE(10), REMOTE_ZONE(11), REMOTE_ZONE(12), REMOTE_ZONE(13), REMOTE_ZONE(14), REMOTE_ZONE(15)
+
+#include "Check.h"
+#include "HttpClient.h"
+#include "JsonDocument.h"
+#include "Sketch.h"
+
+#define COLD 16.0
+#define HOT 31.0
+
+// Setpoints differ per zone so a mixed up zone index shows
+static double setpointLowOf(uint8_t zone)
+{
+  return 19 + zone * 0.25;
+}
+
+static double setpointHighOf(uint8_t zone)
+{
+  return setpointLowOf(zone) + 5;
+}
+
+// A third of the zones is cold, a third hot and the rest inside their band
+static double temperatureOf(uint8_t zone)
+{
+  return zone % 3 == 0 ? COLD : (zone % 3 == 1 ? HOT : setpointLowOf(zone) + 2.5);
+}
+
+static Thermostat::ThermostatState expectedState(double temperature)
+{
+  return temperature == COLD ? Thermostat::ThermostatState::HEATING
+                             : (temperature == HOT ? Thermostat::ThermostatState::COOLING : Thermostat::ThermostatState::IDLE);
+}
+
+// Run loop() until the response arrives, reconnecting if the server dropped the idle connection
+static bool exchange(HttpClient *client, const std::string &request, HttpResponse *response)
+{
+  if (!client->poll() && !client->connect(halListenPort()))
+  {
+    return false;
+  }
+  client->send(request);
+
+  for (unsigned long pass = 0; pass < 1000; pass++)
+  {
+    loop();
+    bool open = client->poll();
+    if (client->takeResponse(response))
+    {
+      return true;
+    }
+    if (!open)
+    {
+      return false;
+    }
+  }
+  return false;
+}
+
+static int post(HttpClient *client, const std::string &target, const std::string &body = "")
+{
+  HttpResponse response;
+  if (!exchange(client, "POST " + target + " HTTP/1.1\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body, &response))
+  {
+    return 0;
+  }
+  return response.status;
+}
+
+static Document status(HttpClient *client, uint8_t zone)
+{
+  HttpResponse response;
+  CHECK(exchange(client, "GET /?zone=" + std::to_string(zone) + " HTTP/1.1\r\n\r\n", &response));
+  CHECK_EQUAL(200, response.status);
+  return parse(response.body);
+}
+
+// Run both cores for duration on the simulated clock
+static void run(unsigned long duration)
+{
+  unsigned long start = millis();
+  while (millis() - start < duration)
+  {
+    sketchStep();
+  }
+}
+
+static bool relaysMatch(uint8_t zone, Thermostat::ThermostatState state)
+{
+  return halPinLevel(zones[zone].heatRelayPin) == (state == Thermostat::ThermostatState::HEATING ? HIGH : LOW) &&
+         halPinLevel(zones[zone].coolRelayPin) == (state == Thermostat::ThermostatState::COOLING ? HIGH : LOW) &&
+         halPinLevel(zones[zone].fanRelayPin) == LOW;
+}
+
+static void testSetpoints(HttpClient *client)
+{
+  for (uint8_t zone = 0; zone < THERMOSTAT_ZONE_COUNT; zone++)
+  {
+    char target[64];
+    snprintf(target, sizeof(target), "/setpoint?zone=%u&low=%.2f&high=%.2f", zone, setpointLowOf(zone), setpointHighOf(zone));
+    CHECK_EQUAL(200, post(client, target));
+  }
+
+  for (uint8_t zone = 0; zone < THERMOSTAT_ZONE_COUNT; zone++)
+  {
+    CHECK(thermostat->getSetpointLow(zone) == Temperature::fromCelsius(setpointLowOf(zone)));
+    CHECK(thermostat->getSetpointHigh(zone) == Temperature::fromCelsius(setpointHighOf(zone)));
+    Document document = status(client, zone);
+    CHECK_EQUAL(lround(setpointLowOf(zone) * 100), lround(atof(document["/thermostat/setpoint_low"].c_str()) * 100));
+    CHECK_EQUAL(lround(setpointHighOf(zone) * 100), lround(atof(document["/thermostat/setpoint_high"].c_str()) * 100));
+  }
+}
+
+static void testZones(HttpClient *client)
+{
+  // The first zone reads the local sensor, the second half of the remote zones report in one batch
+  halBme280.temperature = temperatureOf(0);
+  std::string batch = "[";
+  for (uint8_t zone = 1; zone < THERMOSTAT_ZONE_COUNT; zone++)
+  {
+    char reading[48];
+    snprintf(reading, sizeof(reading), "[\"sensor%u\",%u,%.2f]", zone, zone, temperatureOf(zone));
+    if (zone < THERMOSTAT_ZONE_COUNT / 2)
+    {
+      CHECK_EQUAL(200, post(client, "/temperature?zone=" + std::to_string(zone) + "&source=sensor" + std::to_string(zone) +
+                                        "&temperature=" + std::to_string(temperatureOf(zone))));
+    }
+    else
+    {
+      batch += (batch.size() > 1 ? "," : "") + std::string(reading);
+    }
+  }
+  CHECK_EQUAL(200, post(client, "/temperature", batch + "]"));
+
+  CHECK_EQUAL(200, post(client, "/mode?mode=auto"));
+  run(2 * STATE_CHANGE_DELAY + 10000);
+
+  for (uint8_t zone = 0; zone < THERMOSTAT_ZONE_COUNT; zone++)
+  {
+    Thermostat::ThermostatState expected = expectedState(temperatureOf(zone));
+    if (!relaysMatch(zone, expected))
+    {
+      fprintf(stderr, "zone %u: relays do not match %s\n", zone, Thermostat::getStateName(expected).c_str());
+      CHECK(false);
+    }
+
+    Document document = status(client, zone);
+    CHECK(document["/thermostat/state/description"] == std::string("\"") + Thermostat::getStateName(expected).c_str() + "\"");
+    CHECK(fabs(atof(document["/environment/temperature"].c_str()) - temperatureOf(zone)) < 0.05);
+    CHECK(document["/environment/confidence"] != "0");
+  }
+
+  // Warming one cold zone switches its relays only
+  unsigned long changes[THERMOSTAT_ZONE_COUNT];
+  for (uint8_t zone = 0; zone < THERMOSTAT_ZONE_COUNT; zone++)
+  {
+    changes[zone] = halPinChanges(zones[zone].heatRelayPin) + halPinChanges(zones[zone].coolRelayPin);
+  }
+  const uint8_t warmed = 9;
+  CHECK(expectedState(temperatureOf(warmed)) == Thermostat::ThermostatState::HEATING);
+  CHECK_EQUAL(200, post(client, "/temperature?zone=9&source=sensor9&temperature=" + std::to_string(setpointLowOf(warmed) + 2.5)));
+  run(2 * STATE_CHANGE_DELAY + 10000);
+
+  CHECK(relaysMatch(warmed, Thermostat::ThermostatState::IDLE));
+  for (uint8_t zone = 0; zone < THERMOSTAT_ZONE_COUNT; zone++)
+  {
+    unsigned long now = halPinChanges(zones[zone].heatRelayPin) + halPinChanges(zones[zone].coolRelayPin);
+    CHECK_EQUAL(zone == warmed ? 1 : 0, now - changes[zone]);
+    CHECK(relaysMatch(zone, zone == warmed ? Thermostat::ThermostatState::IDLE : expectedState(temperatureOf(zone))));
+  }
+}
+
+// Zones past the configured count are refused on every route
+static void testUnknownZone(HttpClient *client)
+{
+  HttpResponse response;
+  CHECK(exchange(client, "GET /?zone=16 HTTP/1.1\r\n\r\n", &response));
+  CHECK_EQUAL(400, response.status);
+  CHECK_EQUAL(400, post(client, "/setpoint?zone=16&low=20"));
+  CHECK_EQUAL(400, post(client, "/temperature?zone=16&temperature=20"));
+  CHECK_EQUAL(400, post(client, "/temperature", "[[\"sensor16\",16,20]]"));
+  CHECK_EQUAL(400, post(client, "/mode?zone=-1&mode=heat"));
+}
+
+// The setpoints and state of every zone are in the committed settings log
+static void testPersistence()
+{
+  storage->flush();
+  SettingsLog log(EEPROM_SIZE);
+  CHECK(log.begin());
+  unsigned long active = 0;
+  for (uint8_t zone = 1; zone < THERMOSTAT_ZONE_COUNT; zone++)
+  {
+    uint8_t record[STORAGE_ZONE_RECORD_SIZE];
+    CHECK(log.read(STORAGE_KEY_ZONE_SETPOINTS + zone - 1, record, sizeof(record)));
+    int16_t setpoints[2];
+    memcpy(setpoints, record, sizeof(setpoints));
+    CHECK_EQUAL(lround(setpointLowOf(zone) * 100), setpoints[0]);
+    CHECK_EQUAL(lround(setpointHighOf(zone) * 100), setpoints[1]);
+    CHECK_EQUAL((uint8_t)thermostat->getState(zone), record[4]);
+    active += record[4] != (uint8_t)Thermostat::ThermostatState::IDLE;
+  }
+  // The zones were left heating and cooling, not only idle
+  CHECK(active > 0);
+}
+
+int main()
+{
+  halEepromErase();
+  setup();
+  HttpClient client;
+
+  testSetpoints(&client);
+  testZones(&client);
+  testUnknownZone(&client);
+  testPersistence();
+
+  return checkResult();
+}
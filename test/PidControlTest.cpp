@@ -0,0 +1,182 @@
+// The PID strategy on the thermal plant against the hysteresis strategy it sits beside: after a
+// setpoint step it overshoots less, it never runs or rests the equipment for less than the
+// configured minimum times (hysteresis only guarantees the state change delay), it holds the room
+// at the setpoint, it fits the control step budget and it can be switched at runtime.
+
+#include <limits.h>
+
+#include <chrono>
+
+#include "Check.h"
+#include "Sketch.h"
+#include "ThermalPlant.h"
+
+#define SIMULATION_STEP 1000
+#define DAY 86400000UL
+
+#define SETPOINT_LOW 21
+#define SETPOINT_HIGH 24
+
+// Host time budget for one control step, far below THERMOSTAT_UPDATE_PERIOD on the ESP32 too
+#define STEP_BUDGET_NANOSECONDS 20000
+
+struct Run
+{
+  double overshoot;
+  // Mean temperature and its RMS distance to the low setpoint over the second half of the run
+  double meanTemperature;
+  double trackingError;
+  unsigned long cycles;
+  // Shortest complete run and rest of the equipment in milliseconds
+  unsigned long shortestRun;
+  unsigned long shortestRest;
+  double nanosecondsPerStep;
+};
+
+static int16_t noWallClock()
+{
+  return SCHEDULE_NO_TIME;
+}
+
+static ThermalPlant winter(double temperature)
+{
+  ThermalPlant plant;
+  plant.outdoorMean = 0;
+  plant.outdoorSwing = 5;
+  plant.temperature = temperature;
+  return plant;
+}
+
+// Start the thermostat idle with the relays open, then hand the plant to strategy in AUTOMATIC
+static void start(Thermostat *thermostat, const ThermalPlant &plant, Thermostat::ControlStrategy strategy)
+{
+  thermostat->setMode(Thermostat::ThermostatMode::OFF);
+  thermostat->update(Temperature::fromCelsius(plant.temperature));
+  writeRelays(0, thermostat->getState());
+
+  thermostat->setControlStrategy(strategy);
+  thermostat->setSetpointLow(Temperature::fromCelsius(SETPOINT_LOW));
+  thermostat->setSetpointHigh(Temperature::fromCelsius(SETPOINT_HIGH));
+  thermostat->setMode(Thermostat::ThermostatMode::AUTOMATIC);
+}
+
+// Run the plant for duration, switching to switchTo halfway through unless it is the current strategy
+static Run simulate(Thermostat *thermostat, ThermalPlant *plant, unsigned long duration, Thermostat::ControlStrategy switchTo)
+{
+  Run run = {0, 0, 0, 0, ULONG_MAX, ULONG_MAX, 0};
+  bool active = false;
+  bool reachedSetpoint = false;
+  // Time of the last relay change, 0 until the first one so the initial rest is not counted
+  unsigned long lastChange = 0;
+  double temperatureSum = 0;
+  double squaredError = 0;
+  unsigned long samples = 0;
+  std::chrono::nanoseconds cpuTime(0);
+
+  const unsigned long steps = duration / SIMULATION_STEP;
+  for (unsigned long step = 0; step < steps; step++)
+  {
+    if (step == steps / 2 && thermostat->getControlStrategy() != switchTo)
+    {
+      thermostat->setControlStrategy(switchTo);
+    }
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    Thermostat::ThermostatState state = thermostat->update(Temperature::fromCelsius(plant->temperature));
+    writeRelays(0, state);
+    cpuTime += std::chrono::steady_clock::now() - begin;
+
+    bool relay = halPinLevel(HEAT_RELAY_PIN) == HIGH || halPinLevel(COOL_RELAY_PIN) == HIGH;
+    if (relay != active)
+    {
+      if (lastChange != 0)
+      {
+        unsigned long length = millis() - lastChange;
+        unsigned long *shortest = active ? &run.shortestRun : &run.shortestRest;
+        *shortest = std::min(*shortest, length);
+      }
+      run.cycles += relay;
+      lastChange = millis();
+      active = relay;
+    }
+
+    plant->step(step * (SIMULATION_STEP / 1000.0), SIMULATION_STEP / 1000.0, halPinLevel(HEAT_RELAY_PIN) == HIGH,
+                halPinLevel(COOL_RELAY_PIN) == HIGH);
+    halAdvance(SIMULATION_STEP);
+
+    reachedSetpoint = reachedSetpoint || plant->temperature >= SETPOINT_LOW;
+    if (reachedSetpoint)
+    {
+      run.overshoot = std::max(run.overshoot, plant->temperature - SETPOINT_LOW);
+    }
+    if (step >= steps / 2)
+    {
+      temperatureSum += plant->temperature;
+      squaredError += (plant->temperature - SETPOINT_LOW) * (plant->temperature - SETPOINT_LOW);
+      samples++;
+    }
+  }
+
+  run.meanTemperature = temperatureSum / samples;
+  run.trackingError = sqrt(squaredError / samples);
+  run.nanosecondsPerStep = (double)cpuTime.count() / steps;
+  return run;
+}
+
+static void print(const char *name, const Run &run)
+{
+  printf("%-28s overshoot %.2f K, mean %.2f C, rms error %.2f K, %lu cycles, shortest run %lu s, shortest rest %lu s, %.0f ns/step\n",
+         name, run.overshoot, run.meanTemperature, run.trackingError, run.cycles, run.shortestRun / 1000,
+         run.shortestRest / 1000, run.nanosecondsPerStep);
+}
+
+int main()
+{
+  halEepromErase();
+  Thermostat *thermostat = Thermostat::getInstance();
+  thermostat->setWallClock(noWallClock);
+
+  // A cold start from 17 C: heat up to the low setpoint and hold it for two days
+  ThermalPlant plant = winter(17);
+  start(thermostat, plant, Thermostat::ControlStrategy::STRATEGY_HYSTERESIS);
+  Run hysteresis = simulate(thermostat, &plant, 2 * DAY, Thermostat::ControlStrategy::STRATEGY_HYSTERESIS);
+  print("hysteresis", hysteresis);
+
+  plant = winter(17);
+  start(thermostat, plant, Thermostat::ControlStrategy::STRATEGY_PID);
+  Run pid = simulate(thermostat, &plant, 2 * DAY, Thermostat::ControlStrategy::STRATEGY_PID);
+  print("pid", pid);
+
+  // Overshoot past the setpoint is reduced
+  CHECK(pid.overshoot < hysteresis.overshoot);
+  CHECK(pid.overshoot < ThermostatConfig::hysteresis);
+
+  // Once settled the room is held at the setpoint rather than around the hysteresis band
+  CHECK(fabs(pid.meanTemperature - SETPOINT_LOW) < 0.25);
+  CHECK(pid.trackingError < hysteresis.trackingError);
+
+  // Compressor protection: no run or rest shorter than the configured minimums
+  CHECK(pid.cycles > 2);
+  CHECK(pid.shortestRun >= ThermostatConfig::minimumOnTime);
+  CHECK(pid.shortestRest >= ThermostatConfig::minimumOffTime);
+  CHECK(pid.cycles <= 2 * DAY / PID_CYCLE_PERIOD + 1);
+
+  // The control step stays within budget
+  CHECK(pid.nanosecondsPerStep < STEP_BUDGET_NANOSECONDS);
+
+  // Switching strategy at runtime, in either direction, keeps the minimum times across the switch
+  plant = winter(SETPOINT_LOW);
+  start(thermostat, plant, Thermostat::ControlStrategy::STRATEGY_HYSTERESIS);
+  Run toPid = simulate(thermostat, &plant, 2 * DAY, Thermostat::ControlStrategy::STRATEGY_PID);
+  print("hysteresis, then pid", toPid);
+  CHECK(thermostat->getControlStrategy() == Thermostat::ControlStrategy::STRATEGY_PID);
+  CHECK(fabs(toPid.meanTemperature - SETPOINT_LOW) < 0.25);
+  CHECK(toPid.shortestRun >= std::min(ThermostatConfig::minimumOnTime, ThermostatConfig::stateChangeDelay));
+
+  Run toHysteresis = simulate(thermostat, &plant, 2 * DAY, Thermostat::ControlStrategy::STRATEGY_HYSTERESIS);
+  print("pid, then hysteresis", toHysteresis);
+  CHECK(thermostat->getControlStrategy() == Thermostat::ControlStrategy::STRATEGY_HYSTERESIS);
+  CHECK(toHysteresis.shortestRun >= std::min(ThermostatConfig::minimumOnTime, ThermostatConfig::stateChangeDelay));
+
+  return checkResult();
+}
@@ -0,0 +1,155 @@
+// Runs the thermostat against a thermal plant for two weeks of simulated time per season and control
+// strategy, and reports comfort, relay wear, energy and CPU time per control step. Built once per
+// thermostat configuration (see CMakeLists.txt) so hysteresis and state change delay can be compared.
+
+#include <chrono>
+
+#include "Check.h"
+#include "Sketch.h"
+#include "ThermalPlant.h"
+
+#define SIMULATION_DAYS 14
+// Control step, the sketch runs the thermostat every THERMOSTAT_UPDATE_PERIOD
+#define SIMULATION_STEP 1000
+
+#define NAME(value) #value
+#define STRINGIFY(value) NAME(value)
+
+#define COMFORT_LOW 21
+#define COMFORT_HIGH 24
+
+struct Scenario
+{
+  const char *season;
+  double outdoorMean;
+  double outdoorSwing;
+  Thermostat::ControlStrategy strategy;
+};
+
+struct Result
+{
+  // Distance outside the comfort band, RMS over every step and the worst step, in Kelvin
+  double comfortError;
+  double overshoot;
+  double cyclesPerDay;
+  double kilowattHours;
+  double nanosecondsPerStep;
+};
+
+static int16_t noWallClock()
+{
+  return SCHEDULE_NO_TIME;
+}
+
+static Result simulate(Thermostat *thermostat, const Scenario &scenario)
+{
+  ThermalPlant plant;
+  plant.outdoorMean = scenario.outdoorMean;
+  plant.outdoorSwing = scenario.outdoorSwing;
+  plant.temperature = (COMFORT_LOW + COMFORT_HIGH) / 2.0;
+
+  // Leaving AUTOMATIC resets the PID strategy, the run starts idle with the relays open
+  thermostat->setMode(Thermostat::ThermostatMode::OFF);
+  thermostat->update(Temperature::fromCelsius(plant.temperature));
+  writeRelays(0, thermostat->getState());
+
+  thermostat->setControlStrategy(scenario.strategy);
+  thermostat->setSetpointLow(Temperature::fromCelsius(COMFORT_LOW));
+  thermostat->setSetpointHigh(Temperature::fromCelsius(COMFORT_HIGH));
+  thermostat->setMode(Thermostat::ThermostatMode::AUTOMATIC);
+
+  double squaredError = 0;
+  double overshoot = 0;
+  unsigned long cycles = 0;
+  bool heating = false;
+  bool cooling = false;
+  std::chrono::nanoseconds cpuTime(0);
+
+  const unsigned long steps = SIMULATION_DAYS * 86400000UL / SIMULATION_STEP;
+  for (unsigned long step = 0; step < steps; step++)
+  {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    Thermostat::ThermostatState state = thermostat->update(Temperature::fromCelsius(plant.temperature));
+    writeRelays(0, state);
+    cpuTime += std::chrono::steady_clock::now() - start;
+
+    bool heatRelay = halPinLevel(HEAT_RELAY_PIN) == HIGH;
+    bool coolRelay = halPinLevel(COOL_RELAY_PIN) == HIGH;
+    cycles += (heatRelay && !heating) + (coolRelay && !cooling);
+    heating = heatRelay;
+    cooling = coolRelay;
+
+    double seconds = step * (SIMULATION_STEP / 1000.0);
+    plant.step(seconds, SIMULATION_STEP / 1000.0, heating, cooling);
+    halAdvance(SIMULATION_STEP);
+
+    double error = 0;
+    if (plant.temperature < COMFORT_LOW)
+    {
+      error = COMFORT_LOW - plant.temperature;
+    }
+    else if (plant.temperature > COMFORT_HIGH)
+    {
+      error = plant.temperature - COMFORT_HIGH;
+    }
+    squaredError += error * error;
+    if (error > overshoot)
+    {
+      overshoot = error;
+    }
+  }
+
+  Result result;
+  result.comfortError = sqrt(squaredError / steps);
+  result.overshoot = overshoot;
+  result.cyclesPerDay = (double)cycles / SIMULATION_DAYS;
+  result.kilowattHours = (plant.heatingEnergy + plant.coolingEnergy) / 3.6e6;
+  result.nanosecondsPerStep = (double)cpuTime.count() / steps;
+  return result;
+}
+
+int main()
+{
+  halEepromErase();
+  Thermostat *thermostat = Thermostat::getInstance();
+  thermostat->setWallClock(noWallClock);
+
+  printf("%s: hysteresis %.1f C, state change delay %lu s, minimum on/off %lu/%lu s\n",
+         STRINGIFY(THERMOSTAT_CONFIG), ThermostatConfig::hysteresis, ThermostatConfig::stateChangeDelay / 1000,
+         ThermostatConfig::minimumOnTime / 1000, ThermostatConfig::minimumOffTime / 1000);
+  printf("%-8s %-10s %12s %12s %12s %10s %10s\n", "season", "strategy", "rms error K", "overshoot K", "cycles/day",
+         "kWh", "ns/step");
+
+  const Scenario scenarios[] = {
+      {"winter", 0, 5, Thermostat::ControlStrategy::STRATEGY_HYSTERESIS},
+      {"summer", 30, 6, Thermostat::ControlStrategy::STRATEGY_HYSTERESIS},
+      {"winter", 0, 5, Thermostat::ControlStrategy::STRATEGY_PID},
+      {"summer", 30, 6, Thermostat::ControlStrategy::STRATEGY_PID},
+  };
+
+  for (const Scenario &scenario : scenarios)
+  {
+    Result result = simulate(thermostat, scenario);
+    printf("%-8s %-10s %12.3f %12.3f %12.1f %10.1f %10.1f\n", scenario.season,
+           Thermostat::getControlStrategyName(scenario.strategy), result.comfortError, result.overshoot,
+           result.cyclesPerDay, result.kilowattHours, result.nanosecondsPerStep);
+
+    fflush(stdout);
+
+    // Both strategies hold the house within a couple of degrees of the band. Hysteresis cycles
+    // as the house drifts across the band, PID at most once per PID_CYCLE_PERIOD.
+    CHECK(result.comfortError < 1.0);
+    CHECK(result.overshoot < ThermostatConfig::hysteresis + 1);
+    CHECK(result.cyclesPerDay >= 1);
+    if (scenario.strategy == Thermostat::ControlStrategy::STRATEGY_HYSTERESIS)
+    {
+      CHECK(result.cyclesPerDay < 24);
+    }
+    else
+    {
+      CHECK(result.cyclesPerDay <= 86400000.0 / PID_CYCLE_PERIOD);
+    }
+  }
+
+  return checkResult();
+}
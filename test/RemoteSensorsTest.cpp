@@ -0,0 +1,353 @@
+// Remote temperature sources: the incrementally kept mean, minimum, maximum and designated source of
+// every zone match a brute force recomputation over random readings, zone moves, weight changes,
+// evictions and aggregate changes, and the batch body of POST /temperature is parsed as documented,
+// refusing malformed bodies and readings outside the plausible sensor range as a whole.
+
+#define THERMOSTAT_ZONE_COUNT 3
+
+// The first zone on the board's relays and sensor, the others on expander outputs with remote sensors
+#define ZONE_HARDWARE {HEAT_RELAY_PIN, COOL_RELAY_PIN, FAN_RELAY_PIN, true}, {64, 65, 66, false}, {67, 68, 69, false}
+
+#include <map>
+#include <string>
+
+#include "Check.h"
+#include "HttpClient.h"
+#include "JsonDocument.h"
+#include "Sketch.h"
+
+#define RANDOM_OPERATIONS 200000
+// More source names than slots, so new sources are refused or evict stale ones
+#define SOURCE_NAMES (REMOTE_SENSOR_CAPACITY + REMOTE_SENSOR_CAPACITY / 2)
+
+static uint32_t randomState = 1;
+
+static uint32_t randomBelow(uint32_t limit)
+{
+  randomState = randomState * 1103515245 + 12345;
+  return (randomState >> 8) % limit;
+}
+
+// What the table should hold, recomputed from scratch for every check
+struct ModelSource
+{
+  uint8_t zone;
+  int16_t centi;
+  uint8_t weight;
+  unsigned long time;
+};
+
+struct Model
+{
+  std::map<std::string, ModelSource> sources;
+  std::string designated[THERMOSTAT_ZONE_COUNT];
+  unsigned long time[THERMOSTAT_ZONE_COUNT];
+
+  void evict(unsigned long now)
+  {
+    for (std::map<std::string, ModelSource>::iterator i = sources.begin(); i != sources.end();)
+    {
+      if (now - i->second.time >= REMOTE_SENSOR_TIMEOUT)
+      {
+        time[i->second.zone] = now;
+        i = sources.erase(i);
+      }
+      else
+      {
+        ++i;
+      }
+    }
+  }
+
+  bool update(const RemoteSensorReading &reading, unsigned long now)
+  {
+    std::map<std::string, ModelSource>::iterator found = sources.find(reading.source);
+    if (found == sources.end())
+    {
+      if (sources.size() >= REMOTE_SENSOR_CAPACITY)
+      {
+        evict(now);
+      }
+      if (sources.size() >= REMOTE_SENSOR_CAPACITY)
+      {
+        return false;
+      }
+    }
+    else
+    {
+      time[found->second.zone] = now;
+    }
+    ModelSource source = {reading.zone, reading.temperature.centiCelsius(), reading.weight, now};
+    sources[reading.source] = source;
+    time[reading.zone] = now;
+    return true;
+  }
+
+  Temperature read(uint8_t zone, RemoteAggregate aggregate) const
+  {
+    int64_t weighted = 0;
+    int64_t weights = 0;
+    bool any = false;
+    int16_t minimum = INT16_MAX;
+    int16_t maximum = INT16_MIN;
+    Temperature designatedTemperature;
+    for (std::map<std::string, ModelSource>::const_iterator i = sources.begin(); i != sources.end(); ++i)
+    {
+      const ModelSource &source = i->second;
+      if (source.zone != zone)
+      {
+        continue;
+      }
+      any = true;
+      weighted += (int64_t)source.centi * source.weight;
+      weights += source.weight;
+      minimum = std::min(minimum, source.centi);
+      maximum = std::max(maximum, source.centi);
+      if (i->first == designated[zone])
+      {
+        designatedTemperature = Temperature::fromCentiCelsius(source.centi);
+      }
+    }
+    if (!any)
+    {
+      return Temperature();
+    }
+
+    switch (aggregate)
+    {
+    case REMOTE_AGGREGATE_MEAN:
+      // Rounded half away from zero
+      return Temperature::fromCentiCelsius((weighted + (weighted < 0 ? -weights : weights) / 2) / weights);
+    case REMOTE_AGGREGATE_MINIMUM:
+      return Temperature::fromCentiCelsius(minimum);
+    case REMOTE_AGGREGATE_MAXIMUM:
+      return Temperature::fromCentiCelsius(maximum);
+    default:
+      return designatedTemperature;
+    }
+  }
+};
+
+static std::string sourceName(uint32_t index)
+{
+  return "sensor" + std::to_string(index);
+}
+
+static void testAgainstBruteForce()
+{
+  RemoteSensorTable table;
+  Model model;
+  const RemoteAggregate aggregates[] = {REMOTE_AGGREGATE_MEAN, REMOTE_AGGREGATE_MINIMUM, REMOTE_AGGREGATE_MAXIMUM, REMOTE_AGGREGATE_DESIGNATED};
+  // A few repeated values so minimum and maximum see ties
+  const int16_t common[] = {1900, 2000, 2100};
+  unsigned long now = 1000;
+  for (uint8_t zone = 0; zone < THERMOSTAT_ZONE_COUNT; zone++)
+  {
+    model.time[zone] = 0;
+  }
+
+  unsigned long checks = 0;
+  unsigned long failures = 0;
+  unsigned long refused = 0;
+  unsigned long evictions = 0;
+  for (unsigned long operation = 0; operation < RANDOM_OPERATIONS; operation++)
+  {
+    now += randomBelow(REMOTE_SENSOR_TIMEOUT / 20);
+    uint32_t kind = randomBelow(100);
+    if (kind < 85)
+    {
+      RemoteSensorReading reading;
+      strcpy(reading.source, sourceName(randomBelow(SOURCE_NAMES)).c_str());
+      reading.zone = randomBelow(THERMOSTAT_ZONE_COUNT);
+      reading.temperature = Temperature::fromCentiCelsius(randomBelow(4) == 0 ? common[randomBelow(3)] : (int16_t)randomBelow(12501) - 4000);
+      reading.weight = randomBelow(3) == 0 ? 1 + randomBelow(REMOTE_SENSOR_MAX_WEIGHT) : REMOTE_SENSOR_DEFAULT_WEIGHT;
+      std::map<std::string, ModelSource>::const_iterator known = model.sources.find(reading.source);
+      failures += table.getZone(reading.source) != (known == model.sources.end() ? REMOTE_SENSOR_NONE : known->second.zone);
+      bool stored = table.update(reading, now);
+      failures += stored != model.update(reading, now);
+      refused += !stored;
+    }
+    else if (kind < 92)
+    {
+      size_t before = model.sources.size();
+      failures += table.evict(now) != (model.evict(now), model.sources.size() != before);
+      evictions += model.sources.size() != before;
+    }
+    else
+    {
+      uint8_t zone = randomBelow(THERMOSTAT_ZONE_COUNT);
+      RemoteAggregate aggregate = aggregates[randomBelow(4)];
+      model.designated[zone] = sourceName(randomBelow(SOURCE_NAMES));
+      model.time[zone] = now;
+      table.setAggregate(zone, aggregate, model.designated[zone].c_str(), now);
+      failures += table.getAggregate(zone) != aggregate;
+    }
+
+    // Every aggregate of every zone, on a copy so the table's own selection and change time are left alone
+    for (uint8_t zone = 0; zone < THERMOSTAT_ZONE_COUNT; zone++)
+    {
+      if (table.read(zone).time != model.time[zone])
+      {
+        fprintf(stderr, "operation %lu zone %u: changed at %lu, expected %lu\n", operation, zone, table.read(zone).time, model.time[zone]);
+        failures++;
+      }
+      for (RemoteAggregate aggregate : aggregates)
+      {
+        RemoteSensorTable copy = table;
+        copy.setAggregate(zone, aggregate, model.designated[zone].c_str(), model.time[zone]);
+        SensorReading reading = copy.read(zone);
+        Temperature expected = model.read(zone, aggregate);
+        if (reading.temperature != expected)
+        {
+          if (failures < 10)
+          {
+            fprintf(stderr, "operation %lu zone %u aggregate %d: %d, expected %d\n", operation, zone, aggregate,
+                    reading.temperature.centiCelsius(), expected.centiCelsius());
+          }
+          failures++;
+        }
+        checks++;
+      }
+    }
+  }
+
+  printf("%lu checks over %d operations: %lu refused, %lu evictions, %lu failures\n", checks, RANDOM_OPERATIONS, refused, evictions, failures);
+  CHECK(refused > 0);
+  CHECK(evictions > 0);
+  CHECK_EQUAL(0, failures);
+}
+
+// Run loop() until the response arrives, reconnecting if the server dropped the idle connection
+static bool exchange(HttpClient *client, const std::string &request, HttpResponse *response)
+{
+  if (!client->poll() && !client->connect(halListenPort()))
+  {
+    return false;
+  }
+  client->send(request);
+
+  for (unsigned long pass = 0; pass < 1000; pass++)
+  {
+    loop();
+    bool open = client->poll();
+    if (client->takeResponse(response))
+    {
+      return true;
+    }
+    if (!open)
+    {
+      return false;
+    }
+  }
+  return false;
+}
+
+static int post(HttpClient *client, const std::string &body, const std::string &query = "")
+{
+  HttpResponse response;
+  if (!exchange(client, "POST /temperature" + query + " HTTP/1.1\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body, &response))
+  {
+    return 0;
+  }
+  return response.status;
+}
+
+// The zone's remote aggregate as the status shows it until the control task publishes again
+static std::string remoteTemperature(HttpClient *client, uint8_t zone)
+{
+  HttpResponse response;
+  CHECK(exchange(client, "GET /?zone=" + std::to_string(zone) + " HTTP/1.1\r\n\r\n", &response));
+  return parse(response.body)["/environment/temperature"];
+}
+
+static void testBatchBody(HttpClient *client)
+{
+  // A bare array, an object with a readings member, optional weights, whitespace and imperial units. A
+  // source that moves to another zone leaves the mean of the zone it reported for.
+  CHECK_EQUAL(200, post(client, "[]"));
+  CHECK_EQUAL(200, post(client, "[[\"a\",0,20.5]]"));
+  CHECK(remoteTemperature(client, 0) == "20.50");
+  CHECK_EQUAL(200, post(client, "{\"zone\":0,\"readings\":[[\"a\",0,20],[\"b\",0,22,3]]}"));
+  CHECK(remoteTemperature(client, 0) == "21.50");
+  CHECK_EQUAL(200, post(client, " [ [ \"b\" , 1 , 19 ] , [\"c\",2,23.25,100] ] "));
+  CHECK(remoteTemperature(client, 0) == "20.00");
+  CHECK(remoteTemperature(client, 1) == "19.00");
+  CHECK(remoteTemperature(client, 2) == "23.25");
+  CHECK_EQUAL(200, post(client, "[[\"a\",0,77]]", "?units=imperial"));
+  CHECK(remoteTemperature(client, 0) == "25.00");
+
+  // Malformed bodies are refused as a whole, the readings before the fault are not stored either
+  const char *const malformed[] = {
+      "",
+      "{}",
+      "[",
+      "[[\"d\",0,18],",
+      "[[\"d\",0,18],]",
+      "[[\"d\",0,18]",
+      "[[\"d\",0,18] [\"e\",0,18]]",
+      "[[d,0,18]]",
+      "[[\"d\",0]]",
+      "[[\"d\"]]",
+      "[[\"d\",0,]]",
+      "[[\"d\",0,18,1,2]]",
+      "[[\"d\",3,18]]",
+      "[[\"d\",-1,18]]",
+      "[[\"d\",0.5,18]]",
+      "[[\"d\",0,18,0]]",
+      "[[\"d\",0,18,101]]",
+      "[[\"d\",0,18,1.5]]",
+      "[[\"d\",0,nan]]",
+      "[[\"d\",0,inf]]",
+      "[[\"d\\\"e\",0,18]]",
+      "[[\"0123456789abcdef\",0,18]]",
+      "[[\"d\",0,18],[\"e\",0,\"18\"]]",
+  };
+  for (const char *body : malformed)
+  {
+    int status = post(client, body);
+    if (status != 400)
+    {
+      fprintf(stderr, "%s: %d\n", body, status);
+      CHECK(false);
+    }
+  }
+  CHECK(remoteTemperature(client, 0) == "25.00");
+
+  // More readings than the table has slots is malformed too
+  std::string batch = "[";
+  for (uint8_t i = 0; i <= REMOTE_SENSOR_CAPACITY; i++)
+  {
+    batch += (i == 0 ? "[\"" : ",[\"") + sourceName(i) + "\",0,18]";
+  }
+  CHECK_EQUAL(400, post(client, batch + "]"));
+  CHECK(remoteTemperature(client, 0) == "25.00");
+
+  // Readings no room sensor could give are refused on both paths, the range ends are accepted
+  CHECK_EQUAL(400, post(client, "", "?zone=1&source=b&temperature=1e6"));
+  CHECK_EQUAL(400, post(client, "", "?zone=1&source=b&temperature=85.01"));
+  CHECK_EQUAL(400, post(client, "", "?zone=1&source=b&temperature=-40.01"));
+  CHECK_EQUAL(400, post(client, "", "?zone=1&source=b&temperature=186&units=imperial"));
+  CHECK_EQUAL(400, post(client, "[[\"b\",1,1e6]]"));
+  CHECK_EQUAL(400, post(client, "[[\"b\",1,18],[\"d\",1,-273]]"));
+  CHECK(remoteTemperature(client, 1) == "19.00");
+  CHECK_EQUAL(200, post(client, "", "?zone=1&source=b&temperature=85"));
+  CHECK(remoteTemperature(client, 1) == "85.00");
+  CHECK_EQUAL(200, post(client, "[[\"b\",1,-40]]"));
+  CHECK(remoteTemperature(client, 1) == "-40.00");
+
+  // A fifteen character source name is the longest that fits
+  CHECK_EQUAL(200, post(client, "[[\"0123456789abcde\",2,24.75]]"));
+  CHECK(remoteTemperature(client, 2) == "23.26");
+}
+
+int main()
+{
+  testAgainstBruteForce();
+
+  halEepromErase();
+  setup();
+  HttpClient client;
+  testBatchBody(&client);
+
+  return checkResult();
+}
@@ -0,0 +1,344 @@
+// Request arguments: numbers must parse whole and be finite, a missing argument is told apart from an
+// invalid one by every typed accessor, names match case insensitively, and lookups stay correct when
+// names share a hash table slot or a whole hash. Random requests are checked against a plain map.
+
+#include <map>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Check.h"
+#include "Hal.h"
+#include "RequestArgs.h"
+
+#define RANDOM_REQUESTS 100000
+
+static_assert(requestArgHash("Zone") == requestArgHash("zone"), "");
+static_assert(requestArgHash("zone") != requestArgHash("zones"), "");
+
+// A marker the accessors must leave alone unless they return ARG_OK
+#define UNTOUCHED -12345
+
+static ArgStatus doubleOf(const char *text, double *value)
+{
+  RequestArgs args;
+  args.add("x", text);
+  *value = UNTOUCHED;
+  return args.getDouble("x", value);
+}
+
+static void testDouble()
+{
+  struct Case
+  {
+    const char *text;
+    ArgStatus status;
+    double value;
+  };
+  const Case cases[] = {
+      {"21.5", ARG_OK, 21.5},
+      {"-3", ARG_OK, -3},
+      {"+7.25", ARG_OK, 7.25},
+      {"1e3", ARG_OK, 1000},
+      {"0", ARG_OK, 0},
+      // Only a prefix is a number
+      {"21.5x", ARG_INVALID, 0},
+      {"21 ", ARG_INVALID, 0},
+      {"1,5", ARG_INVALID, 0},
+      {"20C", ARG_INVALID, 0},
+      // Nothing is a number
+      {"", ARG_INVALID, 0},
+      {"abc", ARG_INVALID, 0},
+      {".", ARG_INVALID, 0},
+      {"-", ARG_INVALID, 0},
+      {"e5", ARG_INVALID, 0},
+      // Not finite
+      {"nan", ARG_INVALID, 0},
+      {"NaN", ARG_INVALID, 0},
+      {"inf", ARG_INVALID, 0},
+      {"-Infinity", ARG_INVALID, 0},
+      {"1e400", ARG_INVALID, 0},
+      {"-1e400", ARG_INVALID, 0},
+  };
+  for (const Case &c : cases)
+  {
+    double value;
+    ArgStatus status = doubleOf(c.text, &value);
+    if (status != c.status)
+    {
+      fprintf(stderr, "getDouble(\"%s\")\n", c.text);
+    }
+    CHECK_EQUAL(c.status, status);
+    CHECK(value == (status == ARG_OK ? c.value : UNTOUCHED));
+  }
+
+  // The longest value that fits parses, one digit more is truncated and invalid although its start would parse
+  double value;
+  std::string longest = "1." + std::string(REQUEST_ARG_VALUE_SIZE - 3, '5');
+  CHECK_EQUAL(ARG_OK, doubleOf(longest.c_str(), &value));
+  CHECK(value > 1.55 && value < 1.56);
+  CHECK_EQUAL(ARG_INVALID, doubleOf((longest + "5").c_str(), &value));
+  CHECK(value == UNTOUCHED);
+}
+
+static ArgStatus longOf(const char *text, long *value)
+{
+  RequestArgs args;
+  args.add("x", text);
+  *value = UNTOUCHED;
+  return args.getLong("x", -10, 10, value);
+}
+
+static void testLong()
+{
+  long value;
+  CHECK_EQUAL(ARG_OK, longOf("7", &value));
+  CHECK_EQUAL(7, value);
+  CHECK_EQUAL(ARG_OK, longOf("-10", &value));
+  CHECK_EQUAL(-10, value);
+  CHECK_EQUAL(ARG_OK, longOf("10", &value));
+  CHECK_EQUAL(10, value);
+
+  const char *const invalid[] = {"11", "-11", "", "7.0", "7x", "0x7", "seven", "99999999999999999999", "-99999999999999999999"};
+  for (const char *text : invalid)
+  {
+    CHECK_EQUAL(ARG_INVALID, longOf(text, &value));
+    CHECK_EQUAL(UNTOUCHED, value);
+  }
+}
+
+static ArgStatus boolOf(const char *text, bool *value)
+{
+  RequestArgs args;
+  args.add("x", text);
+  return args.getBool("x", value);
+}
+
+static void testBool()
+{
+  const char *const trues[] = {"true", "TRUE", "True", "1"};
+  const char *const falses[] = {"false", "FALSE", "fAlSe", "0"};
+  const char *const invalid[] = {"", "yes", "no", "on", "2", "01", "10", "-1", "true ", "truex"};
+  bool value;
+  for (const char *text : trues)
+  {
+    value = false;
+    CHECK_EQUAL(ARG_OK, boolOf(text, &value));
+    CHECK(value);
+  }
+  for (const char *text : falses)
+  {
+    value = true;
+    CHECK_EQUAL(ARG_OK, boolOf(text, &value));
+    CHECK(!value);
+  }
+  for (const char *text : invalid)
+  {
+    value = true;
+    CHECK_EQUAL(ARG_INVALID, boolOf(text, &value));
+    CHECK(value);
+  }
+}
+
+enum Fan
+{
+  FAN_AUTO,
+  FAN_ON
+};
+static const ArgEnumValue<Fan> fans[] = {{"auto", FAN_AUTO}, {"on", FAN_ON}};
+
+// Every accessor answers ARG_MISSING for an argument that is not there and ARG_INVALID for one that is
+// there without a usable value, an empty value included
+static void testMissingAndInvalid()
+{
+  RequestArgs args;
+  args.add("empty", "");
+  args.add("word", "text");
+
+  double d = UNTOUCHED;
+  long l = UNTOUCHED;
+  bool b = true;
+  Fan fan = FAN_ON;
+  CHECK_EQUAL(ARG_MISSING, args.getDouble("missing", &d));
+  CHECK_EQUAL(ARG_MISSING, args.getLong("missing", 0, 10, &l));
+  CHECK_EQUAL(ARG_MISSING, args.getBool("missing", &b));
+  CHECK_EQUAL(ARG_MISSING, args.getEnum("missing", fans, &fan));
+  CHECK(!args.has("missing"));
+  CHECK(args.get("missing") == NULL);
+
+  for (const char *name : {"empty", "word"})
+  {
+    CHECK(args.has(name));
+    CHECK_EQUAL(ARG_INVALID, args.getDouble(name, &d));
+    CHECK_EQUAL(ARG_INVALID, args.getLong(name, 0, 10, &l));
+    CHECK_EQUAL(ARG_INVALID, args.getBool(name, &b));
+    CHECK_EQUAL(ARG_INVALID, args.getEnum(name, fans, &fan));
+  }
+  CHECK(strcmp(args.get("empty"), "") == 0);
+
+  // Nothing was written
+  CHECK(d == UNTOUCHED);
+  CHECK_EQUAL(UNTOUCHED, l);
+  CHECK(b);
+  CHECK_EQUAL(FAN_ON, fan);
+
+  // A value is not confused with a name
+  CHECK(!args.has("text"));
+}
+
+static void testCaseInsensitiveNames()
+{
+  RequestArgs args;
+  CHECK(args.add("Zone", "1"));
+  CHECK(args.add("UNITS", "Imperial"));
+  CHECK(args.add("fan", "AUTO"));
+
+  long zone = 0;
+  CHECK_EQUAL(ARG_OK, args.getLong("zone", 0, 15, &zone));
+  CHECK_EQUAL(1, zone);
+  CHECK_EQUAL(ARG_OK, args.getLong("ZONE", 0, 15, &zone));
+  CHECK(args.has("zOnE"));
+  CHECK(args.useImperialUnits());
+  Fan fan = FAN_ON;
+  CHECK_EQUAL(ARG_OK, args.getEnum("Fan", fans, &fan));
+  CHECK_EQUAL(FAN_AUTO, fan);
+
+  // The first occurrence wins whatever its case, the value keeps its own
+  CHECK(!args.add("zone", "2"));
+  CHECK(!args.add("ZONE", "3"));
+  CHECK(strcmp(args.get("zone"), "1") == 0);
+  CHECK(strcmp(args.get("units"), "Imperial") == 0);
+  CHECK_EQUAL(3, args.size());
+
+  // units=imperial only
+  RequestArgs metric;
+  metric.add("units", "metric");
+  CHECK(!metric.useImperialUnits());
+  RequestArgs other;
+  other.add("unit", "imperial");
+  CHECK(!other.useImperialUnits());
+  CHECK(!RequestArgs().useImperialUnits());
+}
+
+// Names that land in the same slot, and distinct names with the same whole hash, are all found with
+// their own values, and names probing through the same chain are not found by mistake
+static void testCollisions()
+{
+  // Names of slot 15, the last, so the probe chain wraps around to the first slots
+  std::vector<std::string> sameSlot;
+  for (unsigned i = 0; sameSlot.size() < 2 * REQUEST_ARGS_CAPACITY; i++)
+  {
+    std::string name = "s" + std::to_string(i);
+    if ((requestArgHash(name.c_str()) & (REQUEST_ARGS_SLOTS - 1)) == REQUEST_ARGS_SLOTS - 1)
+    {
+      sameSlot.push_back(name);
+    }
+  }
+
+  RequestArgs args;
+  for (uint8_t i = 0; i < REQUEST_ARGS_CAPACITY; i++)
+  {
+    CHECK(args.add(sameSlot[i].c_str(), std::to_string(i).c_str()));
+  }
+  CHECK(!args.add(sameSlot[REQUEST_ARGS_CAPACITY].c_str(), "full"));
+  CHECK_EQUAL(REQUEST_ARGS_CAPACITY, args.size());
+  for (uint8_t i = 0; i < REQUEST_ARGS_CAPACITY; i++)
+  {
+    long value = -1;
+    CHECK_EQUAL(ARG_OK, args.getLong(sameSlot[i].c_str(), 0, 100, &value));
+    CHECK_EQUAL(i, value);
+  }
+  for (size_t i = REQUEST_ARGS_CAPACITY; i < sameSlot.size(); i++)
+  {
+    CHECK(!args.has(sameSlot[i].c_str()));
+  }
+
+  // Two names with the same 32 bit hash, found by the birthday bound within a few hundred thousand names
+  std::unordered_map<uint32_t, std::string> seen;
+  std::string first, second;
+  for (unsigned i = 0; second.empty() && i < 2000000; i++)
+  {
+    std::string name = "h" + std::to_string(i);
+    std::pair<std::unordered_map<uint32_t, std::string>::iterator, bool> inserted = seen.insert(std::make_pair(requestArgHash(name.c_str()), name));
+    if (!inserted.second)
+    {
+      first = inserted.first->second;
+      second = name;
+    }
+  }
+  CHECK(!second.empty());
+  CHECK(requestArgHash(first.c_str()) == requestArgHash(second.c_str()));
+
+  RequestArgs same;
+  CHECK(same.add(first.c_str(), "first"));
+  CHECK(!same.has(second.c_str()));
+  CHECK(same.add(second.c_str(), "second"));
+  CHECK(strcmp(same.get(first.c_str()), "first") == 0);
+  CHECK(strcmp(same.get(second.c_str()), "second") == 0);
+}
+
+// Random requests from a small set of names in mixed case, against a map of lowercase names
+static void testAgainstMap()
+{
+  const char *const names[] = {"zone", "low", "high", "mode", "units", "source", "temperature", "fan", "since", "resolution", "a", "b"};
+  std::mt19937 random(7);
+  unsigned long checks = 0;
+
+  RequestArgs args;
+  for (unsigned long request = 0; request < RANDOM_REQUESTS; request++)
+  {
+    args.clear();
+    std::map<std::string, std::string> model;
+
+    unsigned arguments = random() % (REQUEST_ARGS_CAPACITY + 4);
+    for (unsigned i = 0; i < arguments; i++)
+    {
+      std::string name = names[random() % (sizeof(names) / sizeof(names[0]))];
+      for (char &c : name)
+      {
+        c = random() % 2 ? c - 'a' + 'A' : c;
+      }
+      std::string value = std::to_string(random() % 1000);
+
+      std::string lower = name;
+      for (char &c : lower)
+      {
+        c = requestArgLower(c);
+      }
+      bool added = model.size() < REQUEST_ARGS_CAPACITY && model.count(lower) == 0;
+      if (added)
+      {
+        model[lower] = value;
+      }
+      CHECK_EQUAL(added, args.add(name.c_str(), value.c_str()));
+    }
+
+    CHECK_EQUAL(model.size(), args.size());
+    for (const char *name : names)
+    {
+      std::map<std::string, std::string>::iterator expected = model.find(name);
+      const char *value = args.get(name);
+      CHECK((value == NULL) == (expected == model.end()));
+      if (value != NULL && expected != model.end())
+      {
+        CHECK(expected->second == value);
+      }
+      checks++;
+    }
+  }
+  printf("%d random requests, %lu lookups agree with the map\n", RANDOM_REQUESTS, checks);
+}
+
+int main()
+{
+  testDouble();
+  testLong();
+  testBool();
+  testMissingAndInvalid();
+  testCaseInsensitiveNames();
+  testCollisions();
+  testAgainstMap();
+
+  return checkResult();
+}
@@ -0,0 +1,295 @@
+// The weekly schedule on a mock wall clock: tables are stored sorted and rounded, transitions take
+// effect on their minute and across the end of the week, a manual setpoint holds until the zone's next
+// transition, a clock jump re-applies the active transitions, and /schedule refuses a table that is
+// out of range or does not fit the settings log while keeping the running schedule.
+
+#include "Check.h"
+#include "HttpClient.h"
+#include "JsonDocument.h"
+#include "Sketch.h"
+
+#define MONDAY SCHEDULE_MINUTES_PER_DAY
+#define SATURDAY (6 * SCHEDULE_MINUTES_PER_DAY)
+
+// Keys this build does not know, as left by other firmware, they survive compaction and take
+// FOREIGN_KEYS * (SETTINGS_LOG_RECORD_OVERHEAD + FOREIGN_KEY_SIZE) bytes of the bank
+#define FOREIGN_KEY 40
+#define FOREIGN_KEYS 6
+#define FOREIGN_KEY_SIZE 22
+
+// Largest schedule that fits next to the foreign keys and every key of this build
+#define STORABLE_TRANSITIONS \
+  ((EEPROM_SIZE / 2 - SETTINGS_LOG_HEADER_SIZE - SETTINGS_LOG_RECORD_OVERHEAD - STORAGE_OTHER_KEYS_SIZE - FOREIGN_KEYS * (SETTINGS_LOG_RECORD_OVERHEAD + FOREIGN_KEY_SIZE)) / STORAGE_SCHEDULE_TRANSITION_SIZE)
+
+static_assert(STORABLE_TRANSITIONS >= 4 && STORABLE_TRANSITIONS < SCHEDULE_MAX_TRANSITIONS, "the foreign keys must leave room for some but not all transitions");
+
+static int16_t mockMinute = SCHEDULE_NO_TIME;
+
+static int16_t mockClock()
+{
+  return mockMinute;
+}
+
+// Set the wall clock and run one control pass
+static void at(int16_t minute)
+{
+  mockMinute = minute;
+  thermostat->update(Temperature::fromCelsius(21));
+}
+
+static bool setpointsAre(double low, double high)
+{
+  return thermostat->getSetpointLow() == Temperature::fromCelsius(low) && thermostat->getSetpointHigh() == Temperature::fromCelsius(high);
+}
+
+static ScheduleTransition transition(uint16_t minute, double low, double high)
+{
+  ScheduleTransition transition;
+  transition.minute = minute;
+  transition.zone = 0;
+  transition.setpointLow = Temperature::fromCelsius(low);
+  transition.setpointHigh = Temperature::fromCelsius(high);
+  return transition;
+}
+
+// A fresh log over the EEPROM the way the next boot reads it, after a commit
+static bool storedLength(uint8_t *length)
+{
+  storage->flush();
+  SettingsLog log(EEPROM_SIZE);
+  if (!log.begin())
+  {
+    return false;
+  }
+  *length = log.length(STORAGE_KEY_SCHEDULE);
+  return true;
+}
+
+static void testStorage()
+{
+  // Out of order, with hundredths
+  ScheduleTable table;
+  table.count = 3;
+  table.transitions[0] = transition(MONDAY + 22 * 60, 18.04, 28.06);
+  table.transitions[1] = transition(MONDAY + 7 * 60, 21.26, 25);
+  table.transitions[2] = transition(0, 19, 27);
+  CHECK(thermostat->setSchedule(table));
+
+  ScheduleTable stored;
+  storage->getSchedule(&stored);
+  CHECK_EQUAL(3, stored.count);
+  CHECK_EQUAL(0, stored.transitions[0].minute);
+  CHECK_EQUAL(MONDAY + 7 * 60, stored.transitions[1].minute);
+  CHECK_EQUAL(MONDAY + 22 * 60, stored.transitions[2].minute);
+  CHECK_EQUAL(2130, stored.transitions[1].setpointLow.centiCelsius());
+  CHECK_EQUAL(1800, stored.transitions[2].setpointLow.centiCelsius());
+  CHECK_EQUAL(2810, stored.transitions[2].setpointHigh.centiCelsius());
+
+  // The running table is the stored one
+  ScheduleTable running = thermostat->getSchedule();
+  CHECK_EQUAL(3, running.count);
+  CHECK(running.transitions[1].setpointLow == stored.transitions[1].setpointLow);
+
+  uint8_t length = 0;
+  CHECK(storedLength(&length));
+  CHECK_EQUAL(3 * STORAGE_SCHEDULE_TRANSITION_SIZE, length);
+
+  // Out of range tables are refused and change nothing
+  table.transitions[0].setpointHigh = Thermostat::setpointMaximum + Temperature::fromCelsius(1);
+  CHECK(!Thermostat::isValidSchedule(table));
+  CHECK(!thermostat->setSchedule(table));
+  CHECK_EQUAL(3, thermostat->getSchedule().count);
+
+  // As many transitions as fit the bank next to the foreign keys are stored, one more is refused
+  table.count = STORABLE_TRANSITIONS;
+  for (uint8_t i = 0; i < table.count; i++)
+  {
+    table.transitions[i] = transition(i * 60, 20, 26);
+  }
+  CHECK(thermostat->setSchedule(table));
+  CHECK(storedLength(&length));
+  CHECK_EQUAL(STORABLE_TRANSITIONS * STORAGE_SCHEDULE_TRANSITION_SIZE, length);
+
+  table.count = STORABLE_TRANSITIONS + 1;
+  table.transitions[table.count - 1] = transition(MONDAY, 20, 26);
+  CHECK(Thermostat::isValidSchedule(table));
+  CHECK(!storage->isDirty());
+  CHECK(!thermostat->setSchedule(table));
+  CHECK(!storage->isDirty());
+  CHECK_EQUAL(STORABLE_TRANSITIONS, thermostat->getSchedule().count);
+  storage->getSchedule(&stored);
+  CHECK_EQUAL(STORABLE_TRANSITIONS, stored.count);
+}
+
+static void testTransitions()
+{
+  ScheduleTable table;
+  table.count = 3;
+  table.transitions[0] = transition(0, 19, 27);
+  table.transitions[1] = transition(MONDAY + 7 * 60, 21, 25);
+  table.transitions[2] = transition(MONDAY + 22 * 60, 18, 28);
+  CHECK(thermostat->setSchedule(table));
+
+  // A new table applies the transition active at the current minute
+  at(MONDAY + 6 * 60);
+  CHECK(setpointsAre(19, 27));
+  CHECK(!thermostat->isScheduleOverridden());
+
+  // Each transition takes effect on its minute, not before
+  at(MONDAY + 7 * 60 - 1);
+  CHECK(setpointsAre(19, 27));
+  at(MONDAY + 7 * 60);
+  CHECK(setpointsAre(21, 25));
+
+  // A manual setpoint holds until the next transition
+  CHECK(thermostat->setSetpointLow(Temperature::fromCelsius(23)));
+  CHECK(thermostat->isScheduleOverridden());
+  for (int16_t minute = MONDAY + 7 * 60 + 1; minute < MONDAY + 22 * 60; minute++)
+  {
+    at(minute);
+  }
+  CHECK(setpointsAre(23, 25));
+  at(MONDAY + 22 * 60);
+  CHECK(setpointsAre(18, 28));
+  CHECK(!thermostat->isScheduleOverridden());
+
+  // The end of the week wraps to Sunday's transition, a step of a few minutes fires it
+  at(SCHEDULE_MINUTES_PER_WEEK - 2);
+  CHECK(setpointsAre(18, 28));
+  at(2);
+  CHECK(setpointsAre(19, 27));
+
+  // A clock jump past several transitions places the schedule again and applies the active one only
+  at(MONDAY + 12 * 60);
+  CHECK(setpointsAre(21, 25));
+
+  // but keeps a manual override
+  CHECK(thermostat->setSetpointHigh(Temperature::fromCelsius(26)));
+  at(SATURDAY);
+  CHECK(setpointsAre(21, 26));
+  CHECK(thermostat->isScheduleOverridden());
+
+  // Without a wall clock nothing fires
+  at(SCHEDULE_NO_TIME);
+  at(SCHEDULE_NO_TIME);
+  CHECK(setpointsAre(21, 26));
+}
+
+// Run loop() until the response arrives, reconnecting if the server dropped the idle connection
+static bool exchange(HttpClient *client, const std::string &request, HttpResponse *response)
+{
+  if (!client->poll() && !client->connect(halListenPort()))
+  {
+    return false;
+  }
+  client->send(request);
+
+  for (unsigned long pass = 0; pass < 1000; pass++)
+  {
+    loop();
+    bool open = client->poll();
+    if (client->takeResponse(response))
+    {
+      return true;
+    }
+    if (!open)
+    {
+      return false;
+    }
+  }
+  return false;
+}
+
+static int put(HttpClient *client, const std::string &body)
+{
+  HttpResponse response;
+  if (!exchange(client, "PUT /schedule HTTP/1.1\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body, &response))
+  {
+    return 0;
+  }
+  return response.status;
+}
+
+static std::string transitions(uint8_t count)
+{
+  std::string body = "{\"transitions\":[";
+  for (uint8_t i = 0; i < count; i++)
+  {
+    body += (i == 0 ? "[" : ",[") + std::to_string(i * 60) + ",0,20.5,26]";
+  }
+  return body + "]}";
+}
+
+static void testRoutes(HttpClient *client)
+{
+  // The control task picks up the new table and drops the override
+  CHECK_EQUAL(200, put(client, transitions(2)));
+  at(MONDAY + 30);
+  CHECK(setpointsAre(20.5, 26));
+
+  HttpResponse response;
+  CHECK(exchange(client, "GET /schedule HTTP/1.1\r\n\r\n", &response));
+  CHECK_EQUAL(200, response.status);
+  Document document = parse(response.body);
+  CHECK(document["/clock"] == std::to_string(MONDAY + 30));
+  CHECK(document["/override/0"] == "false");
+  CHECK(document["/transitions/1/0"] == "60");
+  CHECK(document["/transitions/1/2"] == "20.50");
+  CHECK(document.count("/transitions/2/0") == 0);
+
+  // Out of range, malformed and unknown zones are bad requests
+  CHECK_EQUAL(400, put(client, "{\"transitions\":[[0,0,50,60]]}"));
+  CHECK_EQUAL(400, put(client, "{\"transitions\":[[0,0,20]]}"));
+  CHECK_EQUAL(400, put(client, "{\"transitions\":[[0,1,20,26]]}"));
+
+  // A table the settings log cannot hold is an error and the previous schedule keeps running
+  CHECK_EQUAL(507, put(client, transitions(STORABLE_TRANSITIONS + 1)));
+  CHECK_EQUAL(2, thermostat->getSchedule().count);
+  CHECK_EQUAL(200, put(client, transitions(STORABLE_TRANSITIONS)));
+  CHECK_EQUAL(STORABLE_TRANSITIONS, thermostat->getSchedule().count);
+}
+
+int main()
+{
+  // The foreign keys go in before the storage loads the log
+  EEPROM.begin(EEPROM_SIZE);
+  halEepromErase();
+  SettingsLog log(EEPROM_SIZE);
+  log.format();
+
+  // Every key of this build holds a value, as on a device that has been in use
+  const uint8_t byteKeys[] = {STORAGE_KEY_CURRENT_MODE, STORAGE_KEY_CURRENT_STATE, STORAGE_KEY_SETTING_SCREEN_UNIT,
+                              STORAGE_KEY_SETTING_REMOTE_TEMPERATURE, STORAGE_KEY_SETTING_CONTROL_STRATEGY};
+  for (uint8_t key : byteKeys)
+  {
+    uint8_t value = 0;
+    CHECK(log.write(key, &value, sizeof(value)));
+  }
+  int16_t setpoints[2] = {2000, 2600};
+  CHECK(log.write(STORAGE_KEY_SETPOINT_LOW, &setpoints[0], sizeof(setpoints[0])));
+  CHECK(log.write(STORAGE_KEY_SETPOINT_HIGH, &setpoints[1], sizeof(setpoints[1])));
+  uint8_t zoneRecord[STORAGE_ZONE_RECORD_SIZE] = {0};
+  memcpy(zoneRecord, setpoints, sizeof(setpoints));
+  for (uint8_t zone = 1; zone < THERMOSTAT_ZONE_COUNT; zone++)
+  {
+    CHECK(log.write(STORAGE_KEY_ZONE_SETPOINTS + zone - 1, zoneRecord, sizeof(zoneRecord)));
+  }
+
+  uint8_t filler[FOREIGN_KEY_SIZE] = {0};
+  for (uint8_t i = 0; i < FOREIGN_KEYS; i++)
+  {
+    CHECK(log.write(FOREIGN_KEY + i, filler, sizeof(filler)));
+  }
+  EEPROM.commit();
+
+  setup();
+  thermostat->setWallClock(mockClock);
+  thermostat->setMode(Thermostat::ThermostatMode::OFF);
+
+  testStorage();
+  testTransitions();
+  HttpClient client;
+  testRoutes(&client);
+
+  return checkResult();
+}
@@ -0,0 +1,179 @@
+// Scheduler on a virtual clock: cadence, catching up, deadlines, runtime statistics, sleeping
+// between tasks and the millis() wrap.
+
+#include <limits.h>
+
+#include "Check.h"
+#include "Hal.h"
+#include "Scheduler.h"
+
+static unsigned long virtualMillis = 0;
+static unsigned long virtualMicros = 0;
+
+static unsigned long clockMillis()
+{
+  return virtualMillis;
+}
+
+static unsigned long clockMicros()
+{
+  return virtualMicros;
+}
+
+static uint32_t clockCycles()
+{
+  return virtualMicros * 240;
+}
+
+static void advance(unsigned long ms)
+{
+  virtualMillis += ms;
+  virtualMicros += ms * 1000;
+}
+
+static unsigned long fastRuns = 0;
+static unsigned long slowRuns = 0;
+static unsigned long slowRuntime = 0;
+// Order tasks ran in during the last run(), as task letters
+static char order[8];
+static uint8_t orderLength = 0;
+
+static void fastTask()
+{
+  fastRuns++;
+  order[orderLength++] = 'f';
+}
+
+static void slowTask()
+{
+  slowRuns++;
+  virtualMicros += slowRuntime;
+  order[orderLength++] = 's';
+}
+
+static void noTask()
+{
+}
+
+static void reset(unsigned long start)
+{
+  virtualMillis = start;
+  virtualMicros = 0;
+  fastRuns = 0;
+  slowRuns = 0;
+  slowRuntime = 0;
+}
+
+// run() then sleep until the next task, like loop(), for duration ms. Returns the number of wakeups.
+static unsigned long runLoop(Scheduler *scheduler, unsigned long duration)
+{
+  unsigned long wakeups = 0;
+  unsigned long start = virtualMillis;
+  while (virtualMillis - start < duration)
+  {
+    orderLength = 0;
+    scheduler->run();
+    advance(scheduler->getTimeUntilNextTask());
+    wakeups++;
+  }
+  return wakeups;
+}
+
+static void testCadence(unsigned long start)
+{
+  reset(start);
+  Scheduler scheduler(clockMillis, clockMicros, clockCycles);
+  CHECK_EQUAL(0, scheduler.addTask("fast", fastTask, 10));
+  CHECK_EQUAL(1, scheduler.addTask("slow", slowTask, 1000));
+
+  // Both are due at once and run in registration order
+  CHECK_EQUAL(0, scheduler.getTimeUntilNextTask());
+  orderLength = 0;
+  scheduler.run();
+  CHECK_EQUAL(2, orderLength);
+  CHECK(order[0] == 'f' && order[1] == 's');
+  CHECK_EQUAL(10, scheduler.getTimeUntilNextTask());
+
+  // A minute of one run every 10 ms and every second, the loop only wakes up when a task is due
+  unsigned long wakeups = runLoop(&scheduler, 60000);
+  CHECK_EQUAL(6000, fastRuns);
+  CHECK_EQUAL(60, slowRuns);
+  CHECK_EQUAL(6000, wakeups);
+  CHECK_EQUAL(0, scheduler.getTask(0)->missedDeadlines);
+}
+
+static void testCatchUp()
+{
+  reset(0);
+  Scheduler scheduler(clockMillis, clockMicros, clockCycles);
+  scheduler.addTask("fast", fastTask, 10, 5);
+  scheduler.run();
+
+  // 3 ms late keeps the cadence, the next run is still due on the 10 ms grid
+  advance(13);
+  scheduler.run();
+  CHECK_EQUAL(2, fastRuns);
+  CHECK_EQUAL(7, scheduler.getTimeUntilNextTask());
+  CHECK_EQUAL(0, scheduler.getTask(0)->missedDeadlines);
+
+  // More than a period behind runs once and restarts the cadence instead of bursting
+  advance(57);
+  scheduler.run();
+  scheduler.run();
+  CHECK_EQUAL(3, fastRuns);
+  CHECK_EQUAL(10, scheduler.getTimeUntilNextTask());
+  CHECK_EQUAL(1, scheduler.getTask(0)->missedDeadlines);
+}
+
+static void testRuntime()
+{
+  reset(0);
+  Scheduler scheduler(clockMillis, clockMicros, clockCycles);
+  scheduler.addTask("slow", slowTask, 100);
+
+  slowRuntime = 250;
+  scheduler.run();
+  advance(100);
+  slowRuntime = 1200;
+  scheduler.run();
+  advance(100);
+  slowRuntime = 50;
+  scheduler.run();
+
+  const Scheduler::Task *task = scheduler.getTask(0);
+  CHECK_EQUAL(3, task->runCount);
+  CHECK_EQUAL(50, task->lastRuntime);
+  CHECK_EQUAL(1200, task->maxRuntime);
+  CHECK_EQUAL(1500, task->totalRuntime);
+#if METRICS_ENABLED
+  CHECK_EQUAL(1200 * 240, task->cycles.getMaximum());
+#endif
+}
+
+static void testFull()
+{
+  reset(0);
+  Scheduler scheduler(clockMillis, clockMicros, clockCycles);
+  for (uint8_t i = 0; i < SCHEDULER_MAX_TASKS; i++)
+  {
+    CHECK_EQUAL(i, scheduler.addTask("task", noTask, 10));
+  }
+  CHECK_EQUAL(-1, scheduler.addTask("task", noTask, 10));
+  CHECK_EQUAL(SCHEDULER_MAX_TASKS, scheduler.getTaskCount());
+  CHECK(scheduler.getTask(SCHEDULER_MAX_TASKS) == 0);
+
+  Scheduler empty(clockMillis, clockMicros, clockCycles);
+  CHECK_EQUAL(0, empty.getTimeUntilNextTask());
+}
+
+int main()
+{
+  testCadence(0);
+  // millis() wraps after 49.7 days on the ESP32, and after ULONG_MAX on the host
+  testCadence(ULONG_MAX - 25000);
+  testCatchUp();
+  testRuntime();
+  testFull();
+
+  return checkResult();
+}
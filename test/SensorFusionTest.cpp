@@ -0,0 +1,204 @@
+// The fusion stage and its filters: every filter smooths sensor noise, the median rejects spikes and
+// the EMA follows its time constant; the fusion ages confidence over the timeout, falls back to the
+// other source when the preferred one goes stale, treats a reading stamped just after now as fresh,
+// and restarts a filter after a gap. Each filter is benchmarked per sample and never allocates.
+
+#include <chrono>
+
+#include "AllocationCounter.h"
+#include "Check.h"
+#include "Hal.h"
+#include "SensorFusion.h"
+
+#define BENCHMARK_SAMPLES 1000000
+// Host budget for one filter update, the ESP32 runs one per source every control pass
+#define SAMPLE_BUDGET_NANOSECONDS 200
+
+#define TRUE_TEMPERATURE 21.0f
+#define SAMPLE_SPACING 2.0f
+
+static uint32_t randomState = 1;
+
+// Uniform noise of +-amplitude, deterministic
+static float noise(float amplitude)
+{
+  randomState = randomState * 1103515245 + 12345;
+  return amplitude * (((randomState >> 8) % 2001) / 1000.0f - 1);
+}
+
+// RMS distance to the true temperature of the filter's output over noisy readings, after it settled
+template <typename Filter>
+static double rmsError(float amplitude)
+{
+  Filter filter;
+  randomState = 1;
+  double squared = 0;
+  unsigned long counted = 0;
+  for (unsigned long i = 0; i < 2000; i++)
+  {
+    float output = filter.update(TRUE_TEMPERATURE + noise(amplitude), SAMPLE_SPACING);
+    if (i >= 100)
+    {
+      squared += (output - TRUE_TEMPERATURE) * (output - TRUE_TEMPERATURE);
+      counted++;
+    }
+  }
+  return sqrt(squared / counted);
+}
+
+static void testFilters()
+{
+  double raw = rmsError<NoFilter>(0.3f);
+  double ema = rmsError<EmaFilter>(0.3f);
+  double median = rmsError<MedianFilter>(0.3f);
+  double kalman = rmsError<KalmanFilter>(0.3f);
+  printf("RMS error of +-0.3 K noise: %.3f K raw, %.3f K EMA, %.3f K median, %.3f K Kalman\n", raw, ema, median, kalman);
+  CHECK(ema < raw / 2);
+  CHECK(median < raw);
+  CHECK(kalman < raw / 2);
+
+  // A single spike does not get through the median
+  MedianFilter medianFilter;
+  for (uint8_t i = 0; i < SENSOR_MEDIAN_WINDOW; i++)
+  {
+    medianFilter.update(TRUE_TEMPERATURE, SAMPLE_SPACING);
+  }
+  CHECK(medianFilter.update(85, SAMPLE_SPACING) == TRUE_TEMPERATURE);
+  CHECK(medianFilter.update(TRUE_TEMPERATURE, SAMPLE_SPACING) == TRUE_TEMPERATURE);
+
+  // The EMA closes 1 - 1/e of a step after one time constant however the readings are spaced, to within
+  // its discretization: two readings per time constant close 0.56
+  const float spacings[] = {0.5f, 2, 5};
+  for (float spacing : spacings)
+  {
+    EmaFilter emaFilter;
+    emaFilter.update(20, 0);
+    float output = 20;
+    for (float elapsed = 0; elapsed < SENSOR_EMA_TIME_CONSTANT - 1e-3f; elapsed += spacing)
+    {
+      output = emaFilter.update(21, spacing);
+    }
+    CHECK(fabs(output - 20.632f) < 0.08f);
+  }
+
+  // reset starts over from the next reading
+  KalmanFilter kalmanFilter;
+  kalmanFilter.update(20, 0);
+  kalmanFilter.reset();
+  CHECK(kalmanFilter.update(25, SAMPLE_SPACING) == 25);
+}
+
+static SensorReading reading(double celsius, unsigned long time)
+{
+  SensorReading reading = {Temperature::fromCelsius(celsius), time};
+  return reading;
+}
+
+static void testFusion()
+{
+  SensorFusion fusion;
+  const unsigned long start = 1000000;
+
+  // Nothing yet
+  FusedTemperature fused = fusion.read(0, true, false, start);
+  CHECK(!fused.temperature.isValid());
+  CHECK_EQUAL(0, fused.confidence);
+
+  // A fresh local reading has full confidence, it halves over the timeout and is gone after it
+  fusion.addLocal(reading(21, start));
+  fused = fusion.read(0, true, false, start);
+  CHECK(fused.temperature == Temperature::fromCelsius(21));
+  CHECK_EQUAL(SENSOR_CONFIDENCE_FULL, fused.confidence);
+  uint8_t previous = SENSOR_CONFIDENCE_FULL;
+  for (unsigned long age = 0; age < SENSOR_LOCAL_TIMEOUT; age += 100)
+  {
+    uint8_t confidence = fusion.read(0, true, false, start + age).confidence;
+    CHECK(confidence <= previous && confidence >= SENSOR_CONFIDENCE_FULL / 2 && confidence % SENSOR_CONFIDENCE_STEP == 0);
+    previous = confidence;
+  }
+  CHECK_EQUAL(0, fusion.read(0, true, false, start + SENSOR_LOCAL_TIMEOUT).confidence);
+
+  // A reading stamped after now, taken by the other core between the clock read and the fusion, is fresh
+  fusion.addLocal(reading(21.5, start + 20005));
+  fused = fusion.read(0, true, false, start + 20000);
+  CHECK_EQUAL(SENSOR_CONFIDENCE_FULL, fused.confidence);
+  CHECK(fused.temperature.isValid());
+
+  // Preferring the remote source: used while fresh, the local one stands in at half confidence once it is stale
+  fusion.addRemote(0, reading(19, start + 20000));
+  fused = fusion.read(0, true, true, start + 20010);
+  CHECK(fused.temperature == Temperature::fromCelsius(19));
+  CHECK_EQUAL(SENSOR_CONFIDENCE_FULL, fused.confidence);
+
+  fusion.addLocal(reading(22, start + 20000 + SENSOR_REMOTE_TIMEOUT));
+  fused = fusion.read(0, true, true, start + 20000 + SENSOR_REMOTE_TIMEOUT);
+  CHECK(fused.temperature == Temperature::fromCelsius(22));
+  CHECK_EQUAL(SENSOR_CONFIDENCE_FULL / 2, fused.confidence);
+
+  // A zone without the local sensor has nothing once its remote source is stale
+  fusion.addRemote(1 % THERMOSTAT_ZONE_COUNT, reading(23, start));
+  fused = fusion.read(1 % THERMOSTAT_ZONE_COUNT, false, false, start + 1000);
+  CHECK_EQUAL(SENSOR_CONFIDENCE_FULL, fused.confidence);
+  fused = fusion.read(1 % THERMOSTAT_ZONE_COUNT, false, false, start + SENSOR_REMOTE_TIMEOUT + 1000);
+  CHECK(!fused.temperature.isValid());
+  CHECK_EQUAL(0, fused.confidence);
+
+  // After a gap longer than the timeout the filter starts over instead of averaging with old state
+  SensorFusion gap;
+  gap.addLocal(reading(18, start));
+  gap.addLocal(reading(18, start + 2000));
+  gap.addLocal(reading(26, start + 2000 + SENSOR_LOCAL_TIMEOUT));
+  CHECK(gap.read(0, true, false, start + 2000 + SENSOR_LOCAL_TIMEOUT).temperature == Temperature::fromCelsius(26));
+
+  // The same reading twice is only filtered once
+  gap.addLocal(reading(30, start + 4000 + SENSOR_LOCAL_TIMEOUT));
+  Temperature once = gap.read(0, true, false, start + 4000 + SENSOR_LOCAL_TIMEOUT).temperature;
+  gap.addLocal(reading(30, start + 4000 + SENSOR_LOCAL_TIMEOUT));
+  CHECK(gap.read(0, true, false, start + 4000 + SENSOR_LOCAL_TIMEOUT).temperature == once);
+}
+
+// Nanoseconds per update over noisy readings, and heap allocations made on the way
+template <typename Filter>
+static double nanosecondsPerSample(const char *name, const float *readings)
+{
+  Filter filter;
+  float sum = 0;
+  unsigned long long allocations = allocationCount;
+  allocationCounting = true;
+  std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+  for (unsigned long i = 0; i < BENCHMARK_SAMPLES; i++)
+  {
+    sum += filter.update(readings[i], SAMPLE_SPACING);
+  }
+  double nanoseconds = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / BENCHMARK_SAMPLES;
+  allocationCounting = false;
+
+  printf("%-8s %6.2f ns/sample, %lu bytes of state (mean output %.3f)\n", name, nanoseconds, (unsigned long)sizeof(Filter), sum / BENCHMARK_SAMPLES);
+  CHECK_EQUAL(0, allocationCount - allocations);
+  CHECK(nanoseconds < SAMPLE_BUDGET_NANOSECONDS);
+  return nanoseconds;
+}
+
+static void benchmark()
+{
+  static float readings[BENCHMARK_SAMPLES];
+  randomState = 7;
+  for (unsigned long i = 0; i < BENCHMARK_SAMPLES; i++)
+  {
+    readings[i] = TRUE_TEMPERATURE + 2 * sin(i * 1e-4) + noise(0.3f);
+  }
+
+  nanosecondsPerSample<NoFilter>("none", readings);
+  nanosecondsPerSample<EmaFilter>("EMA", readings);
+  nanosecondsPerSample<MedianFilter>("median", readings);
+  nanosecondsPerSample<KalmanFilter>("Kalman", readings);
+}
+
+int main()
+{
+  testFilters();
+  testFusion();
+  benchmark();
+
+  return checkResult();
+}
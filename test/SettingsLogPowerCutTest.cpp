@@ -0,0 +1,188 @@
+// Cuts power after every byte of thousands of settings log writes and checks a reboot always finds
+// each key with either its old or its new value. Also reports how many bytes the ESP32 EEPROM
+// emulation commits compared to the bytes that actually changed.
+
+#include <random>
+#include <vector>
+
+#include "Check.h"
+#include "Hal.h"
+#include "SettingsLog.h"
+
+#define REGION_SIZE 512
+#define KEY_COUNT 24
+#define WRITES 3000
+
+struct Value
+{
+  uint8_t length;
+  uint8_t data[16];
+
+  bool equals(const Value &other) const
+  {
+    return length == other.length && memcmp(data, other.data, length) == 0;
+  }
+};
+
+static Value readValue(SettingsLog *log, uint8_t key)
+{
+  Value value;
+  value.length = log->length(key);
+  if (value.length > sizeof(value.data) || !log->read(key, value.data, value.length))
+  {
+    value.length = 0;
+  }
+  return value;
+}
+
+static Value makeValue(uint8_t length, uint8_t seed)
+{
+  Value value;
+  value.length = length;
+  for (uint8_t i = 0; i < length; i++)
+  {
+    value.data[i] = seed + i;
+  }
+  return value;
+}
+
+// Mostly the sizes PersistentStorage writes, with an occasional larger record
+static Value randomValue(std::mt19937 &random)
+{
+  return makeValue(random() % 8 == 0 ? 1 + random() % 16 : 1 + random() % 2, random());
+}
+
+static SettingsLog *reboot(SettingsLog *log)
+{
+  delete log;
+  log = new SettingsLog(REGION_SIZE);
+  CHECK(log->begin());
+  return log;
+}
+
+// A value that only fits once its old record is dropped is rejected and the old value is kept
+static void testValueTooLarge()
+{
+  halEepromErase();
+  SettingsLog *log = new SettingsLog(REGION_SIZE);
+  log->format();
+
+  // 13 keys of 16 bytes and one of 1 byte fill the bank to 255 of 256 bytes after compaction
+  for (uint8_t key = 0; key < 13; key++)
+  {
+    Value value = makeValue(16, key);
+    CHECK(log->write(key, value.data, value.length));
+  }
+  Value small = makeValue(1, 100);
+  CHECK(log->write(13, small.data, small.length));
+
+  // Replacing it with 2 bytes fills the bank exactly, through a compaction once the bank is full
+  Value exact = makeValue(2, 101);
+  for (uint8_t i = 0; i < 20; i++)
+  {
+    CHECK(log->write(13, exact.data, exact.length));
+  }
+  CHECK(readValue(log, 13).equals(exact));
+
+  // 16 bytes would need 270 bytes, the write fails before the other bank is touched
+  Value large = makeValue(16, 102);
+  while (log->getUsedBytes() + SETTINGS_LOG_RECORD_OVERHEAD + large.length <= log->getBankSize())
+  {
+    CHECK(log->write(13, exact.data, exact.length));
+  }
+  CHECK(!log->write(13, large.data, large.length));
+  CHECK(readValue(log, 13).equals(exact));
+
+  log = reboot(log);
+  CHECK(readValue(log, 13).equals(exact));
+  for (uint8_t key = 0; key < 13; key++)
+  {
+    CHECK(readValue(log, key).equals(makeValue(16, key)));
+  }
+  delete log;
+}
+
+int main()
+{
+  std::mt19937 random(1);
+
+  EEPROM.begin(REGION_SIZE);
+  testValueTooLarge();
+
+  halEepromErase();
+  SettingsLog *log = new SettingsLog(REGION_SIZE);
+  CHECK(!log->begin());
+  log->format();
+  EEPROM.commit();
+
+  Value expected[KEY_COUNT];
+  for (uint8_t key = 0; key < KEY_COUNT; key++)
+  {
+    expected[key].length = 0;
+  }
+
+  unsigned long cuts = 0;
+  unsigned long compactions = 0;
+  unsigned long rejected = 0;
+  unsigned long long committedBytes = halEepromCommittedBytes();
+  unsigned long long changedBytes = halEepromChangedBytes();
+
+  for (unsigned long i = 0; i < WRITES; i++)
+  {
+    uint8_t key = random() % KEY_COUNT;
+    Value value = randomValue(random);
+    std::vector<uint8_t> before(halEepromData(), halEepromData() + halEepromSize());
+
+    // Cut after 0, 1, 2 ... bytes until the write completes, rebooting from the same contents each time
+    for (long cutAfter = 0;; cutAfter++)
+    {
+      memcpy(halEepromData(), before.data(), before.size());
+      log = reboot(log);
+      uint16_t usedBefore = log->getUsedBytes();
+
+      halEepromCutAfter(cutAfter);
+      bool written = log->write(key, value.data, value.length);
+      bool cut = halEepromWasCut();
+      halEepromCutAfter(-1);
+
+      if (!cut)
+      {
+        // The uncut write is the one that stays
+        CHECK(readValue(log, key).equals(written ? value : expected[key]));
+        log = reboot(log);
+        CHECK(readValue(log, key).equals(written ? value : expected[key]));
+        if (written)
+        {
+          expected[key] = value;
+          compactions += log->getUsedBytes() < usedBefore;
+        }
+        rejected += !written;
+        break;
+      }
+
+      cuts++;
+      log = reboot(log);
+      for (uint8_t other = 0; other < KEY_COUNT; other++)
+      {
+        Value stored = readValue(log, other);
+        CHECK(stored.equals(expected[other]) || (other == key && stored.equals(value)));
+      }
+    }
+
+    EEPROM.commit();
+  }
+
+  committedBytes = halEepromCommittedBytes() - committedBytes;
+  changedBytes = halEepromChangedBytes() - changedBytes;
+  printf("%d writes, %lu power cuts, %lu compactions, %lu values too large\n", WRITES, cuts, compactions, rejected);
+  printf("Commit per write: %.1f bytes written to flash, %.1f bytes changed\n", (double)committedBytes / WRITES,
+         (double)changedBytes / WRITES);
+
+  CHECK(compactions > 10);
+  // The emulation commits the whole buffer whatever changed
+  CHECK_EQUAL((unsigned long long)WRITES * REGION_SIZE, committedBytes);
+  CHECK(changedBytes < committedBytes / 20);
+
+  delete log;
+  return checkResult();
+}
@@ -0,0 +1,39 @@
+#ifndef SKETCH_H
+#define SKETCH_H
+
+// The whole sketch in one translation unit, the way the Arduino builder compiles openThermostat.ino.
+// setup() runs on the simulated clock: the control task is created but not started, tests drive
+// controlScheduler themselves or start it on a thread with halStartTasks.
+
+#include "Hal.h"
+
+// Any free port, tests find it with halListenPort
+#define PORT 0
+
+#include "Button.h"
+#include "Thermostat.h"
+
+// Prototypes the Arduino builder generates for the sketch's functions
+void controlTask(void *parameters);
+void updateButtons();
+void updateEnvironmentalSensor();
+void recordStateChange(uint8_t zone, Thermostat::ThermostatState state);
+void updateThermostat();
+void writeRelays(uint8_t zone, Thermostat::ThermostatState state);
+void updateWebService();
+void updateDisplay();
+void updateStorage();
+void upButtonEvent(ButtonEvent event);
+void downButtonEvent(ButtonEvent event);
+void multiButtonEvent(ButtonEvent event);
+
+#include "openThermostat.ino"
+
+// One pass of both cores on the simulated clock, the loop() sleep advances time
+static void sketchStep()
+{
+  loop();
+  controlScheduler->run();
+}
+
+#endif
@@ -0,0 +1,176 @@
+// Hours of simulated uptime on a warm afternoon: the sketch controls a thermal plant, heating while the
+// comfort band is raised every other hour and cooling otherwise, redraws the display every second,
+// takes button presses and answers every route over keep-alive connections, and after warming up it
+// makes no heap allocation beyond the socket handle of each accepted connection.
+
+#include "AllocationCounter.h"
+#include "Check.h"
+#include "HttpClient.h"
+#include "Sketch.h"
+#include "ThermalPlant.h"
+
+// Build with a longer span for a real soak, the default keeps the ctest run short
+#ifndef SOAK_HOURS
+#define SOAK_HOURS 3
+#endif
+// Simulated time of day at boot, in hours
+#define START_HOUR 13
+#define WARM_UP_MINUTES 10
+// Simulated time between two bursts of requests, one to every route, and between two button presses
+#define REQUEST_PERIOD 300000UL
+#define PRESS_PERIOD 600000UL
+#define PRESS_TIME 150
+
+static const char *const requests[] = {
+    "GET / HTTP/1.1\r\n\r\n",
+    "GET /?zone=0&units=imperial HTTP/1.1\r\nAccept: application/octet-stream\r\n\r\n",
+    "GET /settings HTTP/1.1\r\n\r\n",
+    "GET /history HTTP/1.1\r\n\r\n",
+    "GET /schedule HTTP/1.1\r\n\r\n",
+    "GET /metrics HTTP/1.1\r\n\r\n",
+    "POST /temperature?source=hall&temperature=21.25 HTTP/1.1\r\nContent-Length: 0\r\n\r\n",
+    "PUT /mode?mode=auto HTTP/1.1\r\nContent-Length: 0\r\n\r\n",
+    "PUT /settings HTTP/1.1\r\nContent-Length: 24\r\n\r\n{\"screenImperial\":false}",
+    "GET /missing HTTP/1.1\r\n\r\n",
+};
+
+// The comfort band of even and odd hours
+static const char *const setpointRequests[] = {
+    "POST /setpoint?low=20.5&high=24 HTTP/1.1\r\nContent-Length: 0\r\n\r\n",
+    "POST /setpoint?low=26&high=30 HTTP/1.1\r\nContent-Length: 0\r\n\r\n",
+};
+
+static ThermalPlant plant;
+static unsigned long connections = 0;
+
+// One pass of both cores, the plant follows the relays over the simulated time it took
+static void step()
+{
+  unsigned long start = millis();
+  allocationCounting = true;
+  sketchStep();
+  allocationCounting = false;
+
+  plant.step(millis() / 1000.0, (millis() - start) / 1000.0, halPinLevel(HEAT_RELAY_PIN) == HIGH, halPinLevel(COOL_RELAY_PIN) == HIGH);
+  halBme280.temperature = plant.temperature;
+}
+
+// Send a request and run the sketch until the response arrives, counting only the sketch's
+// allocations. The server closes keep-alive connections after a number of requests, the client
+// reconnects.
+static bool exchange(HttpClient *client, const char *request, HttpResponse *response)
+{
+  if (!client->poll())
+  {
+    if (!client->connect(halListenPort()))
+    {
+      return false;
+    }
+    connections++;
+  }
+  client->send(request);
+
+  for (unsigned long pass = 0; pass < 1000; pass++)
+  {
+    step();
+    bool open = client->poll();
+    if (client->takeResponse(response))
+    {
+      return true;
+    }
+    if (!open)
+    {
+      return false;
+    }
+  }
+  return false;
+}
+
+// Run for duration, a burst of requests every REQUEST_PERIOD and a press of the up or down button every
+// PRESS_PERIOD. Returns the number of failed requests.
+static unsigned long run(HttpClient *client, unsigned long duration, unsigned long *served)
+{
+  static unsigned long presses = 0;
+  unsigned long failures = 0;
+  unsigned long start = millis();
+  unsigned long lastRequest = start;
+  unsigned long lastPress = start;
+  while (millis() - start < duration)
+  {
+    step();
+
+    if (millis() - lastRequest >= REQUEST_PERIOD)
+    {
+      lastRequest = millis();
+      const size_t count = sizeof(requests) / sizeof(requests[0]);
+      for (size_t i = 0; i <= count; i++)
+      {
+        const char *request = i < count ? requests[i] : setpointRequests[millis() / 3600000 % 2];
+        HttpResponse response;
+        bool missing = strstr(request, "/missing") != NULL;
+        if (!exchange(client, request, &response) || response.status != (missing ? 404 : 200))
+        {
+          fprintf(stderr, "%.*s failed with %d\n", (int)(strchr(request, '\r') - request), request, response.status);
+          failures++;
+        }
+        (*served)++;
+      }
+    }
+
+    if (millis() - lastPress >= PRESS_PERIOD)
+    {
+      lastPress = millis();
+      uint8_t pin = presses++ % 2 == 0 ? UP_BUTTON_PIN : DOWN_BUTTON_PIN;
+      halSetPin(pin, HIGH);
+      while (millis() - lastPress < PRESS_TIME)
+      {
+        step();
+      }
+      halSetPin(pin, LOW);
+    }
+  }
+  return failures;
+}
+
+int main()
+{
+  halEepromErase();
+  halSetMicros(START_HOUR * 3600000000ULL);
+  // A light house on a warm day, it overheats in the afternoon
+  plant.capacity = 2.0e6;
+  plant.outdoorMean = 16;
+  plant.outdoorSwing = 12;
+  plant.temperature = 21;
+  halBme280.temperature = plant.temperature;
+  setup();
+
+  HttpClient client;
+  unsigned long served = 0;
+  CHECK_EQUAL(0, run(&client, WARM_UP_MINUTES * 60000UL, &served));
+
+  unsigned long long allocations = allocationCount;
+  unsigned long accepted = connections;
+  unsigned long commits = halEepromCommits();
+  unsigned long heatingChanges = halPinChanges(HEAT_RELAY_PIN);
+  unsigned long coolingChanges = halPinChanges(COOL_RELAY_PIN);
+  served = 0;
+  unsigned long failures = run(&client, SOAK_HOURS * 3600000UL, &served);
+  allocations = allocationCount - allocations;
+  accepted = connections - accepted;
+
+  printf("%d hours: %lu requests over %lu connections, %lu heating and %lu cooling relay changes, %lu commits, %llu allocations\n",
+         SOAK_HOURS, served, accepted, halPinChanges(HEAT_RELAY_PIN) - heatingChanges, halPinChanges(COOL_RELAY_PIN) - coolingChanges,
+         halEepromCommits() - commits, allocations);
+  CHECK_EQUAL(0, failures);
+  CHECK(served > 0);
+
+  // The run went through heating, cooling and settings changes
+  CHECK(halPinChanges(HEAT_RELAY_PIN) > heatingChanges);
+  CHECK(halPinChanges(COOL_RELAY_PIN) > coolingChanges);
+  CHECK(halEepromCommits() > commits);
+
+  // The only allocation is the socket handle WiFiClient creates for each accepted connection, as on the ESP32
+  CHECK_EQUAL(accepted, allocations);
+
+  return checkResult();
+}
@@ -0,0 +1,68 @@
+// Counts flash commits over simulated hours of the whole sketch: settings that do not change never
+// reach flash, and changes are coalesced into at most one commit per EEPROM_COMMIT_PERIOD.
+
+#include "Check.h"
+#include "Sketch.h"
+
+#define HOUR 3600000UL
+
+static void runFor(unsigned long duration)
+{
+  unsigned long start = millis();
+  while (millis() - start < duration)
+  {
+    sketchStep();
+  }
+}
+
+int main()
+{
+  halEepromErase();
+  setup();
+
+  // Settings written by setup and the legacy migration are committed once
+  storage->flush();
+  unsigned long commits = halEepromCommits();
+  CHECK(commits <= 1);
+
+  // HEAT keeps the state HEATING on every control pass, which used to commit on every loop()
+  thermostat->setMode(Thermostat::ThermostatMode::HEAT);
+  commits = halEepromCommits();
+  runFor(HOUR);
+  unsigned long heatCommits = halEepromCommits() - commits;
+  printf("HEAT for an hour: %lu commits\n", heatCommits);
+  CHECK_EQUAL(1, heatCommits);
+  CHECK_EQUAL(HIGH, halPinLevel(HEAT_RELAY_PIN));
+  CHECK(!storage->isDirty());
+
+  // Nothing changes for another hour
+  commits = halEepromCommits();
+  runFor(HOUR);
+  printf("Idle hour: %lu commits\n", halEepromCommits() - commits);
+  CHECK_EQUAL(0, halEepromCommits() - commits);
+
+  // A setpoint change every 10 seconds is coalesced into one commit per period
+  thermostat->setMode(Thermostat::ThermostatMode::AUTOMATIC);
+  commits = halEepromCommits();
+  unsigned long start = millis();
+  for (unsigned long change = 0; millis() - start < HOUR; change++)
+  {
+    thermostat->setSetpointLow(Temperature::fromCelsius(change % 2 ? 21 : 22));
+    runFor(10000);
+  }
+  unsigned long changeCommits = halEepromCommits() - commits;
+  printf("Setpoint change every 10 s for an hour: %lu commits\n", changeCommits);
+  CHECK(changeCommits >= HOUR / EEPROM_COMMIT_PERIOD - 1);
+  CHECK(changeCommits <= HOUR / EEPROM_COMMIT_PERIOD + 1);
+
+  // flush commits what is pending right away, and nothing when there is nothing pending
+  thermostat->setSetpointLow(Temperature::fromCelsius(23));
+  CHECK(storage->isDirty());
+  commits = halEepromCommits();
+  storage->flush();
+  CHECK_EQUAL(commits + 1, halEepromCommits());
+  storage->flush();
+  CHECK_EQUAL(commits + 1, halEepromCommits());
+
+  return checkResult();
+}
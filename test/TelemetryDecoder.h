@@ -0,0 +1,185 @@
+#ifndef TELEMETRY_DECODER_H
+#define TELEMETRY_DECODER_H
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+
+#include "JsonDocument.h"
+
+// Host side reader of the binary telemetry documents (WEB_BINARY_* in WebService.h), written
+// against the documented layout rather than the writer so a change to either is caught. A
+// document decodes into the member paths of its JSON counterpart; mode and state descriptions
+// are left out, the binary form only carries their values.
+
+#define TELEMETRY_MAGIC 0x544F
+#define TELEMETRY_VERSION 2
+#define TELEMETRY_FLAG_IMPERIAL 0x01
+
+#define TELEMETRY_STATUS 1
+#define TELEMETRY_HISTORY_RAW 2
+#define TELEMETRY_HISTORY_MINUTE 3
+#define TELEMETRY_HISTORY_QUARTER 4
+#define TELEMETRY_HISTORY_TRANSITIONS 5
+
+#define TELEMETRY_NO_TEMPERATURE INT16_MIN
+#define TELEMETRY_NO_HUMIDITY UINT16_MAX
+
+class TelemetryDecoder
+{
+private:
+  const std::string &bytes;
+  size_t at;
+  bool error;
+
+  uint32_t read(uint8_t size)
+  {
+    if (error || at + size > bytes.size())
+    {
+      error = true;
+      return 0;
+    }
+
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < size; i++)
+    {
+      value |= (uint32_t)(uint8_t)bytes[at++] << (8 * i);
+    }
+    return value;
+  }
+
+public:
+  TelemetryDecoder(const std::string &bytes) : bytes(bytes), at(0), error(false)
+  {
+  }
+
+  uint8_t u8()
+  {
+    return read(1);
+  }
+
+  uint16_t u16()
+  {
+    return read(2);
+  }
+
+  int16_t i16()
+  {
+    return (int16_t)read(2);
+  }
+
+  uint32_t u32()
+  {
+    return read(4);
+  }
+
+  // Degrees in the document's units, NAN when the reading was not available
+  double temperature()
+  {
+    int16_t value = i16();
+    return value == TELEMETRY_NO_TEMPERATURE ? NAN : value / 100.0;
+  }
+
+  // Percent, NAN when the reading was not available
+  double humidity()
+  {
+    uint16_t value = u16();
+    return value == TELEMETRY_NO_HUMIDITY ? NAN : value / 100.0;
+  }
+
+  // Checks the magic and version, returns the document type
+  bool header(uint8_t *type, bool *imperial)
+  {
+    if (u16() != TELEMETRY_MAGIC || u8() != TELEMETRY_VERSION)
+    {
+      error = true;
+      return false;
+    }
+    *type = u8();
+    *imperial = (u8() & TELEMETRY_FLAG_IMPERIAL) != 0;
+    return !error;
+  }
+
+  bool atEnd()
+  {
+    return at == bytes.size();
+  }
+
+  bool hasFailed()
+  {
+    return error;
+  }
+};
+
+static std::string telemetryNumber(double value)
+{
+  if (isnan(value))
+  {
+    return "null";
+  }
+  char text[24];
+  snprintf(text, sizeof(text), "%.2f", value);
+  return text;
+}
+
+// Decode a status or history document, false if it is malformed or has trailing bytes
+static bool decodeTelemetry(const std::string &bytes, Document *document, bool *imperial)
+{
+  TelemetryDecoder decoder(bytes);
+  uint8_t type;
+  if (!decoder.header(&type, imperial))
+  {
+    return false;
+  }
+
+  if (type == TELEMETRY_STATUS)
+  {
+    // [i16 temperature][u16 humidity][i16 setpoint_low][i16 setpoint_high][u8 mode][u8 state][u8 confidence]
+    (*document)["/environment/temperature"] = telemetryNumber(decoder.temperature());
+    (*document)["/environment/humidity"] = telemetryNumber(decoder.humidity());
+    (*document)["/thermostat/setpoint_low"] = telemetryNumber(decoder.temperature());
+    (*document)["/thermostat/setpoint_high"] = telemetryNumber(decoder.temperature());
+    (*document)["/thermostat/mode/value"] = std::to_string(decoder.u8());
+    (*document)["/thermostat/state/value"] = std::to_string(decoder.u8());
+    (*document)["/environment/confidence"] = std::to_string(decoder.u8());
+    return !decoder.hasFailed() && decoder.atEnd();
+  }
+
+  static const char *resolutions[] = {"raw", "minute", "quarter", "transitions"};
+  if (type < TELEMETRY_HISTORY_RAW || type > TELEMETRY_HISTORY_TRANSITIONS)
+  {
+    return false;
+  }
+  (*document)["/uptime"] = std::to_string(decoder.u32());
+  (*document)["/resolution"] = std::string("\"") + resolutions[type - TELEMETRY_HISTORY_RAW] + "\"";
+
+  // Records until the end: [u32 time] then [i16 temperature][u16 humidity] for raw samples,
+  // [i16 min][i16 max][i16 average][u16 humidity] for rollups and [u8 state] for transitions
+  for (unsigned long index = 0; !decoder.atEnd() && !decoder.hasFailed(); index++)
+  {
+    std::string entry = "/entries/" + std::to_string(index) + "/";
+    (*document)[entry + "0"] = std::to_string(decoder.u32());
+    if (type == TELEMETRY_HISTORY_RAW)
+    {
+      (*document)[entry + "1"] = telemetryNumber(decoder.temperature());
+      (*document)[entry + "2"] = telemetryNumber(decoder.humidity());
+    }
+    else if (type == TELEMETRY_HISTORY_TRANSITIONS)
+    {
+      (*document)[entry + "1"] = std::to_string(decoder.u8());
+    }
+    else
+    {
+      for (uint8_t field = 1; field <= 3; field++)
+      {
+        (*document)[entry + std::to_string(field)] = telemetryNumber(decoder.temperature());
+      }
+      (*document)[entry + "4"] = telemetryNumber(decoder.humidity());
+    }
+  }
+  return !decoder.hasFailed();
+}
+
+#endif
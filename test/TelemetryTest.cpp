@@ -0,0 +1,289 @@
+// Binary telemetry against JSON: the binary writer round-trips every temperature and humidity it can
+// encode, and the status and every /history resolution decode to the same fields and values as their
+// JSON documents, in both units, including readings that are not available.
+
+#include "Check.h"
+#include "HttpClient.h"
+#include "JsonDocument.h"
+#include "Sketch.h"
+#include "TelemetryDecoder.h"
+
+#define ACCEPT_BINARY "Accept: " WEB_BINARY_CONTENT_TYPE "\r\n"
+
+// The decoder is written from the documented layout, it must agree with the service's constants
+static_assert(TELEMETRY_MAGIC == WEB_BINARY_MAGIC && TELEMETRY_VERSION == WEB_BINARY_VERSION, "");
+static_assert(TELEMETRY_STATUS == WEB_BINARY_STATUS && TELEMETRY_HISTORY_TRANSITIONS == WEB_BINARY_HISTORY_TRANSITIONS, "");
+static_assert(TELEMETRY_NO_TEMPERATURE == BINARY_WRITER_NO_TEMPERATURE && TELEMETRY_NO_HUMIDITY == BINARY_WRITER_NO_HUMIDITY, "");
+
+// Every value the writer can encode decodes to the value written
+static void testWriterRoundTrip()
+{
+  uint8_t buffer[2];
+  BinaryWriter writer(buffer, sizeof(buffer));
+  unsigned long failures = 0;
+
+  for (int32_t centi = INT16_MIN; centi <= INT16_MAX; centi++)
+  {
+    Temperature temperature = Temperature::fromCentiCelsius(centi);
+    for (uint8_t imperial = 0; imperial < 2; imperial++)
+    {
+      writer.reset();
+      writer.temperature(temperature, imperial);
+      std::string bytes((const char *)writer.data(), writer.size());
+      TelemetryDecoder decoder(bytes);
+      double decoded = decoder.temperature();
+
+      int16_t expected = imperial ? temperature.centiFahrenheit() : temperature.centiCelsius();
+      bool ok = temperature.isValid() && expected != TEMPERATURE_INVALID ? lround(decoded * 100) == expected : isnan(decoded);
+      failures += !ok || !decoder.atEnd();
+    }
+  }
+
+  for (uint32_t centi = 0; centi < BINARY_WRITER_NO_HUMIDITY; centi++)
+  {
+    writer.reset();
+    writer.humidity(centi / 100.0);
+    std::string bytes((const char *)writer.data(), writer.size());
+    TelemetryDecoder decoder(bytes);
+    failures += lround(decoder.humidity() * 100) != centi;
+  }
+
+  // Readings that are not available
+  const double unavailable[] = {NAN, -1, BINARY_WRITER_NO_HUMIDITY / 100.0, 1e9};
+  for (double humidity : unavailable)
+  {
+    writer.reset();
+    writer.humidity(humidity);
+    std::string bytes((const char *)writer.data(), writer.size());
+    TelemetryDecoder decoder(bytes);
+    failures += !isnan(decoder.humidity());
+  }
+
+  CHECK_EQUAL(0, failures);
+}
+
+// A truncated or foreign document is refused
+static void testMalformed()
+{
+  Document document;
+  bool imperial;
+  CHECK(!decodeTelemetry("", &document, &imperial));
+  CHECK(!decodeTelemetry("{\"environment\":{}}", &document, &imperial));
+
+  // A status cut off after its temperature
+  const char truncated[] = {0x4F, 0x54, WEB_BINARY_VERSION, WEB_BINARY_STATUS, 0, (char)0xD0, 0x07};
+  CHECK(!decodeTelemetry(std::string(truncated, sizeof(truncated)), &document, &imperial));
+
+  // A version the decoder does not know
+  const char future[] = {0x4F, 0x54, WEB_BINARY_VERSION + 1, WEB_BINARY_STATUS, 0};
+  CHECK(!decodeTelemetry(std::string(future, sizeof(future)), &document, &imperial));
+}
+
+// Run loop() until the response arrives, reconnecting if the server dropped the idle connection
+static bool exchange(HttpClient *client, const std::string &request, HttpResponse *response)
+{
+  if (!client->poll() && !client->connect(halListenPort()))
+  {
+    return false;
+  }
+  client->send(request);
+
+  for (unsigned long pass = 0; pass < 1000; pass++)
+  {
+    loop();
+    bool open = client->poll();
+    if (client->takeResponse(response))
+    {
+      return true;
+    }
+    if (!open)
+    {
+      return false;
+    }
+  }
+  return false;
+}
+
+// Run both cores for duration on the simulated clock
+static void run(unsigned long duration)
+{
+  unsigned long start = millis();
+  while (millis() - start < duration)
+  {
+    sketchStep();
+  }
+}
+
+static bool sameNumber(const std::string &json, const std::string &decoded)
+{
+  if (json == "null" || decoded == "null")
+  {
+    return json == decoded;
+  }
+  // JSON rounds to two decimals or fewer, the binary form carries hundredths
+  return fabs(atof(json.c_str()) - atof(decoded.c_str())) <= 0.005 + 1e-9;
+}
+
+static std::string quoted(const char *name)
+{
+  return std::string("\"") + name + "\"";
+}
+
+// Both encodings carry the same members with the same values
+static bool sameFields(const Document &json, const Document &decoded)
+{
+  unsigned long matched = 0;
+  for (Document::const_iterator member = json.begin(); member != json.end(); ++member)
+  {
+    const std::string &path = member->first;
+    bool ok;
+    if (path.size() > 12 && path.compare(path.size() - 12, 12, "/description") == 0)
+    {
+      // The binary form carries the value, the description must name it
+      Document::const_iterator value = decoded.find(path.substr(0, path.size() - 12) + "/value");
+      ok = value != decoded.end();
+      if (ok)
+      {
+        int number = atoi(value->second.c_str());
+        const char *name = path.find("/mode/") != std::string::npos
+                               ? Thermostat::getModeName((Thermostat::ThermostatMode)number).c_str()
+                               : Thermostat::getStateName((Thermostat::ThermostatState)number).c_str();
+        ok = member->second == quoted(name);
+      }
+    }
+    else
+    {
+      Document::const_iterator value = decoded.find(path);
+      ok = value != decoded.end();
+      if (ok)
+      {
+        matched++;
+        if (member->second[0] != '"')
+        {
+          ok = sameNumber(member->second, value->second);
+        }
+        else if (path.compare(0, 9, "/entries/") == 0)
+        {
+          // Transition states are names in JSON and values in binary
+          ok = member->second == quoted(Thermostat::getStateName((Thermostat::ThermostatState)atoi(value->second.c_str())).c_str());
+        }
+        else
+        {
+          ok = member->second == value->second;
+        }
+      }
+    }
+
+    if (!ok)
+    {
+      fprintf(stderr, "%s: JSON %s, binary %s\n", path.c_str(), member->second.c_str(),
+              decoded.count(path) ? decoded.find(path)->second.c_str() : "missing");
+      return false;
+    }
+  }
+  return matched == decoded.size();
+}
+
+// Request target in both encodings and compare, returns the number of JSON members
+static size_t checkBothEncodings(HttpClient *client, const std::string &target, bool imperial)
+{
+  std::string requestLine = "GET " + target + (imperial ? (target.find('?') == std::string::npos ? "?units=imperial" : "&units=imperial") : "") + " HTTP/1.1\r\n";
+
+  HttpResponse jsonResponse;
+  HttpResponse binaryResponse;
+  CHECK(exchange(client, requestLine + "\r\n", &jsonResponse));
+  CHECK(exchange(client, requestLine + ACCEPT_BINARY "\r\n", &binaryResponse));
+  CHECK_EQUAL(200, jsonResponse.status);
+  CHECK_EQUAL(200, binaryResponse.status);
+  CHECK(jsonResponse.headers.find("Content-Type: application/json") != std::string::npos);
+  CHECK(binaryResponse.headers.find("Content-Type: " WEB_BINARY_CONTENT_TYPE) != std::string::npos);
+
+  Document json = parse(jsonResponse.body);
+  Document decoded;
+  bool decodedImperial = !imperial;
+  CHECK(decodeTelemetry(binaryResponse.body, &decoded, &decodedImperial));
+  CHECK(decodedImperial == imperial);
+  if (!sameFields(json, decoded))
+  {
+    fprintf(stderr, "%s%s differs between encodings\n", target.c_str(), imperial ? " (imperial)" : "");
+    CHECK(false);
+  }
+  return json.size();
+}
+
+static void checkStatus(HttpClient *client, const char *description)
+{
+  for (uint8_t imperial = 0; imperial < 2; imperial++)
+  {
+    CHECK_EQUAL(9, checkBothEncodings(client, "/", imperial));
+  }
+
+  HttpResponse json;
+  HttpResponse binary;
+  exchange(client, "GET / HTTP/1.1\r\n\r\n", &json);
+  exchange(client, "GET / HTTP/1.1\r\n" ACCEPT_BINARY "\r\n", &binary);
+  printf("Status, %s: %lu bytes JSON, %lu bytes binary\n", description, (unsigned long)json.body.size(), (unsigned long)binary.body.size());
+  CHECK(binary.body.size() * 5 < json.body.size());
+}
+
+static void testStatus(HttpClient *client)
+{
+  run(10000);
+  checkStatus(client, "idle");
+
+  halBme280.temperature = 18.377;
+  halBme280.humidity = 45.678;
+  thermostat->setMode(Thermostat::ThermostatMode::HEAT);
+  thermostat->setSetpointLow(Temperature::fromCelsius(20.5));
+  run(10000);
+  checkStatus(client, "heating");
+
+  halBme280.temperature = 27.5;
+  thermostat->setMode(Thermostat::ThermostatMode::AUTOMATIC);
+  thermostat->setSetpointHigh(Temperature::fromFahrenheit(75));
+  run(60000);
+  checkStatus(client, "cooling");
+
+  // Without a sensor the temperature and humidity are not available
+  halBme280.present = false;
+  run(SENSOR_LOCAL_TIMEOUT + 10000);
+  checkStatus(client, "no sensor");
+  halBme280.present = true;
+  run(10000);
+}
+
+static void testHistory(HttpClient *client)
+{
+  // Transitions come from the relays, switch them a few times
+  for (uint8_t i = 0; i < 4; i++)
+  {
+    thermostat->setMode(i % 2 == 0 ? Thermostat::ThermostatMode::FAN_ONLY : Thermostat::ThermostatMode::OFF);
+    run(STATE_CHANGE_DELAY + 10000);
+  }
+  run(20 * 60000);
+
+  const char *targets[] = {"/history?resolution=raw", "/history?resolution=minute", "/history?resolution=quarter",
+                           "/history?resolution=transitions", "/history?resolution=minute&since=600"};
+  for (const char *target : targets)
+  {
+    for (uint8_t imperial = 0; imperial < 2; imperial++)
+    {
+      // uptime, resolution and at least one entry
+      CHECK(checkBothEncodings(client, target, imperial) > 2);
+    }
+  }
+}
+
+int main()
+{
+  testWriterRoundTrip();
+  testMalformed();
+
+  halEepromErase();
+  setup();
+  HttpClient client;
+  testStatus(&client);
+  testHistory(&client);
+
+  return checkResult();
+}
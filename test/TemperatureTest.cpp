@@ -0,0 +1,218 @@
+// Temperature conversions checked exhaustively against double precision references over every
+// hundredth of a degree the type holds, invalid values through arithmetic, and a microbenchmark of
+// the fixed point control path against the double precision code it replaced.
+
+#include <chrono>
+#include <vector>
+
+#include "Check.h"
+#include "Hal.h"
+#include "Temperature.h"
+
+#define BENCHMARK_SAMPLES 1000000
+#define BENCHMARK_PASSES 20
+
+static_assert(Temperature::fromCelsius(21.5).centiCelsius() == 2150, "");
+static_assert(Temperature::fromFahrenheit(212).centiCelsius() == 10000, "");
+static_assert(Temperature::fromCelsius(-40).centiFahrenheit() == -4000, "");
+static_assert(!(Temperature() + Temperature::fromCelsius(1)).isValid(), "");
+
+// Saturating the way Temperature does, INT16_MIN stays reserved for invalid
+static long saturate(long value)
+{
+  return value > INT16_MAX ? INT16_MAX : (value < -INT16_MAX ? -INT16_MAX : value);
+}
+
+static void testConversions()
+{
+  unsigned long failures = 0;
+
+  for (int32_t centi = -INT16_MAX; centi <= INT16_MAX; centi++)
+  {
+    Temperature temperature = Temperature::fromCentiCelsius(centi);
+
+    // Celsius in and out, exactly
+    failures += Temperature::fromCelsius(centi / 100.0).centiCelsius() != centi;
+    failures += fabs(temperature.toCelsius() - centi / 100.0) > 1e-6 * (1 + fabs(centi / 100.0));
+    failures += temperature.roundCelsius() != lround(centi / 100.0);
+
+    // Fahrenheit matches the rounded double conversion; c * 9 / 5 is never halfway between hundredths
+    long centiFahrenheit = saturate(lround(centi * 9 / 5.0 + 3200));
+    failures += temperature.centiFahrenheit() != centiFahrenheit;
+    failures += temperature.roundFahrenheit() != lround(centiFahrenheit / 100.0);
+
+    // Celsius to Fahrenheit and back is lossless wherever Fahrenheit did not saturate: the Fahrenheit
+    // rounding error of half a hundredth is less than a third of a hundredth Celsius
+    if (centiFahrenheit > -INT16_MAX && centiFahrenheit < INT16_MAX)
+    {
+      failures += Temperature::fromFahrenheit(centiFahrenheit / 100.0).centiCelsius() != centi;
+    }
+
+    // Order is the order of the values
+    if (centi < INT16_MAX)
+    {
+      Temperature next = Temperature::fromCentiCelsius(centi + 1);
+      failures += !(temperature < next) || !(next > temperature) || temperature >= next || temperature == next;
+    }
+  }
+  CHECK_EQUAL(0, failures);
+
+  // Every Fahrenheit hundredth in, against the double reference; (f - 32) * 5 / 9 is never halfway either
+  for (int32_t centiFahrenheit = -INT16_MAX; centiFahrenheit <= INT16_MAX; centiFahrenheit++)
+  {
+    failures += Temperature::fromFahrenheit(centiFahrenheit / 100.0).centiCelsius() !=
+                saturate(lround((centiFahrenheit - 3200) * 5 / 9.0));
+  }
+  CHECK_EQUAL(0, failures);
+
+  // Out of range values saturate, NaN is invalid
+  CHECK_EQUAL(INT16_MAX, Temperature::fromCelsius(1e6).centiCelsius());
+  CHECK_EQUAL(-INT16_MAX, Temperature::fromCelsius(-1e6).centiCelsius());
+  CHECK_EQUAL(INT16_MAX, Temperature::fromCelsius(INFINITY).centiCelsius());
+  CHECK_EQUAL(-INT16_MAX, Temperature::fromFahrenheit(-INFINITY).centiCelsius());
+  CHECK(!Temperature::fromCelsius(NAN).isValid());
+  CHECK(!Temperature::fromFahrenheit(NAN).isValid());
+  CHECK(!Temperature::fromUnits(NAN, true).isValid());
+  CHECK(Temperature::fromUnits(212, true) == Temperature::fromCelsius(100));
+}
+
+static void testInvalid()
+{
+  Temperature invalid;
+  CHECK(!invalid.isValid());
+  CHECK(isnan(invalid.toCelsius()));
+  CHECK(isnan(invalid.toFahrenheit()));
+  CHECK_EQUAL(TEMPERATURE_INVALID, invalid.centiFahrenheit());
+
+  // Arithmetic with an invalid side is invalid, whatever the other side
+  unsigned long failures = 0;
+  for (int32_t centi = INT16_MIN; centi <= INT16_MAX; centi++)
+  {
+    Temperature temperature = Temperature::fromCentiCelsius(centi);
+    failures += (temperature + invalid).isValid() || (invalid + temperature).isValid();
+    failures += (temperature - invalid).isValid() || (invalid - temperature).isValid();
+  }
+  CHECK_EQUAL(0, failures);
+
+  // Orderings with an invalid side are false, as with NaN
+  failures = 0;
+  for (int32_t centi = INT16_MIN; centi <= INT16_MAX; centi++)
+  {
+    Temperature temperature = Temperature::fromCentiCelsius(centi);
+    failures += temperature < invalid || temperature <= invalid || temperature > invalid || temperature >= invalid;
+    failures += invalid < temperature || invalid <= temperature || invalid > temperature || invalid >= temperature;
+  }
+  CHECK_EQUAL(0, failures);
+
+  // Valid arithmetic saturates and never produces the invalid marker
+  const int16_t edges[] = {-INT16_MAX, -INT16_MAX + 1, -1, 0, 1, INT16_MAX - 1, INT16_MAX};
+  for (int16_t a : edges)
+  {
+    for (int16_t b : edges)
+    {
+      Temperature left = Temperature::fromCentiCelsius(a);
+      Temperature right = Temperature::fromCentiCelsius(b);
+      CHECK_EQUAL(saturate((long)a + b), (left + right).centiCelsius());
+      CHECK_EQUAL(saturate((long)a - b), (left - right).centiCelsius());
+    }
+  }
+}
+
+// The AUTOMATIC decision and the Fahrenheit status rendering, fixed point against double
+template <typename Function>
+static double nanosecondsPerSample(Function function, long *result)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  long sum = 0;
+  for (uint8_t pass = 0; pass < BENCHMARK_PASSES; pass++)
+  {
+    sum += function();
+  }
+  *result = sum;
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() /
+         ((double)BENCHMARK_SAMPLES * BENCHMARK_PASSES);
+}
+
+static void benchmark()
+{
+  std::vector<Temperature> fixed;
+  std::vector<double> floating;
+  for (unsigned long i = 0; i < BENCHMARK_SAMPLES; i++)
+  {
+    double celsius = 21 + 3 * sin(i * 0.001) + ((long)(i * 7919 % 101) - 50) / 100.0;
+    fixed.push_back(Temperature::fromCelsius(celsius));
+    floating.push_back(fixed.back().centiCelsius() / 100.0);
+  }
+
+  const Temperature setpointLow = Temperature::fromCelsius(20);
+  const Temperature setpointHigh = Temperature::fromCelsius(24);
+  const Temperature hysteresis = Temperature::fromCelsius(1);
+  volatile double setpointLowDouble = 20;
+  volatile double setpointHighDouble = 24;
+  volatile double hysteresisDouble = 1;
+
+  long fixedDecisions;
+  long floatingDecisions;
+  double fixedDecide = nanosecondsPerSample(
+      [&]() {
+        long heating = 0;
+        for (const Temperature &temperature : fixed)
+        {
+          heating += temperature <= setpointLow - hysteresis ? 1 : (temperature >= setpointHigh + hysteresis ? -1 : 0);
+        }
+        return heating;
+      },
+      &fixedDecisions);
+  double floatingDecide = nanosecondsPerSample(
+      [&]() {
+        long heating = 0;
+        double low = setpointLowDouble - hysteresisDouble;
+        double high = setpointHighDouble + hysteresisDouble;
+        for (double temperature : floating)
+        {
+          heating += temperature <= low ? 1 : (temperature >= high ? -1 : 0);
+        }
+        return heating;
+      },
+      &floatingDecisions);
+
+  long fixedSum;
+  long floatingSum;
+  double fixedConvert = nanosecondsPerSample(
+      [&]() {
+        long sum = 0;
+        for (const Temperature &temperature : fixed)
+        {
+          sum += temperature.centiFahrenheit();
+        }
+        return sum;
+      },
+      &fixedSum);
+  double floatingConvert = nanosecondsPerSample(
+      [&]() {
+        long sum = 0;
+        for (double temperature : floating)
+        {
+          sum += lround((temperature * 9 / 5 + 32) * 100);
+        }
+        return sum;
+      },
+      &floatingSum);
+
+  printf("Setpoint decision: %.2f ns fixed point, %.2f ns double\n", fixedDecide, floatingDecide);
+  printf("Celsius to Fahrenheit: %.2f ns fixed point, %.2f ns double\n", fixedConvert, floatingConvert);
+  printf("Storage: %lu bytes fixed point, %lu bytes double\n", (unsigned long)sizeof(Temperature), (unsigned long)sizeof(double));
+
+  // Same decisions and conversions either way
+  CHECK_EQUAL(floatingDecisions, fixedDecisions);
+  CHECK_EQUAL(floatingSum, fixedSum);
+}
+
+int main()
+{
+  testConversions();
+  testInvalid();
+  benchmark();
+
+  return checkResult();
+}
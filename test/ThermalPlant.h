@@ -0,0 +1,63 @@
+#ifndef THERMAL_PLANT_H
+#define THERMAL_PLANT_H
+
+#include <math.h>
+
+// Single node thermal model of a house: C dT/dt = UA (Toutdoor - T) + Qheat - Qcool
+// Outdoor temperature follows a daily sinusoid, coldest at 04:00 and warmest at 16:00.
+struct ThermalPlant
+{
+  // Thermal mass in J/K and envelope conductance in W/K, about a 150 m2 house
+  double capacity;
+  double conductance;
+
+  // Heat delivered by the heating and cooling equipment while its relay is closed, in W
+  double heatingPower;
+  double coolingPower;
+
+  double outdoorMean;
+  double outdoorSwing;
+
+  // Room temperature in Celsius and heat delivered so far in J
+  double temperature;
+  double heatingEnergy;
+  double coolingEnergy;
+
+  ThermalPlant()
+  {
+    capacity = 2.0e7;
+    conductance = 250;
+    heatingPower = 10000;
+    coolingPower = 6000;
+    outdoorMean = 0;
+    outdoorSwing = 5;
+    temperature = 21;
+    heatingEnergy = 0;
+    coolingEnergy = 0;
+  }
+
+  double outdoorTemperature(double seconds) const
+  {
+    const double day = 86400;
+    return outdoorMean - outdoorSwing * cos(2 * M_PI * (seconds - 4 * 3600) / day);
+  }
+
+  // Advance by dt seconds at time seconds with the relays as given
+  void step(double seconds, double dt, bool heating, bool cooling)
+  {
+    double power = conductance * (outdoorTemperature(seconds) - temperature);
+    if (heating)
+    {
+      power += heatingPower;
+      heatingEnergy += heatingPower * dt;
+    }
+    if (cooling)
+    {
+      power -= coolingPower;
+      coolingEnergy += coolingPower * dt;
+    }
+    temperature += power * dt / capacity;
+  }
+};
+
+#endif
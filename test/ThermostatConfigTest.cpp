@@ -0,0 +1,187 @@
+// The thermostat as built for one configuration (THERMOSTAT_CONFIG, see CMakeLists.txt): the limits
+// are compile time constants, setpoints and schedules are accepted up to exactly those limits, modes
+// the equipment cannot run are refused and AUTOMATIC only heats or cools if the equipment can,
+// switching no sooner than the configuration's state change delay, and never while the setpoints are
+// unset.
+
+#include "Check.h"
+#include "Hal.h"
+#include "Thermostat.h"
+
+#define NAME(value) #value
+#define STRINGIFY(value) NAME(value)
+
+// The limits are constants of the configuration
+static_assert(Thermostat::setpointMinimum == Temperature::fromCelsius(ThermostatConfig::setpointMinimum), "");
+static_assert(Thermostat::setpointMaximum == Temperature::fromCelsius(ThermostatConfig::setpointMaximum), "");
+static_assert(Thermostat::hysteresis == Temperature::fromCelsius(ThermostatConfig::hysteresis), "");
+static_assert(Thermostat::supportsMode(Thermostat::ThermostatMode::COOL) == ThermostatConfig::canCool, "");
+
+// Mode and state names are views over literals, sized at compile time
+static_assert(Thermostat::getModeName(Thermostat::ThermostatMode::OFF).size() == 3, "");
+static_assert(Thermostat::getModeName(Thermostat::ThermostatMode::HEAT).size() == 4, "");
+static_assert(Thermostat::getModeName(Thermostat::ThermostatMode::AUTOMATIC).size() == 4, "");
+static_assert(Thermostat::getModeName(Thermostat::ThermostatMode::FAN_ONLY).size() == 8, "");
+static_assert(Thermostat::getStateName(Thermostat::ThermostatState::IDLE).size() == 4, "");
+static_assert(Thermostat::getStateName(Thermostat::ThermostatState::COOLING).size() == 7, "");
+
+static const Temperature step = Temperature::fromCentiCelsius(1);
+
+static int16_t noWallClock()
+{
+  return SCHEDULE_NO_TIME;
+}
+
+static void testNames()
+{
+  CHECK(strcmp(Thermostat::getModeName(Thermostat::ThermostatMode::COOL).c_str(), "cool") == 0);
+  CHECK(strcmp(Thermostat::getModeName(Thermostat::ThermostatMode::FAN_ONLY).c_str(), "fan-only") == 0);
+  CHECK(strcmp(Thermostat::getStateName(Thermostat::ThermostatState::HEATING).c_str(), "heating") == 0);
+  CHECK(strcmp(Thermostat::getStateName(Thermostat::ThermostatState::FAN).c_str(), "fan") == 0);
+  CHECK_EQUAL(0, Thermostat::getStateName((Thermostat::ThermostatState)9).size());
+}
+
+// Without stored setpoints they are unset: AUTOMATIC keeps the zone idle whatever the
+// temperature, with either strategy
+static void testUnsetSetpoints(Thermostat *thermostat)
+{
+  CHECK(!thermostat->getSetpointLow().isValid());
+  CHECK(!thermostat->getSetpointHigh().isValid());
+  CHECK(thermostat->setMode(Thermostat::ThermostatMode::AUTOMATIC));
+
+  const double temperatures[] = {ThermostatConfig::setpointMinimum - 10, 21, ThermostatConfig::setpointMaximum + 10};
+  const Thermostat::ControlStrategy strategies[] = {Thermostat::ControlStrategy::STRATEGY_HYSTERESIS, Thermostat::ControlStrategy::STRATEGY_PID};
+  unsigned long changes = 0;
+  for (Thermostat::ControlStrategy strategy : strategies)
+  {
+    thermostat->setControlStrategy(strategy);
+    for (double temperature : temperatures)
+    {
+      for (unsigned long elapsed = 0; elapsed <= 2 * PID_CYCLE_PERIOD; elapsed += 1000)
+      {
+        halAdvance(1000);
+        changes += thermostat->update(Temperature::fromCelsius(temperature)) != Thermostat::ThermostatState::IDLE;
+      }
+    }
+  }
+  CHECK_EQUAL(0, changes);
+
+  // Nor does a schedule hold an unset setpoint
+  ScheduleTable table;
+  table.count = 1;
+  table.transitions[0].minute = 0;
+  table.transitions[0].zone = 0;
+  table.transitions[0].setpointLow = Temperature();
+  table.transitions[0].setpointHigh = Thermostat::setpointMaximum;
+  CHECK(!Thermostat::isValidSchedule(table));
+
+  CHECK(thermostat->setMode(Thermostat::ThermostatMode::OFF));
+  thermostat->setControlStrategy(Thermostat::ControlStrategy::STRATEGY_HYSTERESIS);
+}
+
+static void testSetpointLimits(Thermostat *thermostat)
+{
+  CHECK(thermostat->setSetpointLow(Thermostat::setpointMinimum));
+  CHECK(thermostat->getSetpointLow() == Thermostat::setpointMinimum);
+  CHECK(thermostat->setSetpointHigh(Thermostat::setpointMaximum));
+  CHECK(thermostat->getSetpointHigh() == Thermostat::setpointMaximum);
+
+  CHECK(!thermostat->setSetpointLow(Thermostat::setpointMinimum - step));
+  CHECK(!thermostat->setSetpointLow(Thermostat::setpointMaximum + step));
+  CHECK(!thermostat->setSetpointHigh(Thermostat::setpointMinimum - step));
+  CHECK(!thermostat->setSetpointHigh(Thermostat::setpointMaximum + step));
+  CHECK(!thermostat->setSetpointLow(Temperature()));
+  CHECK(thermostat->getSetpointLow() == Thermostat::setpointMinimum);
+  CHECK(thermostat->getSetpointHigh() == Thermostat::setpointMaximum);
+
+  // Schedules are held to the same limits
+  ScheduleTable table;
+  table.count = 1;
+  table.transitions[0].minute = 0;
+  table.transitions[0].zone = 0;
+  table.transitions[0].setpointLow = Thermostat::setpointMinimum;
+  table.transitions[0].setpointHigh = Thermostat::setpointMaximum;
+  CHECK(thermostat->setSchedule(table));
+  table.transitions[0].setpointHigh = Thermostat::setpointMaximum + step;
+  CHECK(!thermostat->setSchedule(table));
+  table.count = 0;
+  CHECK(thermostat->setSchedule(table));
+}
+
+static void testModes(Thermostat *thermostat)
+{
+  CHECK(thermostat->setMode(Thermostat::ThermostatMode::HEAT) == ThermostatConfig::canHeat);
+  CHECK(thermostat->setMode(Thermostat::ThermostatMode::COOL) == ThermostatConfig::canCool);
+  CHECK(thermostat->getMode() == (ThermostatConfig::canCool ? Thermostat::ThermostatMode::COOL : Thermostat::ThermostatMode::HEAT));
+  CHECK(thermostat->setMode(Thermostat::ThermostatMode::OFF));
+  CHECK(thermostat->update(Temperature::fromCelsius(20)) == Thermostat::ThermostatState::IDLE);
+}
+
+// Run AUTOMATIC at temperature until the state settles, returns the state and how long it took
+static Thermostat::ThermostatState settle(Thermostat *thermostat, Temperature temperature, unsigned long *elapsed)
+{
+  Thermostat::ThermostatState initial = thermostat->getState();
+  Thermostat::ThermostatState state = initial;
+  for (*elapsed = 0; *elapsed <= 2 * ThermostatConfig::stateChangeDelay && state == initial; *elapsed += 1000)
+  {
+    halAdvance(1000);
+    state = thermostat->update(temperature);
+  }
+  return state;
+}
+
+static void testAutomatic(Thermostat *thermostat)
+{
+  Temperature low = Temperature::fromCelsius(ThermostatConfig::setpointMinimum + 2);
+  Temperature high = Temperature::fromCelsius(ThermostatConfig::setpointMaximum - 2);
+  CHECK(thermostat->setSetpointLow(low));
+  CHECK(thermostat->setSetpointHigh(high));
+  Temperature middle = Temperature::fromCentiCelsius((low.centiCelsius() + high.centiCelsius()) / 2);
+  thermostat->setControlStrategy(Thermostat::ControlStrategy::STRATEGY_HYSTERESIS);
+  CHECK(thermostat->setMode(Thermostat::ThermostatMode::AUTOMATIC));
+
+  // Cold: heat, no sooner than the state change delay after the last change
+  unsigned long elapsed;
+  CHECK(settle(thermostat, low - Thermostat::hysteresis, &elapsed) == Thermostat::ThermostatState::HEATING);
+  CHECK(elapsed <= ThermostatConfig::stateChangeDelay);
+
+  // Inside the band: back to idle, after the delay
+  CHECK(settle(thermostat, middle, &elapsed) == Thermostat::ThermostatState::IDLE);
+  CHECK(elapsed + 1000 >= ThermostatConfig::stateChangeDelay);
+
+  // Hot: cool only if the equipment can
+  Thermostat::ThermostatState state = settle(thermostat, high + Thermostat::hysteresis, &elapsed);
+  CHECK(state == (ThermostatConfig::canCool ? Thermostat::ThermostatState::COOLING : Thermostat::ThermostatState::IDLE));
+  if (ThermostatConfig::canCool)
+  {
+    CHECK(elapsed + 1000 >= ThermostatConfig::stateChangeDelay);
+  }
+
+  // Within the hysteresis of a setpoint nothing changes
+  CHECK(settle(thermostat, middle, &elapsed) == Thermostat::ThermostatState::IDLE);
+  CHECK(settle(thermostat, low - Thermostat::hysteresis + step, &elapsed) == Thermostat::ThermostatState::IDLE);
+}
+
+int main()
+{
+  printf("%s: setpoints %.2f to %.2f C, hysteresis %.2f C, state change delay %lu s, %s%s\n", STRINGIFY(THERMOSTAT_CONFIG),
+         Thermostat::setpointMinimum.toCelsius(), Thermostat::setpointMaximum.toCelsius(), Thermostat::hysteresis.toCelsius(),
+         ThermostatConfig::stateChangeDelay / 1000, ThermostatConfig::canHeat ? "heat" : "", ThermostatConfig::canCool ? " cool" : "");
+
+  // A formatted settings log with no keys, as after a factory reset
+  EEPROM.begin(EEPROM_SIZE);
+  halEepromErase();
+  SettingsLog log(EEPROM_SIZE);
+  log.format();
+  EEPROM.commit();
+  Thermostat *thermostat = Thermostat::getInstance();
+  thermostat->setWallClock(noWallClock);
+
+  testNames();
+  testUnsetSetpoints(thermostat);
+  testSetpointLimits(thermostat);
+  testModes(thermostat);
+  testAutomatic(thermostat);
+
+  return checkResult();
+}
@@ -0,0 +1,133 @@
+// Requests per second and heap allocations per response of the web service, served by loop() on the
+// simulated clock over keep-alive loopback connections. Documents are written from constexpr field
+// schemas into the reused response buffer, so serving a request allocates nothing.
+
+#include <chrono>
+
+#include "AllocationCounter.h"
+#include "Check.h"
+#include "HttpClient.h"
+#include "Sketch.h"
+
+#define REQUESTS 5000
+#define WARM_UP 20
+
+struct BenchmarkCase
+{
+  const char *name;
+  // Sent alternately, so requests that change state keep changing it
+  const char *requests[2];
+};
+
+static const BenchmarkCase cases[] = {
+    {"GET / (memoized)", {"GET / HTTP/1.1\r\n\r\n", "GET / HTTP/1.1\r\n\r\n"}},
+    {"GET / binary", {"GET / HTTP/1.1\r\nAccept: " WEB_BINARY_CONTENT_TYPE "\r\n\r\n",
+                      "GET / HTTP/1.1\r\nAccept: " WEB_BINARY_CONTENT_TYPE "\r\n\r\n"}},
+    {"PUT /mode (rendered)", {"PUT /mode?mode=heat HTTP/1.1\r\nContent-Length: 0\r\n\r\n",
+                              "PUT /mode?mode=off HTTP/1.1\r\nContent-Length: 0\r\n\r\n"}},
+    {"GET /settings", {"GET /settings HTTP/1.1\r\n\r\n", "GET /settings HTTP/1.1\r\n\r\n"}}};
+
+static unsigned long connections = 0;
+
+// Run loop() until the response arrives, counting only the sketch's allocations. The server closes
+// keep-alive connections after HTTP_SERVER_MAX_KEEP_ALIVE_REQUESTS, the client reconnects.
+static bool exchange(HttpClient *client, const char *request, HttpResponse *response)
+{
+  if (!client->isOpen())
+  {
+    if (!client->connect(halListenPort()))
+    {
+      return false;
+    }
+    connections++;
+  }
+  if (!client->send(request))
+  {
+    return false;
+  }
+
+  for (unsigned long pass = 0; pass < 1000; pass++)
+  {
+    allocationCounting = true;
+    loop();
+    allocationCounting = false;
+
+    bool open = client->poll();
+    if (client->takeResponse(response))
+    {
+      return true;
+    }
+    if (!open)
+    {
+      return false;
+    }
+  }
+  return false;
+}
+
+static void benchmark(HttpClient *client, const BenchmarkCase &benchmarkCase)
+{
+  HttpResponse response;
+  for (uint8_t i = 0; i < WARM_UP; i++)
+  {
+    CHECK(exchange(client, benchmarkCase.requests[i % 2], &response));
+  }
+
+  unsigned long long allocations = allocationCount;
+  unsigned long accepted = connections;
+  unsigned long long bytes = 0;
+  unsigned long failures = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (unsigned long i = 0; i < REQUESTS; i++)
+  {
+    if (!exchange(client, benchmarkCase.requests[i % 2], &response) || response.status != 200)
+    {
+      failures++;
+    }
+    bytes += response.size;
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  allocations = allocationCount - allocations;
+  accepted = connections - accepted;
+
+  printf("%-22s %8.0f requests/s %6.0f bytes/response %6.2f allocations/response over %lu connections\n",
+         benchmarkCase.name, REQUESTS / seconds, (double)bytes / REQUESTS, (double)allocations / REQUESTS, accepted);
+  CHECK_EQUAL(0, failures);
+  // The only allocation is the socket handle WiFiClient creates for each accepted connection, as on the ESP32
+  CHECK_EQUAL(accepted, allocations);
+}
+
+// The documents keep the layout clients parse
+static void checkDocuments(HttpClient *client)
+{
+  HttpResponse response;
+  CHECK(exchange(client, "GET /settings HTTP/1.1\r\n\r\n", &response));
+  CHECK(response.body == "{\"screenImperial\":false,\"useRemoteTemperature\":false,\"controlStrategy\":\"hysteresis\"}");
+
+  CHECK(exchange(client, "PUT /mode?mode=heat HTTP/1.1\r\nContent-Length: 0\r\n\r\n", &response));
+  CHECK_EQUAL(200, response.status);
+  CHECK_EQUAL(0, response.body.find("{\"environment\":{\"temperature\":"));
+  CHECK(response.body.find(",\"confidence\":") != std::string::npos);
+  CHECK(response.body.find(",\"humidity\":") != std::string::npos);
+  CHECK(response.body.find("},\"thermostat\":{\"setpoint_low\":") != std::string::npos);
+  CHECK(response.body.find(",\"setpoint_high\":") != std::string::npos);
+  CHECK(response.body.find(",\"mode\":{\"description\":\"heat\",\"value\":1},\"state\":{\"description\":\"") !=
+        std::string::npos);
+  CHECK_EQUAL(response.body.size() - 3, response.body.find("}}}"));
+}
+
+int main()
+{
+  halEepromErase();
+  setup();
+
+  HttpClient client;
+  checkDocuments(&client);
+
+  for (const BenchmarkCase &benchmarkCase : cases)
+  {
+    benchmark(&client, benchmarkCase);
+  }
+
+  return checkResult();
+}
@@ -0,0 +1,101 @@
+#include "Adafruit_BME280.h"
+#include "Hal.h"
+
+#define BME280_STATUS_MEASURING 0x08
+
+HalBme280 halBme280 = {true, 21.0, 40.0, 9300, 0, 0, 0};
+
+static bool converting = false;
+static unsigned long long conversionStart = 0;
+
+static bool conversionRunning()
+{
+  return converting && halMicros() - conversionStart < halBme280.conversionTime;
+}
+
+Adafruit_BME280::Adafruit_BME280(int8_t csPin)
+{
+  _measReg.osrs_t = SAMPLING_X16;
+  _measReg.osrs_p = SAMPLING_X16;
+  _measReg.mode = MODE_NORMAL;
+}
+
+bool Adafruit_BME280::begin()
+{
+  halSpiClaim("bme");
+  halSpiRelease("bme");
+  return halBme280.present;
+}
+
+void Adafruit_BME280::setSampling(sensor_mode mode, sensor_sampling temperatureSampling, sensor_sampling pressureSampling,
+                                  sensor_sampling humiditySampling, sensor_filter filter, standby_duration duration)
+{
+  _measReg.osrs_t = temperatureSampling;
+  _measReg.osrs_p = pressureSampling;
+  _measReg.mode = mode;
+  write8(BME280_REGISTER_CONTROL, _measReg.get());
+}
+
+bool Adafruit_BME280::takeForcedMeasurement()
+{
+  if (_measReg.mode != MODE_FORCED)
+  {
+    return true;
+  }
+
+  write8(BME280_REGISTER_CONTROL, _measReg.get());
+  unsigned long long start = halMicros();
+  while (read8(BME280_REGISTER_STATUS) & BME280_STATUS_MEASURING)
+  {
+    delay(1);
+  }
+  halBme280.blockedTime += halMicros() - start;
+  return true;
+}
+
+float Adafruit_BME280::readTemperature()
+{
+  if (conversionRunning())
+  {
+    halBme280.earlyReads++;
+  }
+  halSpiClaim("bme");
+  halSpiRelease("bme");
+  return halBme280.present ? halBme280.temperature : NAN;
+}
+
+float Adafruit_BME280::readHumidity()
+{
+  if (conversionRunning())
+  {
+    halBme280.earlyReads++;
+  }
+  halSpiClaim("bme");
+  halSpiRelease("bme");
+  return halBme280.present ? halBme280.humidity : NAN;
+}
+
+// Writing forced mode to the control register starts a conversion
+void Adafruit_BME280::write8(uint8_t reg, uint8_t value)
+{
+  halSpiClaim("bme");
+  if (reg == BME280_REGISTER_CONTROL && (value & 0b11) == MODE_FORCED)
+  {
+    converting = true;
+    conversionStart = halMicros();
+    halBme280.conversions++;
+  }
+  halSpiRelease("bme");
+}
+
+uint8_t Adafruit_BME280::read8(uint8_t reg)
+{
+  halSpiClaim("bme");
+  uint8_t value = 0;
+  if (reg == BME280_REGISTER_STATUS && conversionRunning())
+  {
+    value = BME280_STATUS_MEASURING;
+  }
+  halSpiRelease("bme");
+  return value;
+}
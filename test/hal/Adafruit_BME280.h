@@ -0,0 +1,76 @@
+#ifndef ADAFRUIT_BME280_H
+#define ADAFRUIT_BME280_H
+
+#include "Arduino.h"
+
+#define BME280_REGISTER_STATUS 0xF3
+#define BME280_REGISTER_CONTROL 0xF4
+
+// Mock BME280 on the simulated SPI bus. Readings and the conversion time come from halBme280,
+// each register access claims the bus so collisions with the display are counted.
+class Adafruit_BME280
+{
+public:
+  enum sensor_mode
+  {
+    MODE_SLEEP = 0b00,
+    MODE_FORCED = 0b01,
+    MODE_NORMAL = 0b11
+  };
+
+  enum sensor_sampling
+  {
+    SAMPLING_NONE = 0b000,
+    SAMPLING_X1 = 0b001,
+    SAMPLING_X2 = 0b010,
+    SAMPLING_X4 = 0b011,
+    SAMPLING_X8 = 0b100,
+    SAMPLING_X16 = 0b101
+  };
+
+  enum sensor_filter
+  {
+    FILTER_OFF = 0b000,
+    FILTER_X2 = 0b001,
+    FILTER_X4 = 0b010,
+    FILTER_X8 = 0b011,
+    FILTER_X16 = 0b100
+  };
+
+  enum standby_duration
+  {
+    STANDBY_MS_0_5 = 0b000
+  };
+
+  Adafruit_BME280(int8_t csPin);
+
+  bool begin();
+  void setSampling(sensor_mode mode = MODE_NORMAL, sensor_sampling temperatureSampling = SAMPLING_X16,
+                   sensor_sampling pressureSampling = SAMPLING_X16, sensor_sampling humiditySampling = SAMPLING_X16,
+                   sensor_filter filter = FILTER_OFF, standby_duration duration = STANDBY_MS_0_5);
+
+  // Blocks for the conversion like the real driver
+  bool takeForcedMeasurement();
+
+  float readTemperature();
+  float readHumidity();
+
+protected:
+  struct ctrl_meas
+  {
+    unsigned int osrs_t : 3;
+    unsigned int osrs_p : 3;
+    unsigned int mode : 2;
+
+    unsigned int get()
+    {
+      return (osrs_t << 5) | (osrs_p << 2) | mode;
+    }
+  };
+  ctrl_meas _measReg;
+
+  void write8(uint8_t reg, uint8_t value);
+  uint8_t read8(uint8_t reg);
+};
+
+#endif
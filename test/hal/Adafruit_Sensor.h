@@ -0,0 +1,4 @@
+#ifndef ADAFRUIT_SENSOR_H
+#define ADAFRUIT_SENSOR_H
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+// Host build of the parts of the ESP32 Arduino core the sketch uses. Time, pins, EEPROM, the display,
+// the BME280 and sockets are simulated, Hal.h has the controls tests use to drive them.
+
+#include <ctype.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t byte;
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x01
+#define OUTPUT 0x03
+
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+#define F(string) (string)
+#define IRAM_ATTR
+
+#define digitalPinToInterrupt(pin) (pin)
+
+// ====== Time ======
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void configTzTime(const char *tz, const char *server1, const char *server2 = nullptr, const char *server3 = nullptr);
+
+// ====== Pins ======
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+void attachInterruptArg(uint8_t pin, void (*handler)(void *), void *arg, int mode);
+void detachInterrupt(uint8_t pin);
+
+double ledcSetup(uint8_t channel, double frequency, uint8_t resolutionBits);
+void ledcAttachPin(uint8_t pin, uint8_t channel);
+void ledcWrite(uint8_t channel, uint32_t duty);
+
+// ====== Serial ======
+// Discards output unless halSerialEcho is set
+class HardwareSerial
+{
+public:
+  void begin(unsigned long baud);
+
+  void print(const char *text);
+  void print(char c);
+  void print(int value);
+  void print(unsigned int value);
+  void print(long value);
+  void print(unsigned long value);
+  void print(float value);
+  void print(double value);
+
+  // Types the host has no printer for, such as IPAddress
+  template <typename T>
+  void print(const T &value)
+  {
+  }
+
+  template <typename T>
+  void println(const T &value)
+  {
+    print(value);
+    println();
+  }
+
+  void println();
+};
+
+extern HardwareSerial Serial;
+
+// ====== FreeRTOS ======
+typedef void *SemaphoreHandle_t;
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define portMAX_DELAY 0xFFFFFFFF
+#define pdMS_TO_TICKS(ms) (ms)
+
+// Mutexes are std::mutex, not recursive like the FreeRTOS ones
+SemaphoreHandle_t xSemaphoreCreateMutex();
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+
+// Tasks are recorded, halStartTasks runs them on threads
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char *name, uint32_t stackDepth, void *parameters,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core);
+void vTaskDelay(TickType_t ticks);
+
+// ====== ESP ======
+class EspClass
+{
+public:
+  // 240 MHz cycles of the simulated clock
+  uint32_t getCycleCount();
+  uint32_t getCpuFreqMHz();
+  uint32_t getFreeHeap();
+  uint32_t getMinFreeHeap();
+  void restart();
+};
+
+extern EspClass ESP;
+
+// Sketch entry points
+void setup();
+void loop();
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef EEPROM_H
+#define EEPROM_H
+
+#include "Arduino.h"
+
+// ESP32 EEPROM emulation: reads and writes go to a RAM buffer, commit writes the whole buffer to flash
+class EEPROMClass
+{
+public:
+  bool begin(size_t size);
+  uint8_t read(int address);
+  void write(int address, uint8_t value);
+  bool commit();
+  size_t length();
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
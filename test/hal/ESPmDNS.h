@@ -0,0 +1,14 @@
+#ifndef ESPMDNS_H
+#define ESPMDNS_H
+
+#include "Arduino.h"
+
+class MDNSResponder
+{
+public:
+  bool begin(const char *hostName);
+};
+
+extern MDNSResponder MDNS;
+
+#endif
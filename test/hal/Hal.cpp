@@ -0,0 +1,504 @@
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "EEPROM.h"
+#include "ESPmDNS.h"
+#include "Hal.h"
+#include "WiFi.h"
+
+// ====== Clock ======
+static std::atomic<bool> realTime(false);
+static std::atomic<unsigned long long> simulatedMicros(0);
+static const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+void halUseRealTime(bool enabled)
+{
+  realTime = enabled;
+}
+
+unsigned long long halMicros()
+{
+  if (realTime)
+  {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+  }
+  return simulatedMicros;
+}
+
+void halSetMicros(unsigned long long micros)
+{
+  simulatedMicros = micros;
+}
+
+void halAdvance(unsigned long ms)
+{
+  simulatedMicros += (unsigned long long)ms * 1000;
+}
+
+void halAdvanceMicros(unsigned long long micros)
+{
+  simulatedMicros += micros;
+}
+
+unsigned long millis()
+{
+  return halMicros() / 1000;
+}
+
+unsigned long micros()
+{
+  return halMicros();
+}
+
+void delay(unsigned long ms)
+{
+  if (realTime)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+  }
+  else
+  {
+    halAdvance(ms);
+  }
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  if (realTime)
+  {
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+  }
+  else
+  {
+    halAdvanceMicros(us);
+  }
+}
+
+void yield()
+{
+  if (realTime)
+  {
+    std::this_thread::yield();
+  }
+}
+
+void configTzTime(const char *tz, const char *server1, const char *server2, const char *server3)
+{
+}
+
+// ====== Pins ======
+// Numbers past the ESP32's GPIOs stand in for the outputs of an I/O expander
+#define HAL_PIN_COUNT 128
+
+struct Pin
+{
+  std::atomic<uint8_t> level;
+  uint8_t mode;
+  std::atomic<unsigned long> changes;
+  void (*handler)(void *);
+  void *arg;
+};
+
+static Pin pins[HAL_PIN_COUNT];
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+  pins[pin].mode = mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+  if (pins[pin].level.exchange(value ? HIGH : LOW) != (value ? HIGH : LOW))
+  {
+    pins[pin].changes++;
+  }
+}
+
+int digitalRead(uint8_t pin)
+{
+  return pins[pin].level;
+}
+
+void attachInterruptArg(uint8_t pin, void (*handler)(void *), void *arg, int mode)
+{
+  pins[pin].handler = handler;
+  pins[pin].arg = arg;
+}
+
+void detachInterrupt(uint8_t pin)
+{
+  pins[pin].handler = nullptr;
+}
+
+uint8_t halPinLevel(uint8_t pin)
+{
+  return pins[pin].level;
+}
+
+uint8_t halPinMode(uint8_t pin)
+{
+  return pins[pin].mode;
+}
+
+unsigned long halPinChanges(uint8_t pin)
+{
+  return pins[pin].changes;
+}
+
+void halSetPin(uint8_t pin, uint8_t level)
+{
+  if (pins[pin].level.exchange(level) != level)
+  {
+    pins[pin].changes++;
+    if (pins[pin].handler != nullptr)
+    {
+      pins[pin].handler(pins[pin].arg);
+    }
+  }
+}
+
+double ledcSetup(uint8_t channel, double frequency, uint8_t resolutionBits)
+{
+  return frequency;
+}
+
+void ledcAttachPin(uint8_t pin, uint8_t channel)
+{
+}
+
+void ledcWrite(uint8_t channel, uint32_t duty)
+{
+}
+
+// ====== Serial ======
+bool halSerialEcho = false;
+HardwareSerial Serial;
+
+void HardwareSerial::begin(unsigned long baud)
+{
+}
+
+void HardwareSerial::print(const char *text)
+{
+  if (halSerialEcho)
+  {
+    fputs(text, stdout);
+  }
+}
+
+void HardwareSerial::print(char c)
+{
+  if (halSerialEcho)
+  {
+    putchar(c);
+  }
+}
+
+void HardwareSerial::print(int value)
+{
+  print((long)value);
+}
+
+void HardwareSerial::print(unsigned int value)
+{
+  print((unsigned long)value);
+}
+
+void HardwareSerial::print(long value)
+{
+  if (halSerialEcho)
+  {
+    printf("%ld", value);
+  }
+}
+
+void HardwareSerial::print(unsigned long value)
+{
+  if (halSerialEcho)
+  {
+    printf("%lu", value);
+  }
+}
+
+void HardwareSerial::print(float value)
+{
+  print((double)value);
+}
+
+void HardwareSerial::print(double value)
+{
+  if (halSerialEcho)
+  {
+    printf("%.2f", value);
+  }
+}
+
+void HardwareSerial::println()
+{
+  print("\r\n");
+}
+
+// ====== FreeRTOS ======
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+  return new std::mutex();
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks)
+{
+  if (ticks == portMAX_DELAY)
+  {
+    ((std::mutex *)semaphore)->lock();
+    return pdTRUE;
+  }
+  return ((std::mutex *)semaphore)->try_lock() ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+  ((std::mutex *)semaphore)->unlock();
+  return pdTRUE;
+}
+
+struct Task
+{
+  TaskFunction_t function;
+  const char *name;
+  void *parameters;
+  bool started;
+};
+
+static std::vector<Task> tasks;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char *name, uint32_t stackDepth, void *parameters,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core)
+{
+  Task created = {task, name, parameters, false};
+  tasks.push_back(created);
+  return pdPASS;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+  delay(ticks);
+}
+
+uint8_t halTaskCount()
+{
+  return tasks.size();
+}
+
+const char *halTaskName(uint8_t index)
+{
+  return tasks[index].name;
+}
+
+void halStartTasks()
+{
+  for (size_t i = 0; i < tasks.size(); i++)
+  {
+    if (!tasks[i].started)
+    {
+      tasks[i].started = true;
+      std::thread(tasks[i].function, tasks[i].parameters).detach();
+    }
+  }
+}
+
+// ====== ESP ======
+EspClass ESP;
+
+uint32_t EspClass::getCycleCount()
+{
+  return halMicros() * 240;
+}
+
+uint32_t EspClass::getCpuFreqMHz()
+{
+  return 240;
+}
+
+uint32_t EspClass::getFreeHeap()
+{
+  return 200000;
+}
+
+uint32_t EspClass::getMinFreeHeap()
+{
+  return 180000;
+}
+
+void EspClass::restart()
+{
+  exit(0);
+}
+
+// ====== EEPROM ======
+EEPROMClass EEPROM;
+
+static std::vector<uint8_t> eepromBuffer;
+static std::vector<uint8_t> eepromFlash;
+static unsigned long eepromCommits = 0;
+static unsigned long long eepromCommittedBytes = 0;
+static unsigned long long eepromChangedBytes = 0;
+static long eepromWritesLeft = -1;
+static bool eepromCut = false;
+
+bool EEPROMClass::begin(size_t size)
+{
+  if (eepromBuffer.size() != size)
+  {
+    eepromBuffer.assign(size, 0);
+    eepromFlash.assign(size, 0);
+  }
+  return true;
+}
+
+uint8_t EEPROMClass::read(int address)
+{
+  return address >= 0 && (size_t)address < eepromBuffer.size() ? eepromBuffer[address] : 0;
+}
+
+void EEPROMClass::write(int address, uint8_t value)
+{
+  if (address < 0 || (size_t)address >= eepromBuffer.size())
+  {
+    return;
+  }
+
+  if (eepromWritesLeft == 0)
+  {
+    eepromCut = true;
+    return;
+  }
+  if (eepromWritesLeft > 0)
+  {
+    eepromWritesLeft--;
+  }
+  eepromBuffer[address] = value;
+}
+
+bool EEPROMClass::commit()
+{
+  eepromCommits++;
+  eepromCommittedBytes += eepromBuffer.size();
+  for (size_t i = 0; i < eepromBuffer.size(); i++)
+  {
+    if (eepromFlash[i] != eepromBuffer[i])
+    {
+      eepromChangedBytes++;
+    }
+  }
+  eepromFlash = eepromBuffer;
+  return true;
+}
+
+size_t EEPROMClass::length()
+{
+  return eepromBuffer.size();
+}
+
+uint8_t *halEepromData()
+{
+  return eepromBuffer.data();
+}
+
+size_t halEepromSize()
+{
+  return eepromBuffer.size();
+}
+
+void halEepromErase()
+{
+  eepromBuffer.assign(eepromBuffer.size(), 0);
+  eepromFlash.assign(eepromFlash.size(), 0);
+}
+
+unsigned long halEepromCommits()
+{
+  return eepromCommits;
+}
+
+unsigned long long halEepromCommittedBytes()
+{
+  return eepromCommittedBytes;
+}
+
+unsigned long long halEepromChangedBytes()
+{
+  return eepromChangedBytes;
+}
+
+void halEepromCutAfter(long count)
+{
+  eepromWritesLeft = count;
+  eepromCut = false;
+}
+
+bool halEepromWasCut()
+{
+  return eepromCut;
+}
+
+// ====== SPI Bus ======
+static std::atomic<const char *> spiOwner(nullptr);
+static std::atomic<unsigned long> spiCollisions(0);
+
+void halSpiClaim(const char *device)
+{
+  const char *owner = spiOwner.load();
+  if (owner != nullptr && strcmp(owner, device) != 0)
+  {
+    spiCollisions++;
+  }
+  spiOwner = device;
+}
+
+void halSpiRelease(const char *device)
+{
+  const char *owner = spiOwner.load();
+  if (owner != nullptr && strcmp(owner, device) == 0)
+  {
+    spiOwner = nullptr;
+  }
+}
+
+const char *halSpiOwner()
+{
+  return spiOwner;
+}
+
+unsigned long halSpiCollisions()
+{
+  return spiCollisions;
+}
+
+// ====== Network ======
+WiFiClass WiFi;
+MDNSResponder MDNS;
+
+void WiFiClass::mode(int mode)
+{
+}
+
+void WiFiClass::begin(const char *ssid, const char *password)
+{
+}
+
+int WiFiClass::status()
+{
+  return WL_CONNECTED;
+}
+
+IPAddress WiFiClass::localIP()
+{
+  return IPAddress(127, 0, 0, 1);
+}
+
+bool MDNSResponder::begin(const char *hostName)
+{
+  return true;
+}
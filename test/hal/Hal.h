@@ -0,0 +1,102 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include "Arduino.h"
+
+// ====== Clock ======
+// Simulated by default: time only moves when a test advances it or the sketch calls delay.
+// Real time follows the host's monotonic clock and delay sleeps, for tests that run tasks on threads.
+void halUseRealTime(bool realTime);
+unsigned long long halMicros();
+void halSetMicros(unsigned long long micros);
+void halAdvance(unsigned long ms);
+void halAdvanceMicros(unsigned long long micros);
+
+// ====== Pins ======
+uint8_t halPinLevel(uint8_t pin);
+uint8_t halPinMode(uint8_t pin);
+// Times a pin was driven to a different level
+unsigned long halPinChanges(uint8_t pin);
+// Drive an input pin from outside, runs its interrupt handler on a change like the GPIO interrupt would
+void halSetPin(uint8_t pin, uint8_t level);
+
+// ====== Serial ======
+extern bool halSerialEcho;
+
+// ====== Tasks ======
+uint8_t halTaskCount();
+const char *halTaskName(uint8_t index);
+// Run every task created so far on its own thread, the threads run until the process exits
+void halStartTasks();
+
+// ====== EEPROM ======
+// begin keeps the contents, so a new PersistentStorage over the same buffer is a reboot
+uint8_t *halEepromData();
+size_t halEepromSize();
+// Erase the buffer and flash to the zeros a new ESP32 NVS partition reads as
+void halEepromErase();
+unsigned long halEepromCommits();
+// Bytes written to flash by all commits, and bytes that changed value
+unsigned long long halEepromCommittedBytes();
+unsigned long long halEepromChangedBytes();
+// Drop every write after the next count writes, as if power was cut. Negative writes everything.
+void halEepromCutAfter(long count);
+bool halEepromWasCut();
+
+// ====== SPI Bus ======
+// A device claims the bus while its chip select is low, a claim while another device holds it is a collision
+void halSpiClaim(const char *device);
+void halSpiRelease(const char *device);
+const char *halSpiOwner();
+unsigned long halSpiCollisions();
+
+// ====== Display ======
+#define HAL_PANEL_WIDTH 320
+#define HAL_PANEL_HEIGHT 240
+// Panel SPI clock. Writes by the CPU take the bus time of their bytes on the simulated clock,
+// DMA transfers take it in the background until dmaWait.
+#define HAL_SPI_FREQUENCY 40000000
+
+struct HalDisplayStats
+{
+  // Pixels written to the panel, drawn directly or pushed from sprites
+  unsigned long long pixels;
+  // Bytes sent over SPI for them, the panel takes 16 bit colour
+  unsigned long long bytes;
+  // Microseconds the bus spent sending them
+  unsigned long long busTime;
+  unsigned long dmaTransfers;
+  // DMA pushes made without the bus held by startWrite
+  unsigned long dmaErrors;
+};
+
+extern HalDisplayStats halDisplay;
+// Rotated panel, HAL_PANEL_WIDTH by HAL_PANEL_HEIGHT
+uint16_t *halFramebuffer();
+// Sprite memory still free, createSprite fails beyond it
+extern size_t halSpriteMemoryLimit;
+size_t halSpriteMemoryUsed();
+
+// ====== BME280 ======
+struct HalBme280
+{
+  bool present;
+  float temperature;
+  float humidity;
+  // Forced mode conversion time in microseconds
+  unsigned long conversionTime;
+
+  unsigned long conversions;
+  // Results read while a conversion was still running
+  unsigned long earlyReads;
+  // Time spent blocked inside the driver in microseconds
+  unsigned long long blockedTime;
+};
+
+extern HalBme280 halBme280;
+
+// ====== Network ======
+// Port the last WiFiServer listens on
+uint16_t halListenPort();
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef SPI_H
+#define SPI_H
+
+#include "Arduino.h"
+
+// The bus itself is modelled by Hal.h, devices claim it while they talk to it
+
+#endif
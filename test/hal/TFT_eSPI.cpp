@@ -0,0 +1,381 @@
+#include <vector>
+
+#include "Hal.h"
+#include "TFT_eSPI.h"
+
+// Font 2 cell at text size 1, every byte of the string takes one cell
+#define HAL_GLYPH_WIDTH 6
+#define HAL_GLYPH_HEIGHT 16
+
+HalDisplayStats halDisplay;
+size_t halSpriteMemoryLimit = 100000;
+
+static std::vector<uint16_t> framebuffer(HAL_PANEL_WIDTH * HAL_PANEL_HEIGHT);
+static size_t spriteMemoryUsed = 0;
+// End of the DMA transfer in progress on the simulated clock
+static unsigned long long dmaEnd = 0;
+
+uint16_t *halFramebuffer()
+{
+  return framebuffer.data();
+}
+
+size_t halSpriteMemoryUsed()
+{
+  return spriteMemoryUsed;
+}
+
+static unsigned long long busTime(unsigned long long pixels)
+{
+  return pixels * 2 * 8 * 1000000 / HAL_SPI_FREQUENCY;
+}
+
+static void waitForDma()
+{
+  if (halMicros() < dmaEnd)
+  {
+    halAdvanceMicros(dmaEnd - halMicros());
+  }
+}
+
+// The CPU sends pixels once the bus is free and waits until they are out
+static void sendPixels(unsigned long long pixels)
+{
+  waitForDma();
+  halDisplay.pixels += pixels;
+  halDisplay.bytes += pixels * 2;
+  halDisplay.busTime += busTime(pixels);
+  halAdvanceMicros(busTime(pixels));
+}
+
+// Whether the text pixel at (dx, dy) from the text's top left is ink, depends only on the string and position
+static bool glyphInk(const char *text, int32_t dx, int32_t dy, uint8_t size)
+{
+  uint8_t c = text[dx / (HAL_GLYPH_WIDTH * size)];
+  int32_t column = dx % (HAL_GLYPH_WIDTH * size) / size;
+  int32_t row = dy / size;
+  return ((c * 7 + column * 3 + row * 5) % 4) == 0;
+}
+
+TFT_eSPI::TFT_eSPI(int16_t width, int16_t height)
+{
+  panelWidth = width;
+  panelHeight = height;
+  textSize = 1;
+  textColor = TFT_WHITE;
+  textBackground = TFT_BLACK;
+  writeDepth = 0;
+}
+
+TFT_eSPI::~TFT_eSPI()
+{
+}
+
+uint16_t *TFT_eSPI::target()
+{
+  return framebuffer.data();
+}
+
+int16_t TFT_eSPI::targetWidth()
+{
+  return panelWidth;
+}
+
+int16_t TFT_eSPI::targetHeight()
+{
+  return panelHeight;
+}
+
+bool TFT_eSPI::onPanel()
+{
+  return true;
+}
+
+void TFT_eSPI::beginDraw()
+{
+  if (onPanel() && writeDepth == 0)
+  {
+    halSpiClaim("tft");
+  }
+}
+
+void TFT_eSPI::endDraw()
+{
+  if (onPanel() && writeDepth == 0)
+  {
+    halSpiRelease("tft");
+  }
+}
+
+void TFT_eSPI::fill(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t color)
+{
+  int32_t left = x < 0 ? 0 : x;
+  int32_t top = y < 0 ? 0 : y;
+  int32_t right = x + w > targetWidth() ? targetWidth() : x + w;
+  int32_t bottom = y + h > targetHeight() ? targetHeight() : y + h;
+  uint16_t *pixels = target();
+  for (int32_t row = top; row < bottom; row++)
+  {
+    for (int32_t column = left; column < right; column++)
+    {
+      pixels[row * targetWidth() + column] = color;
+    }
+  }
+
+  if (onPanel() && right > left && bottom > top)
+  {
+    sendPixels((right - left) * (bottom - top));
+  }
+}
+
+unsigned long TFT_eSPI::copy(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t *data)
+{
+  uint16_t *pixels = target();
+  unsigned long written = 0;
+  for (int32_t row = 0; row < h; row++)
+  {
+    for (int32_t column = 0; column < w; column++)
+    {
+      if (x + column >= 0 && x + column < targetWidth() && y + row >= 0 && y + row < targetHeight())
+      {
+        pixels[(y + row) * targetWidth() + x + column] = data[row * w + column];
+        written++;
+      }
+    }
+  }
+
+  return written;
+}
+
+void TFT_eSPI::init()
+{
+  framebuffer.assign(framebuffer.size(), TFT_BLACK);
+}
+
+void TFT_eSPI::setRotation(uint8_t rotation)
+{
+  int16_t shorter = panelWidth < panelHeight ? panelWidth : panelHeight;
+  int16_t longer = panelWidth < panelHeight ? panelHeight : panelWidth;
+  panelWidth = rotation % 2 ? longer : shorter;
+  panelHeight = rotation % 2 ? shorter : longer;
+}
+
+void TFT_eSPI::setTextSize(uint8_t size)
+{
+  textSize = size > 0 ? size : 1;
+}
+
+void TFT_eSPI::setTextColor(uint16_t color, uint16_t background)
+{
+  textColor = color;
+  textBackground = background;
+}
+
+void TFT_eSPI::setTextDatum(uint8_t datum)
+{
+}
+
+int16_t TFT_eSPI::textWidth(const char *text, uint8_t font)
+{
+  return strlen(text) * HAL_GLYPH_WIDTH * textSize;
+}
+
+int16_t TFT_eSPI::fontHeight(int16_t font)
+{
+  return HAL_GLYPH_HEIGHT * textSize;
+}
+
+void TFT_eSPI::fillScreen(uint32_t color)
+{
+  fillRect(0, 0, targetWidth(), targetHeight(), color);
+}
+
+void TFT_eSPI::fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color)
+{
+  beginDraw();
+  fill(x, y, w, h, color);
+  endDraw();
+}
+
+int16_t TFT_eSPI::drawCentreString(const char *text, int32_t x, int32_t y, uint8_t font)
+{
+  return drawString(text, x - textWidth(text, font) / 2, y, font);
+}
+
+int16_t TFT_eSPI::drawString(const char *text, int32_t x, int32_t y, uint8_t font)
+{
+  int16_t w = textWidth(text, font);
+  int16_t h = fontHeight(font);
+
+  beginDraw();
+  uint16_t *pixels = target();
+  unsigned long written = 0;
+  for (int32_t dy = 0; dy < h; dy++)
+  {
+    for (int32_t dx = 0; dx < w; dx++)
+    {
+      if (x + dx >= 0 && x + dx < targetWidth() && y + dy >= 0 && y + dy < targetHeight())
+      {
+        pixels[(y + dy) * targetWidth() + x + dx] = glyphInk(text, dx, dy, textSize) ? textColor : textBackground;
+        written++;
+      }
+    }
+  }
+  if (onPanel())
+  {
+    sendPixels(written);
+  }
+  endDraw();
+  return w;
+}
+
+bool TFT_eSPI::initDMA()
+{
+  return true;
+}
+
+void TFT_eSPI::startWrite()
+{
+  if (writeDepth++ == 0)
+  {
+    halSpiClaim("tft");
+  }
+}
+
+void TFT_eSPI::endWrite()
+{
+  if (writeDepth > 0 && --writeDepth == 0)
+  {
+    halSpiRelease("tft");
+  }
+}
+
+// Waits for the previous transfer and starts this one. The framebuffer is updated at once, the bus
+// stays busy for the transfer's time.
+void TFT_eSPI::pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t *data, uint16_t *buffer)
+{
+  if (writeDepth == 0)
+  {
+    halDisplay.dmaErrors++;
+  }
+  waitForDma();
+  unsigned long written = copy(x, y, w, h, data);
+  halDisplay.dmaTransfers++;
+  halDisplay.pixels += written;
+  halDisplay.bytes += written * 2;
+  halDisplay.busTime += busTime(written);
+  dmaEnd = halMicros() + busTime(written);
+}
+
+bool TFT_eSPI::dmaBusy()
+{
+  return halMicros() < dmaEnd;
+}
+
+void TFT_eSPI::dmaWait()
+{
+  waitForDma();
+}
+
+int16_t TFT_eSPI::width()
+{
+  return panelWidth;
+}
+
+int16_t TFT_eSPI::height()
+{
+  return panelHeight;
+}
+
+TFT_eSprite::TFT_eSprite(TFT_eSPI *parent) : TFT_eSPI(0, 0)
+{
+  this->parent = parent;
+  pixels = nullptr;
+  colorDepth = 16;
+}
+
+TFT_eSprite::~TFT_eSprite()
+{
+  deleteSprite();
+}
+
+uint16_t *TFT_eSprite::target()
+{
+  return pixels;
+}
+
+int16_t TFT_eSprite::targetWidth()
+{
+  return panelWidth;
+}
+
+int16_t TFT_eSprite::targetHeight()
+{
+  return panelHeight;
+}
+
+bool TFT_eSprite::onPanel()
+{
+  return false;
+}
+
+void TFT_eSprite::setColorDepth(int8_t depth)
+{
+  colorDepth = depth;
+}
+
+void *TFT_eSprite::createSprite(int16_t w, int16_t h, uint8_t frames)
+{
+  deleteSprite();
+
+  // Memory the ESP32 would allocate at this colour depth, the host always stores 16 bit pixels
+  size_t size = (size_t)w * h * colorDepth / 8;
+  if (spriteMemoryUsed + size > halSpriteMemoryLimit)
+  {
+    return NULL;
+  }
+
+  spriteMemoryUsed += size;
+  pixels = new uint16_t[w * h]();
+  panelWidth = w;
+  panelHeight = h;
+  return pixels;
+}
+
+void TFT_eSprite::deleteSprite()
+{
+  if (pixels != nullptr)
+  {
+    spriteMemoryUsed -= (size_t)panelWidth * panelHeight * colorDepth / 8;
+    delete[] pixels;
+    pixels = nullptr;
+    panelWidth = 0;
+    panelHeight = 0;
+  }
+}
+
+bool TFT_eSprite::created()
+{
+  return pixels != nullptr;
+}
+
+void TFT_eSprite::fillSprite(uint32_t color)
+{
+  fill(0, 0, panelWidth, panelHeight, color);
+}
+
+void *TFT_eSprite::getPointer()
+{
+  return pixels;
+}
+
+void TFT_eSprite::setSwapBytes(bool swap)
+{
+}
+
+void TFT_eSprite::pushSprite(int32_t x, int32_t y)
+{
+  parent->beginDraw();
+  sendPixels(parent->copy(x, y, panelWidth, panelHeight, pixels));
+  parent->endDraw();
+}
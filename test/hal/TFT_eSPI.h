@@ -0,0 +1,105 @@
+#ifndef TFT_ESPI_H
+#define TFT_ESPI_H
+
+#include "Arduino.h"
+
+#define TFT_BLACK 0x0000
+#define TFT_WHITE 0xFFFF
+
+#define TL_DATUM 0
+#define TC_DATUM 1
+#define MC_DATUM 4
+
+// ST7789 panel backed by a host framebuffer (see Hal.h). Every pixel written to the panel is counted,
+// text is rasterised as a pattern derived from the string so rendered frames can be compared.
+class TFT_eSPI
+{
+  friend class TFT_eSprite;
+
+protected:
+  int16_t panelWidth;
+  int16_t panelHeight;
+  uint8_t textSize;
+  uint16_t textColor;
+  uint16_t textBackground;
+
+  // Number of startWrite calls not yet ended
+  uint8_t writeDepth;
+
+  // Where drawing goes, the panel framebuffer or a sprite's buffer
+  virtual uint16_t *target();
+  virtual int16_t targetWidth();
+  virtual int16_t targetHeight();
+  virtual bool onPanel();
+
+  // Claim the bus for one drawing call unless startWrite already holds it
+  void beginDraw();
+  void endDraw();
+
+  void fill(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t color);
+  // Returns the pixels written, the caller accounts for sending them
+  unsigned long copy(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t *data);
+
+public:
+  TFT_eSPI(int16_t width = 240, int16_t height = 320);
+  virtual ~TFT_eSPI();
+
+  void init();
+  void setRotation(uint8_t rotation);
+
+  void setTextSize(uint8_t size);
+  void setTextColor(uint16_t color, uint16_t background);
+  void setTextDatum(uint8_t datum);
+
+  int16_t textWidth(const char *text, uint8_t font);
+  int16_t fontHeight(int16_t font);
+
+  void fillScreen(uint32_t color);
+  void fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color);
+  int16_t drawCentreString(const char *text, int32_t x, int32_t y, uint8_t font);
+  int16_t drawString(const char *text, int32_t x, int32_t y, uint8_t font);
+
+  // ====== DMA ======
+  bool initDMA();
+  void startWrite();
+  void endWrite();
+  void pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t *data, uint16_t *buffer = nullptr);
+  bool dmaBusy();
+  void dmaWait();
+
+  int16_t width();
+  int16_t height();
+};
+
+class TFT_eSprite : public TFT_eSPI
+{
+private:
+  TFT_eSPI *parent;
+  uint16_t *pixels;
+  int8_t colorDepth;
+
+protected:
+  uint16_t *target() override;
+  int16_t targetWidth() override;
+  int16_t targetHeight() override;
+  bool onPanel() override;
+
+public:
+  TFT_eSprite(TFT_eSPI *parent);
+  ~TFT_eSprite();
+
+  void setColorDepth(int8_t depth);
+  // NULL when the sprite does not fit halSpriteMemoryLimit
+  void *createSprite(int16_t w, int16_t h, uint8_t frames = 1);
+  void deleteSprite();
+  bool created();
+
+  void fillSprite(uint32_t color);
+  void *getPointer();
+  void setSwapBytes(bool swap);
+
+  // Converted from the sprite's colour depth and written by the CPU
+  void pushSprite(int32_t x, int32_t y);
+};
+
+#endif
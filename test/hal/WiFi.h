@@ -0,0 +1,44 @@
+#ifndef WIFI_H
+#define WIFI_H
+
+#include "Arduino.h"
+#include "WiFiClient.h"
+
+#define WIFI_STA 1
+
+#define WL_IDLE_STATUS 0
+#define WL_CONNECTED 3
+
+class IPAddress
+{
+private:
+  uint8_t octets[4];
+
+public:
+  IPAddress(uint8_t a = 0, uint8_t b = 0, uint8_t c = 0, uint8_t d = 0)
+  {
+    octets[0] = a;
+    octets[1] = b;
+    octets[2] = c;
+    octets[3] = d;
+  }
+
+  uint8_t operator[](int index) const
+  {
+    return octets[index];
+  }
+};
+
+// Always connected, the host's loopback interface
+class WiFiClass
+{
+public:
+  void mode(int mode);
+  void begin(const char *ssid, const char *password);
+  int status();
+  IPAddress localIP();
+};
+
+extern WiFiClass WiFi;
+
+#endif
@@ -0,0 +1,228 @@
+#include <atomic>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Hal.h"
+#include "WiFiClient.h"
+
+#define HAL_WRITE_ATTEMPTS 10
+#define HAL_WRITE_ATTEMPT_TIMEOUT 1000000
+
+static std::atomic<uint16_t> listenPort(0);
+
+uint16_t halListenPort()
+{
+  return listenPort;
+}
+
+struct WiFiClient::Socket
+{
+  int fd;
+
+  Socket(int fd) : fd(fd)
+  {
+  }
+
+  ~Socket()
+  {
+    close();
+  }
+
+  void close()
+  {
+    if (fd >= 0)
+    {
+      ::close(fd);
+      fd = -1;
+    }
+  }
+};
+
+WiFiClient::WiFiClient()
+{
+}
+
+WiFiClient::WiFiClient(int fd) : socket(std::make_shared<Socket>(fd))
+{
+}
+
+int WiFiClient::fd() const
+{
+  return socket ? socket->fd : -1;
+}
+
+uint8_t WiFiClient::connected()
+{
+  if (fd() < 0)
+  {
+    return false;
+  }
+
+  char c;
+  ssize_t result = recv(fd(), &c, 1, MSG_PEEK | MSG_DONTWAIT);
+  if (result > 0 || (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)))
+  {
+    return true;
+  }
+
+  stop();
+  return false;
+}
+
+WiFiClient::operator bool()
+{
+  return connected();
+}
+
+int WiFiClient::available()
+{
+  int count = 0;
+  if (fd() < 0 || ioctl(fd(), FIONREAD, &count) < 0)
+  {
+    return 0;
+  }
+  return count;
+}
+
+int WiFiClient::read()
+{
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int WiFiClient::read(uint8_t *buffer, size_t size)
+{
+  if (fd() < 0)
+  {
+    return -1;
+  }
+  ssize_t received = recv(fd(), buffer, size, MSG_DONTWAIT);
+  return received > 0 ? received : -1;
+}
+
+size_t WiFiClient::write(const uint8_t *buffer, size_t size)
+{
+  size_t written = 0;
+  int attempts = HAL_WRITE_ATTEMPTS;
+  while (attempts > 0 && written < size && fd() >= 0)
+  {
+    attempts--;
+
+    fd_set set;
+    FD_ZERO(&set);
+    FD_SET(fd(), &set);
+    struct timeval timeout = {0, HAL_WRITE_ATTEMPT_TIMEOUT};
+    if (select(fd() + 1, NULL, &set, NULL, &timeout) < 0)
+    {
+      return written;
+    }
+    if (!FD_ISSET(fd(), &set))
+    {
+      continue;
+    }
+
+    ssize_t sent = send(fd(), buffer + written, size - written, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (sent > 0)
+    {
+      written += sent;
+      attempts = HAL_WRITE_ATTEMPTS;
+    }
+    else if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+    {
+      stop();
+    }
+  }
+  return written;
+}
+
+size_t WiFiClient::write(const char *text)
+{
+  return write((const uint8_t *)text, strlen(text));
+}
+
+void WiFiClient::setNoDelay(bool noDelay)
+{
+  int flag = noDelay;
+  if (fd() >= 0)
+  {
+    setsockopt(fd(), IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+  }
+}
+
+void WiFiClient::stop()
+{
+  if (socket)
+  {
+    socket->close();
+  }
+}
+
+WiFiServer::WiFiServer(uint16_t port)
+{
+  this->port = port;
+  listenFd = -1;
+  noDelay = false;
+}
+
+WiFiServer::~WiFiServer()
+{
+  if (listenFd >= 0)
+  {
+    close(listenFd);
+  }
+}
+
+void WiFiServer::begin()
+{
+  listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+
+  int reuse = 1;
+  setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port);
+  if (bind(listenFd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(listenFd, 16) < 0)
+  {
+    perror("WiFiServer");
+    abort();
+  }
+
+  socklen_t length = sizeof(address);
+  getsockname(listenFd, (struct sockaddr *)&address, &length);
+  listenPort = ntohs(address.sin_port);
+}
+
+WiFiClient WiFiServer::available()
+{
+  if (listenFd < 0)
+  {
+    return WiFiClient();
+  }
+
+  int fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK);
+  if (fd < 0)
+  {
+    return WiFiClient();
+  }
+
+  int size = HAL_SOCKET_SEND_BUFFER;
+  setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+  WiFiClient client(fd);
+  client.setNoDelay(noDelay);
+  return client;
+}
+
+void WiFiServer::setNoDelay(bool noDelay)
+{
+  this->noDelay = noDelay;
+}
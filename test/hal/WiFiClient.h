@@ -0,0 +1,56 @@
+#ifndef WIFICLIENT_H
+#define WIFICLIENT_H
+
+#include <memory>
+
+#include "Arduino.h"
+
+// Send buffer of an accepted socket, about what lwIP gives a connection on the ESP32
+#define HAL_SOCKET_SEND_BUFFER 5744
+
+// ESP32 client over a POSIX socket. Copies share the socket, like the ESP32 core's handle.
+class WiFiClient
+{
+private:
+  struct Socket;
+  std::shared_ptr<Socket> socket;
+
+public:
+  WiFiClient();
+  explicit WiFiClient(int fd);
+
+  int fd() const;
+
+  uint8_t connected();
+  operator bool();
+
+  int available();
+  int read();
+  int read(uint8_t *buffer, size_t size);
+
+  // Waits for the socket like the ESP32 core: up to 1 second per attempt, 10 attempts without progress
+  size_t write(const uint8_t *buffer, size_t size);
+  size_t write(const char *text);
+
+  void setNoDelay(bool noDelay);
+  void stop();
+};
+
+// Listens on all interfaces, port 0 picks a free port (see halListenPort)
+class WiFiServer
+{
+private:
+  uint16_t port;
+  int listenFd;
+  bool noDelay;
+
+public:
+  WiFiServer(uint16_t port);
+  ~WiFiServer();
+
+  void begin();
+  WiFiClient available();
+  void setNoDelay(bool noDelay);
+};
+
+#endif
@@ -0,0 +1,3 @@
+// Placeholder network settings for host builds, wifi.h is kept out of source control
+#define STASSID "host"
+#define STAPSK "host"